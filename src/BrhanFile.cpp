@@ -3,106 +3,222 @@ Copyright (c) 2018-2019 Daniel Fedai Larsen
 LICENSE: See end of file for license information.
 */
 
+#include <algorithm>
 #include "BrhanFile.h"
-#include <fstream>
 #include "glm/gtc/constants.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/trigonometric.hpp"
 #include "Logger.h"
+#include "MappedFile.h"
+#include "NumberParser.h"
+#include <iterator>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <sys/stat.h>
+#include <thread>
 
-void BrhanFile::LoadCamera(const std::string& line)
+/*
+The scene file is memory-mapped and tokenized in place. Every line is a keyword
+followed by 'key[value ...]' pairs, and the values are parsed directly from the
+mapping, so no temporary strings are created except for the ones that end up in
+the resulting structs (file and material names). Large files are split at line
+boundaries and the chunks are parsed on separate threads.
+*/
+
+//Files smaller than this are always parsed on the calling thread
+static const size_t minBytesPerThread = 1 << 20;
+
+//A 'key[value]' pair. Both point into the mapped file.
+struct BrhanToken
+{
+	const char* key;
+	size_t keyLength;
+	const char* value;
+	const char* valueEnd;
+};
+
+//Everything a single thread found in its part of the file
+struct BrhanFileChunk
+{
+	std::vector<ModelFromFile> models;
+	std::vector<SphericalLightFromFile> sphericalLights;
+	const char* cameraLine = NULL;
+	const char* cameraLineEnd = NULL;
+	//Why the first line that failed to parse did, empty if none did
+	std::string error;
+};
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool TokenIs(const BrhanToken& token, const char* key)
+{
+	size_t keyLength = strlen(key);
+	return token.keyLength == keyLength && memcmp(token.key, key, keyLength) == 0;
+}
+
+static inline bool LineStartsWith(const char* line, const char* lineEnd, const char* keyword)
+{
+	size_t keywordLength = strlen(keyword);
+	return size_t(lineEnd - line) >= keywordLength && memcmp(line, keyword, keywordLength) == 0;
+}
+
+//Writes why a line couldn't be parsed to 'error' and returns false
+static bool ParseError(std::string* error, const char* format, ...)
+{
+	char message[1024];
+	va_list argptr;
+	va_start(argptr, format);
+	vsnprintf(message, sizeof(message), format, argptr);
+	va_end(argptr);
+	*error = message;
+	return false;
+}
+
+//Finds the next 'key[value]' pair on the line. Anything that isn't followed by '[' is skipped.
+static bool NextToken(const char*& p, const char* lineEnd, BrhanToken* token)
+{
+	while (p < lineEnd)
+	{
+		while (p < lineEnd && IsSpace(*p)) { p++; }
+		const char* key = p;
+		while (p < lineEnd && !IsSpace(*p) && *p != '[') { p++; }
+		if (p < lineEnd && *p == '[')
+		{
+			token->key = key;
+			token->keyLength = size_t(p - key);
+			p++; //Eat '['
+			token->value = p;
+			while (p < lineEnd && *p != ']') { p++; }
+			token->valueEnd = p;
+			if (p < lineEnd) { p++; } //Eat ']'
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool ParseFloats(const BrhanToken& token, float* values, int numValues, const char* line, const char* lineEnd, std::string* error)
+{
+	const char* p = token.value;
+	for (int i = 0; i < numValues; i++)
+	{
+		while (p < token.valueEnd && IsSpace(*p)) { p++; }
+		if (!ParseFloat(p, token.valueEnd, &values[i]))
+		{
+			return ParseError(error, "Failed to parse value %i of '%.*s' on line: '%.*s'", i, int(token.keyLength), token.key, int(lineEnd - line), line);
+		}
+		//Skip anything trailing the number, e.g. the 'f' in '0.0f'
+		while (p < token.valueEnd && !IsSpace(*p)) { p++; }
+	}
+	return true;
+}
+
+static bool ParseVec3(const BrhanToken& token, const char* line, const char* lineEnd, glm::vec3* v, std::string* error)
+{
+	*v = glm::vec3(0.0f);
+	return ParseFloats(token, &(*v)[0], 3, line, lineEnd, error);
+}
+
+static bool ParseScalar(const BrhanToken& token, const char* line, const char* lineEnd, float* f, std::string* error)
+{
+	*f = 0.0f;
+	return ParseFloats(token, f, 1, line, lineEnd, error);
+}
+
+static bool ParseUnsigned(const BrhanToken& token, const char* line, const char* lineEnd, unsigned int* u, std::string* error)
+{
+	const char* p = token.value;
+	while (p < token.valueEnd && IsSpace(*p)) { p++; }
+	int value = 0;
+	if (!ParseInt(p, token.valueEnd, &value) || value < 0)
+	{
+		return ParseError(error, "Failed to parse value of '%.*s' on line: '%.*s'", int(token.keyLength), token.key, int(lineEnd - line), line);
+	}
+	*u = (unsigned int)(value);
+	return true;
+}
+
+bool BrhanFile::LoadCamera(const char* line, const char* lineEnd, std::string* error)
 {
-	static const std::string positionStr = "position";
 	glm::vec3 position(0.0f);
 	bool foundPosition = false;
-	static const std::string viewDirectionStr = "view_direction";
 	bool foundViewDirection = false;
-	static const std::string verticalFOVStr = "vertical_fov";
 	bool foundVerticalFOV = false;
-	static const std::string widthStr = "width";
 	bool foundWidth = false;
-	static const std::string heightStr = "height";
 	bool foundHeight = false;
 	
-	unsigned int index = 7; //Eat "Camera "
-	while (index < line.length())
+	const char* p = line + 6; //Eat "Camera"
+	BrhanToken token;
+	while (NextToken(p, lineEnd, &token))
 	{
-		if (line.compare(index, positionStr.length(), positionStr) == 0)
+		if (TokenIs(token, "position"))
 		{
-			index += 9; //Eat "position["
-			for (int i = 0; i < 3; i++)
+			if (!ParseVec3(token, line, lineEnd, &position, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				position[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			foundPosition = true;
 		}
-		else if (line.compare(index, viewDirectionStr.length(), viewDirectionStr) == 0)
+		else if (TokenIs(token, "view_direction"))
 		{
-			index += 15; //Eat "view_direction["
-			for (int i = 0; i < 3; i++)
+			if (!ParseVec3(token, line, lineEnd, &cameraViewDir, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				cameraViewDir[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			cameraViewDir = glm::normalize(cameraViewDir);
 			foundViewDirection = true;
 		}
-		else if (line.compare(index, verticalFOVStr.length(), verticalFOVStr) == 0)
+		else if (TokenIs(token, "vertical_fov"))
 		{
-			index += 13; //Eat "view_direction["
-			unsigned int end = index + 1;
-			while (line[end] != ']') { end++; }
-			cameraVerticalFOV = std::stof(line.substr(index, end - index));
-			index = end + 1; //+1 to eat space
+			if (!ParseScalar(token, line, lineEnd, &cameraVerticalFOV, error))
+			{
+				return false;
+			}
 			foundVerticalFOV = true;
 		}
-		else if (line.compare(index, widthStr.length(), widthStr) == 0)
+		else if (TokenIs(token, "width"))
 		{
-			index += 6; //Eat "width["
-			unsigned int end = index + 1;
-			while (line[end] != ']') { end++; }
-			filmWidth = std::stoi(line.substr(index, end - index));
-			index = end + 1; //+1 to eat space
+			if (!ParseUnsigned(token, line, lineEnd, &filmWidth, error))
+			{
+				return false;
+			}
 			foundWidth = true;
 		}
-		else if (line.compare(index, heightStr.length(), heightStr) == 0)
+		else if (TokenIs(token, "height"))
 		{
-			index += 7; //Eat "height["
-			unsigned int end = index + 1;
-			while (line[end] != ']') { end++; }
-			filmHeight = std::stoi(line.substr(index, end - index));
-			index = end + 1; //+1 to eat space
+			if (!ParseUnsigned(token, line, lineEnd, &filmHeight, error))
+			{
+				return false;
+			}
 			foundHeight = true;
 		}
-		
-		index++;
 	}
 	
 	if (!foundPosition)
   	{
-  		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to locate camera position\n");
+  		return ParseError(error, "Failed to locate camera position");
   	}
   	if (!foundViewDirection)
   	{
-  		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to locate camera view direction\n");
+  		return ParseError(error, "Failed to locate camera view direction");
   	}
   	if (!foundVerticalFOV)
   	{
-  		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to locate camera vertical FOV\n");
+  		return ParseError(error, "Failed to locate camera vertical FOV");
   	}
   	if (!foundWidth)
   	{
-  		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to locate camera film width\n");
+  		return ParseError(error, "Failed to locate camera film width");
   	}
   	if (!foundHeight)
   	{
-  		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to locate camera film height\n");
+  		return ParseError(error, "Failed to locate camera film height");
   	}
 	
 	//Assign camera properties
@@ -127,68 +243,49 @@ void BrhanFile::LoadCamera(const std::string& line)
 	cameraHorizontalEnd = lensWidth * cameraRight;
 	//Go height of lense along the camera's down (-up) axis
 	cameraVerticalEnd = lensHeight * (-cameraUp);
+	return true;
 }
 
-void BrhanFile::AddModel(const std::string& line)
+bool BrhanFile::AddModel(const char* line, const char* lineEnd, std::vector<ModelFromFile>* models, std::string* error)
 {
 	ModelFromFile model;
-	static const std::string fileStr = "file";
 	bool foundFile = false;
-	static const std::string translateStr = "translate";
 	bool foundTranslate = false;
-	static const std::string rotateStr = "rotate";
 	bool foundRotate = false;
-	static const std::string scaleStr = "scale";
 	bool foundScale = false;
 	
-	static const std::string materialStr = "material";
 	bool foundMaterial = false;
-	static const std::string diffuseStr = "diffuse";
 	bool foundDiffuse = false;
-	static const std::string specularStr = "specular";
 	bool foundSpecular = false;
-	static const std::string reflectanceStr = "reflectance";
 	bool foundReflectance = false;
-	static const std::string transmittanceStr = "transmittance";
 	bool foundTransmittance = false;
 	
-	unsigned int index = 6; //Eat "Model "
-	while (index < line.length())
+	const char* p = line + 5; //Eat "Model"
+	BrhanToken token;
+	while (NextToken(p, lineEnd, &token))
 	{
-		if (line.compare(index, fileStr.length(), fileStr) == 0)
+		if (TokenIs(token, "file"))
 		{
-			index += 5; //Eat "file["
-			unsigned int end = index + 1;
-			while (line[end] != ']') { end++; }
-			model.file = line.substr(index, end - index);
-			index = end + 1;
+			model.file.assign(token.value, token.valueEnd);
 			foundFile = true;
 		}
-		else if (line.compare(index, translateStr.length(), translateStr) == 0)
+		else if (TokenIs(token, "translate"))
 		{
-			index += 10; //Eat "translate["
-			glm::vec3 translationVec(0.0f);
-			for (int i = 0; i < 3; i++)
+			glm::vec3 translationVec;
+			if (!ParseVec3(token, line, lineEnd, &translationVec, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				translationVec[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			model.translation = glm::translate(glm::mat4(1.0f), translationVec);
 			model.translationActive = true;
 			foundTranslate = true;
 		}
-		else if (line.compare(index, rotateStr.length(), rotateStr) == 0)
+		else if (TokenIs(token, "rotate"))
 		{
-			index += 7; //Eat "rotate["
-			glm::vec3 rotationVec(0.0f);
-			for (int i = 0; i < 3; i++)
+			glm::vec3 rotationVec;
+			if (!ParseVec3(token, line, lineEnd, &rotationVec, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				rotationVec[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			model.rotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotationVec.x), glm::vec3(1.0f, 0.0f, 0.0f));
 			model.rotation = glm::rotate(model.rotation, glm::radians(rotationVec.y), glm::vec3(0.0f, 1.0f, 0.0f));
@@ -196,85 +293,71 @@ void BrhanFile::AddModel(const std::string& line)
 			model.rotationActive = true;
 			foundRotate = true;
 		}
-		else if (line.compare(index, scaleStr.length(), scaleStr) == 0)
+		else if (TokenIs(token, "scale"))
 		{
-			index += 6; //Eat "scale["
-			glm::vec3 scalingVec(0.0f);
-			for (int i = 0; i < 3; i++)
+			glm::vec3 scalingVec;
+			if (!ParseVec3(token, line, lineEnd, &scalingVec, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				scalingVec[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			model.scaling = glm::scale(glm::mat4(1.0f), scalingVec);
 			model.scalingActive = true;
 			foundScale = true;
 		}
-		else if (line.compare(index, materialStr.length(), materialStr) == 0)
+		else if (TokenIs(token, "material"))
 		{
-			index += 9; //Eat "material["
-			unsigned int end = index + 1;
-			while (line[end] != ']') { end++; }
-			model.material = line.substr(index, end - index);
+			model.material.assign(token.value, token.valueEnd);
 			model.hasCustomMaterial = true;
 			foundMaterial = true;
 		}
-		else if (line.compare(index, diffuseStr.length(), diffuseStr) == 0)
+		else if (TokenIs(token, "diffuse"))
 		{
-			index += 8; //Eat "diffuse["
-			for (int i = 0; i < 3; i++)
+			if (!ParseVec3(token, line, lineEnd, &model.diffuse, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				model.diffuse[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			foundDiffuse = true;
 		}
-		else if (line.compare(index, specularStr.length(), specularStr) == 0)
+		else if (TokenIs(token, "specular"))
 		{
-			index += 9; //Eat "specular["
-			for (int i = 0; i < 3; i++)
+			if (!ParseVec3(token, line, lineEnd, &model.specular, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				model.specular[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			foundSpecular = true;
 		}
-		else if (line.compare(index, reflectanceStr.length(), reflectanceStr) == 0)
+		else if (TokenIs(token, "reflectance"))
 		{
-			index += 12; //Eat "reflectance["
-			for (int i = 0; i < 3; i++)
+			if (!ParseVec3(token, line, lineEnd, &model.reflectance, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				model.reflectance[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			foundReflectance = true;
 		}
-		else if (line.compare(index, transmittanceStr.length(), transmittanceStr) == 0)
+		else if (TokenIs(token, "transmittance"))
 		{
-			index += 14; //Eat "transmittance["
-			for (int i = 0; i < 3; i++)
+			if (!ParseVec3(token, line, lineEnd, &model.transmittance, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				model.transmittance[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			foundTransmittance = true;
 		}
-		
-		index++;
+		else if (TokenIs(token, "spatial_splits"))
+		{
+			if (!ParseScalar(token, line, lineEnd, &model.splitBudget, error))
+			{
+				return false;
+			}
+			if (model.splitBudget < 0.0f)
+			{
+				return ParseError(error, "Negative spatial split budget of model %s on line: '%.*s'", model.file.c_str(), int(lineEnd - line), line);
+			}
+		}
 	}
 	
 	if (!foundFile)
 	{
-		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find model file\n");
+		return ParseError(error, "Failed to find model file on line: '%.*s'", int(lineEnd - line), line);
 	}
 	if (!foundTranslate)
 	{
@@ -292,101 +375,147 @@ void BrhanFile::AddModel(const std::string& line)
 	{	
 		if (model.material == "matte" && !foundDiffuse)
 		{
-			LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find diffuse spectrum of model %s on line: '%s'\n", model.file.c_str(), line.c_str());
+			return ParseError(error, "Failed to find diffuse spectrum of model %s on line: '%.*s'", model.file.c_str(), int(lineEnd - line), line);
 		}
 		if (model.material == "mirror" && !foundSpecular)
 		{
-			LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find specular spectrum of model %s on line: '%s'\n", model.file.c_str(), line.c_str());
+			return ParseError(error, "Failed to find specular spectrum of model %s on line: '%.*s'", model.file.c_str(), int(lineEnd - line), line);
 		}
 		/*if (model.material == "plastic" && (!foundDiffuse || !foundSpecular))
 		{
-			LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find diffuse or specular spectrum of model %s on line: '%s'\n", model.file.c_str(), line.c_str());
+			return ParseError(error, "Failed to find diffuse or specular spectrum of model %s on line: '%.*s'", model.file.c_str(), int(lineEnd - line), line);
 		}
 		if ((model.material == "copper" || model.material == "gold" || model.material == "aluminium" || model.material == "salt") && !foundSpecular)
 		{
-			LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find specular spectrum of model %s on line: '%s'\n", model.file.c_str(), line.c_str());
+			return ParseError(error, "Failed to find specular spectrum of model %s on line: '%.*s'", model.file.c_str(), int(lineEnd - line), line);
 		}
 		if (model.material == "translucent" && !foundTransmittance)
 		{
-			LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find transmittance spectrum of model %s on line: '%s'\n", model.file.c_str(), line.c_str());
+			return ParseError(error, "Failed to find transmittance spectrum of model %s on line: '%.*s'", model.file.c_str(), int(lineEnd - line), line);
 		}*/
 		if ((model.material == "water" || model.material == "glass") && (!foundReflectance || !foundTransmittance))
 		{
-			LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find reflectance or transmittance spectrum of model %s on line: '%s'\n", model.file.c_str(), line.c_str());
+			return ParseError(error, "Failed to find reflectance or transmittance spectrum of model %s on line: '%.*s'", model.file.c_str(), int(lineEnd - line), line);
 		}
 	}
 	
-	models.push_back(model);
+	models->push_back(std::move(model));
+	return true;
 }
 
-void BrhanFile::AddSphericalLight(const std::string& line)
+bool BrhanFile::AddSphericalLight(const char* line, const char* lineEnd, std::vector<SphericalLightFromFile>* sphericalLights, std::string* error)
 {
 	SphericalLightFromFile sL;
-	static const std::string centerStr = "center";
 	bool foundCenter = false;
-	static const std::string radiusStr = "radius";
 	bool foundRadius = false;
-	static const std::string emittanceStr = "emittance";
 	bool foundEmittance = false;
 	
-	unsigned int index = 15; //Eat "SphericalLight "
-	while (index < line.length())
+	const char* p = line + 14; //Eat "SphericalLight"
+	BrhanToken token;
+	while (NextToken(p, lineEnd, &token))
 	{
-		if (line.compare(index, centerStr.length(), centerStr) == 0)
+		if (TokenIs(token, "center"))
 		{
-			index += 7; //Eat "center["
-			for (int i = 0; i < 3; i++)
+			if (!ParseFloats(token, &sL.centerAndRadius[0], 3, line, lineEnd, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				sL.centerAndRadius[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			foundCenter = true;
 		}
-		else if (line.compare(index, radiusStr.length(), radiusStr) == 0)
+		else if (TokenIs(token, "radius"))
 		{
-			index += 7; //Eat "radius["
-			unsigned int end = index + 1;
-			while (line[end] != ']') { end++; }
-			sL.centerAndRadius[3] = std::stof(line.substr(index, end - index));
-			index = end + 1; //+1 to eat space
+			if (!ParseScalar(token, line, lineEnd, &sL.centerAndRadius[3], error))
+			{
+				return false;
+			}
 			foundRadius = true;
 		}
-		else if (line.compare(index, emittanceStr.length(), emittanceStr) == 0)
+		else if (TokenIs(token, "emittance"))
 		{
-			index += 10; //Eat "emittance["
-			for (int i = 0; i < 3; i++)
+			if (!ParseFloats(token, &sL.emittance[0], 3, line, lineEnd, error))
 			{
-				unsigned int end = index + 1;
-				while (line[end] != ' ' && line[end] != ']') { end++; }
-				sL.emittance[i] = std::stof(line.substr(index, end - index));
-				index = end + 1; //+1 to eat space
+				return false;
 			}
 			sL.emittance[3] = 0.0f;
 			foundEmittance = true;
 		}
-		
-		index++;
 	}
 	
 	if (!foundCenter)
 	{
-		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find center for spherical light source");
+		return ParseError(error, "Failed to find center for spherical light source on line: '%.*s'", int(lineEnd - line), line);
 	}
 	if (!foundRadius)
 	{
-		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find radius for spherical light source");
+		return ParseError(error, "Failed to find radius for spherical light source on line: '%.*s'", int(lineEnd - line), line);
 	}
 	if (!foundEmittance)
 	{
-		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to find emittance for spherical light source");
+		return ParseError(error, "Failed to find emittance for spherical light source on line: '%.*s'", int(lineEnd - line), line);
 	}
 	
-	sphericalLights.push_back(sL);
+	sphericalLights->push_back(sL);
+	return true;
 }
 
-BrhanFile::BrhanFile(const char* brhanFile)
+//Parses every line in [begin, end). Both must be at the start of a line (or the end of the file).
+//Stops at the first line that fails to parse, see BrhanFileChunk::error.
+static void ParseChunk(const char* begin, const char* end, BrhanFileChunk* chunk)
+{
+	//An empty file isn't mapped, so both are NULL
+	if (begin == end)
+	{
+		return;
+	}
+	
+	//Most lines in large files are models, so reserve for one per line up front
+	size_t numLines = 1;
+	for (const char* c = begin; (c = (const char*)(memchr(c, '\n', size_t(end - c)))) != NULL; c++)
+	{
+		numLines++;
+	}
+	chunk->models.reserve(numLines);
+	
+	const char* line = begin;
+	while (line < end)
+	{
+		const char* lineEnd = (const char*)(memchr(line, '\n', size_t(end - line)));
+		if (lineEnd == NULL)
+		{
+			lineEnd = end;
+		}
+		
+		if (line == lineEnd) {} //Empty
+		else if (LineStartsWith(line, lineEnd, "Camera"))
+		{
+			//Only the last camera in the file is used, so it's parsed once all chunks are done
+			chunk->cameraLine = line;
+			chunk->cameraLineEnd = lineEnd;
+		}
+		else if (LineStartsWith(line, lineEnd, "Model"))
+		{
+			if (!BrhanFile::AddModel(line, lineEnd, &chunk->models, &chunk->error))
+			{
+				return;
+			}
+		}
+		else if (LineStartsWith(line, lineEnd, "Sphere"))
+		{
+			//BrhanFile::AddSphere(line, lineEnd, &chunk->spheres);
+		}
+		else if (LineStartsWith(line, lineEnd, "SphericalLight"))
+		{
+			if (!BrhanFile::AddSphericalLight(line, lineEnd, &chunk->sphericalLights, &chunk->error))
+			{
+				return;
+			}
+		}
+		
+		line = lineEnd + 1;
+	}
+}
+
+BrhanFile::BrhanFile(const char* brhanFile, unsigned int numThreads)
 {
 	if (strcmp(brhanFile, "") == 0)
 	{
@@ -394,50 +523,162 @@ BrhanFile::BrhanFile(const char* brhanFile)
 		exit(EXIT_FAILURE);
 	}
 	
-	std::ifstream file(brhanFile);
-  	if (!file.is_open())
+	std::string error;
+	if (!Load(brhanFile, numThreads, &error))
+	{
+		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "%s\n", error.c_str());
+	}
+}
+
+bool BrhanFile::Load(const char* brhanFile, unsigned int numThreads, std::string* error)
+{
+	MappedFile file(brhanFile);
+  	if (!file.IsOpen())
   	{
-  		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to open file %s\n", brhanFile);
+  		return ParseError(error, "Failed to open file %s", brhanFile);
+  	}
+  	//Without a camera line there is nothing to render
+  	if (file.size == 0)
+  	{
+  		return ParseError(error, "Scene file %s is empty", brhanFile);
   	}
   	
-  	//Parameters
-  	static const std::string cameraStr = "Camera";
-  	bool foundCamera = false;
-  	static const std::string modelStr = "Model";
-  	static const std::string sphereStr = "Sphere";
-  	static const std::string sphericalLightStr = "SphericalLight";
+  	//Decide how many pieces to split the file into
+  	if (numThreads == 0)
+  	{
+  		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  	}
+  	size_t maxUsefulThreads = std::max(file.size / minBytesPerThread, size_t(1));
+  	uint32_t numChunks = uint32_t(std::min(size_t(numThreads), maxUsefulThreads));
   	
-  	std::string line;
-  	while (std::getline(file, line))
+  	//Chunk boundaries are moved forward to the start of the next line
+  	const char* fileBegin = file.data;
+  	const char* fileEnd = file.data + file.size;
+  	std::vector<const char*> chunkBegins(numChunks + 1);
+  	chunkBegins[0] = fileBegin;
+  	chunkBegins[numChunks] = fileEnd;
+  	for (uint32_t i = 1; i < numChunks; i++)
   	{
-  		if (line.length() == 0) { continue; } //Empty
-  		else if (line.compare(0, cameraStr.length(), cameraStr) == 0)
-  		{
-  			LoadCamera(line);
-  			foundCamera = true;
-  		}
-  		else if (line.compare(0, modelStr.length(), modelStr) == 0)
-  		{
-  			AddModel(line);
-  		}
-  		else if (line.compare(0, sphereStr.length(), sphereStr) == 0)
+  		const char* begin = std::max(fileBegin + (file.size / numChunks) * i, chunkBegins[i - 1]);
+  		const char* newline = (const char*)(memchr(begin, '\n', size_t(fileEnd - begin)));
+  		chunkBegins[i] = newline == NULL ? fileEnd : newline + 1;
+  	}
+  	
+  	std::vector<BrhanFileChunk> chunks(numChunks);
+  	std::vector<std::thread> threads;
+  	for (uint32_t i = 1; i < numChunks; i++)
+  	{
+  		threads.push_back(std::thread(ParseChunk, chunkBegins[i], chunkBegins[i + 1], &chunks[i]));
+  	}
+  	ParseChunk(chunkBegins[0], chunkBegins[1], &chunks[0]);
+  	for (std::thread& thread : threads)
+  	{
+  		thread.join();
+  	}
+  	
+  	//Merge in file order
+  	size_t numModels = 0;
+  	size_t numSphericalLights = 0;
+  	for (const BrhanFileChunk& chunk : chunks)
+  	{
+  		numModels += chunk.models.size();
+  		numSphericalLights += chunk.sphericalLights.size();
+  	}
+  	//The first chunk's models are taken over as-is to avoid moving the largest part twice
+  	models.clear();
+  	models.swap(chunks[0].models);
+  	models.reserve(numModels);
+  	sphericalLights.clear();
+  	sphericalLights.reserve(numSphericalLights);
+  	const BrhanFileChunk* cameraChunk = NULL;
+  	for (BrhanFileChunk& chunk : chunks)
+  	{
+  		//The first error in the file is reported
+  		if (!chunk.error.empty())
   		{
-  			//AddSphere(line);
+  			*error = chunk.error;
+  			return false;
   		}
-  		else if (line.compare(0, sphericalLightStr.length(), sphericalLightStr) == 0)
+  		std::move(chunk.models.begin(), chunk.models.end(), std::back_inserter(models));
+  		sphericalLights.insert(sphericalLights.end(), chunk.sphericalLights.begin(), chunk.sphericalLights.end());
+  		if (chunk.cameraLine != NULL)
   		{
-  			AddSphericalLight(line);
+  			cameraChunk = &chunk;
   		}
   	}
   	
-  	file.close();
-  	
-  	if (!foundCamera)
+  	if (cameraChunk == NULL)
   	{
-  		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "Failed to load camera from %s\n", brhanFile);
+  		return ParseError(error, "Failed to load camera from %s", brhanFile);
   	}
+  	return LoadCamera(cameraChunk->cameraLine, cameraChunk->cameraLineEnd, error);
+}
+
+bool BrhanFileDiff::Empty() const
+{
+	return !filmChanged && !cameraChanged && !lightsChanged && !modelsChanged && transformedModels.empty();
+}
+
+static bool SameTransform(const ModelFromFile& a, const ModelFromFile& b)
+{
+	return a.translationActive == b.translationActive && (!a.translationActive || a.translation == b.translation) &&
+		a.rotationActive == b.rotationActive && (!a.rotationActive || a.rotation == b.rotation) &&
+		a.scalingActive == b.scalingActive && (!a.scalingActive || a.scaling == b.scaling);
 }
 
+//Everything that decides which meshes a model gets
+static bool SameGeometry(const ModelFromFile& a, const ModelFromFile& b)
+{
+	if (a.file != b.file || a.hasCustomMaterial != b.hasCustomMaterial)
+	{
+		return false;
+	}
+	return !a.hasCustomMaterial || (a.material == b.material && a.diffuse == b.diffuse && a.specular == b.specular &&
+		a.reflectance == b.reflectance && a.transmittance == b.transmittance);
+}
+
+BrhanFileDiff DiffBrhanFiles(const BrhanFile& oldFile, const BrhanFile& newFile)
+{
+	BrhanFileDiff diff;
+	diff.filmChanged = oldFile.filmWidth != newFile.filmWidth || oldFile.filmHeight != newFile.filmHeight;
+	diff.cameraChanged = oldFile.cameraOrigin != newFile.cameraOrigin || oldFile.cameraViewDir != newFile.cameraViewDir ||
+		oldFile.cameraVerticalFOV != newFile.cameraVerticalFOV;
+	
+	diff.lightsChanged = oldFile.sphericalLights.size() != newFile.sphericalLights.size();
+	for (size_t i = 0; i < newFile.sphericalLights.size() && !diff.lightsChanged; i++)
+	{
+		const SphericalLightFromFile& a = oldFile.sphericalLights[i];
+		const SphericalLightFromFile& b = newFile.sphericalLights[i];
+		diff.lightsChanged = a.centerAndRadius != b.centerAndRadius || a.emittance != b.emittance;
+	}
+	
+	diff.modelsChanged = oldFile.models.size() != newFile.models.size();
+	for (size_t i = 0; i < newFile.models.size() && !diff.modelsChanged; i++)
+	{
+		diff.modelsChanged = !SameGeometry(oldFile.models[i], newFile.models[i]);
+		if (!SameTransform(oldFile.models[i], newFile.models[i]))
+		{
+			diff.transformedModels.push_back(uint32_t(i));
+		}
+	}
+	if (diff.modelsChanged)
+	{
+		diff.transformedModels.clear();
+	}
+	return diff;
+}
+
+int64_t FileModifiedTime(const char* filename)
+{
+	struct stat fileStat;
+	if (stat(filename, &fileStat) != 0)
+	{
+		return -1;
+	}
+	return int64_t(fileStat.st_mtim.tv_sec) * 1000000000 + int64_t(fileStat.st_mtim.tv_nsec);
+}
+
+
 /*
 MIT License
 
@@ -8,6 +8,7 @@ LICENSE: See end of file for license information.
 
 #include "glm/mat4x4.hpp"
 #include "glm/vec3.hpp"
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -27,6 +28,10 @@ struct ModelFromFile
 	glm::vec3 reflectance;
 	glm::vec3 transmittance;
 	bool hasCustomMaterial = false;
+	
+	//spatial_splits[budget] builds the CPU BVHs of the model with spatial splits, making at most
+	//'budget' times as many extra references as it has triangles. 0 uses object splits only.
+	float splitBudget = 0.0f;
 };
 
 struct SphereFromFile
@@ -61,13 +66,39 @@ struct BrhanFile
 	std::vector<SphereFromFile> spheres;
 	std::vector<SphericalLightFromFile> sphericalLights;
 	
-	BrhanFile(const char* brhanFile);
-	void LoadCamera(const std::string& line);
-	void AddModel(const std::string& line);
-	void AddSphericalLight(const std::string& line);
-	//void AddSphere(const std::string& line);
+	//Empty until Load succeeds
+	BrhanFile() {}
+	//numThreads = 0 lets the parser decide based on the file size and number of cores. Exits if the
+	//file can't be parsed.
+	BrhanFile(const char* brhanFile, unsigned int numThreads = 0);
+	//Like the constructor, but returns false with the reason in 'error' instead of exiting, e.g. to
+	//reload a scene file that is being edited
+	bool Load(const char* brhanFile, unsigned int numThreads, std::string* error);
+	//These return false with the reason in 'error' if the line is malformed
+	bool LoadCamera(const char* line, const char* lineEnd, std::string* error);
+	static bool AddModel(const char* line, const char* lineEnd, std::vector<ModelFromFile>* models, std::string* error);
+	static bool AddSphericalLight(const char* line, const char* lineEnd, std::vector<SphericalLightFromFile>* sphericalLights, std::string* error);
+	//static void AddSphere(const char* line, const char* lineEnd, std::vector<SphereFromFile>* spheres);
+};
+
+//What differs between two versions of a scene file
+struct BrhanFileDiff
+{
+	bool filmChanged = false;
+	bool cameraChanged = false;
+	bool lightsChanged = false;
+	//The number of models, or the file or material of a model, differs
+	bool modelsChanged = false;
+	//Models where only the translation, rotation or scaling differs. Empty when modelsChanged is set.
+	std::vector<uint32_t> transformedModels;
+	
+	bool Empty() const;
 };
 
+BrhanFileDiff DiffBrhanFiles(const BrhanFile& oldFile, const BrhanFile& newFile);
+//Modification time in nanoseconds, or -1 if the file can't be read
+int64_t FileModifiedTime(const char* filename);
+
 #endif
 
 /*
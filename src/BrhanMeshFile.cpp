@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include "BrhanMeshFile.h"
+#include <fcntl.h>
+#include "Logger.h"
+#include "MappedFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char brhanMeshFileMagic[8] = { 'B', 'R', 'H', 'A', 'N', 'M', 'S', 'H' };
+
+struct SourceFileInfo
+{
+	uint64_t size;
+	int64_t modifiedTime;
+};
+
+static bool GetSourceFileInfo(const std::string& file, SourceFileInfo* info)
+{
+	struct stat fileStat;
+	if (stat(file.c_str(), &fileStat) != 0)
+	{
+		return false;
+	}
+	info->size = uint64_t(fileStat.st_size);
+	info->modifiedTime = int64_t(fileStat.st_mtim.tv_sec) * 1000000000 + int64_t(fileStat.st_mtim.tv_nsec);
+	return true;
+}
+
+static bool HashSourceFile(const std::string& file, uint64_t* hash)
+{
+	MappedFile source;
+	if (!source.Open(file.c_str()))
+	{
+		return false;
+	}
+	*hash = HashFileContents(source.data, source.size);
+	return true;
+}
+
+std::string BrhanMeshFilePath(const std::string& objFile)
+{
+	return objFile + ".brhanmesh";
+}
+
+uint64_t HashFileContents(const char* data, size_t size)
+{
+	//Eight bytes per step, only needs to tell a changed OBJ from an unchanged one
+	const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+	uint64_t hash = 0xCBF29CE484222325ull ^ uint64_t(size);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 29;
+	}
+	uint64_t tail = 0;
+	if (i < size)
+	{
+		memcpy(&tail, data + i, size - i);
+	}
+	hash = (hash ^ tail) * multiplier;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+bool LoadBrhanMeshFile(const std::string& objFile, std::vector<Mesh>* meshes, bool* hasMaterials)
+{
+	const std::string cacheFile = BrhanMeshFilePath(objFile);
+	MappedFile cache;
+	if (!cache.Open(cacheFile.c_str()) || cache.size < sizeof(BrhanMeshFileHeader))
+	{
+		return false;
+	}
+	
+	BrhanMeshFileHeader header;
+	memcpy(&header, cache.data, sizeof(header));
+	if (memcmp(header.magic, brhanMeshFileMagic, sizeof(brhanMeshFileMagic)) != 0 || header.version != BRHAN_MESH_FILE_VERSION)
+	{
+		return false;
+	}
+	const uint64_t materialsSize = uint64_t(header.numMaterials) * sizeof(BrhanMeshFileMaterial);
+	const uint64_t vertexDataSize = header.numVertices * (3 + 3 + 2) * sizeof(float);
+	const uint64_t indexDataSize = header.numIndices * sizeof(uint32_t);
+	if (cache.size != sizeof(header) + materialsSize + vertexDataSize + indexDataSize)
+	{
+		return false;
+	}
+	
+	//A cache without its OBJ is still usable, which allows shipping only the caches
+	SourceFileInfo source;
+	if (GetSourceFileInfo(objFile, &source))
+	{
+		if (source.size != header.sourceSize)
+		{
+			return false;
+		}
+		if (source.modifiedTime != header.sourceModifiedTime)
+		{
+			//Touched or copied, but possibly not changed
+			uint64_t hash;
+			if (!HashSourceFile(objFile, &hash) || hash != header.sourceHash)
+			{
+				return false;
+			}
+			header.sourceModifiedTime = source.modifiedTime;
+			int fd = open(cacheFile.c_str(), O_WRONLY);
+			if (fd != -1)
+			{
+				if (pwrite(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)))
+				{
+					LOG_WARNING(false, __FILE__, __FUNCTION__, __LINE__, "Failed to refresh the header of '%s'\n", cacheFile.c_str());
+				}
+				close(fd);
+			}
+		}
+	}
+	
+	const BrhanMeshFileMaterial* materials = (const BrhanMeshFileMaterial*)(cache.data + sizeof(header));
+	const float* vertices = (const float*)(cache.data + sizeof(header) + materialsSize);
+	const float* normals = vertices + header.numVertices * 3;
+	const float* uvs = normals + header.numVertices * 3;
+	const uint32_t* indices = (const uint32_t*)(uvs + header.numVertices * 2);
+	for (uint32_t i = 0; i < header.numMaterials; i++)
+	{
+		if (materials[i].firstVertex + materials[i].numVertices > header.numVertices || materials[i].firstIndex + materials[i].numIndices > header.numIndices)
+		{
+			return false;
+		}
+	}
+	
+	size_t oldMeshesSize = meshes->size();
+	meshes->resize(oldMeshesSize + header.numMaterials);
+	for (uint32_t i = 0; i < header.numMaterials; i++)
+	{
+		const BrhanMeshFileMaterial& material = materials[i];
+		Mesh& mesh = (*meshes)[oldMeshesSize + i];
+		memcpy(mesh.material.diffuseColor, material.diffuseColor, sizeof(material.diffuseColor));
+		mesh.vertices.assign(vertices + material.firstVertex * 3, vertices + (material.firstVertex + material.numVertices) * 3);
+		mesh.normals.assign(normals + material.firstVertex * 3, normals + (material.firstVertex + material.numVertices) * 3);
+		mesh.uvs.assign(uvs + material.firstVertex * 2, uvs + (material.firstVertex + material.numVertices) * 2);
+		mesh.indices.assign(indices + material.firstIndex, indices + material.firstIndex + material.numIndices);
+	}
+	*hasMaterials = header.hasMaterials != 0;
+	
+	return true;
+}
+
+bool WriteBrhanMeshFile(const std::string& objFile, const std::vector<Mesh>& meshes, bool hasMaterials)
+{
+	BrhanMeshFileHeader header = {};
+	memcpy(header.magic, brhanMeshFileMagic, sizeof(brhanMeshFileMagic));
+	header.version = BRHAN_MESH_FILE_VERSION;
+	header.hasMaterials = hasMaterials ? 1 : 0;
+	SourceFileInfo source;
+	if (!GetSourceFileInfo(objFile, &source) || !HashSourceFile(objFile, &header.sourceHash))
+	{
+		return false;
+	}
+	header.sourceSize = source.size;
+	header.sourceModifiedTime = source.modifiedTime;
+	header.numMaterials = uint32_t(meshes.size());
+	
+	std::vector<BrhanMeshFileMaterial> materials(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		memcpy(materials[i].diffuseColor, meshes[i].material.diffuseColor, sizeof(materials[i].diffuseColor));
+		materials[i].firstVertex = header.numVertices;
+		materials[i].numVertices = meshes[i].vertices.size() / 3;
+		header.numVertices += materials[i].numVertices;
+		materials[i].firstIndex = header.numIndices;
+		materials[i].numIndices = meshes[i].indices.size();
+		header.numIndices += materials[i].numIndices;
+	}
+	
+	//Written to a temporary file of its own first so a reader never maps a half-written cache, and
+	//writers of the same cache, e.g. two materials of one OBJ or two processes, don't mix their data
+	const std::string cacheFile = BrhanMeshFilePath(objFile);
+	std::string tempFile;
+	FILE* file = CreateTempFile(cacheFile, &tempFile);
+	if (file == NULL)
+	{
+		return false;
+	}
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+	success = success && fwrite(materials.data(), sizeof(BrhanMeshFileMaterial), materials.size(), file) == materials.size();
+	for (const Mesh& mesh : meshes)
+	{
+		success = success && fwrite(mesh.vertices.data(), sizeof(float), mesh.vertices.size(), file) == mesh.vertices.size();
+	}
+	for (const Mesh& mesh : meshes)
+	{
+		success = success && fwrite(mesh.normals.data(), sizeof(float), mesh.normals.size(), file) == mesh.normals.size();
+	}
+	for (const Mesh& mesh : meshes)
+	{
+		success = success && fwrite(mesh.uvs.data(), sizeof(float), mesh.uvs.size(), file) == mesh.uvs.size();
+	}
+	for (const Mesh& mesh : meshes)
+	{
+		success = success && fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size();
+	}
+	success = (fclose(file) == 0) && success;
+	if (!success || rename(tempFile.c_str(), cacheFile.c_str()) != 0)
+	{
+		remove(tempFile.c_str());
+		return false;
+	}
+	
+	return true;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef BRHAN_MESH_FILE_H
+#define BRHAN_MESH_FILE_H
+
+#include "MeshLoader.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+.brhanmesh is a binary cache of the meshes LoadObjMeshes produces for one OBJ
+file. It is stored next to the OBJ (dragon.obj -> dragon.obj.brhanmesh) and
+holds the welded vertices, normals, UVs and indices of all materials back to
+back, in the layout BuildColorAndAttributeData and CreateBottomAccStruct
+consume, so loading it is a mapping plus one copy per array. Indices are
+relative to the first vertex of their material.
+
+Layout:
+	BrhanMeshFileHeader
+	BrhanMeshFileMaterial[numMaterials]
+	float vertices[numVertices * 3]
+	float normals[numVertices * 3]
+	float uvs[numVertices * 2]
+	uint32_t indices[numIndices]
+
+The cache is valid while the size and modification time of the OBJ match
+the header. When only the modification time differs the OBJ is hashed, and
+if the hash still matches the header is refreshed. Edits to the .mtl file
+alone are not detected; delete the cache to pick them up.
+*/
+
+#define BRHAN_MESH_FILE_VERSION 2
+
+struct BrhanMeshFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t hasMaterials;
+	uint64_t sourceSize;
+	int64_t sourceModifiedTime; //Nanoseconds
+	uint64_t sourceHash;
+	uint32_t numMaterials;
+	uint32_t padding;
+	uint64_t numVertices;
+	uint64_t numIndices;
+};
+
+struct BrhanMeshFileMaterial
+{
+	float diffuseColor[4];
+	uint64_t firstVertex;
+	uint64_t numVertices;
+	uint64_t firstIndex;
+	uint64_t numIndices;
+};
+
+std::string BrhanMeshFilePath(const std::string& objFile);
+uint64_t HashFileContents(const char* data, size_t size);
+//Returns false if there is no cache for objFile or it is out of date
+bool LoadBrhanMeshFile(const std::string& objFile, std::vector<Mesh>* meshes, bool* hasMaterials);
+bool WriteBrhanMeshFile(const std::string& objFile, const std::vector<Mesh>& meshes, bool hasMaterials);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <fcntl.h>
+#include "MappedFile.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+MappedFile::MappedFile(const char* filename)
+{
+	Open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+	
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+	{
+		return false;
+	}
+	
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0)
+	{
+		Close();
+		return false;
+	}
+	size = size_t(fileStat.st_size);
+	
+	//mmap does not accept a length of 0, an empty file is simply left unmapped
+	if (size == 0)
+	{
+		return true;
+	}
+	
+	void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	//The whole file is read front to back by every user of this class
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	data = (const char*)(mapping);
+	
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data != NULL)
+	{
+		munmap((void*)(data), size);
+		data = NULL;
+	}
+	if (fd != -1)
+	{
+		close(fd);
+		fd = -1;
+	}
+	size = 0;
+}
+
+FILE* CreateTempFile(const std::string& file, std::string* tempFile)
+{
+	std::vector<char> path(file.begin(), file.end());
+	const char suffix[] = ".XXXXXX";
+	path.insert(path.end(), suffix, suffix + sizeof(suffix));
+	int fd = mkstemp(path.data());
+	if (fd == -1)
+	{
+		return NULL;
+	}
+	//mkstemp makes the file private to the user, the files it replaces are readable by everyone
+	fchmod(fd, 0644);
+	FILE* stream = fdopen(fd, "wb");
+	if (stream == NULL)
+	{
+		close(fd);
+		unlink(path.data());
+		return NULL;
+	}
+	*tempFile = path.data();
+	return stream;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
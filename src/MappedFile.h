@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+
+/*
+Read-only memory mapping of a whole file. Used by the loaders that want to
+parse a file in place instead of copying it through a stream first.
+*/
+struct MappedFile
+{
+	const char* data = NULL;
+	size_t size = 0;
+	int fd = -1;
+	
+	MappedFile() {}
+	MappedFile(const char* filename);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+	bool Open(const char* filename);
+	void Close();
+	bool IsOpen() const { return fd != -1; }
+};
+
+//Creates a new file with a unique name next to 'file' and opens it for writing, so several threads
+//or processes writing the same file never share one. Its path is written to 'tempFile'. Returns NULL
+//on failure. Meant to be renamed over 'file' once complete.
+FILE* CreateTempFile(const std::string& file, std::string* tempFile);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,694 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include "BrhanMeshFile.h"
+#include <chrono>
+#include "glm/geometric.hpp"
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "Logger.h"
+#include "MeshLoader.h"
+#include "ObjFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tinyobjloader/tiny_obj_loader.h"
+
+struct WeldVertex
+{
+	float data[8]; //Position, normal, uv
+	
+	bool operator==(const WeldVertex& other) const
+	{
+		//Bitwise, only vertices that are exactly the same are merged
+		return memcmp(data, other.data, sizeof(data)) == 0;
+	}
+};
+
+struct WeldVertexHash
+{
+	size_t operator()(const WeldVertex& vertex) const
+	{
+		uint32_t words[8];
+		memcpy(words, vertex.data, sizeof(words));
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (int i = 0; i < 8; i++)
+		{
+			hash = (hash ^ words[i]) * 0x100000001B3ull;
+		}
+		return size_t(hash ^ (hash >> 32));
+	}
+};
+
+void WeldMesh(Mesh* mesh)
+{
+	const size_t numSoupVertices = mesh->vertices.size() / 3;
+	std::unordered_map<WeldVertex, uint32_t, WeldVertexHash> uniqueVertices;
+	//Closed scan meshes share each vertex between about six triangles
+	uniqueVertices.reserve(numSoupVertices / 4);
+	
+	std::vector<float> vertices;
+	std::vector<float> normals;
+	std::vector<float> uvs;
+	std::vector<uint32_t> indices;
+	vertices.reserve(numSoupVertices / 2 * 3);
+	normals.reserve(numSoupVertices / 2 * 3);
+	uvs.reserve(numSoupVertices / 2 * 2);
+	indices.reserve(numSoupVertices);
+	
+	WeldVertex corners[3];
+	for (size_t t = 0; t < numSoupVertices / 3; t++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			const size_t v = t * 3 + c;
+			memcpy(&corners[c].data[0], &mesh->vertices[v * 3], 3 * sizeof(float));
+			memcpy(&corners[c].data[3], &mesh->normals[v * 3], 3 * sizeof(float));
+			memcpy(&corners[c].data[6], &mesh->uvs[v * 2], 2 * sizeof(float));
+		}
+		
+		glm::vec3 p0(corners[0].data[0], corners[0].data[1], corners[0].data[2]);
+		glm::vec3 p1(corners[1].data[0], corners[1].data[1], corners[1].data[2]);
+		glm::vec3 p2(corners[2].data[0], corners[2].data[1], corners[2].data[2]);
+		glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+		//Also catches triangles with two identical corners
+		if (areaNormal.x == 0.0f && areaNormal.y == 0.0f && areaNormal.z == 0.0f)
+		{
+			continue;
+		}
+		
+		for (int c = 0; c < 3; c++)
+		{
+			auto inserted = uniqueVertices.insert(std::make_pair(corners[c], uint32_t(vertices.size() / 3)));
+			if (inserted.second)
+			{
+				vertices.insert(vertices.end(), &corners[c].data[0], &corners[c].data[3]);
+				normals.insert(normals.end(), &corners[c].data[3], &corners[c].data[6]);
+				uvs.insert(uvs.end(), &corners[c].data[6], &corners[c].data[8]);
+			}
+			indices.push_back(inserted.first->second);
+		}
+	}
+	
+	vertices.shrink_to_fit();
+	normals.shrink_to_fit();
+	uvs.shrink_to_fit();
+	mesh->vertices.swap(vertices);
+	mesh->normals.swap(normals);
+	mesh->uvs.swap(uvs);
+	mesh->indices.swap(indices);
+}
+
+bool LoadObjMeshes(const std::string& file, std::vector<Mesh>* meshes, bool* hasMaterials)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> material_ts;
+
+	std::string err;
+	bool success = LoadObjFile(file.c_str(), &attrib, &shapes, &material_ts, &err);
+	if (!err.empty()) //`err` may contain warning message
+	{
+	  printf("%s\n", err.c_str());
+	}
+	if (!success)
+	{
+		return false;
+	}
+	*hasMaterials = !material_ts.empty();
+	
+	//Extract materials. Without any, everything goes into a single mesh that LoadMesh gives the custom material.
+	size_t oldMeshesSize = meshes->size();
+	if (material_ts.empty())
+	{
+		meshes->resize(oldMeshesSize + 1);
+		Material& m = meshes->data()[oldMeshesSize].material;
+		m.diffuseColor[0] = 1.0f;
+		m.diffuseColor[1] = 1.0f;
+		m.diffuseColor[2] = 1.0f;
+		m.diffuseColor[3] = 1.0f;
+	}
+	else
+	{
+		meshes->resize(oldMeshesSize + material_ts.size());
+		for (size_t i = 0; i < material_ts.size(); i++)
+		{
+			tinyobj::material_t& mtl = material_ts[i];
+			Material& m = meshes->data()[oldMeshesSize + i].material;
+			
+			m.diffuseColor[0] = mtl.diffuse[0];
+			m.diffuseColor[1] = mtl.diffuse[1];
+			m.diffuseColor[2] = mtl.diffuse[2];
+			m.diffuseColor[3] = 1.0f;
+		}
+	}
+	
+	bool hasNormals = attrib.normals.size() > 0 ? true : false;
+	bool hasUVs = attrib.texcoords.size() > 0 ? true : false;
+	
+	// Loop over shapes
+	glm::vec3 vertex;
+	glm::vec3 normal;
+	glm::vec2 uv;
+	for (size_t s = 0; s < shapes.size(); s++)
+	{
+		// Loop over faces(polygon)
+		size_t index_offset = 0;
+		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+		{
+			// Per-face material, faces without one go into the first mesh
+			int materialIdx = 0;
+			if (*hasMaterials && shapes[s].mesh.material_ids[f] >= 0)
+			{
+				materialIdx = shapes[s].mesh.material_ids[f];
+			}
+			Mesh& mesh = meshes->data()[oldMeshesSize + materialIdx];
+			
+			// Loop over vertices in the face.
+			int fv = shapes[s].mesh.num_face_vertices[f];
+			for (int v = 0; v < fv; v++)
+			{
+			  	// Access to vertex
+			  	tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+				
+			  	vertex.x = attrib.vertices[3*idx.vertex_index+0];
+			 	vertex.y = attrib.vertices[3*idx.vertex_index+1];
+			  	vertex.z = attrib.vertices[3*idx.vertex_index+2];
+			  	
+			  	if (hasNormals)
+			  	{
+			  		normal.x = attrib.normals[3*idx.normal_index+0];
+				  	normal.y = attrib.normals[3*idx.normal_index+1];
+				  	normal.z = attrib.normals[3*idx.normal_index+2];
+			  	}
+			  	
+			  	if (hasUVs)
+			  	{
+			  		uv.x = attrib.texcoords[2*idx.texcoord_index+0];
+			  		uv.y = attrib.texcoords[2*idx.texcoord_index+1];
+			  	}
+			  	else
+			  	{
+			  		uv.x = -1.0f;
+			  		uv.y = -1.0f;
+			  	}
+			  	// Optional: vertex colors
+			  	// tinyobj::real_t red = attrib.colors[3*idx.vertex_index+0];
+			  	// tinyobj::real_t green = attrib.colors[3*idx.vertex_index+1];
+			  	// tinyobj::real_t blue = attrib.colors[3*idx.vertex_index+2];
+			  	
+			  	mesh.vertices.push_back(vertex.x);
+			  	mesh.vertices.push_back(vertex.y);
+			  	mesh.vertices.push_back(vertex.z);
+			  	mesh.normals.push_back(normal.x);
+			  	mesh.normals.push_back(normal.y);
+			  	mesh.normals.push_back(normal.z);
+			  	mesh.uvs.push_back(uv.x);
+			  	mesh.uvs.push_back(uv.y);
+			}
+			index_offset += fv;
+			
+			//Generate normals (all are the same)
+			if (!hasNormals)
+			{
+				glm::vec3 v0(mesh.vertices[mesh.vertices.size() - 9], mesh.vertices[mesh.vertices.size() - 8], mesh.vertices[mesh.vertices.size() - 7]);
+				glm::vec3 v1(mesh.vertices[mesh.vertices.size() - 6], mesh.vertices[mesh.vertices.size() - 5], mesh.vertices[mesh.vertices.size() - 4]);
+				glm::vec3 v2(mesh.vertices[mesh.vertices.size() - 3], mesh.vertices[mesh.vertices.size() - 2], mesh.vertices[mesh.vertices.size() - 1]);
+				
+				glm::vec3 v0v1 = v1 - v0;
+				glm::vec3 v0v2 = v2 - v0;
+				glm::vec3 normal = glm::normalize(glm::cross(v0v1, v0v2));
+				
+				mesh.normals[mesh.normals.size() - 9] = normal.x;
+				mesh.normals[mesh.normals.size() - 8] = normal.y;
+				mesh.normals[mesh.normals.size() - 7] = normal.z;
+				mesh.normals[mesh.normals.size() - 6] = normal.x;
+				mesh.normals[mesh.normals.size() - 5] = normal.y;
+				mesh.normals[mesh.normals.size() - 4] = normal.z;
+				mesh.normals[mesh.normals.size() - 3] = normal.x;
+				mesh.normals[mesh.normals.size() - 2] = normal.y;
+				mesh.normals[mesh.normals.size() - 1] = normal.z;
+			}
+	  	}
+	}
+	
+	size_t numMaterials = material_ts.empty() ? 1 : material_ts.size();
+	for (size_t i = 0; i < numMaterials; i++)
+	{
+		WeldMesh(&(*meshes)[oldMeshesSize + i]);
+	}
+	
+	return true;
+}
+
+void LoadMesh(const ModelFromFile& model, std::vector<Mesh>* meshes)
+{
+	std::string error;
+	if (!TryLoadMesh(model, meshes, &error))
+	{
+		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "%s\n", error.c_str());
+	}
+}
+
+bool TryLoadMesh(const ModelFromFile& model, std::vector<Mesh>* meshes, std::string* error)
+{
+	std::vector<Mesh> objMeshes;
+	bool hasMaterials = false;
+	if (!LoadBrhanMeshFile(model.file, &objMeshes, &hasMaterials))
+	{
+		if (!LoadObjMeshes(model.file, &objMeshes, &hasMaterials))
+		{
+			*error = "Failed to load " + model.file;
+			return false;
+		}
+		if (!WriteBrhanMeshFile(model.file, objMeshes, hasMaterials))
+		{
+			LOG_WARNING(false, __FILE__, __FUNCTION__, __LINE__, "Failed to write mesh cache '%s'\n", BrhanMeshFilePath(model.file).c_str());
+		}
+	}
+	if (!hasMaterials && !model.hasCustomMaterial)
+	{
+		*error = "No material detected for model '" + model.file + "'";
+		return false;
+	}
+	
+	if (!model.hasCustomMaterial)
+	{
+		for (Mesh& mesh : objMeshes)
+		{
+			meshes->push_back(std::move(mesh));
+		}
+		return true;
+	}
+	
+	//The custom material replaces all materials of the file, so its meshes are merged into one
+	meshes->resize(meshes->size() + 1);
+	Mesh& merged = meshes->back();
+	if (objMeshes.size() == 1)
+	{
+		merged = std::move(objMeshes[0]);
+	}
+	else
+	{
+		size_t numVertices = 0;
+		size_t numIndices = 0;
+		for (const Mesh& mesh : objMeshes)
+		{
+			numVertices += mesh.vertices.size() / 3;
+			numIndices += mesh.indices.size();
+		}
+		merged.vertices.reserve(numVertices * 3);
+		merged.normals.reserve(numVertices * 3);
+		merged.uvs.reserve(numVertices * 2);
+		merged.indices.reserve(numIndices);
+		for (const Mesh& mesh : objMeshes)
+		{
+			const uint32_t indexOffset = uint32_t(merged.vertices.size() / 3);
+			merged.vertices.insert(merged.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+			merged.normals.insert(merged.normals.end(), mesh.normals.begin(), mesh.normals.end());
+			merged.uvs.insert(merged.uvs.end(), mesh.uvs.begin(), mesh.uvs.end());
+			for (uint32_t index : mesh.indices)
+			{
+				merged.indices.push_back(index + indexOffset);
+			}
+		}
+	}
+	Material& m = merged.material;
+	m.diffuseColor[0] = model.diffuse.x;
+	m.diffuseColor[1] = model.diffuse.y;
+	m.diffuseColor[2] = model.diffuse.z;
+	m.diffuseColor[3] = 1.0f;
+	return true;
+}
+
+glm::mat4 ModelMatrix(const ModelFromFile& model)
+{
+	glm::mat4 modelMatrix(1.0f);
+	if (model.scalingActive)
+	{
+		modelMatrix = model.scaling * modelMatrix;
+	}
+	if (model.rotationActive)
+	{
+		modelMatrix = model.rotation * modelMatrix;
+	}
+	if (model.translationActive)
+	{
+		modelMatrix = model.translation * modelMatrix;
+	}
+	return modelMatrix;
+}
+
+std::string MeshCacheKey(const ModelFromFile& model)
+{
+	if (!model.hasCustomMaterial)
+	{
+		return model.file;
+	}
+	//A material override gives the model different meshes, so it must not share them with the plain file
+	char material[128];
+	snprintf(material, sizeof(material), "|%.9g %.9g %.9g|", model.diffuse.x, model.diffuse.y, model.diffuse.z);
+	return model.file + material + model.material;
+}
+
+//uniqueModels holds the first model that uses each key
+static void FindUniqueModels(const std::vector<ModelFromFile>& models, std::vector<uint32_t>* modelToUniqueModel, std::vector<uint32_t>* uniqueModels)
+{
+	std::unordered_map<std::string, uint32_t> meshCache;
+	modelToUniqueModel->resize(models.size());
+	for (uint32_t i = 0; i < uint32_t(models.size()); i++)
+	{
+		auto inserted = meshCache.insert(std::make_pair(MeshCacheKey(models[i]), uint32_t(uniqueModels->size())));
+		if (inserted.second)
+		{
+			uniqueModels->push_back(i);
+		}
+		(*modelToUniqueModel)[i] = inserted.first->second;
+	}
+}
+
+void LoadMeshes(const std::vector<ModelFromFile>& models, std::vector<Mesh>* meshes, std::vector<MeshInstance>* instances, ThreadPool& threadPool, LoadedModelTable* loadedModels)
+{
+	auto start_time = std::chrono::high_resolution_clock::now();
+	
+	std::vector<uint32_t> modelToUniqueModel;
+	std::vector<uint32_t> uniqueModels;
+	FindUniqueModels(models, &modelToUniqueModel, &uniqueModels);
+	
+	//Each unique model is loaded into its own list so the merge below can keep the scene-file order
+	std::vector<std::vector<Mesh>> modelMeshes(uniqueModels.size());
+	std::vector<float> modelLoadTimes(uniqueModels.size());
+	std::vector<int64_t> modifiedTimes(uniqueModels.size());
+	threadPool.ParallelFor(0, uint32_t(uniqueModels.size()), 1, [&](uint32_t i)
+	{
+		//Taken before the load, so an edit made while loading is picked up by the next update
+		modifiedTimes[i] = FileModifiedTime(models[uniqueModels[i]].file.c_str());
+		auto modelStartTime = std::chrono::high_resolution_clock::now();
+		LoadMesh(models[uniqueModels[i]], &modelMeshes[i]);
+		auto modelEndTime = std::chrono::high_resolution_clock::now();
+		modelLoadTimes[i] = std::chrono::duration<float, std::milli>(modelEndTime - modelStartTime).count();
+	});
+	
+	std::vector<uint32_t> numInstances(uniqueModels.size(), 0);
+	for (uint32_t u : modelToUniqueModel)
+	{
+		numInstances[u]++;
+	}
+	
+	size_t numMeshes = meshes->size();
+	for (const std::vector<Mesh>& m : modelMeshes)
+	{
+		numMeshes += m.size();
+	}
+	meshes->reserve(numMeshes);
+	std::vector<uint32_t> firstMesh(uniqueModels.size());
+	std::vector<uint32_t> numModelMeshes(uniqueModels.size());
+	std::vector<size_t> numModelTriangles(uniqueModels.size(), 0);
+	float summedLoadTime = 0.0f;
+	size_t uniqueTriangles = 0;
+	for (size_t i = 0; i < uniqueModels.size(); i++)
+	{
+		firstMesh[i] = uint32_t(meshes->size());
+		numModelMeshes[i] = uint32_t(modelMeshes[i].size());
+		size_t numVertices = 0;
+		for (Mesh& mesh : modelMeshes[i])
+		{
+			numVertices += mesh.vertices.size() / 3;
+			numModelTriangles[i] += mesh.indices.size() / 3;
+			meshes->push_back(std::move(mesh));
+		}
+		uniqueTriangles += numModelTriangles[i];
+		summedLoadTime += modelLoadTimes[i];
+		printf("Model %zu (%s) load time (ms): %.2f    triangles: %zu    vertices: %zu    instances: %u\n", i, models[uniqueModels[i]].file.c_str(), modelLoadTimes[i], numModelTriangles[i], numVertices, numInstances[i]);
+		if (loadedModels != NULL)
+		{
+			LoadedModel loaded;
+			loaded.firstMesh = firstMesh[i];
+			loaded.numMeshes = numModelMeshes[i];
+			loaded.fileModifiedTime = modifiedTimes[i];
+			(*loadedModels)[MeshCacheKey(models[uniqueModels[i]])] = loaded;
+		}
+	}
+	
+	//One instance per mesh of every Model line, in scene-file order
+	size_t instancedTriangles = 0;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		uint32_t u = modelToUniqueModel[i];
+		glm::mat4 modelMatrix = ModelMatrix(models[i]);
+		for (uint32_t m = 0; m < numModelMeshes[u]; m++)
+		{
+			MeshInstance instance;
+			instance.meshIndex = firstMesh[u] + m;
+			instance.transform = modelMatrix;
+			instance.splitBudget = models[i].splitBudget;
+			instances->push_back(instance);
+		}
+		instancedTriangles += numModelTriangles[u];
+	}
+	
+	auto end_time = std::chrono::high_resolution_clock::now();
+	float ms = std::chrono::duration<float, std::milli>(end_time - start_time).count();
+	printf("Scene load time (ms): %.2f    sum of model load times (ms): %.2f    threads: %u\n", ms, summedLoadTime, threadPool.NumThreads());
+	printf("Unique models: %zu    model instances: %zu    unique triangles: %zu    instanced triangles: %zu\n", uniqueModels.size(), models.size(), uniqueTriangles, instancedTriangles);
+}
+
+bool UpdateMeshes(const std::vector<ModelFromFile>& models, LoadedModelTable* loadedModels, std::vector<Mesh>* meshes, std::vector<MeshInstance>* instances, std::vector<uint32_t>* keptMeshes, uint32_t* numLoadedModels, std::string* error, ThreadPool& threadPool)
+{
+	std::vector<uint32_t> modelToUniqueModel;
+	std::vector<uint32_t> uniqueModels;
+	FindUniqueModels(models, &modelToUniqueModel, &uniqueModels);
+	
+	std::vector<std::string> keys(uniqueModels.size());
+	std::vector<uint32_t> changedModels;
+	std::vector<int64_t> modifiedTimes;
+	//Only the models that are still in the scene and didn't change keep their meshes
+	LoadedModelTable keptModels;
+	std::vector<bool> meshKept(meshes->size(), false);
+	for (uint32_t i = 0; i < uint32_t(uniqueModels.size()); i++)
+	{
+		keys[i] = MeshCacheKey(models[uniqueModels[i]]);
+		int64_t modifiedTime = FileModifiedTime(models[uniqueModels[i]].file.c_str());
+		auto loaded = loadedModels->find(keys[i]);
+		if (loaded == loadedModels->end() || loaded->second.fileModifiedTime != modifiedTime)
+		{
+			changedModels.push_back(i);
+			modifiedTimes.push_back(modifiedTime);
+		}
+		else
+		{
+			keptModels[keys[i]] = loaded->second;
+			std::fill(meshKept.begin() + loaded->second.firstMesh, meshKept.begin() + loaded->second.firstMesh + loaded->second.numMeshes, true);
+		}
+	}
+	
+	std::vector<std::vector<Mesh>> modelMeshes(changedModels.size());
+	std::vector<float> modelLoadTimes(changedModels.size());
+	std::vector<std::string> modelErrors(changedModels.size());
+	threadPool.ParallelFor(0, uint32_t(changedModels.size()), 1, [&](uint32_t i)
+	{
+		auto modelStartTime = std::chrono::high_resolution_clock::now();
+		TryLoadMesh(models[uniqueModels[changedModels[i]]], &modelMeshes[i], &modelErrors[i]);
+		auto modelEndTime = std::chrono::high_resolution_clock::now();
+		modelLoadTimes[i] = std::chrono::duration<float, std::milli>(modelEndTime - modelStartTime).count();
+	});
+	//Nothing has been touched yet, so a failed load leaves the scene as it was
+	for (const std::string& modelError : modelErrors)
+	{
+		if (!modelError.empty())
+		{
+			*error = modelError;
+			return false;
+		}
+	}
+	
+	//Kept meshes only move towards the front, and the meshes of a model stay next to each other
+	std::vector<uint32_t> newMeshIndex(meshes->size());
+	keptMeshes->clear();
+	for (uint32_t m = 0; m < uint32_t(meshes->size()); m++)
+	{
+		if (meshKept[m])
+		{
+			newMeshIndex[m] = uint32_t(keptMeshes->size());
+			if (m != keptMeshes->size())
+			{
+				(*meshes)[keptMeshes->size()] = std::move((*meshes)[m]);
+			}
+			keptMeshes->push_back(m);
+		}
+	}
+	meshes->resize(keptMeshes->size());
+	for (auto& kept : keptModels)
+	{
+		kept.second.firstMesh = newMeshIndex[kept.second.firstMesh];
+	}
+	loadedModels->swap(keptModels);
+	
+	for (size_t i = 0; i < changedModels.size(); i++)
+	{
+		LoadedModel loaded;
+		loaded.firstMesh = uint32_t(meshes->size());
+		loaded.numMeshes = uint32_t(modelMeshes[i].size());
+		loaded.fileModifiedTime = modifiedTimes[i];
+		size_t numTriangles = 0;
+		for (Mesh& mesh : modelMeshes[i])
+		{
+			numTriangles += mesh.indices.size() / 3;
+			meshes->push_back(std::move(mesh));
+		}
+		(*loadedModels)[keys[changedModels[i]]] = loaded;
+		printf("Model (%s) reloaded, load time (ms): %.2f    triangles: %zu\n", models[uniqueModels[changedModels[i]]].file.c_str(), modelLoadTimes[i], numTriangles);
+	}
+	
+	instances->clear();
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		const LoadedModel& loaded = (*loadedModels)[keys[modelToUniqueModel[i]]];
+		glm::mat4 modelMatrix = ModelMatrix(models[i]);
+		for (uint32_t m = 0; m < loaded.numMeshes; m++)
+		{
+			MeshInstance instance;
+			instance.meshIndex = loaded.firstMesh + m;
+			instance.transform = modelMatrix;
+			instance.splitBudget = models[i].splitBudget;
+			instances->push_back(instance);
+		}
+	}
+	*numLoadedModels = uint32_t(changedModels.size());
+	return true;
+}
+
+void UpdateInstanceTransforms(const std::vector<ModelFromFile>& models, const std::vector<uint32_t>& changedModels, const LoadedModelTable& loadedModels, std::vector<MeshInstance>* instances, std::vector<uint32_t>* changedInstances)
+{
+	//Model line i owns the instances after those of the lines before it
+	std::vector<uint32_t> firstInstance(models.size());
+	uint32_t numInstances = 0;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		firstInstance[i] = numInstances;
+		numInstances += loadedModels.at(MeshCacheKey(models[i])).numMeshes;
+	}
+	
+	for (uint32_t i : changedModels)
+	{
+		glm::mat4 modelMatrix = ModelMatrix(models[i]);
+		uint32_t numMeshes = loadedModels.at(MeshCacheKey(models[i])).numMeshes;
+		for (uint32_t m = 0; m < numMeshes; m++)
+		{
+			(*instances)[firstInstance[i] + m].transform = modelMatrix;
+			changedInstances->push_back(firstInstance[i] + m);
+		}
+	}
+}
+
+MeshStream::~MeshStream()
+{
+	if (threadPool != NULL)
+	{
+		threadPool->Wait(&loadTasks);
+	}
+}
+
+void StartMeshStream(const std::vector<ModelFromFile>& models, MeshStream* stream, ThreadPool& threadPool)
+{
+	stream->startTime = std::chrono::high_resolution_clock::now();
+	stream->models = models;
+	FindUniqueModels(models, &stream->modelToUniqueModel, &stream->uniqueModels);
+	stream->modelMeshes.resize(stream->uniqueModels.size());
+	stream->modelLoadTimes.resize(stream->uniqueModels.size());
+	stream->threadPool = &threadPool;
+	for (uint32_t i = 0; i < uint32_t(stream->uniqueModels.size()); i++)
+	{
+		threadPool.Enqueue(&stream->loadTasks, [stream, i]()
+		{
+			auto modelStartTime = std::chrono::high_resolution_clock::now();
+			//Each task owns its entry of modelMeshes until it is listed in loadedModels
+			LoadMesh(stream->models[stream->uniqueModels[i]], &stream->modelMeshes[i]);
+			auto modelEndTime = std::chrono::high_resolution_clock::now();
+			stream->modelLoadTimes[i] = std::chrono::duration<float, std::milli>(modelEndTime - modelStartTime).count();
+			std::lock_guard<std::mutex> lock(stream->mutex);
+			stream->loadedModels.push_back(i);
+		});
+	}
+}
+
+uint32_t CollectStreamedMeshes(MeshStream* stream, std::vector<Mesh>* meshes, std::vector<MeshInstance>* instances)
+{
+	std::vector<uint32_t> newModels;
+	{
+		std::lock_guard<std::mutex> lock(stream->mutex);
+		newModels.assign(stream->loadedModels.begin() + stream->numCollectedModels, stream->loadedModels.end());
+	}
+	
+	auto now = std::chrono::high_resolution_clock::now();
+	float msSinceStart = std::chrono::duration<float, std::milli>(now - stream->startTime).count();
+	for (uint32_t u : newModels)
+	{
+		const uint32_t firstMesh = uint32_t(meshes->size());
+		const uint32_t numModelMeshes = uint32_t(stream->modelMeshes[u].size());
+		size_t numTriangles = 0;
+		for (Mesh& mesh : stream->modelMeshes[u])
+		{
+			numTriangles += mesh.indices.size() / 3;
+			meshes->push_back(std::move(mesh));
+		}
+		stream->modelMeshes[u].clear();
+		
+		uint32_t numInstances = 0;
+		for (size_t i = 0; i < stream->models.size(); i++)
+		{
+			if (stream->modelToUniqueModel[i] != u)
+			{
+				continue;
+			}
+			glm::mat4 modelMatrix = ModelMatrix(stream->models[i]);
+			for (uint32_t m = 0; m < numModelMeshes; m++)
+			{
+				MeshInstance instance;
+				instance.meshIndex = firstMesh + m;
+				instance.transform = modelMatrix;
+				instance.splitBudget = stream->models[i].splitBudget;
+				instances->push_back(instance);
+			}
+			numInstances++;
+		}
+		stream->numCollectedModels++;
+		printf("Model %u/%zu (%s) streamed in after (ms): %.2f    load time (ms): %.2f    triangles: %zu    instances: %u\n", stream->numCollectedModels, stream->uniqueModels.size(), stream->models[stream->uniqueModels[u]].file.c_str(), msSinceStart, stream->modelLoadTimes[u], numTriangles, numInstances);
+	}
+	return uint32_t(newModels.size());
+}
+
+bool MeshStreamFinished(const MeshStream& stream)
+{
+	return stream.numCollectedModels == stream.uniqueModels.size();
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "BrhanFile.h"
+#include <chrono>
+#include "glm/mat4x4.hpp"
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include "ThreadPool.h"
+#include <unordered_map>
+#include <vector>
+
+struct Material
+{
+	float diffuseColor[4];
+};
+
+//vertices, normals and uvs hold one entry per unique vertex, indices three per triangle
+struct Mesh
+{
+	std::vector<float> vertices;
+	std::vector<float> normals;
+	std::vector<float> uvs;
+	std::vector<uint32_t> indices;
+	Material material;
+};
+
+//A placement of a mesh in the scene. Meshes are stored in object space and
+//shared by every instance that references them.
+struct MeshInstance
+{
+	uint32_t meshIndex;
+	glm::mat4 transform;
+	//Of the model it came from, see ModelFromFile::splitBudget
+	float splitBudget = 0.0f;
+};
+
+//Turns a mesh with three unindexed vertices per triangle into an indexed one. Vertices with
+//identical position, normal and uv are merged, and triangles with no area are dropped.
+void WeldMesh(Mesh* mesh);
+//Parses an OBJ file in object space and appends one welded mesh per material of the file to 'meshes'.
+//A file without materials gives a single mesh.
+bool LoadObjMeshes(const std::string& file, std::vector<Mesh>* meshes, bool* hasMaterials);
+//Loads a single model in object space, from its .brhanmesh cache when it is up to date, and
+//appends one mesh per material to 'meshes'. A stale or missing cache is rewritten.
+void LoadMesh(const ModelFromFile& model, std::vector<Mesh>* meshes);
+//Like LoadMesh, but returns false with the reason in 'error' instead of exiting when the model
+//can't be loaded
+bool TryLoadMesh(const ModelFromFile& model, std::vector<Mesh>* meshes, std::string* error);
+//scaling, then rotation, then translation
+glm::mat4 ModelMatrix(const ModelFromFile& model);
+//Models with the same key share their meshes: the file path, plus the material override if any
+std::string MeshCacheKey(const ModelFromFile& model);
+//Where the meshes of a loaded model are, and how old its file was when it was read
+struct LoadedModel
+{
+	uint32_t firstMesh;
+	uint32_t numMeshes;
+	int64_t fileModifiedTime;
+};
+
+//Loaded models by MeshCacheKey
+typedef std::unordered_map<std::string, LoadedModel> LoadedModelTable;
+
+//Loads every unique model once on the thread pool. The meshes are appended in the order
+//the models first appear, and every Model line gets one instance per mesh of its model.
+//If 'loadedModels' is given, every unique model is recorded in it.
+void LoadMeshes(const std::vector<ModelFromFile>& models, std::vector<Mesh>* meshes, std::vector<MeshInstance>* instances, ThreadPool& threadPool, LoadedModelTable* loadedModels = NULL);
+//Brings the meshes up to date with an edited scene. Only unique models missing from 'loadedModels',
+//or whose file changed on disk since it was read, are loaded. The meshes of the other models are
+//moved to the front of 'meshes' in their old order, and the old index of each is written to
+//'keptMeshes'. The loaded meshes follow them. The meshes of reloaded models and of models no longer
+//in the scene are dropped, along with their 'loadedModels' entries. 'instances' is rebuilt for every
+//Model line, and the number of models loaded is written to 'numLoadedModels'. If a model fails to
+//load, returns false with the reason in 'error' and leaves everything as it was.
+bool UpdateMeshes(const std::vector<ModelFromFile>& models, LoadedModelTable* loadedModels, std::vector<Mesh>* meshes, std::vector<MeshInstance>* instances, std::vector<uint32_t>* keptMeshes, uint32_t* numLoadedModels, std::string* error, ThreadPool& threadPool);
+//Recomputes the transform of the instances of the given Model lines and appends their indices to
+//'changedInstances'. 'instances' must be laid out the way LoadMeshes and UpdateMeshes create them.
+void UpdateInstanceTransforms(const std::vector<ModelFromFile>& models, const std::vector<uint32_t>& changedModels, const LoadedModelTable& loadedModels, std::vector<MeshInstance>* instances, std::vector<uint32_t>* changedInstances);
+
+//Loads the unique models of a scene in the background so the scene can be rendered
+//while its geometry arrives. See StartMeshStream and CollectStreamedMeshes.
+struct MeshStream
+{
+	std::vector<ModelFromFile> models;
+	std::vector<uint32_t> modelToUniqueModel;
+	std::vector<uint32_t> uniqueModels;
+	std::vector<std::vector<Mesh>> modelMeshes;
+	std::vector<float> modelLoadTimes;
+	//Unique models in the order they finished loading, guarded by 'mutex'
+	std::vector<uint32_t> loadedModels;
+	uint32_t numCollectedModels = 0;
+	std::mutex mutex;
+	TaskGroup loadTasks;
+	ThreadPool* threadPool = NULL;
+	std::chrono::high_resolution_clock::time_point startTime;
+	
+	//Waits for the loads still running, they write into the stream
+	~MeshStream();
+};
+
+//Starts loading every unique model on the thread pool and returns right away. The calling
+//thread never helps out, so the pool needs at least one worker.
+void StartMeshStream(const std::vector<ModelFromFile>& models, MeshStream* stream, ThreadPool& threadPool);
+//Appends the meshes of the models that finished loading since the last call, in the order
+//they finished, and the instances of every Model line using them. Returns the number of
+//unique models added.
+uint32_t CollectStreamedMeshes(MeshStream* stream, std::vector<Mesh>* meshes, std::vector<MeshInstance>* instances);
+//True once every unique model has been collected
+bool MeshStreamFinished(const MeshStream& stream);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
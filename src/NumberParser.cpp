@@ -0,0 +1,320 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include "NumberParser.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Every power of ten up to 10^10 is exactly representable as a float
+static const float exactPowersOfTen[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+static const int maxExactPowerOfTen = 10;
+//Largest integer below which every integer is exactly representable as a float
+static const uint64_t maxExactFloatMantissa = uint64_t(1) << 24;
+//More digits than this might overflow the 64-bit mantissa
+static const int maxMantissaDigits = 19;
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+//Digit runs of up to seven characters are parsed eight bytes at a time (SWAR).
+//The byte tricks below assume the first character lands in the lowest byte.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NUMBER_PARSER_SWAR 1
+#else
+#define NUMBER_PARSER_SWAR 0
+#endif
+
+#if NUMBER_PARSER_SWAR
+static const uint64_t integerPowersOfTen[] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull
+};
+
+//Number of digit characters at the start of the eight characters in 'word'
+static inline int CountLeadingDigits(uint64_t word)
+{
+	const uint64_t highBits = 0x8080808080808080ull;
+	const uint64_t low = word & ~highBits;
+	//No byte can carry into the next one: low bytes are at most 0x7F
+	const uint64_t aboveNine = low + 0x4646464646464646ull; //High bit set for bytes > '9'
+	const uint64_t atLeastZero = low + 0x5050505050505050ull; //High bit set for bytes >= '0'
+	const uint64_t nonDigits = (word | aboveNine | ~atLeastZero) & highBits;
+	return nonDigits == 0 ? 8 : __builtin_ctzll(nonDigits) / 8;
+}
+
+//Value of the first 'numDigits' (1 to 7) characters of 'word', which must all be digits
+static inline uint32_t ParseDigits(uint64_t word, int numDigits)
+{
+	//Move the digits to the end and fill the front with '0', then reduce pairs, quads and octets
+	word = (word << (8 * (8 - numDigits))) | (0x3030303030303030ull >> (8 * numDigits));
+	word -= 0x3030303030303030ull;
+	word = ((word * 10) + (word >> 8)) & 0x00FF00FF00FF00FFull;
+	word = ((word * 100) + (word >> 16)) & 0x0000FFFF0000FFFFull;
+	word = (word * 10000) + (word >> 32);
+	return uint32_t(word & 0xFFFFFFFFull);
+}
+#endif
+
+static float ParseFloatFallback(const char* begin, const char* numberEnd, bool* success)
+{
+	char buffer[128];
+	size_t length = size_t(numberEnd - begin);
+	if (length >= sizeof(buffer))
+	{
+		*success = false;
+		return 0.0f;
+	}
+	memcpy(buffer, begin, length);
+	buffer[length] = '\0';
+	*success = true;
+	return strtof(buffer, NULL);
+}
+
+bool ParseFloat(const char*& p, const char* end, float* value)
+{
+	const char* c = p;
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		negative = *c == '-';
+		c++;
+	}
+	
+	uint64_t mantissa = 0;
+	int numMantissaDigits = 0;
+	int exponent = 0;
+	bool foundDigit = false;
+	bool truncated = false;
+	
+	//Integer part
+#if NUMBER_PARSER_SWAR
+	if (end - c >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, c, 8);
+		int numDigits = CountLeadingDigits(word);
+		if (numDigits > 0 && numDigits < 8)
+		{
+			//Leading zeros are counted as mantissa digits here, which can only make the fast path below less likely
+			mantissa = ParseDigits(word, numDigits);
+			numMantissaDigits = numDigits;
+			foundDigit = true;
+			c += numDigits;
+		}
+	}
+#endif
+	for (; c < end && IsDigit(*c); c++)
+	{
+		foundDigit = true;
+		if (mantissa == 0 && *c == '0') { continue; } //Leading zeros don't count
+		if (numMantissaDigits < maxMantissaDigits)
+		{
+			mantissa = mantissa * 10 + uint64_t(*c - '0');
+			numMantissaDigits++;
+		}
+		else
+		{
+			exponent++;
+			truncated = true;
+		}
+	}
+	//Fractional part
+	if (c < end && *c == '.')
+	{
+		c++;
+#if NUMBER_PARSER_SWAR
+		if (end - c >= 8)
+		{
+			uint64_t word;
+			memcpy(&word, c, 8);
+			int numDigits = CountLeadingDigits(word);
+			if (numDigits > 0 && numDigits < 8 && numMantissaDigits + numDigits <= maxMantissaDigits)
+			{
+				//Trailing zeros are dropped for the same reason as the pending zeros below
+				uint32_t digits = ParseDigits(word, numDigits);
+				int numSignificantDigits = numDigits;
+				while (numSignificantDigits > 0 && digits % 10 == 0)
+				{
+					digits /= 10;
+					numSignificantDigits--;
+				}
+				mantissa = mantissa * integerPowersOfTen[numSignificantDigits] + digits;
+				numMantissaDigits += numSignificantDigits;
+				exponent -= numSignificantDigits;
+				foundDigit = true;
+				c += numDigits;
+			}
+		}
+#endif
+		//Zeros are only added to the mantissa once a non-zero digit follows them,
+		//otherwise "1.500000" wouldn't fit the fast path below
+		int pendingZeros = 0;
+		for (; c < end && IsDigit(*c); c++)
+		{
+			foundDigit = true;
+			if (*c == '0')
+			{
+				if (mantissa == 0)
+				{
+					exponent--;
+				}
+				else
+				{
+					pendingZeros++;
+				}
+				continue;
+			}
+			for (; pendingZeros > 0 && numMantissaDigits < maxMantissaDigits; pendingZeros--)
+			{
+				mantissa *= 10;
+				numMantissaDigits++;
+				exponent--;
+			}
+			if (pendingZeros == 0 && numMantissaDigits < maxMantissaDigits)
+			{
+				mantissa = mantissa * 10 + uint64_t(*c - '0');
+				numMantissaDigits++;
+				exponent--;
+			}
+			else
+			{
+				truncated = true;
+			}
+		}
+	}
+	if (!foundDigit)
+	{
+		return false;
+	}
+	//Exponent part, only consumed if it's well-formed
+	if (c < end && (*c == 'e' || *c == 'E'))
+	{
+		const char* e = c + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+'))
+		{
+			negativeExponent = *e == '-';
+			e++;
+		}
+		if (e < end && IsDigit(*e))
+		{
+			int explicitExponent = 0;
+			for (; e < end && IsDigit(*e); e++)
+			{
+				if (explicitExponent < 10000)
+				{
+					explicitExponent = explicitExponent * 10 + (*e - '0');
+				}
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+			c = e;
+		}
+	}
+	
+	//Fast path: both the mantissa and the power of ten are exact floats, so a
+	//single correctly rounded multiplication or division gives the exact result
+	float result;
+	if (mantissa == 0)
+	{
+		result = 0.0f;
+	}
+	else if (!truncated && mantissa <= maxExactFloatMantissa && exponent >= -maxExactPowerOfTen && exponent <= maxExactPowerOfTen)
+	{
+		result = float(mantissa);
+		if (exponent < 0)
+		{
+			result /= exactPowersOfTen[-exponent];
+		}
+		else
+		{
+			result *= exactPowersOfTen[exponent];
+		}
+	}
+	else
+	{
+		bool success;
+		result = ParseFloatFallback(p, c, &success);
+		if (!success)
+		{
+			return false;
+		}
+		negative = false; //strtof already took care of the sign
+	}
+	
+	*value = negative ? -result : result;
+	p = c;
+	return true;
+}
+
+bool ParseInt(const char*& p, const char* end, int* value)
+{
+	const char* c = p;
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		negative = *c == '-';
+		c++;
+	}
+	if (c >= end || !IsDigit(*c))
+	{
+		return false;
+	}
+	
+	int64_t result = 0;
+#if NUMBER_PARSER_SWAR
+	if (end - c >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, c, 8);
+		int numDigits = CountLeadingDigits(word);
+		if (numDigits < 8)
+		{
+			result = ParseDigits(word, numDigits);
+			c += numDigits;
+		}
+	}
+#endif
+	for (; c < end && IsDigit(*c); c++)
+	{
+		result = result * 10 + (*c - '0');
+		if (result > int64_t(0x7FFFFFFF))
+		{
+			return false;
+		}
+	}
+	
+	*value = negative ? -int(result) : int(result);
+	p = c;
+	return true;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,49 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef NUMBER_PARSER_H
+#define NUMBER_PARSER_H
+
+/*
+Allocation-free number parsing in the style of std::from_chars. Both functions
+parse the number starting at 'p' and stop at the first character that can't be
+part of it, leaving 'p' pointing at that character. Nothing is read at or past
+'end'. If no number could be parsed, false is returned and 'p' is left untouched.
+
+ParseFloat gives the same result as strtof for the decimal numbers found in our
+scene and model files: the common case is handled exactly without leaving the
+parser, and anything that can't be (very long mantissas, large exponents) is
+handed to strtof through a small stack buffer.
+*/
+
+bool ParseFloat(const char*& p, const char* end, float* value);
+bool ParseInt(const char*& p, const char* end, int* value);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
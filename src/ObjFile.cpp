@@ -0,0 +1,475 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include <map>
+#include "MappedFile.h"
+#include "NumberParser.h"
+#include "ObjFile.h"
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+
+//Files smaller than this are always parsed on the calling thread
+static const size_t minBytesPerThread = 1 << 20;
+
+//Faces from 'firstTriangle' on use the material named materialNames[nameIndex]
+struct ObjMaterialRun
+{
+	size_t firstTriangle;
+	uint32_t nameIndex;
+};
+
+//A 'g' or 'o' statement. Faces from 'firstTriangle' on belong to a new shape.
+struct ObjShapeStart
+{
+	size_t firstTriangle;
+	std::string name;
+};
+
+//Everything a single thread found in its part of the file. Faces before the first
+//usemtl, g or o of the chunk continue the material and shape of the previous chunk.
+struct ObjFileChunk
+{
+	std::vector<float> vertices;
+	std::vector<float> normals;
+	std::vector<float> texcoords;
+	std::vector<tinyobj::index_t> indices;
+	std::vector<ObjMaterialRun> materialRuns;
+	std::vector<std::string> materialNames;
+	std::vector<ObjShapeStart> shapeStarts;
+	std::vector<std::string> mtllibs;
+	//Negative (relative) indices can only be resolved once the counts of the previous
+	//chunks are known. These are positions into 'indices' as index * 3 + component,
+	//and the stored value is relative to the first element of the chunk.
+	std::vector<size_t> relativeIndices;
+};
+
+static inline bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline bool IsStatement(const char* p, const char* lineEnd, const char* keyword, size_t keywordLength)
+{
+	return size_t(lineEnd - p) > keywordLength && memcmp(p, keyword, keywordLength) == 0 && IsBlank(p[keywordLength]);
+}
+
+static void ParseFloats(const char* p, const char* lineEnd, int numValues, std::vector<float>* values)
+{
+	for (int i = 0; i < numValues; i++)
+	{
+		while (p < lineEnd && IsBlank(*p)) { p++; }
+		float value = 0.0f;
+		ParseFloat(p, lineEnd, &value); //Missing values are 0, like tinyobjloader
+		values->push_back(value);
+		while (p < lineEnd && !IsBlank(*p)) { p++; }
+	}
+}
+
+//A face corner. The bits of 'relative' mark the components (vertex, normal, texcoord)
+//that were given relative to the end of the chunk and need fixing up when merging.
+struct ObjCorner
+{
+	tinyobj::index_t index;
+	uint32_t relative;
+};
+
+//Converts a 1-based (or negative, relative) OBJ index into a 0-based one
+static inline int FixIndex(int index, size_t numElements, uint32_t component, uint32_t* relative)
+{
+	if (index > 0)
+	{
+		return index - 1;
+	}
+	if (index == 0)
+	{
+		return 0;
+	}
+	*relative |= 1u << component;
+	return int(numElements) + index;
+}
+
+static inline void AddCorner(const ObjCorner& corner, ObjFileChunk* chunk)
+{
+	for (uint32_t component = 0; component < 3; component++)
+	{
+		if (corner.relative & (1u << component))
+		{
+			chunk->relativeIndices.push_back(chunk->indices.size() * 3 + component);
+		}
+	}
+	chunk->indices.push_back(corner.index);
+}
+
+static std::string NextWord(const char*& p, const char* lineEnd)
+{
+	while (p < lineEnd && IsBlank(*p)) { p++; }
+	const char* begin = p;
+	while (p < lineEnd && !IsBlank(*p)) { p++; }
+	return std::string(begin, p);
+}
+
+static void ParseFace(const char* p, const char* lineEnd, ObjFileChunk* chunk)
+{
+	const size_t numVertices = chunk->vertices.size() / 3;
+	const size_t numNormals = chunk->normals.size() / 3;
+	const size_t numTexcoords = chunk->texcoords.size() / 2;
+	
+	//Triangle fan around the first corner, as tinyobjloader triangulates
+	ObjCorner first = {};
+	ObjCorner previous = {};
+	int numCorners = 0;
+	for (;;)
+	{
+		while (p < lineEnd && IsBlank(*p)) { p++; }
+		int v;
+		if (!ParseInt(p, lineEnd, &v))
+		{
+			break;
+		}
+		ObjCorner corner;
+		corner.relative = 0;
+		corner.index.vertex_index = FixIndex(v, numVertices, 0, &corner.relative);
+		corner.index.normal_index = -1;
+		corner.index.texcoord_index = -1;
+		if (p < lineEnd && *p == '/')
+		{
+			p++;
+			int vt;
+			if (ParseInt(p, lineEnd, &vt))
+			{
+				corner.index.texcoord_index = FixIndex(vt, numTexcoords, 2, &corner.relative);
+			}
+			if (p < lineEnd && *p == '/')
+			{
+				p++;
+				int vn;
+				if (ParseInt(p, lineEnd, &vn))
+				{
+					corner.index.normal_index = FixIndex(vn, numNormals, 1, &corner.relative);
+				}
+			}
+		}
+		while (p < lineEnd && !IsBlank(*p)) { p++; }
+		
+		if (numCorners == 0)
+		{
+			first = corner;
+		}
+		else if (numCorners >= 2)
+		{
+			AddCorner(first, chunk);
+			AddCorner(previous, chunk);
+			AddCorner(corner, chunk);
+		}
+		previous = corner;
+		numCorners++;
+	}
+}
+
+static void ParseChunk(const char* begin, const char* end, ObjFileChunk* chunk)
+{
+	//Roughly one element per 30 bytes, mostly 'v' and 'f' lines
+	chunk->vertices.reserve(size_t(end - begin) / 30);
+	chunk->indices.reserve(size_t(end - begin) / 30);
+	
+	const char* line = begin;
+	while (line < end)
+	{
+		const char* lineEnd = (const char*)(memchr(line, '\n', size_t(end - line)));
+		if (lineEnd == NULL)
+		{
+			lineEnd = end;
+		}
+		const char* next = lineEnd + (lineEnd < end ? 1 : 0);
+		if (lineEnd > line && lineEnd[-1] == '\r')
+		{
+			lineEnd--;
+		}
+		
+		const char* p = line;
+		while (p < lineEnd && IsBlank(*p)) { p++; }
+		line = next;
+		if (p == lineEnd || *p == '#')
+		{
+			continue;
+		}
+		
+		if (IsStatement(p, lineEnd, "v", 1))
+		{
+			ParseFloats(p + 2, lineEnd, 3, &chunk->vertices);
+		}
+		else if (IsStatement(p, lineEnd, "vn", 2))
+		{
+			ParseFloats(p + 3, lineEnd, 3, &chunk->normals);
+		}
+		else if (IsStatement(p, lineEnd, "vt", 2))
+		{
+			ParseFloats(p + 3, lineEnd, 2, &chunk->texcoords);
+		}
+		else if (IsStatement(p, lineEnd, "f", 1))
+		{
+			ParseFace(p + 2, lineEnd, chunk);
+		}
+		else if (IsStatement(p, lineEnd, "usemtl", 6))
+		{
+			p += 7;
+			ObjMaterialRun run;
+			run.firstTriangle = chunk->indices.size() / 3;
+			run.nameIndex = uint32_t(chunk->materialNames.size());
+			chunk->materialNames.push_back(NextWord(p, lineEnd));
+			//A run without faces is replaced by the next one
+			if (!chunk->materialRuns.empty() && chunk->materialRuns.back().firstTriangle == run.firstTriangle)
+			{
+				chunk->materialRuns.back() = run;
+			}
+			else
+			{
+				chunk->materialRuns.push_back(run);
+			}
+		}
+		else if (IsStatement(p, lineEnd, "mtllib", 6))
+		{
+			chunk->mtllibs.push_back(std::string(p + 7, lineEnd));
+		}
+		else if (IsStatement(p, lineEnd, "g", 1) || IsStatement(p, lineEnd, "o", 1))
+		{
+			//'g' names the shape after its first group name, 'o' after the object name
+			p += 2;
+			ObjShapeStart shapeStart;
+			shapeStart.firstTriangle = chunk->indices.size() / 3;
+			shapeStart.name = NextWord(p, lineEnd);
+			chunk->shapeStarts.push_back(shapeStart);
+		}
+		//Anything else is ignored
+	}
+}
+
+static void LoadMaterials(const std::vector<ObjFileChunk>& chunks, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* materialMap, std::string* err)
+{
+	tinyobj::MaterialFileReader materialFileReader("");
+	for (const ObjFileChunk& chunk : chunks)
+	{
+		for (const std::string& mtllib : chunk.mtllibs)
+		{
+			//Several files may be listed, the first one that loads is used
+			std::vector<std::string> filenames;
+			std::stringstream stream(mtllib);
+			std::string filename;
+			while (std::getline(stream, filename, ' '))
+			{
+				filenames.push_back(filename);
+			}
+			if (filenames.empty())
+			{
+				*err += "WARN: Looks like empty filename for mtllib. Use default material. \n";
+				continue;
+			}
+			bool found = false;
+			for (const std::string& name : filenames)
+			{
+				std::string mtlErr;
+				found = materialFileReader(name, materials, materialMap, &mtlErr);
+				*err += mtlErr;
+				if (found)
+				{
+					break;
+				}
+			}
+			if (!found)
+			{
+				*err += "WARN: Failed to load material file(s). Use default material.\n";
+			}
+		}
+	}
+}
+
+bool LoadObjFile(const char* filename, tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::vector<tinyobj::material_t>* materials, std::string* err, unsigned int numThreads)
+{
+	attrib->vertices.clear();
+	attrib->normals.clear();
+	attrib->texcoords.clear();
+	shapes->clear();
+	std::string errors;
+	
+	MappedFile file(filename);
+	if (!file.IsOpen())
+	{
+		if (err != NULL)
+		{
+			*err = "Cannot open file [" + std::string(filename) + "]\n";
+		}
+		return false;
+	}
+	
+	//Decide how many pieces to split the file into
+	if (numThreads == 0)
+	{
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	size_t maxUsefulThreads = std::max(file.size / minBytesPerThread, size_t(1));
+	uint32_t numChunks = uint32_t(std::min(size_t(numThreads), maxUsefulThreads));
+	
+	//Chunk boundaries are moved forward to the start of the next line
+	const char* fileBegin = file.data;
+	const char* fileEnd = file.data + file.size;
+	std::vector<const char*> chunkBegins(numChunks + 1);
+	chunkBegins[0] = fileBegin;
+	chunkBegins[numChunks] = fileEnd;
+	for (uint32_t i = 1; i < numChunks; i++)
+	{
+		const char* begin = std::max(fileBegin + (file.size / numChunks) * i, chunkBegins[i - 1]);
+		const char* newline = (const char*)(memchr(begin, '\n', size_t(fileEnd - begin)));
+		chunkBegins[i] = newline == NULL ? fileEnd : newline + 1;
+	}
+	
+	std::vector<ObjFileChunk> chunks(numChunks);
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < numChunks; i++)
+	{
+		threads.push_back(std::thread(ParseChunk, chunkBegins[i], chunkBegins[i + 1], &chunks[i]));
+	}
+	ParseChunk(chunkBegins[0], chunkBegins[1], &chunks[0]);
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	
+	std::map<std::string, int> materialMap;
+	LoadMaterials(chunks, materials, &materialMap, &errors);
+	
+	//Merge in file order. The first chunk's arrays are taken over as-is to avoid moving the largest part twice.
+	size_t numFloats[3] = { 0, 0, 0 };
+	size_t numIndices = 0;
+	for (const ObjFileChunk& chunk : chunks)
+	{
+		numFloats[0] += chunk.vertices.size();
+		numFloats[1] += chunk.normals.size();
+		numFloats[2] += chunk.texcoords.size();
+		numIndices += chunk.indices.size();
+	}
+	std::vector<tinyobj::index_t> indices;
+	std::vector<int> materialIds;
+	std::vector<ObjShapeStart> shapeStarts(1); //Faces before the first 'g' or 'o' form an unnamed shape
+	shapeStarts[0].firstTriangle = 0;
+	attrib->vertices.swap(chunks[0].vertices);
+	attrib->normals.swap(chunks[0].normals);
+	attrib->texcoords.swap(chunks[0].texcoords);
+	indices.swap(chunks[0].indices);
+	attrib->vertices.reserve(numFloats[0]);
+	attrib->normals.reserve(numFloats[1]);
+	attrib->texcoords.reserve(numFloats[2]);
+	indices.reserve(numIndices);
+	materialIds.reserve(numIndices / 3);
+	int currentMaterial = -1;
+	size_t firstIndex = 0;
+	for (uint32_t i = 0; i < numChunks; i++)
+	{
+		ObjFileChunk& chunk = chunks[i];
+		//Number of elements in the previous chunks. The first chunk's arrays are in place already.
+		size_t bases[3] = { 0, 0, 0 };
+		if (i > 0)
+		{
+			bases[0] = attrib->vertices.size() / 3;
+			bases[1] = attrib->normals.size() / 3;
+			bases[2] = attrib->texcoords.size() / 2;
+			firstIndex = indices.size();
+			attrib->vertices.insert(attrib->vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+			attrib->normals.insert(attrib->normals.end(), chunk.normals.begin(), chunk.normals.end());
+			attrib->texcoords.insert(attrib->texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+			indices.insert(indices.end(), chunk.indices.begin(), chunk.indices.end());
+		}
+		const size_t chunkEnd = indices.size();
+		
+		for (size_t position : chunk.relativeIndices)
+		{
+			tinyobj::index_t& index = indices[firstIndex + position / 3];
+			switch (position % 3)
+			{
+				case 0: index.vertex_index += int(bases[0]); break;
+				case 1: index.normal_index += int(bases[1]); break;
+				case 2: index.texcoord_index += int(bases[2]); break;
+			}
+		}
+		
+		//Material of every triangle, carrying the current material over from the previous chunk
+		size_t triangle = firstIndex / 3;
+		for (const ObjMaterialRun& run : chunk.materialRuns)
+		{
+			materialIds.insert(materialIds.end(), firstIndex / 3 + run.firstTriangle - triangle, currentMaterial);
+			triangle = firstIndex / 3 + run.firstTriangle;
+			auto material = materialMap.find(chunk.materialNames[run.nameIndex]);
+			currentMaterial = material == materialMap.end() ? -1 : material->second;
+		}
+		materialIds.insert(materialIds.end(), chunkEnd / 3 - triangle, currentMaterial);
+		
+		for (ObjShapeStart& shapeStart : chunk.shapeStarts)
+		{
+			shapeStart.firstTriangle += firstIndex / 3;
+			shapeStarts.push_back(std::move(shapeStart));
+		}
+		
+		chunk = ObjFileChunk();
+	}
+	
+	//Split into shapes, leaving out the ones without faces
+	const size_t numTriangles = indices.size() / 3;
+	for (size_t i = 0; i < shapeStarts.size(); i++)
+	{
+		const size_t begin = shapeStarts[i].firstTriangle;
+		const size_t end = i + 1 < shapeStarts.size() ? shapeStarts[i + 1].firstTriangle : numTriangles;
+		if (begin == end)
+		{
+			continue;
+		}
+		shapes->push_back(tinyobj::shape_t());
+		tinyobj::shape_t& s = shapes->back();
+		s.name = shapeStarts[i].name;
+		if (begin == 0 && end == numTriangles)
+		{
+			s.mesh.indices.swap(indices);
+			s.mesh.material_ids.swap(materialIds);
+		}
+		else
+		{
+			s.mesh.indices.assign(indices.begin() + begin * 3, indices.begin() + end * 3);
+			s.mesh.material_ids.assign(materialIds.begin() + begin, materialIds.begin() + end);
+		}
+		s.mesh.num_face_vertices.assign(end - begin, 3);
+	}
+	
+	if (err != NULL)
+	{
+		*err = errors;
+	}
+	return true;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
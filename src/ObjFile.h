@@ -0,0 +1,53 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef OBJ_FILE_H
+#define OBJ_FILE_H
+
+#include <string>
+#include "tinyobjloader/tiny_obj_loader.h"
+#include <vector>
+
+/*
+Drop-in replacement for tinyobj::LoadObj(attrib, shapes, materials, err, filename)
+with triangulation on. The file is memory-mapped, split at line boundaries and
+the chunks are parsed on separate threads with the number parser from
+NumberParser.h, then merged in file order into the same tinyobj structures.
+
+Differences to tinyobjloader: 't' (subdivision tag) lines are ignored, 'usemtl'
+may refer to a material from an 'mtllib' further down the file, and the faces
+of a group whose last statement is 'usemtl' are kept. As with tinyobjloader,
+.mtl files are looked up relative to the working directory.
+
+numThreads = 0 lets the reader decide based on the file size and number of cores.
+*/
+bool LoadObjFile(const char* filename, tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::vector<tinyobj::material_t>* materials, std::string* err, unsigned int numThreads = 0);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
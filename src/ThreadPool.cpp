@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+	if (numThreads == 0)
+	{
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	for (unsigned int i = 1; i < numThreads; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		shutdown = true;
+	}
+	tasksAvailable.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+unsigned int ThreadPool::NumThreads() const
+{
+	return (unsigned int)(workers.size()) + 1;
+}
+
+void ThreadPool::Enqueue(TaskGroup* group, std::function<void()> task)
+{
+	group->pendingTasks++;
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		tasks.push_back(std::make_pair(std::move(task), group));
+	}
+	tasksAvailable.notify_one();
+}
+
+bool ThreadPool::RunPendingTask()
+{
+	std::pair<std::function<void()>, TaskGroup*> task;
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		if (tasks.empty())
+		{
+			return false;
+		}
+		task = std::move(tasks.front());
+		tasks.pop_front();
+	}
+	task.first();
+	task.second->pendingTasks--;
+	return true;
+}
+
+void ThreadPool::Wait(TaskGroup* group)
+{
+	while (group->pendingTasks > 0)
+	{
+		//Help out instead of blocking, the task we're waiting on may still be queued
+		if (!RunPendingTask())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::ParallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const std::function<void(uint32_t)>& func)
+{
+	grainSize = std::max(grainSize, 1u);
+	TaskGroup group;
+	for (uint32_t chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize)
+	{
+		uint32_t chunkEnd = std::min(chunkBegin + grainSize, end);
+		Enqueue(&group, [chunkBegin, chunkEnd, &func]()
+		{
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				func(i);
+			}
+		});
+	}
+	Wait(&group);
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::pair<std::function<void()>, TaskGroup*> task;
+		{
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			tasksAvailable.wait(lock, [this]() { return shutdown || !tasks.empty(); });
+			if (tasks.empty())
+			{
+				return; //Shutting down
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task.first();
+		task.second->pendingTasks--;
+	}
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
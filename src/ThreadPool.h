@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+/*
+A fixed set of worker threads pulling tasks from a shared queue. Tasks are
+submitted as part of a TaskGroup, and waiting on a group makes the waiting
+thread execute queued tasks itself until the group is done. That makes it
+safe for tasks to submit and wait on their own sub-tasks.
+*/
+
+struct TaskGroup
+{
+	std::atomic<uint32_t> pendingTasks;
+	
+	TaskGroup() : pendingTasks(0) {}
+};
+
+struct ThreadPool
+{
+	std::vector<std::thread> workers;
+	std::deque<std::pair<std::function<void()>, TaskGroup*>> tasks;
+	std::mutex tasksMutex;
+	std::condition_variable tasksAvailable;
+	bool shutdown = false;
+	
+	//numThreads = 0 creates one thread per core. The thread calling Wait() also
+	//executes tasks, so one less worker than the number of cores is created.
+	ThreadPool(unsigned int numThreads = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+	unsigned int NumThreads() const;
+	void Enqueue(TaskGroup* group, std::function<void()> task);
+	void Wait(TaskGroup* group);
+	//Calls func(i) for every i in [begin, end), in chunks of grainSize indices per task
+	void ParallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const std::function<void(uint32_t)>& func);
+	
+private:
+	bool RunPendingTask();
+	void WorkerLoop();
+};
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,188 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <cmath>
+#include <string.h>
+#include "VertexEncoding.h"
+
+//sign() that never gives 0, GLSL's sign(0.0) would fold the normal onto an axis
+static float SignNotZero(float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+//packSnorm2x16 for one component
+static uint16_t FloatToSnorm16(float value)
+{
+	value = std::fmin(std::fmax(value, -1.0f), 1.0f);
+	return uint16_t(int16_t(std::round(value * 32767.0f)));
+}
+
+static float Snorm16ToFloat(uint16_t value)
+{
+	return std::fmax(float(int16_t(value)) / 32767.0f, -1.0f);
+}
+
+static void OctahedralToNormal(float u, float v, float normal[3])
+{
+	float x = u;
+	float y = v;
+	float z = 1.0f - std::fabs(u) - std::fabs(v);
+	//Unfold the lower hemisphere
+	float t = std::fmax(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	float length = std::sqrt(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+uint32_t EncodeOctahedralNormal(const float normal[3])
+{
+	//Project onto the octahedron, then fold the lower hemisphere over the upper one
+	float l1 = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+	if (!(l1 > 0.0f))
+	{
+		return 0;
+	}
+	float u = normal[0] / l1;
+	float v = normal[1] / l1;
+	if (normal[2] < 0.0f)
+	{
+		float foldedU = (1.0f - std::fabs(v)) * SignNotZero(u);
+		float foldedV = (1.0f - std::fabs(u)) * SignNotZero(v);
+		u = foldedU;
+		v = foldedV;
+	}
+	
+	//Try the four quantized neighbours of (u, v). They decode to within a few 1e-5 of each other,
+	//far too close for a float dot product to tell apart, so compare distances in double.
+	double length = std::sqrt(double(normal[0]) * normal[0] + double(normal[1]) * normal[1] + double(normal[2]) * normal[2]);
+	float floorU = std::floor(std::fmin(std::fmax(u, -1.0f), 1.0f) * 32767.0f);
+	float floorV = std::floor(std::fmin(std::fmax(v, -1.0f), 1.0f) * 32767.0f);
+	uint32_t best = 0;
+	double bestDistance = 8.0;
+	for (int i = 0; i < 4; i++)
+	{
+		float qu = std::fmin(floorU + float(i & 1), 32767.0f) / 32767.0f;
+		float qv = std::fmin(floorV + float(i >> 1), 32767.0f) / 32767.0f;
+		uint32_t encoded = uint32_t(FloatToSnorm16(qu)) | (uint32_t(FloatToSnorm16(qv)) << 16);
+		float decoded[3];
+		DecodeOctahedralNormal(encoded, decoded);
+		double distance = 0.0;
+		for (int c = 0; c < 3; c++)
+		{
+			double difference = decoded[c] - normal[c] / length;
+			distance += difference * difference;
+		}
+		if (distance < bestDistance)
+		{
+			bestDistance = distance;
+			best = encoded;
+		}
+	}
+	return best;
+}
+
+void DecodeOctahedralNormal(uint32_t encoded, float normal[3])
+{
+	OctahedralToNormal(Snorm16ToFloat(uint16_t(encoded & 0xffff)), Snorm16ToFloat(uint16_t(encoded >> 16)), normal);
+}
+
+uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t magnitude = bits & 0x7fffffff;
+	if (magnitude >= 0x7f800000)
+	{
+		//Infinity stays infinity, NaN stays a quiet NaN
+		return uint16_t(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+	}
+	if (magnitude >= 0x477ff000)
+	{
+		//Rounds to beyond 65504
+		return uint16_t(sign | 0x7c00);
+	}
+	if (magnitude < 0x38800000)
+	{
+		//Subnormal half, let the float addition do the rounding: adding 0.5 aligns
+		//the value so its lowest mantissa bits are the half's subnormal bits
+		float absolute;
+		memcpy(&absolute, &magnitude, sizeof(absolute));
+		absolute += 0.5f;
+		uint32_t absoluteBits;
+		memcpy(&absoluteBits, &absolute, sizeof(absoluteBits));
+		return uint16_t(sign | (absoluteBits - 0x3f000000));
+	}
+	//Normal half, round to nearest even on the 13 dropped mantissa bits
+	uint32_t mantissaOdd = (magnitude >> 13) & 1;
+	magnitude += 0xc8000fff + mantissaOdd;
+	return uint16_t(sign | (magnitude >> 13));
+}
+
+float HalfToFloat(uint16_t value)
+{
+	uint32_t sign = uint32_t(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+	uint32_t bits;
+	if (exponent == 0x1f)
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else if (exponent == 0)
+	{
+		//Zero or subnormal, 2^-24 per mantissa step
+		float magnitude = float(mantissa) * (1.0f / 16777216.0f);
+		memcpy(&bits, &magnitude, sizeof(bits));
+		bits |= sign;
+	}
+	else
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+uint32_t PackHalf2(float x, float y)
+{
+	return uint32_t(FloatToHalf(x)) | (uint32_t(FloatToHalf(y)) << 16);
+}
+
+void UnpackHalf2(uint32_t packed, float* x, float* y)
+{
+	*x = HalfToFloat(uint16_t(packed & 0xffff));
+	*y = HalfToFloat(uint16_t(packed >> 16));
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
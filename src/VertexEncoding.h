@@ -0,0 +1,54 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef VERTEX_ENCODING_H
+#define VERTEX_ENCODING_H
+
+#include <stdint.h>
+
+/*
+Encodings of the compact per-vertex attribute layout, see COMPACT_VERTEX_ATTRIBUTES
+in shaders/include/Defines.glsl. Each function matches its GLSL counterpart bit for bit:
+normals are octahedral coordinates in packSnorm2x16 and uvs are packHalf2x16, with
+the first component in the low 16 bits.
+*/
+
+//'normal' does not have to be normalized, a zero vector gives +z. Of the quantized coordinates around
+//the exact ones, the one that decodes closest to 'normal' is picked, so the error is as small as 16 bits allow.
+uint32_t EncodeOctahedralNormal(const float normal[3]);
+//Gives a normalized vector
+void DecodeOctahedralNormal(uint32_t encoded, float normal[3]);
+//Round to nearest even. Values beyond the half range become infinity.
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+uint32_t PackHalf2(float x, float y);
+void UnpackHalf2(uint32_t packed, float* x, float* y);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
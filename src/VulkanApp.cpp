@@ -20,9 +20,8 @@ This is the implementation of the Vulkan framework.
 #include <stdlib.h>
 #include <string.h>
 #include <string>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tinyobjloader/tiny_obj_loader.h"
 #include <vector>
+#include "VertexEncoding.h"
 #include "VulkanApp.h"
 
 std::chrono::high_resolution_clock::time_point VulkanApp::GetTime()
@@ -1210,179 +1209,30 @@ float VulkanApp::RenderOffscreen(VkCommandBuffer* commandBuffers, float rebuildT
 	return ms;
 }
 
-void VulkanApp::LoadMesh(const ModelFromFile& model, std::vector<Mesh>* meshes)
-{
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> material_ts;
-
-	std::string err;
-	bool success = tinyobj::LoadObj(&attrib, &shapes, &material_ts, &err, model.file.c_str()); 
-	if (!err.empty()) //`err` may contain warning message
-	{
-	  printf("%s\n", err.c_str());
-	}
-	if (!success)
-	{
-		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "tinyobjloader failed to load %s\n", model.file.c_str());
-		return;
-	}
-	if (material_ts.empty() && !model.hasCustomMaterial)
-	{
-		LOG_ERROR(false, __FILE__, __FUNCTION__, __LINE__, "No material detected for model '%s'\n", model.file.c_str());
-	}
-	
-	//Extract materials
-	size_t oldMeshesSize = meshes->size();
-	if (model.hasCustomMaterial)
-	{
-		meshes->resize(oldMeshesSize + 1);
-		Material& m = meshes->data()[oldMeshesSize].material;
-		m.diffuseColor[0] = model.diffuse.x;
-		m.diffuseColor[1] = model.diffuse.y;
-		m.diffuseColor[2] = model.diffuse.z;
-		m.diffuseColor[3] = 1.0f;
-	}
-	else
-	{
-		meshes->resize(oldMeshesSize + material_ts.size());
-		for (size_t i = 0; i < material_ts.size(); i++)
-		{
-			tinyobj::material_t& mtl = material_ts[i];
-			Material& m = meshes->data()[oldMeshesSize + i].material;
-			
-			m.diffuseColor[0] = mtl.diffuse[0];
-			m.diffuseColor[1] = mtl.diffuse[1];
-			m.diffuseColor[2] = mtl.diffuse[2];
-			m.diffuseColor[3] = 1.0f;
-		}
-	}
-	
-	bool hasNormals = attrib.normals.size() > 0 ? true : false;
-	bool hasUVs = attrib.texcoords.size() > 0 ? true : false;
-	
-	// Pre-calculate model matrix
-	glm::mat4 modelMatrix(1.0f);
-	bool modelMatrixActive = false;
-	if (model.scalingActive)
-	{
-		modelMatrix = model.scaling * modelMatrix;
-		modelMatrixActive = true;
-	}
-	if (model.rotationActive)
-	{
-		modelMatrix = model.rotation * modelMatrix;
-		modelMatrixActive = true;
-	}
-	if (model.translationActive)
-	{
-		modelMatrix = model.translation * modelMatrix;
-		modelMatrixActive = true;
-	}
-	
-	// Loop over shapes
-	glm::vec3 vertex;
-	glm::vec3 normal;
-	glm::vec2 uv;
-	for (size_t s = 0; s < shapes.size(); s++)
-	{
-		// Loop over faces(polygon)
-		size_t index_offset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
-		{
-			// Per-face material
-			int materialIdx = 0; // Assuming model has custom material
-			if (!model.hasCustomMaterial)
-			{
-				materialIdx = shapes[s].mesh.material_ids[f];
-			}
-			Mesh& mesh = meshes->data()[oldMeshesSize + materialIdx];
-			
-			// Loop over vertices in the face.
-			int fv = shapes[s].mesh.num_face_vertices[f];
-			for (int v = 0; v < fv; v++)
-			{
-			  	// Access to vertex
-			  	tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-				
-			  	vertex.x = attrib.vertices[3*idx.vertex_index+0];
-			 	vertex.y = attrib.vertices[3*idx.vertex_index+1];
-			  	vertex.z = attrib.vertices[3*idx.vertex_index+2];
-			  	
-			  	if (hasNormals)
-			  	{
-			  		normal.x = attrib.normals[3*idx.normal_index+0];
-				  	normal.y = attrib.normals[3*idx.normal_index+1];
-				  	normal.z = attrib.normals[3*idx.normal_index+2];
-			  	}
-			  	
-			  	if (hasUVs)
-			  	{
-			  		uv.x = attrib.texcoords[2*idx.texcoord_index+0];
-			  		uv.y = attrib.texcoords[2*idx.texcoord_index+1];
-			  	}
-			  	else
-			  	{
-			  		uv.x = -1.0f;
-			  		uv.y = -1.0f;
-			  	}
-			  	// Optional: vertex colors
-			  	// tinyobj::real_t red = attrib.colors[3*idx.vertex_index+0];
-			  	// tinyobj::real_t green = attrib.colors[3*idx.vertex_index+1];
-			  	// tinyobj::real_t blue = attrib.colors[3*idx.vertex_index+2];
-			  	
-			  	if (modelMatrixActive)
-			  	{
-			  		vertex = glm::vec3(modelMatrix * glm::vec4(vertex, 1.0f));
-			  		if (model.rotationActive)
-			  		{
-			  			normal = glm::normalize(glm::vec3(model.rotation * glm::vec4(normal, 1.0f)));
-			  		}
-			  	}
-			  	
-			  	mesh.vertices.push_back(vertex.x);
-			  	mesh.vertices.push_back(vertex.y);
-			  	mesh.vertices.push_back(vertex.z);
-			  	mesh.normals.push_back(normal.x);
-			  	mesh.normals.push_back(normal.y);
-			  	mesh.normals.push_back(normal.z);
-			  	mesh.uvs.push_back(uv.x);
-			  	mesh.uvs.push_back(uv.y);
-			}
-			index_offset += fv;
-			
-			//Generate normals (all are the same)
-			if (!hasNormals)
-			{
-				glm::vec3 v0(mesh.vertices[mesh.vertices.size() - 9], mesh.vertices[mesh.vertices.size() - 8], mesh.vertices[mesh.vertices.size() - 7]);
-				glm::vec3 v1(mesh.vertices[mesh.vertices.size() - 6], mesh.vertices[mesh.vertices.size() - 5], mesh.vertices[mesh.vertices.size() - 4]);
-				glm::vec3 v2(mesh.vertices[mesh.vertices.size() - 3], mesh.vertices[mesh.vertices.size() - 2], mesh.vertices[mesh.vertices.size() - 1]);
-				
-				glm::vec3 v0v1 = v1 - v0;
-				glm::vec3 v0v2 = v2 - v0;
-				glm::vec3 normal = glm::normalize(glm::cross(v0v1, v0v2));
-				
-				mesh.normals[mesh.normals.size() - 9] = normal.x;
-				mesh.normals[mesh.normals.size() - 8] = normal.y;
-				mesh.normals[mesh.normals.size() - 7] = normal.z;
-				mesh.normals[mesh.normals.size() - 6] = normal.x;
-				mesh.normals[mesh.normals.size() - 5] = normal.y;
-				mesh.normals[mesh.normals.size() - 4] = normal.z;
-				mesh.normals[mesh.normals.size() - 3] = normal.x;
-				mesh.normals[mesh.normals.size() - 2] = normal.y;
-				mesh.normals[mesh.normals.size() - 1] = normal.z;
-			}
-	  	}
-	}
-}
-
-void VulkanApp::BuildColorAndAttributeData(const std::vector<Mesh>& meshes, std::vector<float>* perMeshAttributeData, std::vector<float>* perVertexAttributeData, std::vector<uint32_t>* customIDToAttributeArrayIndex)
+void VulkanApp::BuildColorAndAttributeData(const std::vector<Mesh>& meshes, std::vector<float>* perMeshAttributeData, std::vector<float>* perVertexAttributeData, std::vector<uint32_t>* indexData, std::vector<uint32_t>* customIDToAttributeArrayIndex)
 {
 	uint32_t currentAttributeIndex = 0;
 	for (const Mesh& mesh : meshes)
 	{
+		//The first vertex and the first index of the mesh, uvec2 in shader
 		customIDToAttributeArrayIndex->push_back(currentAttributeIndex);
+		customIDToAttributeArrayIndex->push_back(uint32_t(indexData->size()));
+		indexData->insert(indexData->end(), mesh.indices.begin(), mesh.indices.end());
 		
+#if COMPACT_VERTEX_ATTRIBUTES
+		//Two uints per vertex, std430: the octahedral normal and the uv as two halfs.
+		//The bits are copied into the float array as they are.
+		for (size_t i = 0; i < mesh.vertices.size() / 3; i++)
+		{
+			uint32_t encoded[2];
+			encoded[0] = EncodeOctahedralNormal(&mesh.normals[i * 3]);
+			encoded[1] = PackHalf2(mesh.uvs[i * 2 + 0], mesh.uvs[i * 2 + 1]);
+			size_t offset = perVertexAttributeData->size();
+			perVertexAttributeData->resize(offset + 2);
+			memcpy(perVertexAttributeData->data() + offset, encoded, sizeof(encoded));
+			currentAttributeIndex++;
+		}
+#else
 		//Remember that the layout is required to be std140 = 16-byte aligned.
 		//That's the reason for the padding below.
 		//For each vertex
@@ -1398,6 +1248,7 @@ void VulkanApp::BuildColorAndAttributeData(const std::vector<Mesh>& meshes, std:
 			perVertexAttributeData->push_back(0.0f); //For vec4 in shader
 			currentAttributeIndex++;
 		}
+#endif
 		
 		perMeshAttributeData->push_back(mesh.material.diffuseColor[0]);
 		perMeshAttributeData->push_back(mesh.material.diffuseColor[1]);
@@ -1406,21 +1257,18 @@ void VulkanApp::BuildColorAndAttributeData(const std::vector<Mesh>& meshes, std:
 	}
 }
 
-//Basic transform
-const float basicTransform[12] = { 
-	1.0f, 0.0f, 0.0f, 0.0f,
-	0.0f, 1.0f, 0.0f, 0.0f,
-	0.0f, 0.0f, 1.0f, 0.0f
-};
 
-
-void VulkanApp::CreateBottomAccStruct(const std::vector<float>& geometry, VkGeometryInstanceNV* geometryInstance, uint32_t i, BottomAccStruct* bottomAccStruct, VkDevice device)
+void VulkanApp::CreateBottomAccStruct(const Mesh& mesh, BottomAccStruct* bottomAccStruct, VkDevice device)
 {	
 	bottomAccStruct->device = device;
 
 	//Create vertex buffer
-	VkDeviceSize vertexBufferSize = geometry.size() * sizeof(float);
-	CreateDeviceBuffer(vertexBufferSize, (void*)(geometry.data()), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &bottomAccStruct->vertexBuffer, &bottomAccStruct->vertexBufferMemory);
+	VkDeviceSize vertexBufferSize = mesh.vertices.size() * sizeof(float);
+	CreateDeviceBuffer(vertexBufferSize, (void*)(mesh.vertices.data()), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &bottomAccStruct->vertexBuffer, &bottomAccStruct->vertexBufferMemory);
+	
+	//Create index buffer
+	VkDeviceSize indexBufferSize = mesh.indices.size() * sizeof(uint32_t);
+	CreateDeviceBuffer(indexBufferSize, (void*)(mesh.indices.data()), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &bottomAccStruct->indexBuffer, &bottomAccStruct->indexBufferMemory);
 
 	//Steps
 	/*
@@ -1433,7 +1281,6 @@ void VulkanApp::CreateBottomAccStruct(const std::vector<float>& geometry, VkGeom
 	g) Allocate memory for the acceleration structure
 	h) Bind memory to acceleration structure
 	i) Get uint64_t handle to acceleration structure
-	j) Create an instance of the geometry using the handle from g)
 	*/
 	
 	//a
@@ -1442,17 +1289,13 @@ void VulkanApp::CreateBottomAccStruct(const std::vector<float>& geometry, VkGeom
 	bottomAccStruct->triangleInfo.pNext = NULL;
 	bottomAccStruct->triangleInfo.vertexData = bottomAccStruct->vertexBuffer;
 	bottomAccStruct->triangleInfo.vertexOffset = 0;
-	bottomAccStruct->triangleInfo.vertexCount = geometry.size() / 3;
+	bottomAccStruct->triangleInfo.vertexCount = mesh.vertices.size() / 3;
 	bottomAccStruct->triangleInfo.vertexStride = 3 * sizeof(float);
 	bottomAccStruct->triangleInfo.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-	bottomAccStruct->triangleInfo.indexData = VK_NULL_HANDLE;
+	bottomAccStruct->triangleInfo.indexData = bottomAccStruct->indexBuffer;
 	bottomAccStruct->triangleInfo.indexOffset = 0;
-	bottomAccStruct->triangleInfo.indexCount = 0;
-	bottomAccStruct->triangleInfo.indexType = VK_INDEX_TYPE_NONE_NV;
-	/*bottomAccStruct->triangleInfo.indexData = bottomAccStruct->indexBuffer;
-	bottomAccStruct->triangleInfo.indexOffset = 0;
-	bottomAccStruct->triangleInfo.indexCount = geometry.second.size();
-	bottomAccStruct->triangleInfo.indexType = VK_INDEX_TYPE_UINT32;*/
+	bottomAccStruct->triangleInfo.indexCount = mesh.indices.size();
+	bottomAccStruct->triangleInfo.indexType = VK_INDEX_TYPE_UINT32;
 	bottomAccStruct->triangleInfo.transformData = VK_NULL_HANDLE;
 	//bottomAccStruct->triangleInfo.transformOffset = IGNORED
 		
@@ -1526,14 +1369,23 @@ void VulkanApp::CreateBottomAccStruct(const std::vector<float>& geometry, VkGeom
 		
 	//i
 	CHECK_VK_RESULT(vkGetAccelerationStructureHandleNV(vkDevice, bottomAccStruct->accelerationStructure, sizeof(uint64_t), &bottomAccStruct->accelerationStructureHandle))
-		
-	//j
-	memcpy(geometryInstance->transform, basicTransform, sizeof(float) * 12);
-	geometryInstance->instanceCustomIndex = i;
-	geometryInstance->mask = 0xff;
-	geometryInstance->instanceOffset = 0;
-	geometryInstance->flags = VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV;
-	geometryInstance->accelerationStructureHandle = bottomAccStruct->accelerationStructureHandle;
+}
+
+//VkGeometryInstanceNV stores the top three rows of the transform, row-major
+static void ToGeometryInstanceTransform(const glm::mat4x4& transformation, float* transform)
+{
+	transform[0]  = transformation[0][0];
+	transform[1]  = transformation[1][0];
+	transform[2]  = transformation[2][0];
+	transform[3]  = transformation[3][0];
+	transform[4]  = transformation[0][1];
+	transform[5]  = transformation[1][1];
+	transform[6]  = transformation[2][1];
+	transform[7]  = transformation[3][1];
+	transform[8]  = transformation[0][2];
+	transform[9]  = transformation[1][2];
+	transform[10] = transformation[2][2];
+	transform[11] = transformation[3][2];
 }
 
 void VulkanApp::CreateTopAccStruct(uint32_t numInstances, TopAccStruct* topAccStruct, VkDevice device)
@@ -1598,36 +1450,86 @@ void VulkanApp::CreateTopAccStruct(uint32_t numInstances, TopAccStruct* topAccSt
 	CHECK_VK_RESULT(vkGetAccelerationStructureHandleNV(vkDevice, topAccStruct->accelerationStructure, sizeof(uint64_t), &topAccStruct->accelerationStructureHandle))
 }
 
-void VulkanApp::CreateVulkanAccelerationStructure(const std::vector<std::vector<float>>& geometryData, VulkanAccelerationStructure* accStruct)
+void VulkanApp::CreateVulkanAccelerationStructure(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, VulkanAccelerationStructure* accStruct)
+{
+	accStruct->device = vkDevice;
+	ExtendVulkanAccelerationStructure(meshes, instances, accStruct);
+}
+
+void VulkanApp::ExtendVulkanAccelerationStructure(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, VulkanAccelerationStructure* accStruct)
 {
 	//Steps
 	/*
-	a) Create all bottom level acceleration structures
-	b) Create buffer containing all geometry instances
-	c) Create top level acceleration structure
+	a) Create one bottom level acceleration structure per unique mesh that doesn't have one yet
+	b) Fill in all geometry instances, each pointing at the bottom level acceleration structure of its mesh
+	c) Create the instance buffer and the top level acceleration structure if the instances don't fit the current ones
+	d) Upload the instances
 	*/
 	
-	accStruct->device = vkDevice;
-	const uint32_t numMeshes = geometryData.size();
+	const uint32_t numMeshes = meshes.size();
+	const uint32_t firstNewMesh = accStruct->bottomAccStructs.size();
 	accStruct->bottomAccStructs.resize(numMeshes);
-	std::vector<VkGeometryInstanceNV> geometryInstances(numMeshes);
 	
 	//a)
-	for (uint32_t i = 0; i < numMeshes; i++)
+	for (uint32_t i = firstNewMesh; i < numMeshes; i++)
 	{
-		const std::vector<float>& geometry = geometryData[i];
-		VkGeometryInstanceNV* geometryInstance = &geometryInstances[i];
-		BottomAccStruct* bottomAccStruct = &accStruct->bottomAccStructs[i];
-		
-		CreateBottomAccStruct(geometry, geometryInstance, i, bottomAccStruct, vkDevice);
+		accStruct->bottomAccStructs[i].reset(new BottomAccStruct());
+		CreateBottomAccStruct(meshes[i], accStruct->bottomAccStructs[i].get(), vkDevice);
 	}
 	
 	//b)
-	accStruct->geometryInstancesBufferSize = geometryInstances.size() * sizeof(VkGeometryInstanceNV);
-	CreateHostVisibleBuffer(accStruct->geometryInstancesBufferSize, (void*)(geometryInstances.data()), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &accStruct->geometryInstancesBuffer, &accStruct->geometryInstancesBufferMemory);
-
+	accStruct->geometryInstances.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		VkGeometryInstanceNV& geometryInstance = accStruct->geometryInstances[i];
+		ToGeometryInstanceTransform(instances[i].transform, geometryInstance.transform);
+		//The custom index is the mesh index, so the hit shaders find the shared attributes of the mesh
+		geometryInstance.instanceCustomIndex = instances[i].meshIndex;
+		geometryInstance.mask = 0xff;
+		geometryInstance.instanceOffset = 0;
+		geometryInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV;
+		geometryInstance.accelerationStructureHandle = accStruct->bottomAccStructs[instances[i].meshIndex]->accelerationStructureHandle;
+	}
+	const uint32_t numInstances = instances.size();
+	
 	//c)
-	CreateTopAccStruct(geometryInstances.size(), &accStruct->topAccStruct, vkDevice);
+	if (numInstances > accStruct->instanceCapacity)
+	{
+		if (accStruct->instanceCapacity > 0)
+		{
+			vkFreeMemory(vkDevice, accStruct->geometryInstancesBufferMemory, NULL);
+			vkDestroyBuffer(vkDevice, accStruct->geometryInstancesBuffer, NULL);
+			vkFreeMemory(vkDevice, accStruct->topAccStruct.accelerationStructureMemory, NULL);
+			vkDestroyAccelerationStructureNV(vkDevice, accStruct->topAccStruct.accelerationStructure, NULL);
+		}
+		//Leave room to grow, so adding a few instances at a time doesn't recreate them every time
+		accStruct->instanceCapacity = std::max(numInstances, 2 * accStruct->instanceCapacity);
+		accStruct->geometryInstancesBufferSize = accStruct->instanceCapacity * sizeof(VkGeometryInstanceNV);
+		CreateHostVisibleBuffer(accStruct->geometryInstancesBufferSize, (void*)(NULL), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &accStruct->geometryInstancesBuffer, &accStruct->geometryInstancesBufferMemory);
+		CreateTopAccStruct(accStruct->instanceCapacity, &accStruct->topAccStruct, vkDevice);
+	}
+	//A top level acceleration structure may be built from fewer instances than it was created for
+	accStruct->topAccStruct.accelerationStructureInfo.instanceCount = numInstances;
+	
+	//d)
+	UpdateHostVisibleBuffer(numInstances * sizeof(VkGeometryInstanceNV), (void*)(accStruct->geometryInstances.data()), accStruct->geometryInstancesBufferMemory);
+}
+
+void VulkanApp::CompactVulkanAccelerationStructure(const std::vector<uint32_t>& keptMeshes, VulkanAccelerationStructure* accStruct)
+{
+	//Kept meshes only move towards the front, so every one is taken before its old slot is reused.
+	//The built ones stay a prefix, since the order is kept.
+	uint32_t numBuilt = 0;
+	for (uint32_t i = 0; i < uint32_t(keptMeshes.size()); i++)
+	{
+		if (keptMeshes[i] != i)
+		{
+			accStruct->bottomAccStructs[i] = std::move(accStruct->bottomAccStructs[keptMeshes[i]]);
+		}
+		numBuilt += keptMeshes[i] < accStruct->numBuiltBottomAccStructs ? 1 : 0;
+	}
+	accStruct->bottomAccStructs.resize(keptMeshes.size());
+	accStruct->numBuiltBottomAccStructs = numBuilt;
 }
 
 BottomAccStruct::~BottomAccStruct()
@@ -1648,6 +1550,8 @@ TopAccStruct::~TopAccStruct()
 
 VulkanAccelerationStructure::~VulkanAccelerationStructure()
 {
+	vkFreeMemory(device, scratchBufferMemory, NULL);
+	vkDestroyBuffer(device, scratchBuffer, NULL);
 	vkFreeMemory(device, geometryInstancesBufferMemory, NULL);
 	vkDestroyBuffer(device, geometryInstancesBuffer, NULL);
 }
@@ -1661,9 +1565,10 @@ void VulkanApp::BuildAccelerationStructure(VulkanAccelerationStructure& accStruc
 	/*
 	a) Find largest acceleration structure
 		- Should have the largest size that will be needed = max(largest_bottom_level, top_level)
+		- Only the bottom levels that haven't been built yet count
 		- Size is of type VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV
-	b) Create a buffer that will be used as scratch when building
-	c) Allocate command buffer
+	b) Create a buffer that will be used as scratch when building, unless the one of the previous build is large enough
+	c) Allocate command buffer, replacing the one of the previous build
 	d) Begin command buffer
 	e) Build Bottom level acceleration structures
 		- Repeat for each
@@ -1685,8 +1590,10 @@ void VulkanApp::BuildAccelerationStructure(VulkanAccelerationStructure& accStruc
 	accelerationStructureMemoryRequirementInfo.pNext = NULL;
 	accelerationStructureMemoryRequirementInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
 	VkMemoryRequirements2 accelerationStructMemoryRequirements;
-	for (const BottomAccStruct& bottomAccStruct : accStruct.bottomAccStructs)
+	const uint32_t numBottomAccStructs = accStruct.bottomAccStructs.size();
+	for (uint32_t i = accStruct.numBuiltBottomAccStructs; i < numBottomAccStructs; i++)
 	{
+		const BottomAccStruct& bottomAccStruct = *accStruct.bottomAccStructs[i];
 		accelerationStructureMemoryRequirementInfo.accelerationStructure = bottomAccStruct.accelerationStructure;
 		vkGetAccelerationStructureMemoryRequirementsNV(vkDevice, &accelerationStructureMemoryRequirementInfo, &accelerationStructMemoryRequirements);
 		scratchBufferSize = std::max(scratchBufferSize, accelerationStructMemoryRequirements.memoryRequirements.size);
@@ -1699,9 +1606,23 @@ void VulkanApp::BuildAccelerationStructure(VulkanAccelerationStructure& accStruc
 	
 	
 	//b
-	CreateDeviceBuffer(scratchBufferSize, (void*)(NULL), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &accStruct.scratchBuffer, &accStruct.scratchBufferMemory);
+	//Kept when it fits, so rebuilding only the top level, e.g. after moving instances, allocates nothing
+	if (scratchBufferSize > accStruct.scratchBufferSize)
+	{
+		if (accStruct.scratchBuffer != VK_NULL_HANDLE)
+		{
+			vkFreeMemory(vkDevice, accStruct.scratchBufferMemory, NULL);
+			vkDestroyBuffer(vkDevice, accStruct.scratchBuffer, NULL);
+		}
+		CreateDeviceBuffer(scratchBufferSize, (void*)(NULL), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &accStruct.scratchBuffer, &accStruct.scratchBufferMemory);
+		accStruct.scratchBufferSize = scratchBufferSize;
+	}
 	
 	//c
+	if (accStruct.buildCommandBuffer != VK_NULL_HANDLE)
+	{
+		FreeGraphicsQueueCommandBuffer(&accStruct.buildCommandBuffer);
+	}
 	AllocateGraphicsQueueCommandBuffer(&accStruct.buildCommandBuffer);
 	
 	//d
@@ -1718,8 +1639,9 @@ void VulkanApp::BuildAccelerationStructure(VulkanAccelerationStructure& accStruc
 	memoryBarrier.pNext = NULL;
 	memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
 	memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
-	for (const BottomAccStruct& bottomAccStruct : accStruct.bottomAccStructs)
+	for (uint32_t i = accStruct.numBuiltBottomAccStructs; i < numBottomAccStructs; i++)
 	{
+		const BottomAccStruct& bottomAccStruct = *accStruct.bottomAccStructs[i];
 		//Build
 		vkCmdBuildAccelerationStructureNV(accStruct.buildCommandBuffer, &bottomAccStruct.accelerationStructureInfo, VK_NULL_HANDLE, 0, VK_FALSE, bottomAccStruct.accelerationStructure, VK_NULL_HANDLE, accStruct.scratchBuffer, 0);
 		//Barrier
@@ -1750,6 +1672,7 @@ void VulkanApp::BuildAccelerationStructure(VulkanAccelerationStructure& accStruc
 	
 	//i
 	vkQueueWaitIdle(vkGraphicsQueue);
+	accStruct.numBuiltBottomAccStructs = numBottomAccStructs;
 	
 	auto end_time = GetTime();
 	unsigned int ns = (unsigned int)(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count());
@@ -1766,18 +1689,7 @@ void VulkanApp::UpdateAccelerationStructureTransforms(VulkanAccelerationStructur
 	char* pData = (char*)(data);
 	for (const glm::mat4x4& transformation : transformationData)
 	{
-		transform[0]  = transformation[0][0];
-		transform[1]  = transformation[1][0];
-		transform[2]  = transformation[2][0];
-		transform[3]  = transformation[3][0];
-		transform[4]  = transformation[0][1];
-		transform[5]  = transformation[1][1];
-		transform[6]  = transformation[2][1];
-		transform[7]  = transformation[3][1];
-		transform[8]  = transformation[0][2];
-		transform[9]  = transformation[1][2];
-		transform[10] = transformation[2][2];
-		transform[11] = transformation[3][2];
+		ToGeometryInstanceTransform(transformation, transform);
 		memcpy(pData, transform, copySize);
 		// VkGeometryInstanceNV is 64 bytes
 		pData += 64;
@@ -22,6 +22,8 @@ are not supported as I've only added when I've needed a specific combination.
 #include "Camera.h"
 #include <chrono>
 #include "BrhanFile.h"
+#include <memory>
+#include "MeshLoader.h"
 #include <stdio.h>
 
 #if VK_DEBUG
@@ -89,15 +91,21 @@ struct TopAccStruct
 struct VulkanAccelerationStructure
 {
 	VkDevice device;
-	std::vector<BottomAccStruct> bottomAccStructs;
+	//One per mesh. Held through pointers, since BottomAccStruct frees its resources when destroyed and
+	//its info points into itself, so it must stay in place when meshes are added or removed.
+	std::vector<std::unique_ptr<BottomAccStruct>> bottomAccStructs;
+	uint32_t numBuiltBottomAccStructs = 0;
 	std::vector<VkGeometryInstanceNV> geometryInstances;
+	//Number of instances the instance buffer and the top level acceleration structure were created for
+	uint32_t instanceCapacity = 0;
 	VkBuffer geometryInstancesBuffer;
 	VkDeviceMemory geometryInstancesBufferMemory;
 	VkDeviceSize geometryInstancesBufferSize;
 	TopAccStruct topAccStruct;
-	VkBuffer scratchBuffer;
-	VkDeviceMemory scratchBufferMemory;
-	VkCommandBuffer buildCommandBuffer;
+	VkBuffer scratchBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory scratchBufferMemory = VK_NULL_HANDLE;
+	VkDeviceSize scratchBufferSize = 0;
+	VkCommandBuffer buildCommandBuffer = VK_NULL_HANDLE;
 	
 	~VulkanAccelerationStructure();
 };
@@ -112,19 +120,6 @@ struct VulkanTexture
 	~VulkanTexture();
 };
 
-struct Material
-{
-	float diffuseColor[4];
-};
-
-struct Mesh
-{
-	std::vector<float> vertices;
-	std::vector<float> normals;
-	std::vector<float> uvs;
-	Material material;
-};
-
 struct VulkanApp
 {
 	//Window
@@ -207,9 +202,16 @@ public:
 	void AllocateDefaultGraphicsQueueCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers);
 	float Render(VkCommandBuffer* commandBuffers, float rebuildTime);
 	float RenderOffscreen(VkCommandBuffer* commandBuffers, float rebuildTime);
-	void LoadMesh(const ModelFromFile& model, std::vector<Mesh>* meshes);
-	void BuildColorAndAttributeData(const std::vector<Mesh>& meshes, std::vector<float>* perMeshAttributeData, std::vector<float>* perVertexAttributeData, std::vector<uint32_t>* customIDToAttributeArrayIndex);
-	void CreateVulkanAccelerationStructure(const std::vector<std::vector<float>>& geometryData, VulkanAccelerationStructure* accStruct);
+	void BuildColorAndAttributeData(const std::vector<Mesh>& meshes, std::vector<float>* perMeshAttributeData, std::vector<float>* perVertexAttributeData, std::vector<uint32_t>* indexData, std::vector<uint32_t>* customIDToAttributeArrayIndex);
+	void CreateVulkanAccelerationStructure(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, VulkanAccelerationStructure* accStruct);
+	//Adds bottom level acceleration structures for the meshes that don't have one yet and replaces the
+	//instances. The top level acceleration structure is recreated when the instances no longer fit, which
+	//changes its handle. Nothing may be using the acceleration structure, and it must be built afterwards.
+	void ExtendVulkanAccelerationStructure(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, VulkanAccelerationStructure* accStruct);
+	//Keeps the bottom level acceleration structures of 'keptMeshes', see UpdateMeshes, in that order and
+	//destroys the others. The device must be idle, and the instances must be replaced afterwards.
+	void CompactVulkanAccelerationStructure(const std::vector<uint32_t>& keptMeshes, VulkanAccelerationStructure* accStruct);
+	//Builds the bottom level acceleration structures that haven't been built yet, then the top level one
 	void BuildAccelerationStructure(VulkanAccelerationStructure& accStruct);
 	void UpdateAccelerationStructureTransforms(VulkanAccelerationStructure& accStruct, const std::vector<glm::mat4x4>& transformationData);
 	
@@ -227,7 +229,7 @@ private:
 	void CreateGraphicsQueueCommandPool();
 	void CreateSyncObjects();
 	std::vector<char> ReadShaderFile(const char* spirvFile);
-	void CreateBottomAccStruct(const std::vector<float>& geometry, VkGeometryInstanceNV* geometryInstance, uint32_t i, BottomAccStruct* bottomAccStruct, VkDevice device);
+	void CreateBottomAccStruct(const Mesh& mesh, BottomAccStruct* bottomAccStruct, VkDevice device);
 	void CreateTopAccStruct(uint32_t numInstances, TopAccStruct* topAccStruct, VkDevice device);
 };
 
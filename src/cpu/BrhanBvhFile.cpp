@@ -0,0 +1,245 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include "BrhanBvhFile.h"
+#include "BrhanMeshFile.h"
+#include "MappedFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static const char brhanBvhFileMagic[8] = { 'B', 'R', 'H', 'A', 'N', 'B', 'V', 'H' };
+
+//Where each array starts, in the order of the layout, and the size of the file in the last entry
+struct BrhanBvhFileOffsets
+{
+	uint64_t nodes;
+	uint64_t primitives;
+	uint64_t wideNodes;
+	uint64_t quantizedNodes;
+	uint64_t widePrimitives;
+	uint64_t blocks;
+	uint64_t firstBlocks;
+	uint64_t end;
+};
+
+static uint64_t Align(uint64_t offset)
+{
+	return (offset + BRHAN_BVH_FILE_ALIGNMENT - 1) / BRHAN_BVH_FILE_ALIGNMENT * BRHAN_BVH_FILE_ALIGNMENT;
+}
+
+static BrhanBvhFileOffsets FileOffsets(const BrhanBvhFileHeader& header)
+{
+	BrhanBvhFileOffsets offsets;
+	offsets.nodes = Align(sizeof(BrhanBvhFileHeader));
+	offsets.primitives = Align(offsets.nodes + header.numNodes * sizeof(BvhNode));
+	offsets.wideNodes = Align(offsets.primitives + header.numPrimitives * sizeof(uint32_t));
+	offsets.quantizedNodes = Align(offsets.wideNodes + header.numWideNodes * sizeof(Bvh8Node));
+	offsets.widePrimitives = Align(offsets.quantizedNodes + header.numWideNodes * sizeof(Bvh8QuantizedNode));
+	offsets.blocks = Align(offsets.widePrimitives + header.numPrimitives * sizeof(uint32_t));
+	offsets.firstBlocks = Align(offsets.blocks + header.numBlocks * sizeof(TriangleBlock));
+	offsets.end = offsets.firstBlocks + header.numPrimitives * sizeof(uint32_t);
+	return offsets;
+}
+
+//Hash of the arrays of the layout, each 'sizes[i]' bytes at 'arrays[i]'
+static uint64_t HashArrays(const void* const* arrays, const uint64_t* sizes, size_t numArrays)
+{
+	uint64_t hash = 0;
+	for (size_t i = 0; i < numArrays; ++i)
+	{
+		hash = (hash ^ HashFileContents((const char*)(arrays[i]), size_t(sizes[i]))) * 0x9E3779B97F4A7C15ull;
+	}
+	return hash;
+}
+
+//Writes 'size' bytes at 'offset', after zeros from where the file ends, '*written', up to it
+static bool WriteArray(FILE* file, uint64_t offset, const void* data, uint64_t size, uint64_t* written)
+{
+	static const char zeros[BRHAN_BVH_FILE_ALIGNMENT] = {};
+	const uint64_t padding = offset - *written;
+	*written = offset + size;
+	return fwrite(zeros, 1, padding, file) == padding && fwrite(data, 1, size, file) == size;
+}
+
+std::string BrhanBvhFilePath(const std::string& sceneFile)
+{
+	return sceneFile + ".brhanbvh";
+}
+
+uint64_t HashCpuSceneGeometry(const std::vector<glm::vec3>& vertices, const std::vector<uint8_t>& splittable, float splitBudget)
+{
+	uint64_t budgetBits = 0;
+	memcpy(&budgetBits, &splitBudget, sizeof(splitBudget));
+	uint64_t hash = HashFileContents((const char*)(vertices.data()), vertices.size() * sizeof(glm::vec3));
+	hash = (hash ^ HashFileContents((const char*)(splittable.data()), splittable.size())) * 0x9E3779B97F4A7C15ull;
+	return (hash ^ budgetBits) * 0x9E3779B97F4A7C15ull;
+}
+
+bool LoadBrhanBvhFile(const std::string& cacheFile, uint64_t geometryHash, CpuScene* scene, CpuSceneStats* stats)
+{
+	MappedFile& cache = scene->bvhCache;
+	if (!cache.Open(cacheFile.c_str()) || cache.size < sizeof(BrhanBvhFileHeader))
+	{
+		cache.Close();
+		return false;
+	}
+	
+	BrhanBvhFileHeader header;
+	memcpy(&header, cache.data, sizeof(header));
+	const uint64_t numTriangles = scene->vertices.size() / 3;
+	if (memcmp(header.magic, brhanBvhFileMagic, sizeof(brhanBvhFileMagic)) != 0 || header.version != BRHAN_BVH_FILE_VERSION || header.nodeSize != sizeof(BvhNode) || header.wideNodeSize != sizeof(Bvh8Node) ||
+		header.quantizedNodeSize != sizeof(Bvh8QuantizedNode) || header.blockSize != sizeof(TriangleBlock) || header.geometryHash != geometryHash || header.numTriangles != numTriangles ||
+		header.numNodes == 0 || header.numNodes > UINT32_MAX || header.numPrimitives > UINT32_MAX || FileOffsets(header).end != cache.size)
+	{
+		cache.Close();
+		return false;
+	}
+	
+	//The traversal jumps around the whole file, unlike the readers MappedFile advises for
+	madvise((void*)(cache.data), cache.size, MADV_NORMAL);
+	madvise((void*)(cache.data), cache.size, MADV_WILLNEED);
+	const BrhanBvhFileOffsets offsets = FileOffsets(header);
+	//Read through once before the traversal trusts indices from it
+	const void* arrays[] = { cache.data + offsets.nodes, cache.data + offsets.primitives, cache.data + offsets.wideNodes, cache.data + offsets.quantizedNodes,
+		cache.data + offsets.widePrimitives, cache.data + offsets.blocks, cache.data + offsets.firstBlocks };
+	const uint64_t sizes[] = { header.numNodes * sizeof(BvhNode), header.numPrimitives * sizeof(uint32_t), header.numWideNodes * sizeof(Bvh8Node), header.numWideNodes * sizeof(Bvh8QuantizedNode),
+		header.numPrimitives * sizeof(uint32_t), header.numBlocks * sizeof(TriangleBlock), header.numPrimitives * sizeof(uint32_t) };
+	if (HashArrays(arrays, sizes, 7) != header.payloadHash)
+	{
+		cache.Close();
+		return false;
+	}
+	BvhView& view = scene->cachedBvh;
+	view.numNodes = uint32_t(header.numNodes);
+	view.nodes = (const BvhNode*)(cache.data + offsets.nodes);
+	view.primitives = (const uint32_t*)(cache.data + offsets.primitives);
+	view.wideNodes = (const Bvh8Node*)(cache.data + offsets.wideNodes);
+	view.quantizedNodes = (const Bvh8QuantizedNode*)(cache.data + offsets.quantizedNodes);
+	view.blocks = (const TriangleBlock*)(cache.data + offsets.blocks);
+	view.firstBlocks = (const uint32_t*)(cache.data + offsets.firstBlocks);
+	
+	stats->bvh.numNodes = uint32_t(header.numNodes);
+	stats->bvh.numLeaves = header.numLeaves;
+	stats->bvh.maxDepth = header.maxDepth;
+	stats->bvh.sahCost = header.sahCost;
+	stats->bvh.numReferences = uint32_t(header.numPrimitives);
+	stats->wideBvh.numNodes = uint32_t(header.numWideNodes);
+	stats->wideBvh.averageChildren = header.averageChildren;
+	stats->wideBvh.maxDepth = header.wideMaxDepth;
+	
+	return true;
+}
+
+bool WriteBrhanBvhFile(const std::string& cacheFile, uint64_t geometryHash, const CpuScene& scene, const CpuSceneStats& stats)
+{
+	const Bvh& bvh = scene.bvh;
+	const Bvh8& wideBvh = scene.wideBvh;
+	const TriangleBlocks& triangleBlocks = scene.triangleBlocks;
+	if (bvh.nodes.empty() || wideBvh.primitives.size() != bvh.primitives.size() || triangleBlocks.firstBlocks.size() != bvh.primitives.size())
+	{
+		return false;
+	}
+	BrhanBvhFileHeader header = {};
+	memcpy(header.magic, brhanBvhFileMagic, sizeof(brhanBvhFileMagic));
+	header.version = BRHAN_BVH_FILE_VERSION;
+	header.nodeSize = sizeof(BvhNode);
+	header.wideNodeSize = sizeof(Bvh8Node);
+	header.quantizedNodeSize = sizeof(Bvh8QuantizedNode);
+	header.blockSize = sizeof(TriangleBlock);
+	header.geometryHash = geometryHash;
+	header.numTriangles = scene.vertices.size() / 3;
+	header.numNodes = bvh.nodes.size();
+	header.numPrimitives = bvh.primitives.size();
+	header.numWideNodes = wideBvh.nodes.size();
+	header.numBlocks = triangleBlocks.blocks.size();
+	header.sahCost = bvh.builtSahCost;
+	header.numLeaves = stats.bvh.numLeaves;
+	header.maxDepth = stats.bvh.maxDepth;
+	header.wideMaxDepth = stats.wideBvh.maxDepth;
+	header.averageChildren = stats.wideBvh.averageChildren;
+	const void* arrays[] = { bvh.nodes.data(), bvh.primitives.data(), wideBvh.nodes.data(), wideBvh.quantizedNodes.data(), wideBvh.primitives.data(), triangleBlocks.blocks.data(),
+		triangleBlocks.firstBlocks.data() };
+	const uint64_t sizes[] = { bvh.nodes.size() * sizeof(BvhNode), bvh.primitives.size() * sizeof(uint32_t), wideBvh.nodes.size() * sizeof(Bvh8Node), wideBvh.quantizedNodes.size() * sizeof(Bvh8QuantizedNode),
+		wideBvh.primitives.size() * sizeof(uint32_t), triangleBlocks.blocks.size() * sizeof(TriangleBlock), triangleBlocks.firstBlocks.size() * sizeof(uint32_t) };
+	header.payloadHash = HashArrays(arrays, sizes, 7);
+	const BrhanBvhFileOffsets offsets = FileOffsets(header);
+	
+	//Written to a temporary file of its own first so a reader never maps a half-written cache, and
+	//two processes building the same scene don't write into one. Processes that mapped the cache it
+	//replaces keep reading that.
+	std::string tempFile;
+	FILE* file = CreateTempFile(cacheFile, &tempFile);
+	if (file == NULL)
+	{
+		return false;
+	}
+	uint64_t written = 0;
+	bool success = WriteArray(file, 0, &header, sizeof(header), &written);
+	success = success && WriteArray(file, offsets.nodes, bvh.nodes.data(), bvh.nodes.size() * sizeof(BvhNode), &written);
+	success = success && WriteArray(file, offsets.primitives, bvh.primitives.data(), bvh.primitives.size() * sizeof(uint32_t), &written);
+	success = success && WriteArray(file, offsets.wideNodes, wideBvh.nodes.data(), wideBvh.nodes.size() * sizeof(Bvh8Node), &written);
+	success = success && WriteArray(file, offsets.quantizedNodes, wideBvh.quantizedNodes.data(), wideBvh.quantizedNodes.size() * sizeof(Bvh8QuantizedNode), &written);
+	success = success && WriteArray(file, offsets.widePrimitives, wideBvh.primitives.data(), wideBvh.primitives.size() * sizeof(uint32_t), &written);
+	success = success && WriteArray(file, offsets.blocks, triangleBlocks.blocks.data(), triangleBlocks.blocks.size() * sizeof(TriangleBlock), &written);
+	success = success && WriteArray(file, offsets.firstBlocks, triangleBlocks.firstBlocks.data(), triangleBlocks.firstBlocks.size() * sizeof(uint32_t), &written);
+	success = (fclose(file) == 0) && success;
+	if (!success || rename(tempFile.c_str(), cacheFile.c_str()) != 0)
+	{
+		remove(tempFile.c_str());
+		return false;
+	}
+	
+	return true;
+}
+
+void CopyMappedBvh(CpuScene* scene)
+{
+	if (!scene->bvh.nodes.empty() || !scene->bvhCache.IsOpen())
+	{
+		return;
+	}
+	BrhanBvhFileHeader header;
+	memcpy(&header, scene->bvhCache.data, sizeof(header));
+	const BrhanBvhFileOffsets offsets = FileOffsets(header);
+	const char* data = scene->bvhCache.data;
+	const BvhView& view = scene->cachedBvh;
+	scene->bvh.nodes.assign(view.nodes, view.nodes + header.numNodes);
+	scene->bvh.primitives.assign(view.primitives, view.primitives + header.numPrimitives);
+	scene->bvh.builtSahCost = header.sahCost;
+	scene->wideBvh.nodes.assign(view.wideNodes, view.wideNodes + header.numWideNodes);
+	scene->wideBvh.quantizedNodes.assign(view.quantizedNodes, view.quantizedNodes + header.numWideNodes);
+	const uint32_t* widePrimitives = (const uint32_t*)(data + offsets.widePrimitives);
+	scene->wideBvh.primitives.assign(widePrimitives, widePrimitives + header.numPrimitives);
+	scene->triangleBlocks.blocks.assign(view.blocks, view.blocks + header.numBlocks);
+	scene->triangleBlocks.firstBlocks.assign(view.firstBlocks, view.firstBlocks + header.numPrimitives);
+	scene->bvhCache.Close();
+	scene->cachedBvh = BvhView();
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef BRHAN_BVH_FILE_H
+#define BRHAN_BVH_FILE_H
+
+#include "CpuScene.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+.brhanbvh is a binary cache of the BVHs of a flat CpuScene, stored next to the
+scene file (complex.brhan -> complex.brhan.brhanbvh). It holds the arrays of
+'bvh', 'wideBvh' and 'triangleBlocks' as they are in memory, with indices
+instead of pointers, each starting at a multiple of BRHAN_BVH_FILE_ALIGNMENT.
+Layout:
+	BrhanBvhFileHeader
+	BvhNode nodes[numNodes]
+	uint32_t primitives[numPrimitives]
+	Bvh8Node wideNodes[numWideNodes]
+	Bvh8QuantizedNode quantizedNodes[numWideNodes]
+	uint32_t widePrimitives[numPrimitives]
+	TriangleBlock blocks[numBlocks]
+	uint32_t firstBlocks[numPrimitives]
+The cache is valid while the hash of the scene's triangles and split settings
+matches the header, see HashCpuSceneGeometry, and the arrays hash to
+'payloadHash', so a truncated or damaged file is rebuilt rather than traced. A scene loaded from it traces the
+file mapping directly, so every process rendering the same scene on a host
+shares one copy of the pages.
+*/
+
+#define BRHAN_BVH_FILE_VERSION 2
+#define BRHAN_BVH_FILE_ALIGNMENT 64
+
+struct BrhanBvhFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	//sizeof of the stored structs, which change with the code rather than the version
+	uint32_t nodeSize;
+	uint32_t wideNodeSize;
+	uint32_t quantizedNodeSize;
+	uint32_t blockSize;
+	uint32_t padding;
+	uint64_t geometryHash;
+	uint64_t numTriangles;
+	uint64_t numNodes;
+	//References, more than there are triangles with spatial splits
+	uint64_t numPrimitives;
+	uint64_t numWideNodes;
+	uint64_t numBlocks;
+	//BvhBuildStats and Bvh8Stats of the build that wrote the cache
+	float sahCost;
+	uint32_t numLeaves;
+	uint32_t maxDepth;
+	uint32_t wideMaxDepth;
+	float averageChildren;
+	uint32_t padding2;
+	//Hash of the arrays after the header, without the padding between them
+	uint64_t payloadHash;
+};
+
+std::string BrhanBvhFilePath(const std::string& sceneFile);
+//Hash of what the BVHs of a flat scene are built from: three 'vertices' per triangle, which of them
+//may be split, and the split budget
+uint64_t HashCpuSceneGeometry(const std::vector<glm::vec3>& vertices, const std::vector<uint8_t>& splittable, float splitBudget);
+//Maps the cache read-only into 'scene', which has its triangles placed already. Returns false if
+//there is no cache or it is for other geometry. 'stats' gets the counts the cache was built with.
+bool LoadBrhanBvhFile(const std::string& cacheFile, uint64_t geometryHash, CpuScene* scene, CpuSceneStats* stats);
+bool WriteBrhanBvhFile(const std::string& cacheFile, uint64_t geometryHash, const CpuScene& scene, const CpuSceneStats& stats);
+//Copies the BVHs of a scene loaded from a cache out of the mapping, so they can be refit or rebuilt,
+//and unmaps it. Does nothing for a scene that was built.
+void CopyMappedBvh(CpuScene* scene);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
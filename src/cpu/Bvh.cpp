@@ -0,0 +1,985 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include "Bvh.h"
+#include <chrono>
+#include "glm/common.hpp"
+#include "LinearBvh.h"
+
+//SAH bins per axis. Small nodes use fewer, one per primitive, since sweeping
+//the bins costs more than binning the primitives there.
+static const uint32_t MAX_BINS = 32;
+static const uint32_t MIN_BINS = 4;
+//Nodes with more primitives than this are built in parallel
+static const uint32_t PARALLEL_SUBTREE_SIZE = 4096;
+static const uint32_t PARALLEL_RANGE_SIZE = 65536;
+//Refits run the subtrees this close to the root as tasks, in trees with enough nodes to be worth it
+static const uint32_t PARALLEL_REFIT_DEPTH = 8;
+static const uint32_t PARALLEL_REFIT_NODES = 2 * PARALLEL_SUBTREE_SIZE;
+//Spatial splits are looked for where the children of the object split overlap by more than this
+//fraction of the surface area of the root, the value Stich et al. suggest
+static const float SPATIAL_SPLIT_MIN_OVERLAP = 1e-5f;
+
+void BoundingBox::Grow(const glm::vec3& point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void BoundingBox::Grow(const BoundingBox& box)
+{
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+glm::vec3 BoundingBox::Center() const
+{
+	return (min + max) * 0.5f;
+}
+
+float BoundingBox::SurfaceArea() const
+{
+	glm::vec3 extent = max - min;
+	if (extent.x < 0.0f || extent.y < 0.0f || extent.z < 0.0f)
+	{
+		return 0.0f;
+	}
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+struct Bin
+{
+	BoundingBox bounds;
+	uint32_t count = 0;
+};
+
+//Bins of the spatial splits count the references that start and end in them, and hold the parts
+//of the triangles that are inside them
+struct SpatialBin
+{
+	BoundingBox bounds;
+	uint32_t entries = 0;
+	uint32_t exits = 0;
+};
+
+//A primitive as the builder sees it. The references of a node are contiguous so they can be
+//read in order instead of through Bvh::primitives. Spatial splits clip the bounds to a part of
+//the triangle, and can make more than one reference to it.
+struct Reference
+{
+	BoundingBox bounds;
+	glm::vec3 centroid;
+	uint32_t primitive;
+};
+
+struct BuildContext
+{
+	std::vector<Reference> references;
+	Bvh* bvh;
+	std::atomic<uint32_t> numNodes;
+	std::atomic<uint32_t> numLeaves;
+	std::atomic<uint32_t> maxDepth;
+	ThreadPool* threadPool;
+};
+
+struct SpatialSplitContext
+{
+	//Three per triangle
+	const glm::vec3* vertices;
+	//One per triangle, or null when all of them may be split
+	const uint8_t* splittable;
+	//Spatial splits are only looked for in nodes whose object split has children overlapping by more
+	float minOverlapArea;
+	//References put in leaves so far, the leaves are given their place in Bvh::primitives as they are made
+	std::atomic<uint32_t> numReferences;
+	Bvh* bvh;
+	std::atomic<uint32_t> numNodes;
+	std::atomic<uint32_t> numLeaves;
+	std::atomic<uint32_t> maxDepth;
+	ThreadPool* threadPool;
+};
+
+//The cheapest split between two bins of the centroids, 'axis' is -1 when there is none
+struct ObjectSplit
+{
+	int axis = -1;
+	uint32_t split = 0;
+	float cost = FLT_MAX;
+	uint32_t numBins = 0;
+	glm::vec3 binScale;
+	BoundingBox leftBounds;
+	BoundingBox rightBounds;
+};
+
+//The cheapest plane between two spatial bins, 'axis' is -1 when there is none
+struct SpatialSplit
+{
+	int axis = -1;
+	uint32_t split = 0;
+	float cost = FLT_MAX;
+	float position = 0.0f;
+	uint32_t numBins = 0;
+	glm::vec3 binScale;
+	uint32_t leftCount = 0;
+	uint32_t rightCount = 0;
+	BoundingBox leftBounds;
+	BoundingBox rightBounds;
+};
+
+//The bounds of 'count' references and of their centroids
+static void RangeBounds(const Reference* references, uint32_t count, ThreadPool& threadPool, BoundingBox* bounds, BoundingBox* centroidBounds)
+{
+	auto rangeBounds = [&](uint32_t begin, uint32_t end, BoundingBox* b, BoundingBox* c)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			b->Grow(references[i].bounds);
+			c->Grow(references[i].centroid);
+		}
+	};
+	
+	if (count < PARALLEL_RANGE_SIZE)
+	{
+		rangeBounds(0, count, bounds, centroidBounds);
+		return;
+	}
+	const uint32_t numChunks = (count + PARALLEL_RANGE_SIZE - 1) / PARALLEL_RANGE_SIZE;
+	std::vector<BoundingBox> chunkBounds(numChunks);
+	std::vector<BoundingBox> chunkCentroidBounds(numChunks);
+	threadPool.ParallelFor(0, numChunks, 1, [&](uint32_t chunk)
+	{
+		uint32_t begin = chunk * PARALLEL_RANGE_SIZE;
+		rangeBounds(begin, std::min(begin + PARALLEL_RANGE_SIZE, count), &chunkBounds[chunk], &chunkCentroidBounds[chunk]);
+	});
+	for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+	{
+		bounds->Grow(chunkBounds[chunk]);
+		centroidBounds->Grow(chunkCentroidBounds[chunk]);
+	}
+}
+
+static uint32_t BinIndex(float centroid, float centroidMin, float binScale, uint32_t numBins)
+{
+	return std::min(uint32_t((centroid - centroidMin) * binScale), numBins - 1);
+}
+
+//Bins the primitives along all three axes in one pass, bins[axis * numBins + i]. Axes with no
+//centroid extent have a 'binScale' of 0 and end up in their first bin.
+static void FillBins(const Reference* references, uint32_t count, ThreadPool& threadPool, const glm::vec3& centroidMin, const glm::vec3& binScale, uint32_t numBins, Bin* bins)
+{
+	auto fillBins = [&](uint32_t begin, uint32_t end, Bin* b)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				Bin& bin = b[axis * numBins + BinIndex(references[i].centroid[axis], centroidMin[axis], binScale[axis], numBins)];
+				bin.bounds.Grow(references[i].bounds);
+				bin.count++;
+			}
+		}
+	};
+	
+	if (count < PARALLEL_RANGE_SIZE)
+	{
+		fillBins(0, count, bins);
+		return;
+	}
+	const uint32_t numChunks = (count + PARALLEL_RANGE_SIZE - 1) / PARALLEL_RANGE_SIZE;
+	std::vector<Bin> chunkBins(numChunks * 3 * numBins);
+	threadPool.ParallelFor(0, numChunks, 1, [&](uint32_t chunk)
+	{
+		uint32_t begin = chunk * PARALLEL_RANGE_SIZE;
+		fillBins(begin, std::min(begin + PARALLEL_RANGE_SIZE, count), &chunkBins[chunk * 3 * numBins]);
+	});
+	for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+	{
+		for (uint32_t i = 0; i < 3 * numBins; i++)
+		{
+			bins[i].bounds.Grow(chunkBins[chunk * 3 * numBins + i].bounds);
+			bins[i].count += chunkBins[chunk * 3 * numBins + i].count;
+		}
+	}
+}
+
+static uint32_t NumBins(uint32_t count)
+{
+	return std::max(std::min(count, MAX_BINS), MIN_BINS);
+}
+
+//Finds the cheapest split between two bins of the centroids on any axis
+static ObjectSplit FindObjectSplit(const Reference* references, uint32_t count, const BoundingBox& centroidBounds, ThreadPool& threadPool)
+{
+	ObjectSplit best;
+	const glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+	best.numBins = NumBins(count);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		best.binScale[axis] = centroidExtent[axis] > 0.0f ? best.numBins / centroidExtent[axis] : 0.0f;
+	}
+	const uint32_t numBins = best.numBins;
+	Bin bins[3 * MAX_BINS];
+	FillBins(references, count, threadPool, centroidBounds.min, best.binScale, numBins, bins);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (best.binScale[axis] == 0.0f)
+		{
+			continue;
+		}
+		const Bin* axisBins = &bins[axis * numBins];
+		
+		//rightCosts[i] is the cost of the bins from i + 1 onwards
+		float rightCosts[MAX_BINS];
+		BoundingBox rightBoxes[MAX_BINS];
+		BoundingBox rightBounds;
+		uint32_t rightCount = 0;
+		for (uint32_t i = numBins - 1; i > 0; i--)
+		{
+			rightBounds.Grow(axisBins[i].bounds);
+			rightCount += axisBins[i].count;
+			rightCosts[i - 1] = rightBounds.SurfaceArea() * rightCount;
+			rightBoxes[i - 1] = rightBounds;
+		}
+		BoundingBox leftBounds;
+		uint32_t leftCount = 0;
+		for (uint32_t i = 0; i < numBins - 1; i++)
+		{
+			leftBounds.Grow(axisBins[i].bounds);
+			leftCount += axisBins[i].count;
+			if (leftCount == 0 || leftCount == count)
+			{
+				continue;
+			}
+			float cost = leftBounds.SurfaceArea() * leftCount + rightCosts[i];
+			if (cost < best.cost)
+			{
+				best.cost = cost;
+				best.axis = axis;
+				best.split = i;
+				best.leftBounds = leftBounds;
+				best.rightBounds = rightBoxes[i];
+			}
+		}
+	}
+	return best;
+}
+
+//Moves the references on the left of 'split' to the front, and returns how many there are
+static uint32_t PartitionObjects(Reference* references, uint32_t count, const ObjectSplit& split, const BoundingBox& centroidBounds)
+{
+	const int axis = split.axis;
+	const float centroidMin = centroidBounds.min[axis];
+	const float axisBinScale = split.binScale[axis];
+	const uint32_t numBins = split.numBins;
+	Reference* middle = std::partition(references, references + count, [&](const Reference& reference)
+	{
+		return BinIndex(reference.centroid[axis], centroidMin, axisBinScale, numBins) <= split.split;
+	});
+	return uint32_t(middle - references);
+}
+
+//Whether a node is better off as a leaf than split into children whose area times count add up
+//to 'splitCost'. Larger nodes are always split.
+static bool MakesLeaf(uint32_t count, const BoundingBox& bounds, float splitCost)
+{
+	const float area = bounds.SurfaceArea();
+	const float cost = BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST * (area > 0.0f ? splitCost / area : float(count));
+	return count <= BVH_MAX_LEAF_SIZE && cost >= BVH_INTERSECTION_COST * count;
+}
+
+static void MakeLeaf(BuildContext& context, BvhNode* node, uint32_t first, uint32_t count)
+{
+	node->leftOrFirst = first;
+	node->count = count;
+	context.numLeaves++;
+}
+
+static void BuildNode(BuildContext& context, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth)
+{
+	uint32_t maxDepth = context.maxDepth;
+	while (depth > maxDepth && !context.maxDepth.compare_exchange_weak(maxDepth, depth));
+	
+	Reference* references = context.references.data() + first;
+	BoundingBox bounds;
+	BoundingBox centroidBounds;
+	RangeBounds(references, count, *context.threadPool, &bounds, &centroidBounds);
+	BvhNode* node = &context.bvh->nodes[nodeIndex];
+	node->boundsMin = bounds.min;
+	node->boundsMax = bounds.max;
+	if (count == 1 || depth == BVH_MAX_DEPTH - 1)
+	{
+		MakeLeaf(context, node, first, count);
+		return;
+	}
+	
+	const ObjectSplit split = FindObjectSplit(references, count, centroidBounds, *context.threadPool);
+	uint32_t leftCount;
+	if (split.axis == -1)
+	{
+		//Every centroid is in the same spot, only the leaf size limit makes splitting worth it
+		if (count <= BVH_MAX_LEAF_SIZE)
+		{
+			MakeLeaf(context, node, first, count);
+			return;
+		}
+		leftCount = count / 2;
+	}
+	else
+	{
+		if (MakesLeaf(count, bounds, split.cost))
+		{
+			MakeLeaf(context, node, first, count);
+			return;
+		}
+		leftCount = PartitionObjects(references, count, split, centroidBounds);
+	}
+	
+	//Siblings are next to each other
+	const uint32_t left = context.numNodes.fetch_add(2);
+	node->leftOrFirst = left;
+	node->count = 0;
+	if (count > PARALLEL_SUBTREE_SIZE)
+	{
+		TaskGroup leftTask;
+		context.threadPool->Enqueue(&leftTask, [&context, left, first, leftCount, depth]()
+		{
+			BuildNode(context, left, first, leftCount, depth + 1);
+		});
+		BuildNode(context, left + 1, first + leftCount, count - leftCount, depth + 1);
+		context.threadPool->Wait(&leftTask);
+	}
+	else
+	{
+		BuildNode(context, left, first, leftCount, depth + 1);
+		BuildNode(context, left + 1, first + leftCount, count - leftCount, depth + 1);
+	}
+}
+
+BvhBuildStats BuildBvh(const std::vector<BoundingBox>& primitiveBounds, ThreadPool& threadPool, Bvh* bvh)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	const uint32_t numPrimitives = uint32_t(primitiveBounds.size());
+	BuildContext context;
+	context.bvh = bvh;
+	context.numNodes = 1;
+	context.numLeaves = 0;
+	context.maxDepth = 0;
+	context.threadPool = &threadPool;
+	context.references.resize(numPrimitives);
+	threadPool.ParallelFor(0, numPrimitives, PARALLEL_RANGE_SIZE, [&](uint32_t i)
+	{
+		context.references[i].bounds = primitiveBounds[i];
+		context.references[i].centroid = primitiveBounds[i].Center();
+		context.references[i].primitive = i;
+	});
+	
+	bvh->nodes.clear();
+	BvhBuildStats stats;
+	if (numPrimitives > 0)
+	{
+		//A binary tree with one primitive per leaf has the most nodes
+		bvh->nodes.resize(numPrimitives * 2 - 1);
+		BuildNode(context, 0, 0, numPrimitives, 0);
+		bvh->nodes.resize(context.numNodes);
+		bvh->nodes.shrink_to_fit();
+		bvh->primitives.resize(numPrimitives);
+		for (uint32_t i = 0; i < numPrimitives; i++)
+		{
+			bvh->primitives[i] = context.references[i].primitive;
+		}
+		stats.numNodes = context.numNodes;
+		stats.numLeaves = context.numLeaves;
+		stats.maxDepth = context.maxDepth;
+		stats.numReferences = numPrimitives;
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.buildTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	stats.sahCost = BvhSahCost(*bvh);
+	bvh->builtSahCost = stats.sahCost;
+	return stats;
+}
+
+static bool Splittable(const SpatialSplitContext& context, uint32_t primitive)
+{
+	return context.splittable == nullptr || context.splittable[primitive] != 0;
+}
+
+//The common part of two boxes, an empty box when they don't touch
+static BoundingBox Intersection(const BoundingBox& a, const BoundingBox& b)
+{
+	BoundingBox intersection;
+	intersection.min = glm::max(a.min, b.min);
+	intersection.max = glm::min(a.max, b.max);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (intersection.min[axis] > intersection.max[axis])
+		{
+			return BoundingBox();
+		}
+	}
+	return intersection;
+}
+
+//Clips the part of the triangle that is inside the bounds of 'reference' to either side of the
+//plane at 'position' along 'axis'. A side the triangle doesn't reach gets empty bounds.
+static void SplitReference(const SpatialSplitContext& context, const Reference& reference, int axis, float position, Reference* left, Reference* right)
+{
+	BoundingBox leftBounds;
+	BoundingBox rightBounds;
+	const glm::vec3* triangle = &context.vertices[reference.primitive * 3];
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& a = triangle[i];
+		const glm::vec3& b = triangle[(i + 1) % 3];
+		if (a[axis] <= position)
+		{
+			leftBounds.Grow(a);
+		}
+		if (a[axis] >= position)
+		{
+			rightBounds.Grow(a);
+		}
+		//Where the edge crosses the plane
+		if ((a[axis] < position && position < b[axis]) || (b[axis] < position && position < a[axis]))
+		{
+			const float t = glm::clamp((position - a[axis]) / (b[axis] - a[axis]), 0.0f, 1.0f);
+			glm::vec3 point = glm::mix(a, b, t);
+			point[axis] = position;
+			leftBounds.Grow(point);
+			rightBounds.Grow(point);
+		}
+	}
+	left->bounds = Intersection(leftBounds, reference.bounds);
+	left->centroid = left->bounds.Center();
+	left->primitive = reference.primitive;
+	right->bounds = Intersection(rightBounds, reference.bounds);
+	right->centroid = right->bounds.Center();
+	right->primitive = reference.primitive;
+}
+
+static bool Empty(const BoundingBox& box)
+{
+	return box.min.x > box.max.x;
+}
+
+static float SplitPlane(const BoundingBox& nodeBounds, const glm::vec3& binScale, int axis, uint32_t split)
+{
+	return nodeBounds.min[axis] + (split + 1) / binScale[axis];
+}
+
+//Bins a reference along all three axes, bins[axis * numBins + i]. A triangle that may be split is
+//clipped to every bin it overlaps, the others go whole into the bin of their centroid.
+static void BinReference(const SpatialSplitContext& context, const Reference& reference, const BoundingBox& nodeBounds, const glm::vec3& binScale, uint32_t numBins, SpatialBin* bins)
+{
+	const bool splittable = Splittable(context, reference.primitive);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (binScale[axis] == 0.0f)
+		{
+			continue;
+		}
+		SpatialBin* axisBins = &bins[axis * numBins];
+		if (!splittable)
+		{
+			SpatialBin& bin = axisBins[BinIndex(reference.centroid[axis], nodeBounds.min[axis], binScale[axis], numBins)];
+			bin.bounds.Grow(reference.bounds);
+			bin.entries++;
+			bin.exits++;
+			continue;
+		}
+		const uint32_t firstBin = BinIndex(reference.bounds.min[axis], nodeBounds.min[axis], binScale[axis], numBins);
+		const uint32_t lastBin = BinIndex(reference.bounds.max[axis], nodeBounds.min[axis], binScale[axis], numBins);
+		Reference rest = reference;
+		for (uint32_t i = firstBin; i < lastBin && !Empty(rest.bounds); i++)
+		{
+			Reference left;
+			Reference right;
+			SplitReference(context, rest, axis, SplitPlane(nodeBounds, binScale, axis, i), &left, &right);
+			axisBins[i].bounds.Grow(left.bounds);
+			rest = right;
+		}
+		axisBins[lastBin].bounds.Grow(rest.bounds);
+		axisBins[firstBin].entries++;
+		axisBins[lastBin].exits++;
+	}
+}
+
+static void FillSpatialBins(const SpatialSplitContext& context, const std::vector<Reference>& references, const BoundingBox& nodeBounds, const glm::vec3& binScale, uint32_t numBins, SpatialBin* bins)
+{
+	const uint32_t count = uint32_t(references.size());
+	auto fillBins = [&](uint32_t begin, uint32_t end, SpatialBin* b)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			BinReference(context, references[i], nodeBounds, binScale, numBins, b);
+		}
+	};
+	
+	if (count < PARALLEL_RANGE_SIZE)
+	{
+		fillBins(0, count, bins);
+		return;
+	}
+	const uint32_t numChunks = (count + PARALLEL_RANGE_SIZE - 1) / PARALLEL_RANGE_SIZE;
+	std::vector<SpatialBin> chunkBins(numChunks * 3 * numBins);
+	context.threadPool->ParallelFor(0, numChunks, 1, [&](uint32_t chunk)
+	{
+		uint32_t begin = chunk * PARALLEL_RANGE_SIZE;
+		fillBins(begin, std::min(begin + PARALLEL_RANGE_SIZE, count), &chunkBins[chunk * 3 * numBins]);
+	});
+	for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+	{
+		for (uint32_t i = 0; i < 3 * numBins; i++)
+		{
+			bins[i].bounds.Grow(chunkBins[chunk * 3 * numBins + i].bounds);
+			bins[i].entries += chunkBins[chunk * 3 * numBins + i].entries;
+			bins[i].exits += chunkBins[chunk * 3 * numBins + i].exits;
+		}
+	}
+}
+
+//Finds the cheapest plane between two bins of the node bounds on any axis. References that
+//straddle it count on both sides, and planes that straddle more than 'splitBudget' are skipped.
+static SpatialSplit FindSpatialSplit(const SpatialSplitContext& context, const std::vector<Reference>& references, const BoundingBox& bounds, uint32_t splitBudget)
+{
+	SpatialSplit best;
+	const uint32_t count = uint32_t(references.size());
+	const glm::vec3 extent = bounds.max - bounds.min;
+	best.numBins = NumBins(count);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		best.binScale[axis] = extent[axis] > 0.0f ? best.numBins / extent[axis] : 0.0f;
+	}
+	const uint32_t numBins = best.numBins;
+	SpatialBin bins[3 * MAX_BINS];
+	FillSpatialBins(context, references, bounds, best.binScale, numBins, bins);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (best.binScale[axis] == 0.0f)
+		{
+			continue;
+		}
+		const SpatialBin* axisBins = &bins[axis * numBins];
+		
+		float rightCosts[MAX_BINS];
+		uint32_t rightCounts[MAX_BINS];
+		BoundingBox rightBoxes[MAX_BINS];
+		BoundingBox rightBounds;
+		uint32_t rightCount = 0;
+		for (uint32_t i = numBins - 1; i > 0; i--)
+		{
+			rightBounds.Grow(axisBins[i].bounds);
+			rightCount += axisBins[i].exits;
+			rightCosts[i - 1] = rightBounds.SurfaceArea() * rightCount;
+			rightCounts[i - 1] = rightCount;
+			rightBoxes[i - 1] = rightBounds;
+		}
+		BoundingBox leftBounds;
+		uint32_t leftCount = 0;
+		for (uint32_t i = 0; i < numBins - 1; i++)
+		{
+			leftBounds.Grow(axisBins[i].bounds);
+			leftCount += axisBins[i].entries;
+			if (leftCount == 0 || rightCounts[i] == 0 || leftCount + rightCounts[i] - count > splitBudget)
+			{
+				continue;
+			}
+			float cost = leftBounds.SurfaceArea() * leftCount + rightCosts[i];
+			if (cost < best.cost)
+			{
+				best.cost = cost;
+				best.axis = axis;
+				best.split = i;
+				best.leftCount = leftCount;
+				best.rightCount = rightCounts[i];
+				best.leftBounds = leftBounds;
+				best.rightBounds = rightBoxes[i];
+			}
+		}
+	}
+	if (best.axis != -1)
+	{
+		best.position = SplitPlane(bounds, best.binScale, best.axis, best.split);
+	}
+	return best;
+}
+
+//Sorts the references to the sides of a spatial split, clipping the ones that straddle it. A
+//straddling reference is kept whole on one side instead when that is cheaper, which is how
+//Stich et al. keep the number of references down, so there are never more than the binning
+//counted. Returns false and leaves 'left' and 'right' empty when everything ended up on one side.
+static bool PartitionSpatially(const SpatialSplitContext& context, const std::vector<Reference>& references, const BoundingBox& bounds, const SpatialSplit& split, std::vector<Reference>* left, std::vector<Reference>* right)
+{
+	const int axis = split.axis;
+	const float binMin = bounds.min[axis];
+	const float axisBinScale = split.binScale[axis];
+	BoundingBox leftBounds = split.leftBounds;
+	BoundingBox rightBounds = split.rightBounds;
+	uint32_t leftCount = split.leftCount;
+	uint32_t rightCount = split.rightCount;
+	left->reserve(leftCount);
+	right->reserve(rightCount);
+	for (const Reference& reference : references)
+	{
+		if (!Splittable(context, reference.primitive))
+		{
+			if (BinIndex(reference.centroid[axis], binMin, axisBinScale, split.numBins) <= split.split)
+			{
+				left->push_back(reference);
+			}
+			else
+			{
+				right->push_back(reference);
+			}
+			continue;
+		}
+		if (BinIndex(reference.bounds.max[axis], binMin, axisBinScale, split.numBins) <= split.split)
+		{
+			left->push_back(reference);
+			continue;
+		}
+		if (BinIndex(reference.bounds.min[axis], binMin, axisBinScale, split.numBins) > split.split)
+		{
+			right->push_back(reference);
+			continue;
+		}
+		
+		BoundingBox leftGrown = leftBounds;
+		leftGrown.Grow(reference.bounds);
+		BoundingBox rightGrown = rightBounds;
+		rightGrown.Grow(reference.bounds);
+		const float splitCost = leftBounds.SurfaceArea() * leftCount + rightBounds.SurfaceArea() * rightCount;
+		const float leftCost = leftGrown.SurfaceArea() * leftCount + rightBounds.SurfaceArea() * (rightCount - 1);
+		const float rightCost = leftBounds.SurfaceArea() * (leftCount - 1) + rightGrown.SurfaceArea() * rightCount;
+		Reference leftPart;
+		Reference rightPart;
+		if (splitCost <= leftCost && splitCost <= rightCost)
+		{
+			SplitReference(context, reference, axis, split.position, &leftPart, &rightPart);
+		}
+		if (leftCost < splitCost && leftCost <= rightCost)
+		{
+			left->push_back(reference);
+			leftBounds = leftGrown;
+			rightCount--;
+		}
+		else if (rightCost < splitCost)
+		{
+			right->push_back(reference);
+			rightBounds = rightGrown;
+			leftCount--;
+		}
+		//Rounding can leave one side of the plane without any of the triangle
+		else if (Empty(leftPart.bounds))
+		{
+			right->push_back(reference);
+		}
+		else if (Empty(rightPart.bounds))
+		{
+			left->push_back(reference);
+		}
+		else
+		{
+			left->push_back(leftPart);
+			right->push_back(rightPart);
+		}
+	}
+	
+	if (left->empty() || right->empty())
+	{
+		left->clear();
+		right->clear();
+		return false;
+	}
+	return true;
+}
+
+static void MakeSpatialLeaf(SpatialSplitContext& context, BvhNode* node, const std::vector<Reference>& references)
+{
+	const uint32_t count = uint32_t(references.size());
+	const uint32_t first = context.numReferences.fetch_add(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		context.bvh->primitives[first + i] = references[i].primitive;
+	}
+	node->leftOrFirst = first;
+	node->count = count;
+	context.numLeaves++;
+}
+
+//Like BuildNode, but a node owns its references since spatial splits make more of them. They are
+//freed once the node has handed them to its children. 'splitBudget' is how many references the
+//subtree may add. What a node doesn't use is shared by its children by how many references they
+//get, so the splits near the root can't use it all up.
+static void BuildSpatialNode(SpatialSplitContext& context, uint32_t nodeIndex, std::vector<Reference>& references, uint32_t splitBudget, uint32_t depth)
+{
+	uint32_t maxDepth = context.maxDepth;
+	while (depth > maxDepth && !context.maxDepth.compare_exchange_weak(maxDepth, depth));
+	
+	const uint32_t count = uint32_t(references.size());
+	BoundingBox bounds;
+	BoundingBox centroidBounds;
+	RangeBounds(references.data(), count, *context.threadPool, &bounds, &centroidBounds);
+	BvhNode* node = &context.bvh->nodes[nodeIndex];
+	node->boundsMin = bounds.min;
+	node->boundsMax = bounds.max;
+	if (count == 1 || depth == BVH_MAX_DEPTH - 1)
+	{
+		MakeSpatialLeaf(context, node, references);
+		return;
+	}
+	
+	const ObjectSplit objectSplit = FindObjectSplit(references.data(), count, centroidBounds, *context.threadPool);
+	//Spatial splits only pay for their references where the children of the object split overlap
+	SpatialSplit spatialSplit;
+	if (splitBudget > 0 && (objectSplit.axis == -1 || Intersection(objectSplit.leftBounds, objectSplit.rightBounds).SurfaceArea() > context.minOverlapArea))
+	{
+		spatialSplit = FindSpatialSplit(context, references, bounds, splitBudget);
+	}
+	const float bestCost = std::min(objectSplit.cost, spatialSplit.cost);
+	if (bestCost == FLT_MAX ? count <= BVH_MAX_LEAF_SIZE : MakesLeaf(count, bounds, bestCost))
+	{
+		MakeSpatialLeaf(context, node, references);
+		return;
+	}
+	
+	std::vector<Reference> leftReferences;
+	std::vector<Reference> rightReferences;
+	if (spatialSplit.cost >= objectSplit.cost || !PartitionSpatially(context, references, bounds, spatialSplit, &leftReferences, &rightReferences))
+	{
+		//Halved when every centroid is in the same spot, like in BuildNode
+		const uint32_t leftCount = objectSplit.axis == -1 ? count / 2 : PartitionObjects(references.data(), count, objectSplit, centroidBounds);
+		leftReferences.assign(references.begin(), references.begin() + leftCount);
+		rightReferences.assign(references.begin() + leftCount, references.end());
+	}
+	std::vector<Reference>().swap(references);
+	const uint32_t numChildReferences = uint32_t(leftReferences.size() + rightReferences.size());
+	splitBudget -= numChildReferences - count;
+	const uint32_t leftBudget = uint32_t(uint64_t(splitBudget) * leftReferences.size() / numChildReferences);
+	const uint32_t rightBudget = splitBudget - leftBudget;
+	
+	const uint32_t left = context.numNodes.fetch_add(2);
+	node->leftOrFirst = left;
+	node->count = 0;
+	if (count > PARALLEL_SUBTREE_SIZE)
+	{
+		TaskGroup leftTask;
+		context.threadPool->Enqueue(&leftTask, [&context, &leftReferences, left, leftBudget, depth]()
+		{
+			BuildSpatialNode(context, left, leftReferences, leftBudget, depth + 1);
+		});
+		BuildSpatialNode(context, left + 1, rightReferences, rightBudget, depth + 1);
+		context.threadPool->Wait(&leftTask);
+	}
+	else
+	{
+		BuildSpatialNode(context, left, leftReferences, leftBudget, depth + 1);
+		BuildSpatialNode(context, left + 1, rightReferences, rightBudget, depth + 1);
+	}
+}
+
+BvhBuildStats BuildSpatialSplitBvh(const std::vector<glm::vec3>& vertices, const std::vector<uint8_t>& splittable, float splitBudget, ThreadPool& threadPool, Bvh* bvh)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	const uint32_t numTriangles = uint32_t(vertices.size() / 3);
+	std::vector<Reference> references(numTriangles);
+	threadPool.ParallelFor(0, numTriangles, PARALLEL_RANGE_SIZE, [&](uint32_t i)
+	{
+		for (uint32_t corner = i * 3; corner < i * 3 + 3; corner++)
+		{
+			references[i].bounds.Grow(vertices[corner]);
+		}
+		references[i].centroid = references[i].bounds.Center();
+		references[i].primitive = i;
+	});
+	
+	SpatialSplitContext context;
+	context.vertices = vertices.data();
+	context.splittable = splittable.empty() ? nullptr : splittable.data();
+	context.numReferences = 0;
+	context.bvh = bvh;
+	context.numNodes = 1;
+	context.numLeaves = 0;
+	context.maxDepth = 0;
+	context.threadPool = &threadPool;
+	const uint32_t maxSplitReferences = uint32_t(std::max(splitBudget, 0.0f) * numTriangles);
+	const uint32_t maxReferences = numTriangles + maxSplitReferences;
+	
+	bvh->nodes.clear();
+	BvhBuildStats stats;
+	if (numTriangles > 0)
+	{
+		BoundingBox rootBounds;
+		BoundingBox rootCentroidBounds;
+		RangeBounds(references.data(), numTriangles, threadPool, &rootBounds, &rootCentroidBounds);
+		context.minOverlapArea = SPATIAL_SPLIT_MIN_OVERLAP * rootBounds.SurfaceArea();
+		bvh->nodes.resize(maxReferences * 2 - 1);
+		bvh->primitives.resize(maxReferences);
+		BuildSpatialNode(context, 0, references, maxSplitReferences, 0);
+		bvh->nodes.resize(context.numNodes);
+		bvh->nodes.shrink_to_fit();
+		bvh->primitives.resize(context.numReferences);
+		bvh->primitives.shrink_to_fit();
+		stats.numNodes = context.numNodes;
+		stats.numLeaves = context.numLeaves;
+		stats.maxDepth = context.maxDepth;
+		stats.numReferences = context.numReferences;
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.buildTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	stats.sahCost = BvhSahCost(*bvh);
+	bvh->builtSahCost = stats.sahCost;
+	return stats;
+}
+
+//Surface area times the cost of testing what the node holds, summed over the nodes and divided
+//by the area of the root it is the SAH cost
+static double NodeSahCost(const BvhNode& node)
+{
+	BoundingBox bounds;
+	bounds.min = node.boundsMin;
+	bounds.max = node.boundsMax;
+	return bounds.SurfaceArea() * (node.count == 0 ? BVH_TRAVERSAL_COST : BVH_INTERSECTION_COST * node.count);
+}
+
+static float NormalizeSahCost(const Bvh& bvh, double cost)
+{
+	BoundingBox root;
+	root.min = bvh.nodes[0].boundsMin;
+	root.max = bvh.nodes[0].boundsMax;
+	const float rootArea = root.SurfaceArea();
+	if (!(rootArea > 0.0f))
+	{
+		return BVH_INTERSECTION_COST * bvh.primitives.size();
+	}
+	return float(cost / rootArea);
+}
+
+float BvhSahCost(const Bvh& bvh)
+{
+	if (bvh.nodes.empty())
+	{
+		return 0.0f;
+	}
+	double cost = 0.0;
+	for (const BvhNode& node : bvh.nodes)
+	{
+		cost += NodeSahCost(node);
+	}
+	return NormalizeSahCost(bvh, cost);
+}
+
+struct RefitContext
+{
+	const BoundingBox* primitiveBounds;
+	Bvh* bvh;
+	uint32_t parallelDepth;
+	ThreadPool* threadPool;
+};
+
+//Sets the bounds of the subtree at 'nodeIndex' from its leaves up, and returns its part of the SAH cost
+static double RefitNode(RefitContext& context, uint32_t nodeIndex, uint32_t depth)
+{
+	BvhNode& node = context.bvh->nodes[nodeIndex];
+	BoundingBox bounds;
+	double cost = 0.0;
+	if (node.count > 0)
+	{
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			bounds.Grow(context.primitiveBounds[context.bvh->primitives[i]]);
+		}
+	}
+	else
+	{
+		const uint32_t left = node.leftOrFirst;
+		if (depth < context.parallelDepth)
+		{
+			double leftCost = 0.0;
+			TaskGroup leftTask;
+			context.threadPool->Enqueue(&leftTask, [&context, &leftCost, left, depth]()
+			{
+				leftCost = RefitNode(context, left, depth + 1);
+			});
+			cost = RefitNode(context, left + 1, depth + 1);
+			context.threadPool->Wait(&leftTask);
+			cost += leftCost;
+		}
+		else
+		{
+			cost = RefitNode(context, left, depth + 1) + RefitNode(context, left + 1, depth + 1);
+		}
+		const BvhNode* children = &context.bvh->nodes[left];
+		bounds.min = glm::min(children[0].boundsMin, children[1].boundsMin);
+		bounds.max = glm::max(children[0].boundsMax, children[1].boundsMax);
+	}
+	node.boundsMin = bounds.min;
+	node.boundsMax = bounds.max;
+	return cost + NodeSahCost(node);
+}
+
+BvhRefitStats RefitBvh(const std::vector<BoundingBox>& primitiveBounds, ThreadPool& threadPool, Bvh* bvh)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	BvhRefitStats stats;
+	stats.builtSahCost = bvh->builtSahCost;
+	if (!bvh->nodes.empty())
+	{
+		RefitContext context;
+		context.primitiveBounds = primitiveBounds.data();
+		context.bvh = bvh;
+		context.parallelDepth = bvh->nodes.size() >= PARALLEL_REFIT_NODES ? PARALLEL_REFIT_DEPTH : 0;
+		context.threadPool = &threadPool;
+		stats.sahCost = NormalizeSahCost(*bvh, RefitNode(context, 0, 0));
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.refitTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return stats;
+}
+
+BvhRefitStats RefitOrRebuildBvh(const std::vector<BoundingBox>& primitiveBounds, float rebuildThreshold, ThreadPool& threadPool, Bvh* bvh, BvhBuilder builder)
+{
+	BvhRefitStats stats;
+	if (rebuildThreshold > 0.0f)
+	{
+		stats = RefitBvh(primitiveBounds, threadPool, bvh);
+		if (stats.sahCost <= rebuildThreshold * stats.builtSahCost)
+		{
+			return stats;
+		}
+	}
+	const BvhBuildStats buildStats = builder == BVH_BUILDER_SAH ? BuildBvh(primitiveBounds, threadPool, bvh) : BuildLinearBvh(primitiveBounds, builder == BVH_BUILDER_LINEAR_TREELETS, threadPool, bvh);
+	stats.rebuilt = true;
+	stats.rebuildTime = buildStats.buildTime;
+	stats.sahCost = buildStats.sahCost;
+	stats.builtSahCost = buildStats.sahCost;
+	return stats;
+}
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
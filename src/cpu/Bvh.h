@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <float.h>
+#include "glm/vec3.hpp"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+struct BoundingBox
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+	
+	void Grow(const glm::vec3& point);
+	void Grow(const BoundingBox& box);
+	glm::vec3 Center() const;
+	//0 for an empty box
+	float SurfaceArea() const;
+};
+
+//32 bytes. An inner node has count = 0 and its children at 'leftOrFirst' and 'leftOrFirst' + 1.
+//A leaf holds 'count' primitives, starting at 'leftOrFirst' in Bvh::primitives.
+struct BvhNode
+{
+	glm::vec3 boundsMin;
+	uint32_t leftOrFirst;
+	glm::vec3 boundsMax;
+	uint32_t count;
+};
+
+//Binary bounding volume hierarchy over primitives given by their bounding boxes. The root is nodes[0].
+struct Bvh
+{
+	std::vector<BvhNode> nodes;
+	//Primitive indices in leaf order
+	std::vector<uint32_t> primitives;
+	//SAH cost of the tree as it was built. Refits keep the tree and only ever make it worse.
+	float builtSahCost = 0.0f;
+};
+
+struct BvhBuildStats
+{
+	float buildTime = 0.0f; //ms
+	uint32_t numNodes = 0;
+	uint32_t numLeaves = 0;
+	uint32_t maxDepth = 0;
+	float sahCost = 0.0f;
+	//Entries in Bvh::primitives, more than there are primitives when spatial splits made some of them
+	//appear in several leaves
+	uint32_t numReferences = 0;
+};
+
+struct BvhRefitStats
+{
+	float refitTime = 0.0f; //ms
+	//After the refit, and of the tree as it was built
+	float sahCost = 0.0f;
+	float builtSahCost = 0.0f;
+	//Set when the refit made the tree too slow and it was built again
+	bool rebuilt = false;
+	float rebuildTime = 0.0f; //ms
+};
+
+//Cost model of the builder and of BvhSahCost, relative to one primitive intersection
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_INTERSECTION_COST = 1.0f;
+//Leaves are only made larger than this when the primitives can't be told apart
+const uint32_t BVH_MAX_LEAF_SIZE = 8;
+//No path from the root is longer, which bounds the traversal stacks. Deeper nodes become leaves.
+const uint32_t BVH_MAX_DEPTH = 64;
+//A refitted tree is built again once its SAH cost is this many times the cost it was built with.
+//Rays slow down about as much as the cost grows, see test_scripts/BvhRefit.
+const float DEFAULT_BVH_REBUILD_THRESHOLD = 1.2f;
+
+//How RefitOrRebuildBvh builds a tree again
+enum BvhBuilder
+{
+	//BuildBvh
+	BVH_BUILDER_SAH,
+	//BuildLinearBvh, which builds faster and traces slower, for scenes rebuilt every frame
+	BVH_BUILDER_LINEAR,
+	//BuildLinearBvh with treelet reordering
+	BVH_BUILDER_LINEAR_TREELETS
+};
+
+//Binned SAH build. Subtrees are built as tasks on the thread pool, and the binning and bounds
+//of the large nodes near the root are computed in parallel too.
+BvhBuildStats BuildBvh(const std::vector<BoundingBox>& primitiveBounds, ThreadPool& threadPool, Bvh* bvh);
+//Binned SAH build over triangles, three 'vertices' each, that also tries splitting the space of a node
+//where the children of its best object split overlap. Triangles straddling such a split are clipped
+//to both sides and referenced from both, see Stich, Friedrich and Dietrich, "Spatial Splits in
+//Bounding Volume Hierarchies", 2009. It pays off on long, thin triangles whose boxes are mostly
+//empty. At most 'splitBudget' times as many references as there are triangles are added. Every
+//subtree gets a share of the budget by how many references it has, and uses object splits once it
+//is spent. Only triangles with a nonzero entry in 'splittable' are split, or all of them when it
+//is empty. A primitive may appear in more than one leaf, and the
+//leaves hold the bounds of the clipped parts. Refits grow them back to whole triangles, which is
+//usually slower than an object split tree, so RefitOrRebuildBvh soon builds it again with object
+//splits only. In the two-level layout moving instances only refits the top level, and the meshes
+//keep their spatial splits.
+BvhBuildStats BuildSpatialSplitBvh(const std::vector<glm::vec3>& vertices, const std::vector<uint8_t>& splittable, float splitBudget, ThreadPool& threadPool, Bvh* bvh);
+//Expected cost of a random ray hitting the root, under the cost model above
+float BvhSahCost(const Bvh& bvh);
+//Computes the bounds of every node again, bottom-up, from new bounds of the same primitives. The
+//tree stays the same, so primitives that moved apart make it slower. Subtrees near the root are
+//refit as tasks on the thread pool.
+BvhRefitStats RefitBvh(const std::vector<BoundingBox>& primitiveBounds, ThreadPool& threadPool, Bvh* bvh);
+//Refits, then builds the tree again with 'builder' when its SAH cost has grown past 'rebuildThreshold'
+//times the cost it was built with. A threshold of 0 or less always builds it again, without
+//refitting first.
+BvhRefitStats RefitOrRebuildBvh(const std::vector<BoundingBox>& primitiveBounds, float rebuildThreshold, ThreadPool& threadPool, Bvh* bvh, BvhBuilder builder = BVH_BUILDER_SAH);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
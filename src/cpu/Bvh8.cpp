@@ -0,0 +1,287 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include "Bvh8.h"
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+//Refits run the children of the wide nodes this close to the root as tasks, in trees with enough
+//nodes to be worth it
+static const uint32_t PARALLEL_REFIT_DEPTH = 3;
+static const uint32_t PARALLEL_REFIT_NODES = 1024;
+
+static float NodeSurfaceArea(const BvhNode& node)
+{
+	BoundingBox bounds;
+	bounds.min = node.boundsMin;
+	bounds.max = node.boundsMax;
+	return bounds.SurfaceArea();
+}
+
+static void ClearNode(Bvh8Node* node)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		node->bounds[BVH8_MIN_X][i] = FLT_MAX;
+		node->bounds[BVH8_MIN_Y][i] = FLT_MAX;
+		node->bounds[BVH8_MIN_Z][i] = FLT_MAX;
+		node->bounds[BVH8_MAX_X][i] = -FLT_MAX;
+		node->bounds[BVH8_MAX_Y][i] = -FLT_MAX;
+		node->bounds[BVH8_MAX_Z][i] = -FLT_MAX;
+		node->child[i] = BVH8_EMPTY;
+		node->count[i] = 0;
+	}
+}
+
+static void SetChildBounds(Bvh8Node* node, int slot, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	node->bounds[BVH8_MIN_X][slot] = boundsMin.x;
+	node->bounds[BVH8_MIN_Y][slot] = boundsMin.y;
+	node->bounds[BVH8_MIN_Z][slot] = boundsMin.z;
+	node->bounds[BVH8_MAX_X][slot] = boundsMax.x;
+	node->bounds[BVH8_MAX_Y][slot] = boundsMax.y;
+	node->bounds[BVH8_MAX_Z][slot] = boundsMax.z;
+}
+
+static void SetChild(Bvh8Node* node, int slot, const BvhNode& child)
+{
+	SetChildBounds(node, slot, child.boundsMin, child.boundsMax);
+}
+
+//Quantizes the planes of one axis of 'node' with the scale 2^exponent. Returns false if a child
+//doesn't fit in 255 steps.
+static bool QuantizeAxis(const Bvh8Node& node, int axis, float origin, int exponent, Bvh8QuantizedNode* quantized)
+{
+	const float scale = std::ldexp(1.0f, exponent);
+	for (int i = 0; i < 8 && node.child[i] != BVH8_EMPTY; i++)
+	{
+		const float boundsMin = node.bounds[BVH8_MIN_X + axis][i];
+		const float boundsMax = node.bounds[BVH8_MAX_X + axis][i];
+		float low = std::floor((boundsMin - origin) / scale);
+		float high = std::ceil((boundsMax - origin) / scale);
+		//The divisions round, so step outwards until the planes hold the child
+		low = std::max(low, 0.0f);
+		while (low > 0.0f && origin + low * scale > boundsMin)
+		{
+			low--;
+		}
+		while (high <= 255.0f && origin + high * scale < boundsMax)
+		{
+			high++;
+		}
+		if (high > 255.0f)
+		{
+			return false;
+		}
+		quantized->bounds[BVH8_MIN_X + axis][i] = uint8_t(low);
+		quantized->bounds[BVH8_MAX_X + axis][i] = uint8_t(std::max(high, low));
+	}
+	return true;
+}
+
+static void QuantizeNode(const Bvh8Node& node, Bvh8QuantizedNode* quantized)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		quantized->child[i] = node.child[i];
+		//A wrapped count would turn a leaf into an inner node
+		assert(node.count[i] <= UINT16_MAX);
+		quantized->count[i] = uint16_t(node.count[i]);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			quantized->bounds[BVH8_MIN_X + axis][i] = 255;
+			quantized->bounds[BVH8_MAX_X + axis][i] = 0;
+		}
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float boundsMin = FLT_MAX;
+		float boundsMax = -FLT_MAX;
+		for (int i = 0; i < 8 && node.child[i] != BVH8_EMPTY; i++)
+		{
+			boundsMin = std::min(boundsMin, node.bounds[BVH8_MIN_X + axis][i]);
+			boundsMax = std::max(boundsMax, node.bounds[BVH8_MAX_X + axis][i]);
+		}
+		//The smallest power of two that spans the node in 255 steps, or one more when rounding
+		//pushes a plane past the last step
+		int exponent = 0;
+		std::frexp((boundsMax - boundsMin) / 255.0f, &exponent);
+		exponent = std::max(exponent, BVH8_MIN_EXPONENT);
+		while (!QuantizeAxis(node, axis, boundsMin, exponent, quantized))
+		{
+			exponent++;
+		}
+		quantized->origin[axis] = boundsMin;
+		quantized->exponent[axis] = int8_t(exponent);
+	}
+}
+
+//Fills the wide node at 'wideIndex' from the inner binary node at 'binaryIndex'
+static void CollapseNode(const Bvh& bvh, uint32_t binaryIndex, uint32_t wideIndex, uint32_t depth, Bvh8* wideBvh, Bvh8Stats* stats)
+{
+	stats->maxDepth = std::max(stats->maxDepth, depth);
+	uint32_t children[8];
+	int numChildren = 2;
+	children[0] = bvh.nodes[binaryIndex].leftOrFirst;
+	children[1] = bvh.nodes[binaryIndex].leftOrFirst + 1;
+	while (numChildren < 8)
+	{
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (int i = 0; i < numChildren; i++)
+		{
+			const BvhNode& child = bvh.nodes[children[i]];
+			if (child.count == 0 && NodeSurfaceArea(child) > largestArea)
+			{
+				largest = i;
+				largestArea = NodeSurfaceArea(child);
+			}
+		}
+		if (largest == -1)
+		{
+			break;
+		}
+		const uint32_t opened = children[largest];
+		children[largest] = bvh.nodes[opened].leftOrFirst;
+		children[numChildren++] = bvh.nodes[opened].leftOrFirst + 1;
+	}
+	
+	//'nodes' may grow below, so the node is filled through its index
+	ClearNode(&wideBvh->nodes[wideIndex]);
+	for (int i = 0; i < numChildren; i++)
+	{
+		const BvhNode& child = bvh.nodes[children[i]];
+		SetChild(&wideBvh->nodes[wideIndex], i, child);
+		if (child.count > 0)
+		{
+			wideBvh->nodes[wideIndex].child[i] = child.leftOrFirst;
+			wideBvh->nodes[wideIndex].count[i] = child.count;
+		}
+		else
+		{
+			const uint32_t childWideIndex = uint32_t(wideBvh->nodes.size());
+			wideBvh->nodes.push_back(Bvh8Node());
+			wideBvh->nodes[wideIndex].child[i] = childWideIndex;
+			wideBvh->nodes[wideIndex].count[i] = 0;
+			CollapseNode(bvh, children[i], childWideIndex, depth + 1, wideBvh, stats);
+		}
+	}
+	stats->averageChildren += numChildren;
+}
+
+Bvh8Stats CollapseBvh(const Bvh& bvh, Bvh8* wideBvh)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	Bvh8Stats stats;
+	wideBvh->nodes.clear();
+	wideBvh->primitives = bvh.primitives;
+	if (!bvh.nodes.empty())
+	{
+		//Every wide node holds at least two binary children
+		wideBvh->nodes.reserve(bvh.nodes.size() / 2 + 1);
+		wideBvh->nodes.push_back(Bvh8Node());
+		if (bvh.nodes[0].count > 0)
+		{
+			//A single leaf
+			ClearNode(&wideBvh->nodes[0]);
+			SetChild(&wideBvh->nodes[0], 0, bvh.nodes[0]);
+			wideBvh->nodes[0].child[0] = bvh.nodes[0].leftOrFirst;
+			wideBvh->nodes[0].count[0] = bvh.nodes[0].count;
+			stats.averageChildren = 1.0f;
+		}
+		else
+		{
+			CollapseNode(bvh, 0, 0, 0, wideBvh, &stats);
+		}
+		wideBvh->nodes.shrink_to_fit();
+		stats.numNodes = uint32_t(wideBvh->nodes.size());
+		stats.averageChildren /= stats.numNodes;
+	}
+	wideBvh->quantizedNodes.resize(wideBvh->nodes.size());
+	for (size_t i = 0; i < wideBvh->nodes.size(); i++)
+	{
+		QuantizeNode(wideBvh->nodes[i], &wideBvh->quantizedNodes[i]);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.collapseTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return stats;
+}
+
+
+//Sets the child bounds of the wide node at 'nodeIndex' and of the nodes below it, and returns its bounds
+static BoundingBox RefitNode(const BoundingBox* primitiveBounds, uint32_t nodeIndex, uint32_t depth, uint32_t parallelDepth, ThreadPool& threadPool, Bvh8* wideBvh)
+{
+	Bvh8Node& node = wideBvh->nodes[nodeIndex];
+	BoundingBox childBounds[8];
+	TaskGroup childTasks;
+	for (int i = 0; i < 8 && node.child[i] != BVH8_EMPTY; i++)
+	{
+		if (node.count[i] > 0)
+		{
+			for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i]; p++)
+			{
+				childBounds[i].Grow(primitiveBounds[wideBvh->primitives[p]]);
+			}
+		}
+		else if (depth < parallelDepth)
+		{
+			const uint32_t child = node.child[i];
+			BoundingBox* bounds = &childBounds[i];
+			threadPool.Enqueue(&childTasks, [primitiveBounds, child, depth, parallelDepth, &threadPool, wideBvh, bounds]()
+			{
+				*bounds = RefitNode(primitiveBounds, child, depth + 1, parallelDepth, threadPool, wideBvh);
+			});
+		}
+		else
+		{
+			childBounds[i] = RefitNode(primitiveBounds, node.child[i], depth + 1, parallelDepth, threadPool, wideBvh);
+		}
+	}
+	threadPool.Wait(&childTasks);
+	
+	BoundingBox bounds;
+	for (int i = 0; i < 8 && node.child[i] != BVH8_EMPTY; i++)
+	{
+		SetChildBounds(&node, i, childBounds[i].min, childBounds[i].max);
+		bounds.Grow(childBounds[i]);
+	}
+	QuantizeNode(node, &wideBvh->quantizedNodes[nodeIndex]);
+	return bounds;
+}
+
+void RefitBvh8(const std::vector<BoundingBox>& primitiveBounds, ThreadPool& threadPool, Bvh8* wideBvh)
+{
+	if (!wideBvh->nodes.empty())
+	{
+		const uint32_t parallelDepth = wideBvh->nodes.size() >= PARALLEL_REFIT_NODES ? PARALLEL_REFIT_DEPTH : 0;
+		RefitNode(primitiveBounds.data(), 0, 0, parallelDepth, threadPool, wideBvh);
+	}
+}
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef BVH8_H
+#define BVH8_H
+
+#include "Bvh.h"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+//Axis of the child bounds, bounds[BVH8_MIN_X][i] is the minimum x of child i
+enum Bvh8Bound
+{
+	BVH8_MIN_X,
+	BVH8_MIN_Y,
+	BVH8_MIN_Z,
+	BVH8_MAX_X,
+	BVH8_MAX_Y,
+	BVH8_MAX_Z
+};
+
+//256 bytes, the bounds of all eight children stored as SoA so they can be tested at once.
+//Children are packed to the front. Unused slots have inverted, infinite bounds that no ray hits
+//and a count of 0 and child index of BVH8_EMPTY.
+//A child with count = 0 is an inner node at 'child' in Bvh8::nodes. Otherwise it's a leaf of 'count'
+//primitives, starting at 'child' in Bvh8::primitives.
+struct Bvh8Node
+{
+	float bounds[6][8];
+	uint32_t child[8];
+	uint32_t count[8];
+};
+
+const uint32_t BVH8_EMPTY = 0xffffffff;
+
+//112 bytes, a Bvh8Node with the child bounds stored in 8 bits per plane. On each axis the planes are
+//origin + q * 2^exponent, where the origin is the minimum of the node's own bounds. They are rounded
+//outwards, so every child is inside its quantized bounds, and q * 2^exponent is exact so a traversal
+//kernel computes the same planes. Unused slots have bounds of 255 to 0, which no ray hits.
+//Counts take 16 bits, since the builders make a leaf of whatever is left at BVH_MAX_DEPTH.
+struct Bvh8QuantizedNode
+{
+	float origin[3];
+	uint8_t bounds[6][8];
+	int8_t exponent[3];
+	uint32_t child[8];
+	uint16_t count[8];
+};
+
+//The root is nodes[0]
+struct Bvh8
+{
+	std::vector<Bvh8Node> nodes;
+	//The same nodes quantized, kept up to date with 'nodes'
+	std::vector<Bvh8QuantizedNode> quantizedNodes;
+	//Primitive indices in leaf order
+	std::vector<uint32_t> primitives;
+};
+
+struct Bvh8Stats
+{
+	float collapseTime = 0.0f; //ms
+	uint32_t numNodes = 0;
+	//Average number of used child slots
+	float averageChildren = 0.0f;
+	uint32_t maxDepth = 0;
+};
+
+//Lowest exponent of a Bvh8QuantizedNode, so 2^exponent is a normal float
+const int BVH8_MIN_EXPONENT = -126;
+
+//Turns a binary BVH into an 8-wide one. Each wide node takes in the children of a binary node,
+//then keeps opening up the inner child with the largest surface area until eight are reached.
+//The leaves, and so the primitive order, stay the same. Also quantizes the nodes.
+Bvh8Stats CollapseBvh(const Bvh& bvh, Bvh8* wideBvh);
+//Computes the child bounds of every node again from new bounds of the same primitives, like RefitBvh.
+//The leaves of the wide tree are read directly, so it doesn't need the binary tree to be refit first.
+//The quantized nodes are refit too.
+void RefitBvh8(const std::vector<BoundingBox>& primitiveBounds, ThreadPool& threadPool, Bvh8* wideBvh);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
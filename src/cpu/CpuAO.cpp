@@ -0,0 +1,439 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+A CPU port of the AO pass, shaders/ao/primary.rgen. Either traces the rays the way the shader does,
+pixel by pixel, or as ray streams: the rays of a batch of pixels are sorted so that rays going the
+same way from nearby points are traced one after the other, in packets, and their hits are
+scattered back to the pixels. Both give the same image, but for the rounding of the packet
+triangle test. The rays end where a hit would hardly add to the occlusion anymore, rather than at
+the tMax of the shader.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include "CpuAO.h"
+#include "glm/geometric.hpp"
+#include "glm/mat3x3.hpp"
+#include "glm/mat4x4.hpp"
+#include "RayPacket.h"
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#include "stb/stb_image.h"
+
+//Same as in ao/primary.rgen
+static const float T_MIN = 0.0f;
+static const float T_MAX = 100.0f;
+static const int NUM_OCCLUSION_SAMPLES = 8;
+static const int TOTAL_OCCLUSION_SAMPLES = NUM_OCCLUSION_SAMPLES * NUM_OCCLUSION_SAMPLES;
+static const uint32_t BLUE_NOISE_IMAGE_SIZE = 64;
+static const float TWO_PI = 6.2831853071795865f;
+static const float GOLDEN_RATIO = 1.61803398875f;
+
+static const float SAMPLE_POINTS[TOTAL_OCCLUSION_SAMPLES][2] =
+{
+	{0.869141f, 0.657227f}, {0.379883f, 0.838867f}, {0.349609f, 0.327148f}, {0.610352f, 0.965820f},
+	{0.652344f, 0.242188f}, {0.127930f, 0.654297f}, {0.803711f, 0.305664f}, {0.863281f, 0.047852f},
+	{0.058594f, 0.240234f}, {0.355469f, 0.554688f}, {0.617188f, 0.684570f}, {0.385742f, 0.095703f},
+	{0.196289f, 0.835938f}, {0.192383f, 0.029297f}, {0.538086f, 0.458008f}, {0.935547f, 0.457031f},
+	{0.162109f, 0.416992f}, {0.933594f, 0.852539f}, {0.739258f, 0.434570f}, {0.720703f, 0.054688f},
+	{0.245117f, 0.196289f}, {0.482422f, 0.198242f}, {0.008789f, 0.044922f}, {0.333008f, 0.684570f},
+	{0.783203f, 0.798828f}, {0.340820f, 0.972656f}, {0.775391f, 0.177734f}, {0.091797f, 0.927734f},
+	{0.504883f, 0.589844f}, {0.561523f, 0.818359f}, {0.972656f, 0.325195f}, {0.530273f, 0.342773f},
+	{0.086914f, 0.528320f}, {0.898438f, 0.186523f}, {0.584961f, 0.099609f}, {0.437500f, 0.466797f},
+	{0.744141f, 0.627930f}, {0.464844f, 0.931641f}, {0.068359f, 0.747070f}, {0.318359f, 0.450195f},
+	{0.708008f, 0.900391f}, {0.419922f, 0.731445f}, {0.165039f, 0.289062f}, {0.090820f, 0.128906f},
+	{0.194336f, 0.547852f}, {0.053711f, 0.401367f}, {0.526367f, 0.729492f}, {0.657227f, 0.356445f},
+	{0.370117f, 0.214844f}, {0.623047f, 0.526367f}, {0.948242f, 0.963867f}, {0.990234f, 0.663086f},
+	{0.794922f, 0.966797f}, {0.282227f, 0.887695f}, {0.858398f, 0.532227f}, {0.917969f, 0.765625f},
+	{0.674805f, 0.784180f}, {0.842773f, 0.416016f}, {0.468750f, 0.059570f}, {0.435547f, 0.374023f},
+	{0.231445f, 0.725586f}, {0.951172f, 0.585938f}, {0.228516f, 0.346680f}, {0.292969f, 0.080078f}
+};
+
+//Rays gathered before they are sorted and traced, 16384 pixels' worth. About 40 MB with the sort keys.
+static const uint32_t AO_STREAM_BATCH_RAYS = 1 << 20;
+//Sorted rays are traced in packets of this many, as long as they go into the same octant
+static const uint32_t AO_STREAM_PACKET_RAYS = 128;
+//Cells per axis of the direction grid of the sort key, and where the grid starts in the key
+static const uint32_t DIR_BINS = 4;
+static const uint32_t DIR_SHIFT = 24;
+
+float AORadius(float visibilityCutoff)
+{
+	if (visibilityCutoff <= 0.0f)
+	{
+		return T_MAX;
+	}
+	//Solves 8^-radius = visibilityCutoff
+	return std::min(std::max(-std::log(visibilityCutoff) / std::log(8.0f), 0.0f), T_MAX);
+}
+
+std::vector<float> LoadBlueNoise(const std::string& filename)
+{
+	std::vector<float> blueNoise;
+	int x, y, comp;
+	//Flipped like VulkanApp::CreateTexture uploads it
+	stbi_set_flip_vertically_on_load(1);
+	stbi_uc* imageData = stbi_load(filename.c_str(), &x, &y, &comp, STBI_grey);
+	if (imageData == NULL)
+	{
+		return blueNoise;
+	}
+	if (uint32_t(x) == BLUE_NOISE_IMAGE_SIZE && uint32_t(y) == BLUE_NOISE_IMAGE_SIZE)
+	{
+		for (int i = 0; i < x * y; i++)
+		{
+			blueNoise.push_back(imageData[i] / 255.0f);
+		}
+	}
+	stbi_image_free(imageData);
+	return blueNoise;
+}
+
+//Geometric.glsl
+static glm::mat3 RotationToAlignAToB(const glm::vec3& a, const glm::vec3& b)
+{
+	const glm::vec3 v = glm::cross(a, b);
+	const glm::mat3 m(glm::vec3(0.0f, v[2], -v[1]), glm::vec3(-v[2], 0.0f, v[0]), glm::vec3(v[1], -v[0], 0.0f));
+	const float s = glm::length(v);
+	const float c = glm::dot(a, b);
+	return glm::mat3(1.0f) + m + ((m * m) * ((1.0f - c) / (s * s)));
+}
+
+static glm::mat4 Rotate(float angle, glm::vec3 axis)
+{
+	axis = glm::normalize(axis);
+	const float s = std::sin(angle);
+	const float c = std::cos(angle);
+	const float oc = 1.0f - c;
+	return glm::mat4(oc * axis.x * axis.x + c, oc * axis.x * axis.y - axis.z * s, oc * axis.z * axis.x + axis.y * s, 0.0f,
+		oc * axis.x * axis.y + axis.z * s, oc * axis.y * axis.y + c, oc * axis.y * axis.z - axis.x * s, 0.0f,
+		oc * axis.z * axis.x - axis.y * s, oc * axis.y * axis.z + axis.x * s, oc * axis.z * axis.z + c, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+//Sample.glsl
+static glm::vec3 SampleHemisphereCosine(const glm::vec3& normal, float u0, float u1)
+{
+	const float phi = TWO_PI * u0;
+	const float theta = std::sqrt(u1);
+	const glm::vec3 sampledDir(theta * std::cos(phi), theta * std::sin(phi), std::sqrt(1.0f - u1));
+	const glm::mat3 rotation = RotationToAlignAToB(glm::vec3(0.0f, 0.0f, 1.0f), normal);
+	return glm::normalize(rotation * sampledDir);
+}
+
+static float VisibilityFunction(float dist)
+{
+	return std::pow(8.0f, -dist);
+}
+
+static int WrapSample(int sample)
+{
+	if (sample < 0)
+	{
+		return NUM_OCCLUSION_SAMPLES + sample;
+	}
+	else if (sample >= NUM_OCCLUSION_SAMPLES)
+	{
+		return NUM_OCCLUSION_SAMPLES - (NUM_OCCLUSION_SAMPLES - sample) - 1;
+	}
+	return sample;
+}
+
+//The early exit of the shader
+static bool NeedsAO(const CpuImages& images, size_t pixel)
+{
+	const glm::vec4& positionFractionVisible = images.position[pixel];
+	return !(glm::vec3(positionFractionVisible) == glm::vec3(0.0f) || positionFractionVisible.w > 0.0f);
+}
+
+//The occlusion rays of a pixel, in the order the shader traces them
+static void GenerateOcclusionRays(const CpuImages& images, const std::vector<float>& blueNoise, uint32_t currentFrame, uint32_t x, uint32_t y, Ray* rays)
+{
+	const size_t pixel = size_t(y) * images.width + x;
+	const glm::vec3 isectPoint(images.position[pixel]);
+	const glm::vec3 isectNormal(images.normal[pixel]);
+	
+	//Sample degree of rotation, through a nearest, repeating sampler
+	float blueNoiseRotationAngle = blueNoise[(y % BLUE_NOISE_IMAGE_SIZE) * BLUE_NOISE_IMAGE_SIZE + (x % BLUE_NOISE_IMAGE_SIZE)];
+	blueNoiseRotationAngle = blueNoiseRotationAngle + GOLDEN_RATIO * float(currentFrame);
+	blueNoiseRotationAngle = (blueNoiseRotationAngle - std::floor(blueNoiseRotationAngle)) * TWO_PI;
+	const glm::mat4 xzPlaneRotation = Rotate(blueNoiseRotationAngle, glm::vec3(0.0f, -1.0f, 0.0f));
+	const int sampleCenter = NUM_OCCLUSION_SAMPLES / 2;
+	for (int sampleY = 0; sampleY < NUM_OCCLUSION_SAMPLES; sampleY++)
+	{
+		for (int sampleX = 0; sampleX < NUM_OCCLUSION_SAMPLES; sampleX++)
+		{
+			const glm::vec4 rotatedSampleRelative = xzPlaneRotation * glm::vec4(float(sampleX - sampleCenter), 0.0f, float(sampleY - sampleCenter), 1.0f);
+			const int wrapRotatedSampleX = WrapSample(int(std::round(rotatedSampleRelative.x)) + sampleCenter);
+			const int wrapRotatedSampleZ = WrapSample(int(std::round(rotatedSampleRelative.z)) + sampleCenter);
+			const int idx = wrapRotatedSampleZ * NUM_OCCLUSION_SAMPLES + wrapRotatedSampleX;
+			
+			Ray& ray = rays[sampleY * NUM_OCCLUSION_SAMPLES + sampleX];
+			ray.origin = isectPoint + (isectNormal * 0.001f);
+			ray.dir = SampleHemisphereCosine(isectNormal, SAMPLE_POINTS[idx][0], SAMPLE_POINTS[idx][1]);
+		}
+	}
+}
+
+//What the shader stores, from the visibility of each ray
+static float Occlusion(const float* visibilities)
+{
+	float occlusion = 0.0f;
+	for (int i = 0; i < TOTAL_OCCLUSION_SAMPLES; i++)
+	{
+		occlusion += visibilities[i];
+	}
+	occlusion /= float(TOTAL_OCCLUSION_SAMPLES);
+	//For safety due to rounding-error: occlusion cannot be more than 1.0f
+	return std::min(occlusion, 1.0f);
+}
+
+static float HitVisibility(const Hit& hit)
+{
+	return hit.t >= 0.0f ? VisibilityFunction(hit.t) : 0.0f;
+}
+
+//RotationToAlignAToB divides by zero for normals along z. Such rays are counted as misses
+//instead of being traced, a NaN ray passes every slab test and would visit the whole BVH.
+static bool ValidRay(const Ray& ray)
+{
+	return std::isfinite(ray.dir.x + ray.dir.y + ray.dir.z);
+}
+
+//10 bits of each coordinate interleaved
+static uint32_t MortonCode(const glm::vec3& point)
+{
+	uint32_t code = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		uint32_t value = uint32_t(std::min(std::max(point[axis] * 1024.0f, 0.0f), 1023.0f));
+		value = (value | (value << 16)) & 0x030000ff;
+		value = (value | (value << 8)) & 0x0300f00f;
+		value = (value | (value << 4)) & 0x030c30c3;
+		value = (value | (value << 2)) & 0x09249249;
+		code |= value << axis;
+	}
+	return code;
+}
+
+//Under a top bit set for rays that are not traced: the sign bits of the direction, then a 4x4 grid
+//over the x and y magnitudes of the direction, then the origin. Rays going the same way from
+//nearby points end up next to each other, and the rays not traced come last.
+static uint32_t RaySortKey(const Ray& ray, const glm::vec3& sceneMin, const glm::vec3& sceneScale)
+{
+	if (!ValidRay(ray))
+	{
+		return 0xffffffff;
+	}
+	const uint32_t octant = (ray.dir.x < 0.0f ? 1 : 0) | (ray.dir.y < 0.0f ? 2 : 0) | (ray.dir.z < 0.0f ? 4 : 0);
+	const uint32_t dirX = std::min(uint32_t(std::fabs(ray.dir.x) * DIR_BINS), DIR_BINS - 1);
+	const uint32_t dirY = std::min(uint32_t(std::fabs(ray.dir.y) * DIR_BINS), DIR_BINS - 1);
+	return (octant << 28) | (((dirY * DIR_BINS) + dirX) << DIR_SHIFT) | (MortonCode((ray.origin - sceneMin) * sceneScale) >> (30 - DIR_SHIFT));
+}
+
+//LSD radix sort on the high 32 bits, a byte at a time. Stable, so rays with the same key stay in order.
+static void SortByKey(uint64_t* values, uint32_t count, uint64_t* scratch)
+{
+	for (int shift = 32; shift < 64; shift += 8)
+	{
+		uint32_t offsets[256] = {};
+		for (uint32_t i = 0; i < count; i++)
+		{
+			offsets[(values[i] >> shift) & 0xff]++;
+		}
+		uint32_t sum = 0;
+		for (uint32_t bucket = 0; bucket < 256; bucket++)
+		{
+			const uint32_t bucketSize = offsets[bucket];
+			offsets[bucket] = sum;
+			sum += bucketSize;
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			scratch[offsets[(values[i] >> shift) & 0xff]++] = values[i];
+		}
+		std::swap(values, scratch);
+	}
+}
+
+static void RenderAOPerPixel(const CpuScene& scene, const std::vector<float>& blueNoise, uint32_t currentFrame, const AOSettings& settings, ThreadPool& threadPool, CpuImages* images, AOStats* stats)
+{
+	const float radius = AORadius(settings.visibilityCutoff);
+	std::atomic<uint32_t> aoPixels(0);
+	//Pixels that skip AO cost next to nothing and the others trace every occlusion ray, so tiles differ a lot
+	stats->tiles = RunTiles(images->width, images->height, settings.tileSize, threadPool, [&](uint32_t startX, uint32_t startY, uint32_t endX, uint32_t endY)
+	{
+		uint32_t tilePixels = 0;
+		for (uint32_t y = startY; y < endY; y++)
+		{
+			for (uint32_t x = startX; x < endX; x++)
+			{
+				const size_t pixel = size_t(y) * images->width + x;
+				if (!NeedsAO(*images, pixel))
+				{
+					images->ao[pixel] = 0.0f;
+					continue;
+				}
+				Ray rays[TOTAL_OCCLUSION_SAMPLES];
+				float visibilities[TOTAL_OCCLUSION_SAMPLES];
+				GenerateOcclusionRays(*images, blueNoise, currentFrame, x, y, rays);
+				for (int i = 0; i < TOTAL_OCCLUSION_SAMPLES; i++)
+				{
+					if (!ValidRay(rays[i]))
+					{
+						visibilities[i] = 0.0f;
+						continue;
+					}
+					const Hit hit = settings.query == HIT_ANY ? TraceAnyHit(scene, rays[i], T_MIN, radius) : TraceRay(scene, rays[i], T_MIN, radius);
+					visibilities[i] = HitVisibility(hit);
+				}
+				images->ao[pixel] = Occlusion(visibilities);
+				tilePixels++;
+			}
+		}
+		aoPixels += tilePixels;
+	});
+	stats->aoPixels = aoPixels;
+}
+
+static void RenderAORayStream(const CpuScene& scene, const std::vector<float>& blueNoise, uint32_t currentFrame, const AOSettings& settings, ThreadPool& threadPool, CpuImages* images, AOStats* stats)
+{
+	const float radius = AORadius(settings.visibilityCutoff);
+	std::vector<uint32_t> aoPixels;
+	for (size_t pixel = 0; pixel < images->ao.size(); pixel++)
+	{
+		images->ao[pixel] = 0.0f;
+		if (NeedsAO(*images, pixel))
+		{
+			aoPixels.push_back(uint32_t(pixel));
+		}
+	}
+	stats->aoPixels = uint32_t(aoPixels.size());
+	const BoundingBox sceneBounds = CpuSceneBounds(scene);
+	if (aoPixels.empty() || sceneBounds.min.x > sceneBounds.max.x)
+	{
+		return;
+	}
+	const glm::vec3 sceneMin = sceneBounds.min;
+	const glm::vec3 sceneScale = 1.0f / glm::max(sceneBounds.max - sceneMin, glm::vec3(1e-6f));
+	
+	const uint32_t pixelsPerBatch = AO_STREAM_BATCH_RAYS / TOTAL_OCCLUSION_SAMPLES;
+	std::vector<Ray> rays(AO_STREAM_BATCH_RAYS);
+	//Sort key in the high half, ray index in the low half
+	std::vector<uint64_t> order(AO_STREAM_BATCH_RAYS);
+	std::vector<uint64_t> sortScratch(AO_STREAM_BATCH_RAYS);
+	std::vector<float> visibilities(AO_STREAM_BATCH_RAYS);
+	std::vector<uint32_t> packetStarts;
+	std::atomic<uint64_t> packets(0);
+	for (uint32_t batchStart = 0; batchStart < aoPixels.size(); batchStart += pixelsPerBatch)
+	{
+		const uint32_t batchPixels = std::min(pixelsPerBatch, uint32_t(aoPixels.size()) - batchStart);
+		const uint32_t batchRays = batchPixels * TOTAL_OCCLUSION_SAMPLES;
+		threadPool.ParallelFor(0, batchPixels, 64, [&](uint32_t i)
+		{
+			const uint32_t pixel = aoPixels[batchStart + i];
+			Ray* pixelRays = &rays[i * TOTAL_OCCLUSION_SAMPLES];
+			GenerateOcclusionRays(*images, blueNoise, currentFrame, pixel % images->width, pixel / images->width, pixelRays);
+			for (int j = 0; j < TOTAL_OCCLUSION_SAMPLES; j++)
+			{
+				const uint32_t ray = i * TOTAL_OCCLUSION_SAMPLES + j;
+				order[ray] = (uint64_t(RaySortKey(pixelRays[j], sceneMin, sceneScale)) << 32) | ray;
+			}
+		});
+		
+		auto sortStartTime = std::chrono::high_resolution_clock::now();
+		//An even number of passes, so the sorted rays end up back in 'order'
+		SortByKey(order.data(), batchRays, sortScratch.data());
+		auto sortEndTime = std::chrono::high_resolution_clock::now();
+		stats->sortTime += std::chrono::duration<float, std::milli>(sortEndTime - sortStartTime).count();
+		
+		//A packet ends when it's full or the octant changes
+		packetStarts.clear();
+		uint32_t numTracedRays = 0;
+		while (numTracedRays < batchRays && (order[numTracedRays] >> 63) == 0)
+		{
+			if (packetStarts.empty() || numTracedRays - packetStarts.back() == AO_STREAM_PACKET_RAYS || (order[numTracedRays] >> 60) != (order[numTracedRays - 1] >> 60))
+			{
+				packetStarts.push_back(numTracedRays);
+			}
+			numTracedRays++;
+		}
+		for (uint32_t i = numTracedRays; i < batchRays; i++)
+		{
+			visibilities[uint32_t(order[i])] = 0.0f;
+		}
+		packetStarts.push_back(numTracedRays);
+		threadPool.ParallelFor(0, uint32_t(packetStarts.size() - 1), 16, [&](uint32_t p)
+		{
+			RayPacket packet;
+			for (uint32_t i = packetStarts[p]; i < packetStarts[p + 1]; i++)
+			{
+				AddRay(&packet, rays[uint32_t(order[i])]);
+			}
+			Hit hits[AO_STREAM_PACKET_RAYS];
+			PacketStats packetStats;
+			TracePacket(scene, packet, T_MIN, radius, settings.query, hits, &packetStats);
+			for (uint32_t i = packetStarts[p]; i < packetStarts[p + 1]; i++)
+			{
+				visibilities[uint32_t(order[i])] = HitVisibility(hits[i - packetStarts[p]]);
+			}
+		});
+		packets += packetStarts.size() - 1;
+		
+		//Scatter back, each pixel sums its rays in the order the shader does
+		threadPool.ParallelFor(0, batchPixels, 256, [&](uint32_t i)
+		{
+			images->ao[aoPixels[batchStart + i]] = Occlusion(&visibilities[i * TOTAL_OCCLUSION_SAMPLES]);
+		});
+	}
+	stats->packets = packets;
+}
+
+AOStats RenderAO(const CpuScene& scene, const std::vector<float>& blueNoise, uint32_t currentFrame, const AOSettings& settings, ThreadPool& threadPool, CpuImages* images)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	AOStats stats;
+	images->ao.resize(images->position.size());
+	if (settings.order == AO_PER_PIXEL)
+	{
+		RenderAOPerPixel(scene, blueNoise, currentFrame, settings, threadPool, images, &stats);
+	}
+	else
+	{
+		RenderAORayStream(scene, blueNoise, currentFrame, settings, threadPool, images, &stats);
+	}
+	stats.rays = uint64_t(stats.aoPixels) * TOTAL_OCCLUSION_SAMPLES;
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.renderTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return stats;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
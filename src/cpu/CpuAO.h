@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef CPU_AO_H
+#define CPU_AO_H
+
+#include "CpuRenderer.h"
+#include "CpuScene.h"
+#include <stdint.h>
+#include <string>
+#include "ThreadPool.h"
+#include <vector>
+
+//The order the occlusion rays are traced in
+enum AOOrder
+{
+	//All 64 rays of a pixel, pixel after pixel, like the shader
+	AO_PER_PIXEL,
+	//Rays of many pixels gathered, sorted by direction octant and origin, and traced as packets
+	AO_RAY_STREAM
+};
+
+//A hit adds 8^-t to the occlusion of its ray. Hits that would add less than this are not looked for,
+//which at most changes the occlusion of a pixel by as much, half a step of an 8-bit image.
+const float DEFAULT_AO_VISIBILITY_CUTOFF = 1.0f / 512.0f;
+
+struct AOSettings
+{
+	AOOrder order = AO_PER_PIXEL;
+	//HIT_ANY weights a ray by the first hit found, which may be further away than the closest. The
+	//same as tracing with gl_RayFlagsTerminateOnFirstHitNV on the GPU.
+	HitQuery query = HIT_CLOSEST;
+	//The rays end at AORadius(visibilityCutoff)
+	float visibilityCutoff = DEFAULT_AO_VISIBILITY_CUTOFF;
+	//Pixel by pixel only, the pixels are traced in tiles this size, see RunTiles
+	uint32_t tileSize = DEFAULT_TILE_SIZE;
+};
+
+struct AOStats
+{
+	uint32_t aoPixels = 0;
+	uint64_t rays = 0;
+	float renderTime = 0.0f; //ms
+	//Ray streams only. The time spent sorting is part of 'renderTime'.
+	float sortTime = 0.0f; //ms
+	uint64_t packets = 0;
+	//Pixel by pixel only
+	TileStats tiles;
+};
+
+//The distance where a hit adds 'visibilityCutoff' to the occlusion of a ray. A cutoff of 0 or less
+//gives the tMax of the shader, 100.
+float AORadius(float visibilityCutoff);
+//The red channel of the blue noise texture the AO pass rotates its sample points with, as the GPU
+//samples it. Returns an empty vector when the file can't be read.
+std::vector<float> LoadBlueNoise(const std::string& filename);
+//A CPU port of shaders/ao/primary.rgen with primary.rchit and primary.rmiss, reading the position
+//and normal images of the color/position pass and writing images->ao. 'blueNoise' is 64x64.
+AOStats RenderAO(const CpuScene& scene, const std::vector<float>& blueNoise, uint32_t currentFrame, const AOSettings& settings, ThreadPool& threadPool, CpuImages* images);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,289 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+A CPU port of the color/position pass: shaders/color_position/primary.rgen with primary.rchit,
+primary.rmiss, secondary.rchit and secondary.rmiss. The shaders are followed line by line so
+the images can be compared against the ones the GPU produces.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include "CpuRenderer.h"
+#include <cstdio>
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "RayPacket.h"
+
+//Same as in primary.rgen
+static const float T_MIN = 0.0f;
+static const float T_MAX = 100.0f;
+
+//Camera.glsl
+static Ray GenerateRayFromCamera(const Camera& camera, uint32_t x, uint32_t y)
+{
+	Ray ray;
+	ray.origin = camera.origin;
+	const float u = float(x) / float(camera.filmWidth - 1);
+	const float v = float(y) / float(camera.filmHeight - 1);
+	ray.dir = glm::normalize(camera.topLeftCorner + (u * camera.horizontalEnd) + (v * camera.verticalEnd) - ray.origin);
+	return ray;
+}
+
+//Lights shaded at a hit point, kept from pixel to pixel
+struct ShadingScratch
+{
+	float lightCutoff = 0.0f;
+	std::vector<uint32_t> shadedLights;
+	std::vector<uint32_t> lightClusters;
+};
+
+//primary.rgen for one pixel, given where its primary ray hit the geometry. Returns the number of shadow rays traced.
+static uint32_t ShadePixel(const CpuScene& scene, uint32_t x, uint32_t y, const Ray& ray, const Hit& hit, ShadingScratch* scratch, CpuImages* images)
+{
+	const size_t pixel = size_t(y) * images->width + x;
+	
+	//Trace primary ray against the light sources, the geometry has been traced
+	float lightSourceT = T_MAX;
+	const int lightSourceIdx = TraceLights(scene, ray, T_MIN, T_MAX, &lightSourceT);
+	
+	//Early exit - light hit and it's closer than the closest geometry hit
+	if (lightSourceIdx > -1 && (lightSourceT < std::max(hit.t, 0.0f) || hit.t < 0.0f))
+	{
+		images->color[pixel] = glm::vec4(glm::vec3(scene.lights[lightSourceIdx].emittance), 1.0f);
+		images->position[pixel] = glm::vec4(0.0f);
+		images->normal[pixel] = glm::vec4(0.0f);
+		return 0;
+	}
+	//Early exit - no geometry hit
+	else if (hit.t < 0.0f)
+	{
+		//Background color: blue sky-ish
+		const float t = float(y) / float(images->height);
+		images->color[pixel] = glm::vec4(glm::mix(0.0f, 0.7f, t), glm::mix(0.65f, 0.9f, t), 0.8f, 1.0f);
+		images->position[pixel] = glm::vec4(0.0f);
+		images->normal[pixel] = glm::vec4(0.0f);
+		return 0;
+	}
+	
+	//Intersection data
+	const glm::vec3 isectPoint = ray.origin + (ray.dir * hit.t);
+	const glm::vec3 isectNormal = HitNormal(scene, hit);
+	
+	glm::vec3 color(0.0f);
+	int numVisible = 0;
+	GatherLights(scene.lightBvh, scene.lights, isectPoint, scratch->lightCutoff, &scratch->shadedLights, &scratch->lightClusters);
+	for (uint32_t lightIdx : scratch->shadedLights)
+	{
+		const SphericalLightFromFile& light = scene.lights[lightIdx];
+		const glm::vec3 lightCenter(light.centerAndRadius);
+		const float lightRadius = light.centerAndRadius.w;
+		const glm::vec3 lightEmittance(light.emittance);
+		const glm::vec3 isectPointToLightCenter = lightCenter - isectPoint;
+		const glm::vec3 isectPointToLightCenterDir = glm::normalize(isectPointToLightCenter);
+		const float isectPointToLightCenterDist = glm::length(isectPointToLightCenter);
+		const float isectPointToLightCenterClosestDist = isectPointToLightCenterDist - lightRadius;
+		
+		//Trace shadow rays, only up to the light. Whatever is hit before it blocks the light, so the
+		//first hit found is enough.
+		Ray shadowRay;
+		shadowRay.origin = isectPoint + (isectNormal * 0.001f);
+		shadowRay.dir = isectPointToLightCenterDir;
+		
+		//Either didn't hit any geometry, or hit it beyond the light
+		if (!Occluded(scene, shadowRay, T_MIN, std::min(isectPointToLightCenterClosestDist, T_MAX)))
+		{
+			numVisible++;
+		}
+		color += lightEmittance * (1.0f / isectPointToLightCenterClosestDist) * glm::dot(isectNormal, isectPointToLightCenterDir);
+	}
+	//Lights too far away to trace shadow rays to, as one light at the center of their emittance
+	for (uint32_t clusterIdx : scratch->lightClusters)
+	{
+		const LightCluster& cluster = scene.lightBvh.clusters[clusterIdx];
+		const glm::vec3 isectPointToCluster = cluster.center - isectPoint;
+		const float isectPointToClusterDist = glm::length(isectPointToCluster);
+		color += cluster.emittance * (1.0f / isectPointToClusterDist) * glm::dot(isectNormal, isectPointToCluster / isectPointToClusterDist);
+		numVisible += int(cluster.numLights);
+	}
+	//The shader divides by zero without lights, 0 makes the AO pass treat the pixel the same way.
+	//Lights in clusters count as visible, like their color.
+	const float fractionOfVisibleLights = scene.lights.empty() ? 0.0f : float(numVisible) / float(scene.lights.size());
+	const float* diffuseColor = scene.materials[HitMesh(scene, hit)].diffuseColor;
+	color *= glm::vec3(diffuseColor[0], diffuseColor[1], diffuseColor[2]);
+	
+	images->color[pixel] = glm::vec4(color, 1.0f);
+	images->position[pixel] = glm::vec4(isectPoint, fractionOfVisibleLights);
+	images->normal[pixel] = glm::vec4(isectNormal, 0.0f);
+	return uint32_t(scratch->shadedLights.size());
+}
+
+//Traces the primary rays of a tile of pixels as a packet and shades them. Returns the number of shadow rays traced.
+static uint64_t ShadePacket(const CpuScene& scene, const Camera& camera, uint32_t startX, uint32_t startY, uint32_t endX, uint32_t endY, ShadingScratch* scratch, CpuImages* images, uint64_t* singleRays)
+{
+	RayPacket packet;
+	for (uint32_t y = startY; y < endY; y++)
+	{
+		for (uint32_t x = startX; x < endX; x++)
+		{
+			AddRay(&packet, GenerateRayFromCamera(camera, x, y));
+		}
+	}
+	Hit hits[PACKET_MAX_RAYS];
+	PacketStats packetStats;
+	TracePacket(scene, packet, T_MIN, T_MAX, HIT_CLOSEST, hits, &packetStats);
+	*singleRays += packetStats.singleRays;
+	
+	uint64_t shadowRays = 0;
+	uint32_t i = 0;
+	for (uint32_t y = startY; y < endY; y++)
+	{
+		for (uint32_t x = startX; x < endX; x++)
+		{
+			shadowRays += ShadePixel(scene, x, y, GenerateRayFromCamera(camera, x, y), hits[i++], scratch, images);
+		}
+	}
+	return shadowRays;
+}
+
+CpuRenderStats RenderColorPosition(const CpuScene& scene, const Camera& camera, uint32_t packetSize, ThreadPool& threadPool, CpuImages* images, uint32_t tileSize, float lightCutoff)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	images->width = camera.filmWidth;
+	images->height = camera.filmHeight;
+	const size_t numPixels = size_t(images->width) * images->height;
+	images->color.resize(numPixels);
+	images->position.resize(numPixels);
+	images->normal.resize(numPixels);
+	
+	//Packets start where they would if the whole image was split into them
+	if (packetSize > 0)
+	{
+		tileSize = std::max((tileSize + packetSize - 1) / packetSize, 1u) * packetSize;
+	}
+	std::atomic<uint64_t> shadowRays(0);
+	std::atomic<uint64_t> singleRays(0);
+	const TileStats tiles = RunTiles(images->width, images->height, tileSize, threadPool, [&](uint32_t startX, uint32_t startY, uint32_t endX, uint32_t endY)
+	{
+		ShadingScratch scratch;
+		scratch.lightCutoff = lightCutoff;
+		uint64_t tileShadowRays = 0;
+		uint64_t tileSingleRays = 0;
+		if (packetSize == 0)
+		{
+			for (uint32_t y = startY; y < endY; y++)
+			{
+				for (uint32_t x = startX; x < endX; x++)
+				{
+					const Ray ray = GenerateRayFromCamera(camera, x, y);
+					tileShadowRays += ShadePixel(scene, x, y, ray, TraceRay(scene, ray, T_MIN, T_MAX), &scratch, images);
+				}
+			}
+		}
+		else
+		{
+			for (uint32_t y = startY; y < endY; y += packetSize)
+			{
+				for (uint32_t x = startX; x < endX; x += packetSize)
+				{
+					tileShadowRays += ShadePacket(scene, camera, x, y, std::min(x + packetSize, endX), std::min(y + packetSize, endY), &scratch, images, &tileSingleRays);
+				}
+			}
+		}
+		shadowRays += tileShadowRays;
+		singleRays += tileSingleRays;
+	});
+	
+	CpuRenderStats stats;
+	stats.primaryRays = numPixels;
+	stats.shadowRays = shadowRays;
+	stats.packetSingleRays = singleRays;
+	stats.tiles = tiles;
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.renderTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return stats;
+}
+
+//Portable float map, rows go from the bottom up. Writes 'numChannels' values per pixel, starting
+//at 'firstValue' of the 'valuesPerPixel' values every pixel has in 'values'.
+static bool WritePFM(const std::string& filename, const CpuImages& images, const float* values, int valuesPerPixel, int firstValue, int numChannels)
+{
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	fprintf(file, "%s\n%u %u\n-1.0\n", numChannels == 3 ? "PF" : "Pf", images.width, images.height);
+	std::vector<float> row(images.width * numChannels);
+	for (uint32_t y = images.height; y-- > 0;)
+	{
+		for (uint32_t x = 0; x < images.width; x++)
+		{
+			const float* value = values + (size_t(y) * images.width + x) * valuesPerPixel + firstValue;
+			for (int c = 0; c < numChannels; c++)
+			{
+				row[x * numChannels + c] = value[c];
+			}
+		}
+		fwrite(row.data(), sizeof(float), row.size(), file);
+	}
+	return fclose(file) == 0;
+}
+
+bool WriteCpuImages(const CpuImages& images, const std::string& prefix)
+{
+	FILE* file = fopen((prefix + "_color.ppm").c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	fprintf(file, "P6\n%u %u\n255\n", images.width, images.height);
+	std::vector<unsigned char> rgb(size_t(images.width) * images.height * 3);
+	for (size_t i = 0; i < images.color.size(); i++)
+	{
+		//UNORM conversion, like storing to the rgba8 color image
+		for (int c = 0; c < 3; c++)
+		{
+			rgb[i * 3 + c] = (unsigned char)(std::round(glm::clamp(images.color[i][c], 0.0f, 1.0f) * 255.0f));
+		}
+	}
+	fwrite(rgb.data(), 1, rgb.size(), file);
+	if (fclose(file) != 0)
+	{
+		return false;
+	}
+	
+	return WritePFM(prefix + "_position.pfm", images, &images.position[0].x, 4, 0, 3) &&
+		WritePFM(prefix + "_normal.pfm", images, &images.normal[0].x, 4, 0, 3) &&
+		WritePFM(prefix + "_visibility.pfm", images, &images.position[0].x, 4, 3, 1) &&
+		(images.ao.empty() || WritePFM(prefix + "_ao.pfm", images, images.ao.data(), 1, 0, 1));
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include "Camera.h"
+#include "CpuScene.h"
+#include "glm/vec4.hpp"
+#include <stdint.h>
+#include <string>
+#include "ThreadPool.h"
+#include "TileScheduler.h"
+#include <vector>
+
+//The images written by the color/position pass, row by row from the top left pixel.
+//'color' is unclamped, the GPU clamps it when storing to its rgba8 image.
+struct CpuImages
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<glm::vec4> color;
+	//xyz is the hit point, w the fraction of the lights that are visible from it
+	std::vector<glm::vec4> position;
+	std::vector<glm::vec4> normal;
+	//Written by the AO pass, see RenderAO
+	std::vector<float> ao;
+};
+
+struct CpuRenderStats
+{
+	uint64_t primaryRays = 0;
+	uint64_t shadowRays = 0;
+	//Primary rays that left their packet, see TracePacket
+	uint64_t packetSingleRays = 0;
+	float renderTime = 0.0f; //ms
+	TileStats tiles;
+};
+
+//The camera's film size decides the size of the images. The primary rays of every 'packetSize' squared
+//tile of pixels are traced together as a packet, or one by one when 'packetSize' is 0. Up to 16.
+//The pixels are shaded in 'tileSize' squared tiles, see RunTiles, rounded up to whole packets. Groups
+//of lights that would add less than 'lightCutoff' to a pixel are shaded without shadow rays, see
+//GatherLights. 0 shades every light like the shader.
+CpuRenderStats RenderColorPosition(const CpuScene& scene, const Camera& camera, uint32_t packetSize, ThreadPool& threadPool, CpuImages* images, uint32_t tileSize = DEFAULT_TILE_SIZE, float lightCutoff = 0.0f);
+//Writes <prefix>_color.ppm, <prefix>_position.pfm, <prefix>_normal.pfm and <prefix>_visibility.pfm,
+//the last one holding the w component of the position image, and <prefix>_ao.pfm if AO was rendered
+bool WriteCpuImages(const CpuImages& images, const std::string& prefix);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
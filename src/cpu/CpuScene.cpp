@@ -0,0 +1,795 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include "BrhanBvhFile.h"
+#include <chrono>
+#include <cmath>
+#include "CpuScene.h"
+#include <cstring>
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "glm/mat3x3.hpp"
+#include "glm/matrix.hpp"
+#include <immintrin.h>
+#include "Logger.h"
+
+//Writes the world space triangles of every instance of a flat scene into its already sized vertices
+//and normals, and returns their bounds
+static std::vector<BoundingBox> PlaceTriangles(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, ThreadPool& threadPool, CpuScene* scene)
+{
+	std::vector<uint32_t> firstTriangles(instances.size());
+	uint32_t numTriangles = 0;
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		firstTriangles[i] = numTriangles;
+		numTriangles += uint32_t(meshes[instances[i].meshIndex].indices.size() / 3);
+	}
+	std::vector<BoundingBox> triangleBounds(numTriangles);
+	threadPool.ParallelFor(0, uint32_t(instances.size()), 1, [&](uint32_t i)
+	{
+		const MeshInstance& instance = instances[i];
+		const Mesh& mesh = meshes[instance.meshIndex];
+		//primary.rchit multiplies by the world-to-object matrix from the left, which is the same
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.transform)));
+		uint32_t corner = firstTriangles[i] * 3;
+		for (uint32_t index : mesh.indices)
+		{
+			glm::vec3 vertex(mesh.vertices[index * 3 + 0], mesh.vertices[index * 3 + 1], mesh.vertices[index * 3 + 2]);
+			glm::vec3 normal(mesh.normals[index * 3 + 0], mesh.normals[index * 3 + 1], mesh.normals[index * 3 + 2]);
+			scene->vertices[corner] = glm::vec3(instance.transform * glm::vec4(vertex, 1.0f));
+			scene->normals[corner] = normalMatrix * normal;
+			triangleBounds[corner / 3].Grow(scene->vertices[corner]);
+			corner++;
+		}
+	});
+	return triangleBounds;
+}
+
+CpuSceneStats BuildCpuScene(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, const std::vector<SphericalLightFromFile>& lights, CpuSceneLayout layout, ThreadPool& threadPool, CpuScene* scene, const char* bvhCacheFile)
+{
+	scene->layout = layout;
+	scene->materials.clear();
+	for (const Mesh& mesh : meshes)
+	{
+		scene->materials.push_back(mesh.material);
+	}
+	scene->lights = lights;
+	scene->lightBvh = LightBvh();
+	scene->bvh = Bvh();
+	scene->wideBvh = Bvh8();
+	scene->triangleBlocks = TriangleBlocks();
+	scene->bvhCache.Close();
+	scene->cachedBvh = BvhView();
+	scene->twoLevel = TwoLevelBvh();
+	
+	CpuSceneStats stats;
+	stats.lightBvh = BuildLightBvh(lights, threadPool, &scene->lightBvh);
+	if (layout == CPU_SCENE_TWO_LEVEL)
+	{
+		scene->vertices.clear();
+		scene->normals.clear();
+		scene->triangleMeshes.clear();
+		stats.twoLevel = BuildTwoLevelBvh(meshes, instances, threadPool, &scene->twoLevel);
+		stats.numTriangles = stats.twoLevel.numInstancedTriangles;
+		return stats;
+	}
+	
+	size_t numTriangles = 0;
+	for (const MeshInstance& instance : instances)
+	{
+		numTriangles += meshes[instance.meshIndex].indices.size() / 3;
+	}
+	scene->vertices.resize(numTriangles * 3);
+	scene->normals.resize(numTriangles * 3);
+	scene->triangleMeshes.clear();
+	scene->triangleMeshes.reserve(numTriangles);
+	for (const MeshInstance& instance : instances)
+	{
+		scene->triangleMeshes.insert(scene->triangleMeshes.end(), meshes[instance.meshIndex].indices.size() / 3, instance.meshIndex);
+	}
+	
+	const std::vector<BoundingBox> triangleBounds = PlaceTriangles(meshes, instances, threadPool, scene);
+	stats.numTriangles = numTriangles;
+	//Only the triangles of instances with a split budget may be split, and the budgets add up
+	std::vector<uint8_t> splittable;
+	float splitReferences = 0.0f;
+	for (const MeshInstance& instance : instances)
+	{
+		const size_t numInstanceTriangles = meshes[instance.meshIndex].indices.size() / 3;
+		splittable.insert(splittable.end(), numInstanceTriangles, instance.splitBudget > 0.0f ? 1 : 0);
+		splitReferences += instance.splitBudget * numInstanceTriangles;
+	}
+	const float splitBudget = numTriangles > 0 ? splitReferences / numTriangles : 0.0f;
+	uint64_t geometryHash = 0;
+	if (bvhCacheFile != NULL)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		geometryHash = HashCpuSceneGeometry(scene->vertices, splittable, splitBudget);
+		stats.bvhCached = LoadBrhanBvhFile(bvhCacheFile, geometryHash, scene, &stats);
+		auto endTime = std::chrono::high_resolution_clock::now();
+		stats.bvhCacheTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+		if (stats.bvhCached)
+		{
+			return stats;
+		}
+	}
+	if (splitBudget > 0.0f)
+	{
+		stats.bvh = BuildSpatialSplitBvh(scene->vertices, splittable, splitBudget, threadPool, &scene->bvh);
+	}
+	else
+	{
+		stats.bvh = BuildBvh(triangleBounds, threadPool, &scene->bvh);
+	}
+	stats.wideBvh = CollapseBvh(scene->bvh, &scene->wideBvh);
+	BuildTriangleBlocks(scene->wideBvh, scene->vertices, threadPool, &scene->triangleBlocks);
+	if (bvhCacheFile != NULL && numTriangles > 0)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		if (!WriteBrhanBvhFile(bvhCacheFile, geometryHash, *scene, stats))
+		{
+			LOG_WARNING(false, __FILE__, __FUNCTION__, __LINE__, "Failed to write BVH cache '%s'\n", bvhCacheFile);
+		}
+		auto endTime = std::chrono::high_resolution_clock::now();
+		stats.bvhCacheTime += std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	}
+	return stats;
+}
+
+CpuSceneUpdateStats UpdateCpuScene(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, bool meshesChanged, float rebuildThreshold, ThreadPool& threadPool, CpuScene* scene, BvhBuilder builder)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	CpuSceneUpdateStats stats;
+	if (scene->layout == CPU_SCENE_TWO_LEVEL)
+	{
+		if (meshesChanged)
+		{
+			stats.rebuiltMeshes = UpdateMeshVertices(meshes, rebuildThreshold, threadPool, &scene->twoLevel, builder);
+		}
+		std::vector<glm::mat4> transforms;
+		transforms.reserve(instances.size());
+		for (const MeshInstance& instance : instances)
+		{
+			transforms.push_back(instance.transform);
+		}
+		stats.bvh = UpdateInstanceTransforms(transforms, rebuildThreshold, threadPool, &scene->twoLevel, builder);
+	}
+	else
+	{
+		//Every triangle is in world space, so moving an instance moves its triangles
+		CopyMappedBvh(scene);
+		const std::vector<BoundingBox> triangleBounds = PlaceTriangles(meshes, instances, threadPool, scene);
+		stats.bvh = RefitOrRebuildBvh(triangleBounds, rebuildThreshold, threadPool, &scene->bvh, builder);
+		if (stats.bvh.rebuilt)
+		{
+			CollapseBvh(scene->bvh, &scene->wideBvh);
+		}
+		else
+		{
+			RefitBvh8(triangleBounds, threadPool, &scene->wideBvh);
+		}
+		BuildTriangleBlocks(scene->wideBvh, scene->vertices, threadPool, &scene->triangleBlocks);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.updateTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return stats;
+}
+
+BoundingBox CpuSceneBounds(const CpuScene& scene)
+{
+	BoundingBox bounds;
+	const BvhNode* root = NULL;
+	if (scene.layout == CPU_SCENE_TWO_LEVEL)
+	{
+		root = scene.twoLevel.topLevel.nodes.empty() ? NULL : &scene.twoLevel.topLevel.nodes[0];
+	}
+	else
+	{
+		const BvhView view = FlatBvhView(scene);
+		root = view.numNodes > 0 ? view.nodes : NULL;
+	}
+	if (root != NULL)
+	{
+		bounds.min = root->boundsMin;
+		bounds.max = root->boundsMax;
+	}
+	return bounds;
+}
+
+static BvhView ViewOf(const Bvh& bvh, const Bvh8& wideBvh, const TriangleBlocks& triangleBlocks)
+{
+	BvhView view;
+	view.numNodes = uint32_t(bvh.nodes.size());
+	view.nodes = bvh.nodes.data();
+	view.primitives = bvh.primitives.data();
+	view.wideNodes = wideBvh.nodes.data();
+	view.quantizedNodes = wideBvh.quantizedNodes.data();
+	view.blocks = triangleBlocks.blocks.data();
+	view.firstBlocks = triangleBlocks.firstBlocks.data();
+	return view;
+}
+
+BvhView FlatBvhView(const CpuScene& scene)
+{
+	//Anything built since the cache was mapped is in the vectors
+	return scene.bvh.nodes.empty() ? scene.cachedBvh : ViewOf(scene.bvh, scene.wideBvh, scene.triangleBlocks);
+}
+
+//Slab test, the entry distance or FLT_MAX on a miss
+static float IntersectNode(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDir, float tMin, float tMax)
+{
+	const glm::vec3 t0 = (node.boundsMin - origin) * inverseDir;
+	const glm::vec3 t1 = (node.boundsMax - origin) * inverseDir;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, tMin));
+	const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+	return entry <= exit ? entry : FLT_MAX;
+}
+
+//Walks a binary BVH from the node 'root'. 'intersectPrimitive(primitive, tMax, hit)' tests a primitive
+//of a leaf and returns true when it updated 'hit' with a closer hit than tMax. Returns true if any did.
+template <HitQuery QUERY, typename IntersectPrimitive>
+static bool WalkBinary(const BvhNode* nodes, const uint32_t* primitives, uint32_t root, const Ray& ray, float tMin, float tMax, Hit* hit, IntersectPrimitive intersectPrimitive)
+{
+	const glm::vec3 inverseDir = 1.0f / ray.dir;
+	if (IntersectNode(nodes[root], ray.origin, inverseDir, tMin, tMax) == FLT_MAX)
+	{
+		return false;
+	}
+	
+	//Nodes on the stack have been hit, but may be further away than a hit found since
+	uint32_t stack[BVH_MAX_DEPTH];
+	float stackEntries[BVH_MAX_DEPTH];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = root;
+	bool found = false;
+	while (true)
+	{
+		const BvhNode& node = nodes[nodeIndex];
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				if (intersectPrimitive(primitives[i], tMax, hit))
+				{
+					found = true;
+					if (QUERY == HIT_ANY)
+					{
+						return true;
+					}
+					tMax = hit->t;
+				}
+			}
+		}
+		else
+		{
+			//Visit the nearer child first
+			uint32_t near = node.leftOrFirst;
+			uint32_t far = node.leftOrFirst + 1;
+			float nearEntry = IntersectNode(nodes[near], ray.origin, inverseDir, tMin, tMax);
+			float farEntry = IntersectNode(nodes[far], ray.origin, inverseDir, tMin, tMax);
+			if (farEntry < nearEntry)
+			{
+				std::swap(near, far);
+				std::swap(nearEntry, farEntry);
+			}
+			if (nearEntry != FLT_MAX)
+			{
+				if (farEntry != FLT_MAX)
+				{
+					stack[stackSize] = far;
+					stackEntries[stackSize] = farEntry;
+					stackSize++;
+				}
+				nodeIndex = near;
+				continue;
+			}
+		}
+		
+		//Pop the next node that is still in front of the closest hit
+		do
+		{
+			if (stackSize == 0)
+			{
+				return found;
+			}
+			stackSize--;
+		} while (stackEntries[stackSize] > tMax);
+		nodeIndex = stack[stackSize];
+	}
+}
+
+//A binary BVH over the triangles in 'vertices'
+template <HitQuery QUERY>
+static bool WalkTriangles(const BvhView& bvh, const glm::vec3* vertices, uint32_t root, const Ray& ray, float tMin, float tMax, Hit* hit)
+{
+	const TriangleRay triangleRay = PrepareTriangleRay(ray);
+	return WalkBinary<QUERY>(bvh.nodes, bvh.primitives, root, ray, tMin, tMax, hit, [&](uint32_t triangle, float closestT, Hit* closestHit)
+	{
+		if (IntersectTriangle(vertices[triangle * 3 + 0], vertices[triangle * 3 + 1], vertices[triangle * 3 + 2], triangleRay, tMin, closestT, closestHit))
+		{
+			closestHit->triangle = triangle;
+			return true;
+		}
+		return false;
+	});
+}
+
+void TraceSubtree(const CpuScene& scene, uint32_t root, const Ray& ray, float tMin, float tMax, HitQuery query, Hit* hit)
+{
+	const BvhView bvh = FlatBvhView(scene);
+	if (query == HIT_ANY)
+	{
+		WalkTriangles<HIT_ANY>(bvh, scene.vertices.data(), root, ray, tMin, tMax, hit);
+	}
+	else
+	{
+		WalkTriangles<HIT_CLOSEST>(bvh, scene.vertices.data(), root, ray, tMin, tMax, hit);
+	}
+}
+
+//A ray prepared for testing eight children at once. The near and far planes of every
+//axis are picked from the sign of the direction, so no min or max is needed per axis.
+struct WideRay
+{
+	glm::vec3 inverseDir;
+	glm::vec3 originTimesInverseDir;
+	int nearBounds[3];
+	int farBounds[3];
+};
+
+static WideRay PrepareWideRay(const Ray& ray)
+{
+	WideRay wideRay;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		//A zero component would make both products infinite, and their difference NaN, which the
+		//min and max ignore. That turns off the axis and the ray visits far too many nodes.
+		const float dir = std::fabs(ray.dir[axis]) < 1e-20f ? std::copysign(1e-20f, ray.dir[axis]) : ray.dir[axis];
+		wideRay.inverseDir[axis] = 1.0f / dir;
+	}
+	wideRay.originTimesInverseDir = ray.origin * wideRay.inverseDir;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		wideRay.nearBounds[axis] = ray.dir[axis] >= 0.0f ? BVH8_MIN_X + axis : BVH8_MAX_X + axis;
+		wideRay.farBounds[axis] = ray.dir[axis] >= 0.0f ? BVH8_MAX_X + axis : BVH8_MIN_X + axis;
+	}
+	return wideRay;
+}
+
+//Slab tests of the eight children. Writes the entry distances and returns a bit per child hit.
+static uint32_t IntersectChildrenSse(const Bvh8Node& node, const WideRay& ray, float tMin, float tMax, float* entries)
+{
+	const __m128 inverseDirX = _mm_set1_ps(ray.inverseDir.x);
+	const __m128 inverseDirY = _mm_set1_ps(ray.inverseDir.y);
+	const __m128 inverseDirZ = _mm_set1_ps(ray.inverseDir.z);
+	const __m128 originX = _mm_set1_ps(ray.originTimesInverseDir.x);
+	const __m128 originY = _mm_set1_ps(ray.originTimesInverseDir.y);
+	const __m128 originZ = _mm_set1_ps(ray.originTimesInverseDir.z);
+	const __m128 rayMin = _mm_set1_ps(tMin);
+	const __m128 rayMax = _mm_set1_ps(tMax);
+	uint32_t mask = 0;
+	for (int half = 0; half < 8; half += 4)
+	{
+		const __m128 nearX = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&node.bounds[ray.nearBounds[0]][half]), inverseDirX), originX);
+		const __m128 nearY = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&node.bounds[ray.nearBounds[1]][half]), inverseDirY), originY);
+		const __m128 nearZ = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&node.bounds[ray.nearBounds[2]][half]), inverseDirZ), originZ);
+		const __m128 farX = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&node.bounds[ray.farBounds[0]][half]), inverseDirX), originX);
+		const __m128 farY = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&node.bounds[ray.farBounds[1]][half]), inverseDirY), originY);
+		const __m128 farZ = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&node.bounds[ray.farBounds[2]][half]), inverseDirZ), originZ);
+		const __m128 entry = _mm_max_ps(_mm_max_ps(nearX, nearY), _mm_max_ps(nearZ, rayMin));
+		const __m128 exit = _mm_min_ps(_mm_min_ps(farX, farY), _mm_min_ps(farZ, rayMax));
+		_mm_storeu_ps(entries + half, entry);
+		mask |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(entry, exit))) << half;
+	}
+	return mask;
+}
+
+#ifdef __AVX2__
+static uint32_t IntersectChildrenAvx2(const Bvh8Node& node, const WideRay& ray, float tMin, float tMax, float* entries)
+{
+	const __m256 inverseDirX = _mm256_set1_ps(ray.inverseDir.x);
+	const __m256 inverseDirY = _mm256_set1_ps(ray.inverseDir.y);
+	const __m256 inverseDirZ = _mm256_set1_ps(ray.inverseDir.z);
+	const __m256 originX = _mm256_set1_ps(ray.originTimesInverseDir.x);
+	const __m256 originY = _mm256_set1_ps(ray.originTimesInverseDir.y);
+	const __m256 originZ = _mm256_set1_ps(ray.originTimesInverseDir.z);
+	const __m256 nearX = _mm256_fmsub_ps(_mm256_loadu_ps(node.bounds[ray.nearBounds[0]]), inverseDirX, originX);
+	const __m256 nearY = _mm256_fmsub_ps(_mm256_loadu_ps(node.bounds[ray.nearBounds[1]]), inverseDirY, originY);
+	const __m256 nearZ = _mm256_fmsub_ps(_mm256_loadu_ps(node.bounds[ray.nearBounds[2]]), inverseDirZ, originZ);
+	const __m256 farX = _mm256_fmsub_ps(_mm256_loadu_ps(node.bounds[ray.farBounds[0]]), inverseDirX, originX);
+	const __m256 farY = _mm256_fmsub_ps(_mm256_loadu_ps(node.bounds[ray.farBounds[1]]), inverseDirY, originY);
+	const __m256 farZ = _mm256_fmsub_ps(_mm256_loadu_ps(node.bounds[ray.farBounds[2]]), inverseDirZ, originZ);
+	const __m256 entry = _mm256_max_ps(_mm256_max_ps(nearX, nearY), _mm256_max_ps(nearZ, _mm256_set1_ps(tMin)));
+	const __m256 exit = _mm256_min_ps(_mm256_min_ps(farX, farY), _mm256_min_ps(farZ, _mm256_set1_ps(tMax)));
+	_mm256_storeu_ps(entries, entry);
+	return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ)));
+}
+#endif
+
+//2^exponent, built from its bits
+static float ExponentScale(int8_t exponent)
+{
+	const uint32_t bits = uint32_t(exponent + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(float));
+	return scale;
+}
+
+//Without AVX2 the quantized nodes are tested four children at a time
+#ifndef __AVX2__
+//Four planes of a quantized node from 'half' on. The products are exact, so the planes are the
+//ones the node was quantized against.
+static __m128 DequantizeSse(const uint8_t* planes, int half, __m128 origin, __m128 scale)
+{
+	int32_t bytes;
+	memcpy(&bytes, planes + half, sizeof(int32_t));
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i steps = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+	return _mm_add_ps(origin, _mm_mul_ps(_mm_cvtepi32_ps(steps), scale));
+}
+
+//IntersectChildrenSse with the child bounds dequantized first
+static uint32_t IntersectChildrenQuantizedSse(const Bvh8QuantizedNode& node, const WideRay& ray, float tMin, float tMax, float* entries)
+{
+	const __m128 inverseDirX = _mm_set1_ps(ray.inverseDir.x);
+	const __m128 inverseDirY = _mm_set1_ps(ray.inverseDir.y);
+	const __m128 inverseDirZ = _mm_set1_ps(ray.inverseDir.z);
+	const __m128 originX = _mm_set1_ps(ray.originTimesInverseDir.x);
+	const __m128 originY = _mm_set1_ps(ray.originTimesInverseDir.y);
+	const __m128 originZ = _mm_set1_ps(ray.originTimesInverseDir.z);
+	const __m128 nodeOriginX = _mm_set1_ps(node.origin[0]);
+	const __m128 nodeOriginY = _mm_set1_ps(node.origin[1]);
+	const __m128 nodeOriginZ = _mm_set1_ps(node.origin[2]);
+	const __m128 scaleX = _mm_set1_ps(ExponentScale(node.exponent[0]));
+	const __m128 scaleY = _mm_set1_ps(ExponentScale(node.exponent[1]));
+	const __m128 scaleZ = _mm_set1_ps(ExponentScale(node.exponent[2]));
+	const __m128 rayMin = _mm_set1_ps(tMin);
+	const __m128 rayMax = _mm_set1_ps(tMax);
+	uint32_t mask = 0;
+	for (int half = 0; half < 8; half += 4)
+	{
+		const __m128 nearX = _mm_sub_ps(_mm_mul_ps(DequantizeSse(node.bounds[ray.nearBounds[0]], half, nodeOriginX, scaleX), inverseDirX), originX);
+		const __m128 nearY = _mm_sub_ps(_mm_mul_ps(DequantizeSse(node.bounds[ray.nearBounds[1]], half, nodeOriginY, scaleY), inverseDirY), originY);
+		const __m128 nearZ = _mm_sub_ps(_mm_mul_ps(DequantizeSse(node.bounds[ray.nearBounds[2]], half, nodeOriginZ, scaleZ), inverseDirZ), originZ);
+		const __m128 farX = _mm_sub_ps(_mm_mul_ps(DequantizeSse(node.bounds[ray.farBounds[0]], half, nodeOriginX, scaleX), inverseDirX), originX);
+		const __m128 farY = _mm_sub_ps(_mm_mul_ps(DequantizeSse(node.bounds[ray.farBounds[1]], half, nodeOriginY, scaleY), inverseDirY), originY);
+		const __m128 farZ = _mm_sub_ps(_mm_mul_ps(DequantizeSse(node.bounds[ray.farBounds[2]], half, nodeOriginZ, scaleZ), inverseDirZ), originZ);
+		const __m128 entry = _mm_max_ps(_mm_max_ps(nearX, nearY), _mm_max_ps(nearZ, rayMin));
+		const __m128 exit = _mm_min_ps(_mm_min_ps(farX, farY), _mm_min_ps(farZ, rayMax));
+		_mm_storeu_ps(entries + half, entry);
+		mask |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(entry, exit))) << half;
+	}
+	return mask;
+}
+#endif
+
+#ifdef __AVX2__
+static __m256 DequantizeAvx2(const uint8_t* planes, __m256 origin, __m256 scale)
+{
+	const __m256i steps = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes)));
+	return _mm256_add_ps(origin, _mm256_mul_ps(_mm256_cvtepi32_ps(steps), scale));
+}
+
+static uint32_t IntersectChildrenQuantizedAvx2(const Bvh8QuantizedNode& node, const WideRay& ray, float tMin, float tMax, float* entries)
+{
+	const __m256 inverseDirX = _mm256_set1_ps(ray.inverseDir.x);
+	const __m256 inverseDirY = _mm256_set1_ps(ray.inverseDir.y);
+	const __m256 inverseDirZ = _mm256_set1_ps(ray.inverseDir.z);
+	const __m256 originX = _mm256_set1_ps(ray.originTimesInverseDir.x);
+	const __m256 originY = _mm256_set1_ps(ray.originTimesInverseDir.y);
+	const __m256 originZ = _mm256_set1_ps(ray.originTimesInverseDir.z);
+	const __m256 nodeOriginX = _mm256_set1_ps(node.origin[0]);
+	const __m256 nodeOriginY = _mm256_set1_ps(node.origin[1]);
+	const __m256 nodeOriginZ = _mm256_set1_ps(node.origin[2]);
+	const __m256 scaleX = _mm256_set1_ps(ExponentScale(node.exponent[0]));
+	const __m256 scaleY = _mm256_set1_ps(ExponentScale(node.exponent[1]));
+	const __m256 scaleZ = _mm256_set1_ps(ExponentScale(node.exponent[2]));
+	const __m256 nearX = _mm256_fmsub_ps(DequantizeAvx2(node.bounds[ray.nearBounds[0]], nodeOriginX, scaleX), inverseDirX, originX);
+	const __m256 nearY = _mm256_fmsub_ps(DequantizeAvx2(node.bounds[ray.nearBounds[1]], nodeOriginY, scaleY), inverseDirY, originY);
+	const __m256 nearZ = _mm256_fmsub_ps(DequantizeAvx2(node.bounds[ray.nearBounds[2]], nodeOriginZ, scaleZ), inverseDirZ, originZ);
+	const __m256 farX = _mm256_fmsub_ps(DequantizeAvx2(node.bounds[ray.farBounds[0]], nodeOriginX, scaleX), inverseDirX, originX);
+	const __m256 farY = _mm256_fmsub_ps(DequantizeAvx2(node.bounds[ray.farBounds[1]], nodeOriginY, scaleY), inverseDirY, originY);
+	const __m256 farZ = _mm256_fmsub_ps(DequantizeAvx2(node.bounds[ray.farBounds[2]], nodeOriginZ, scaleZ), inverseDirZ, originZ);
+	const __m256 entry = _mm256_max_ps(_mm256_max_ps(nearX, nearY), _mm256_max_ps(nearZ, _mm256_set1_ps(tMin)));
+	const __m256 exit = _mm256_min_ps(_mm256_min_ps(farX, farY), _mm256_min_ps(farZ, _mm256_set1_ps(tMax)));
+	_mm256_storeu_ps(entries, entry);
+	return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ)));
+}
+#endif
+
+//The nodes WalkWide walks
+template <typename Node>
+static const Node* WideNodes(const BvhView& bvh);
+
+template <>
+const Bvh8Node* WideNodes<Bvh8Node>(const BvhView& bvh)
+{
+	return bvh.wideNodes;
+}
+
+template <>
+const Bvh8QuantizedNode* WideNodes<Bvh8QuantizedNode>(const BvhView& bvh)
+{
+	return bvh.quantizedNodes;
+}
+
+//A child waiting to be visited, with the distance where the ray enters it
+struct WideStackEntry
+{
+	uint32_t child;
+	uint32_t count;
+	float entry;
+};
+
+//The triangles of a leaf are tested a block at a time
+template <HitQuery QUERY, typename Node, uint32_t (*IntersectChildren)(const Node&, const WideRay&, float, float, float*), bool (*IntersectBlock)(const TriangleBlock&, const TriangleRay&, float, float, Hit*)>
+static bool WalkWide(const BvhView& bvh, const Ray& ray, float tMin, float tMax, Hit* hit)
+{
+	const WideRay wideRay = PrepareWideRay(ray);
+	const TriangleRay triangleRay = PrepareTriangleRay(ray);
+	const Node* nodes = WideNodes<Node>(bvh);
+	const TriangleBlock* blocks = bvh.blocks;
+	bool found = false;
+	
+	//Each level pushes at most seven children besides the one visited next
+	WideStackEntry stack[8 * BVH_MAX_DEPTH];
+	uint32_t stackSize = 1;
+	stack[0].child = 0;
+	stack[0].count = 0;
+	stack[0].entry = tMin;
+	while (stackSize > 0)
+	{
+		const WideStackEntry current = stack[--stackSize];
+		if (current.entry > tMax)
+		{
+			continue;
+		}
+		if (current.count > 0)
+		{
+			const uint32_t firstBlock = bvh.firstBlocks[current.child];
+			const uint32_t numBlocks = (current.count + TRIANGLE_BLOCK_SIZE - 1) / TRIANGLE_BLOCK_SIZE;
+			for (uint32_t i = firstBlock; i < firstBlock + numBlocks; i++)
+			{
+				if (IntersectBlock(blocks[i], triangleRay, tMin, tMax, hit))
+				{
+					found = true;
+					if (QUERY == HIT_ANY)
+					{
+						return true;
+					}
+					tMax = hit->t;
+				}
+			}
+			continue;
+		}
+		
+		const Node& node = nodes[current.child];
+		float entries[8];
+		uint32_t mask = IntersectChildren(node, wideRay, tMin, tMax, entries);
+		//Push the children so the nearest ends up on top
+		const uint32_t first = stackSize;
+		while (mask != 0)
+		{
+			const int slot = __builtin_ctz(mask);
+			mask &= mask - 1;
+			WideStackEntry entry;
+			entry.child = node.child[slot];
+			entry.count = node.count[slot];
+			entry.entry = entries[slot];
+			uint32_t position = stackSize++;
+			while (position > first && stack[position - 1].entry < entry.entry)
+			{
+				stack[position] = stack[position - 1];
+				position--;
+			}
+			stack[position] = entry;
+		}
+	}
+	return found;
+}
+
+//The BVHs of a flat scene
+template <HitQuery QUERY>
+static Hit TraceBinary(const CpuScene& scene, const Ray& ray, float tMin, float tMax)
+{
+	Hit hit;
+	const BvhView bvh = FlatBvhView(scene);
+	if (bvh.numNodes > 0)
+	{
+		WalkTriangles<QUERY>(bvh, scene.vertices.data(), 0, ray, tMin, tMax, &hit);
+	}
+	return hit;
+}
+
+template <HitQuery QUERY, typename Node, uint32_t (*IntersectChildren)(const Node&, const WideRay&, float, float, float*), bool (*IntersectBlock)(const TriangleBlock&, const TriangleRay&, float, float, Hit*)>
+static Hit TraceWide(const CpuScene& scene, const Ray& ray, float tMin, float tMax)
+{
+	Hit hit;
+	const BvhView bvh = FlatBvhView(scene);
+	if (bvh.numNodes > 0)
+	{
+		WalkWide<QUERY, Node, IntersectChildren, IntersectBlock>(bvh, ray, tMin, tMax, &hit);
+	}
+	return hit;
+}
+
+//The BVHs of a mesh of a two-level scene, with a ray in its object space
+template <HitQuery QUERY>
+static bool WalkMeshBinary(const MeshBvh& mesh, const Ray& ray, float tMin, float tMax, Hit* hit)
+{
+	return !mesh.bvh.nodes.empty() && WalkTriangles<QUERY>(ViewOf(mesh.bvh, mesh.wideBvh, mesh.triangleBlocks), mesh.vertices.data(), 0, ray, tMin, tMax, hit);
+}
+
+template <HitQuery QUERY, typename Node, uint32_t (*IntersectChildren)(const Node&, const WideRay&, float, float, float*), bool (*IntersectBlock)(const TriangleBlock&, const TriangleRay&, float, float, Hit*)>
+static bool WalkMeshWide(const MeshBvh& mesh, const Ray& ray, float tMin, float tMax, Hit* hit)
+{
+	return !mesh.wideBvh.nodes.empty() && WalkWide<QUERY, Node, IntersectChildren, IntersectBlock>(ViewOf(mesh.bvh, mesh.wideBvh, mesh.triangleBlocks), ray, tMin, tMax, hit);
+}
+
+//Walks the top level, and the BVH of the mesh of every instance reached, with the ray taken into the
+//space of the instance. The direction isn't normalized again, so distances along it stay the same.
+template <HitQuery QUERY, bool (*WalkMesh)(const MeshBvh&, const Ray&, float, float, Hit*)>
+static Hit TraceTwoLevel(const CpuScene& scene, const Ray& ray, float tMin, float tMax)
+{
+	Hit hit;
+	const TwoLevelBvh& twoLevel = scene.twoLevel;
+	if (twoLevel.topLevel.nodes.empty())
+	{
+		return hit;
+	}
+	WalkBinary<QUERY>(twoLevel.topLevel.nodes.data(), twoLevel.topLevel.primitives.data(), 0, ray, tMin, tMax, &hit, [&](uint32_t instanceIndex, float closestT, Hit* closestHit)
+	{
+		const BvhInstance& instance = twoLevel.instances[instanceIndex];
+		Ray objectRay;
+		objectRay.origin = glm::vec3(instance.inverseTransform * glm::vec4(ray.origin, 1.0f));
+		objectRay.dir = glm::vec3(instance.inverseTransform * glm::vec4(ray.dir, 0.0f));
+		if (WalkMesh(twoLevel.meshes[instance.mesh], objectRay, tMin, closestT, closestHit))
+		{
+			closestHit->instance = instanceIndex;
+			return true;
+		}
+		return false;
+	});
+	return hit;
+}
+
+template <HitQuery QUERY>
+static Hit Trace(const CpuScene& scene, const Ray& ray, float tMin, float tMax, TraversalKernel kernel)
+{
+	if (scene.layout == CPU_SCENE_TWO_LEVEL)
+	{
+		switch (kernel)
+		{
+			case TRAVERSAL_BINARY:
+				return TraceTwoLevel<QUERY, WalkMeshBinary<QUERY> >(scene, ray, tMin, tMax);
+			case TRAVERSAL_BVH8_QUANTIZED:
+#ifdef __AVX2__
+				return TraceTwoLevel<QUERY, WalkMeshWide<QUERY, Bvh8QuantizedNode, IntersectChildrenQuantizedAvx2, IntersectBlockAvx2> >(scene, ray, tMin, tMax);
+#else
+				return TraceTwoLevel<QUERY, WalkMeshWide<QUERY, Bvh8QuantizedNode, IntersectChildrenQuantizedSse, IntersectBlockSse> >(scene, ray, tMin, tMax);
+#endif
+#ifdef __AVX512VL__
+			case TRAVERSAL_BVH8_AVX512:
+				return TraceTwoLevel<QUERY, WalkMeshWide<QUERY, Bvh8Node, IntersectChildrenAvx2, IntersectBlockAvx512> >(scene, ray, tMin, tMax);
+#endif
+#ifdef __AVX2__
+			case TRAVERSAL_BVH8_AVX2:
+				return TraceTwoLevel<QUERY, WalkMeshWide<QUERY, Bvh8Node, IntersectChildrenAvx2, IntersectBlockAvx2> >(scene, ray, tMin, tMax);
+#endif
+			default:
+				return TraceTwoLevel<QUERY, WalkMeshWide<QUERY, Bvh8Node, IntersectChildrenSse, IntersectBlockSse> >(scene, ray, tMin, tMax);
+		}
+	}
+	switch (kernel)
+	{
+		case TRAVERSAL_BINARY:
+			return TraceBinary<QUERY>(scene, ray, tMin, tMax);
+		case TRAVERSAL_BVH8_QUANTIZED:
+#ifdef __AVX2__
+			return TraceWide<QUERY, Bvh8QuantizedNode, IntersectChildrenQuantizedAvx2, IntersectBlockAvx2>(scene, ray, tMin, tMax);
+#else
+			return TraceWide<QUERY, Bvh8QuantizedNode, IntersectChildrenQuantizedSse, IntersectBlockSse>(scene, ray, tMin, tMax);
+#endif
+#ifdef __AVX512VL__
+		case TRAVERSAL_BVH8_AVX512:
+			return TraceWide<QUERY, Bvh8Node, IntersectChildrenAvx2, IntersectBlockAvx512>(scene, ray, tMin, tMax);
+#endif
+#ifdef __AVX2__
+		case TRAVERSAL_BVH8_AVX2:
+			return TraceWide<QUERY, Bvh8Node, IntersectChildrenAvx2, IntersectBlockAvx2>(scene, ray, tMin, tMax);
+#endif
+		default:
+			return TraceWide<QUERY, Bvh8Node, IntersectChildrenSse, IntersectBlockSse>(scene, ray, tMin, tMax);
+	}
+}
+
+Hit TraceRay(const CpuScene& scene, const Ray& ray, float tMin, float tMax, TraversalKernel kernel)
+{
+	return Trace<HIT_CLOSEST>(scene, ray, tMin, tMax, kernel);
+}
+
+Hit TraceAnyHit(const CpuScene& scene, const Ray& ray, float tMin, float tMax, TraversalKernel kernel)
+{
+	return Trace<HIT_ANY>(scene, ray, tMin, tMax, kernel);
+}
+
+bool Occluded(const CpuScene& scene, const Ray& ray, float tMin, float tMax, TraversalKernel kernel)
+{
+	return Trace<HIT_ANY>(scene, ray, tMin, tMax, kernel).t >= 0.0f;
+}
+
+int TraceLights(const CpuScene& scene, const Ray& ray, float tMin, float tMax, float* t)
+{
+	const Bvh& bvh = scene.lightBvh.bvh;
+	if (bvh.nodes.empty())
+	{
+		return -1;
+	}
+	//'triangle' is the light. It starts at 0 so a light at exactly tMax is a miss, like in the shader.
+	Hit hit;
+	const bool found = WalkBinary<HIT_CLOSEST>(bvh.nodes.data(), bvh.primitives.data(), 0, ray, tMin, tMax, &hit, [&](uint32_t light, float closestT, Hit* closest)
+	{
+		const glm::vec4& centerAndRadius = scene.lights[light].centerAndRadius;
+		const float lightT = SphereIntersect(glm::vec3(centerAndRadius), centerAndRadius.w, ray.origin, ray.dir, tMin, closestT);
+		if (lightT > tMin && (lightT < closestT || (lightT == closestT && light < closest->triangle)))
+		{
+			closest->t = lightT;
+			closest->triangle = light;
+			return true;
+		}
+		return false;
+	});
+	*t = hit.t;
+	return found ? int(hit.triangle) : -1;
+}
+
+glm::vec3 HitNormal(const CpuScene& scene, const Hit& hit)
+{
+	if (scene.layout == CPU_SCENE_TWO_LEVEL)
+	{
+		const BvhInstance& instance = scene.twoLevel.instances[hit.instance];
+		const glm::vec3* normals = &scene.twoLevel.meshes[instance.mesh].normals[hit.triangle * 3];
+		return glm::normalize(instance.normalMatrix * ((1.0f - hit.u - hit.v) * normals[0] + hit.u * normals[1] + hit.v * normals[2]));
+	}
+	const glm::vec3* normals = &scene.normals[hit.triangle * 3];
+	return glm::normalize((1.0f - hit.u - hit.v) * normals[0] + hit.u * normals[1] + hit.v * normals[2]);
+}
+
+uint32_t HitMesh(const CpuScene& scene, const Hit& hit)
+{
+	if (scene.layout == CPU_SCENE_TWO_LEVEL)
+	{
+		return scene.twoLevel.instances[hit.instance].mesh;
+	}
+	return scene.triangleMeshes[hit.triangle];
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
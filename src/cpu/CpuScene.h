@@ -0,0 +1,187 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef CPU_SCENE_H
+#define CPU_SCENE_H
+
+#include "BrhanFile.h"
+#include "Bvh.h"
+#include "Bvh8.h"
+#include "glm/vec3.hpp"
+#include "LightBvh.h"
+#include "MappedFile.h"
+#include "MeshLoader.h"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include "TriangleBlock.h"
+#include "TwoLevelBvh.h"
+#include <vector>
+
+//How a scene keeps its instances
+enum CpuSceneLayout
+{
+	//Every instance flattened into world space triangles, under one BVH. The fastest to trace.
+	CPU_SCENE_FLAT,
+	//A BVH per mesh and one over the instances, like the bottom and top level acceleration
+	//structures on the GPU. Rays are taken into the space of every instance they reach. Moving
+	//instances only refits or rebuilds the top level, see UpdateCpuScene.
+	CPU_SCENE_TWO_LEVEL
+};
+
+//The arrays the traversal reads of a binary BVH, its BVH8 and their triangle blocks, wherever they are
+struct BvhView
+{
+	uint32_t numNodes = 0;
+	const BvhNode* nodes = NULL;
+	const uint32_t* primitives = NULL;
+	const Bvh8Node* wideNodes = NULL;
+	const Bvh8QuantizedNode* quantizedNodes = NULL;
+	const TriangleBlock* blocks = NULL;
+	const uint32_t* firstBlocks = NULL;
+};
+
+//The geometry of a scene, either flattened or in two levels. This is what the top and bottom level
+//acceleration structures, and the attribute buffers, hold on the GPU.
+struct CpuScene
+{
+	CpuSceneLayout layout = CPU_SCENE_FLAT;
+	//One per mesh
+	std::vector<Material> materials;
+	std::vector<SphericalLightFromFile> lights;
+	LightBvh lightBvh;
+	
+	//Flat scenes only. Three per triangle.
+	std::vector<glm::vec3> vertices;
+	//Three per triangle, in world space but not normalized so they can be interpolated first
+	std::vector<glm::vec3> normals;
+	//The mesh of every triangle, which is the custom index of its instance on the GPU
+	std::vector<uint32_t> triangleMeshes;
+	//Over the triangles, and the same tree collapsed to eight children per node
+	Bvh bvh;
+	Bvh8 wideBvh;
+	//The triangles of the leaves of 'wideBvh'
+	TriangleBlocks triangleBlocks;
+	//Set when the three above were loaded from a BVH cache file, see LoadBrhanBvhFile. They stay
+	//empty and the traversal reads the mapping, until an update copies them out of it.
+	MappedFile bvhCache;
+	BvhView cachedBvh;
+	
+	//Two-level scenes only
+	TwoLevelBvh twoLevel;
+};
+
+struct CpuSceneStats
+{
+	//Triangles of all instances, in either layout
+	uint64_t numTriangles = 0;
+	BvhBuildStats lightBvh;
+	//Flat scenes
+	BvhBuildStats bvh;
+	Bvh8Stats wideBvh;
+	//Flat scenes whose BVHs were mapped from a cache file instead of built. The build and collapse
+	//times are then 0, and the counts are from the build that wrote the cache.
+	bool bvhCached = false;
+	float bvhCacheTime = 0.0f; //ms, hashing the triangles and mapping the cache, or writing it
+	//Two-level scenes
+	TwoLevelBvhStats twoLevel;
+};
+
+struct CpuSceneUpdateStats
+{
+	float updateTime = 0.0f; //ms, all of the update
+	//The BVH over the triangles of a flat scene, or the top level of a two-level scene
+	BvhRefitStats bvh;
+	//Two-level scenes whose meshes changed, how many had their BVH built again
+	uint32_t rebuiltMeshes = 0;
+};
+
+//How TraceRay walks the scene
+enum TraversalKernel
+{
+	TRAVERSAL_BINARY,
+	//BVH8 with the eight children, and the triangles of a leaf, tested as two groups of four
+	TRAVERSAL_BVH8_SSE,
+	//BVH8 with the eight children, and the triangles of a leaf, tested at once. Only when compiled with AVX2.
+	TRAVERSAL_BVH8_AVX2,
+	//TRAVERSAL_BVH8_AVX2 with the triangles tested by IntersectBlockAvx512. Only when compiled with AVX-512VL.
+	TRAVERSAL_BVH8_AVX512,
+	//BVH8 over Bvh8QuantizedNode, with the AVX2 tests when compiled with AVX2 and SSE otherwise.
+	//The quantized bounds hold the float ones, so it finds the same hits, after visiting more nodes.
+	TRAVERSAL_BVH8_QUANTIZED
+};
+
+//What a trace looks for
+enum HitQuery
+{
+	//The closest hit, for rays that need to know what they hit
+	HIT_CLOSEST,
+	//The first hit the traversal comes across, which is not always the closest. The traversal stops
+	//there, so rays that only ask whether something is in the way are cheaper.
+	HIT_ANY
+};
+
+#ifdef __AVX2__
+const TraversalKernel DEFAULT_TRAVERSAL_KERNEL = TRAVERSAL_BVH8_AVX2;
+#else
+const TraversalKernel DEFAULT_TRAVERSAL_KERNEL = TRAVERSAL_BVH8_SSE;
+#endif
+
+//Also builds the BVHs of the layout and the light BVH, with spatial splits for the instances that have a split budget.
+//A flat scene given a 'bvhCacheFile' maps its BVHs from it when it was written for the same
+//geometry, and otherwise builds them and writes the file, see BrhanBvhFile.h. Two-level scenes are
+//always built.
+CpuSceneStats BuildCpuScene(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, const std::vector<SphericalLightFromFile>& lights, CpuSceneLayout layout, ThreadPool& threadPool, CpuScene* scene, const char* bvhCacheFile = NULL);
+//Brings a scene built from 'meshes' and 'instances' up to date after the instances were given new
+//transforms, or the vertices of the meshes moved when 'meshesChanged' is set. There have to be as
+//many meshes, instances and triangles as it was built with. The BVHs are refit, and built again once
+//the refits have made them too slow, see RefitOrRebuildBvh, with 'builder'.
+CpuSceneUpdateStats UpdateCpuScene(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, bool meshesChanged, float rebuildThreshold, ThreadPool& threadPool, CpuScene* scene, BvhBuilder builder = BVH_BUILDER_SAH);
+//World space bounds of all the geometry
+BoundingBox CpuSceneBounds(const CpuScene& scene);
+//The BVHs of a flat scene, in the scene or in the cache it was loaded from
+BvhView FlatBvhView(const CpuScene& scene);
+//Closest triangle hit in (tMin, tMax). Every kernel finds the same hit.
+Hit TraceRay(const CpuScene& scene, const Ray& ray, float tMin, float tMax, TraversalKernel kernel = DEFAULT_TRAVERSAL_KERNEL);
+//Any triangle hit in (tMin, tMax). Children are visited nearest first, so it is often the closest one.
+Hit TraceAnyHit(const CpuScene& scene, const Ray& ray, float tMin, float tMax, TraversalKernel kernel = DEFAULT_TRAVERSAL_KERNEL);
+//True when a triangle is hit in (tMin, tMax)
+bool Occluded(const CpuScene& scene, const Ray& ray, float tMin, float tMax, TraversalKernel kernel = DEFAULT_TRAVERSAL_KERNEL);
+//Walks the binary BVH of a flat scene from the node 'root' and updates 'hit' with a triangle in
+//(tMin, tMax), as 'query' asks
+void TraceSubtree(const CpuScene& scene, uint32_t root, const Ray& ray, float tMin, float tMax, HitQuery query, Hit* hit);
+//The closest light whose sphere the ray hits in (tMin, tMax), the first of them on a tie like the
+//loop over the lights in primary.rgen. Returns its index and writes the distance to 't', or -1 on a miss.
+int TraceLights(const CpuScene& scene, const Ray& ray, float tMin, float tMax, float* t);
+//Interpolated and normalized world space normal at a hit
+glm::vec3 HitNormal(const CpuScene& scene, const Hit& hit);
+//The mesh that was hit, which indexes 'materials'
+uint32_t HitMesh(const CpuScene& scene, const Hit& hit);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
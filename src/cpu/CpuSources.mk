@@ -0,0 +1,7 @@
+#The sources of the CPU renderer, shared by the top-level Makefile and the test_scripts that link
+#against it so the lists can't drift apart. Set SRC_DIR before including this.
+#The CPU renderer only needs the scene loading code, no Vulkan or GLFW
+CPU_SRC_FILES = $(wildcard $(SRC_DIR)/cpu/*.cpp)
+CPU_SRC_FILES += $(addprefix $(SRC_DIR)/, BrhanFile.cpp BrhanMeshFile.cpp Camera.cpp Logger.cpp MappedFile.cpp MeshLoader.cpp NumberParser.cpp ObjFile.cpp ThreadPool.cpp)
+#Everything but the CpuRenderer's main, for programs with their own
+CPU_LIB_SRC_FILES = $(filter-out $(SRC_DIR)/cpu/main.cpp, $(CPU_SRC_FILES))
@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "LightBvh.h"
+
+float SphereIntersect(const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& rayOrigin, const glm::vec3& rayDir, float tMin, float tMax)
+{
+	float a = glm::dot(rayDir, rayDir);
+	glm::vec3 sphereCenterToRayOrigin = rayOrigin - sphereCenter;
+	float b = 2.0f * glm::dot(rayDir, sphereCenterToRayOrigin);
+	float c = glm::dot(sphereCenterToRayOrigin, sphereCenterToRayOrigin) - sphereRadius * sphereRadius;
+	
+	float discriminant = b * b - 4.0f * a * c;
+	if (discriminant <= 0.0f)
+	{
+		return -1.0f;
+	}
+	
+	float denominator = 2.0f * a;
+	float t2 = (-b - std::sqrt(discriminant)) / denominator;
+	if (t2 >= tMin && t2 <= tMax)
+	{
+		return t2;
+	}
+	
+	float t1 = (-b + std::sqrt(discriminant)) / denominator;
+	if (t1 >= tMin && t1 <= tMax)
+	{
+		return t1;
+	}
+	
+	return -1.0f;
+}
+
+static float MaxChannel(const glm::vec3& emittance)
+{
+	return std::max(std::max(emittance.x, emittance.y), emittance.z);
+}
+
+static LightCluster ComputeCluster(const std::vector<SphericalLightFromFile>& lights, uint32_t nodeIndex, LightBvh* lightBvh)
+{
+	const BvhNode& node = lightBvh->bvh.nodes[nodeIndex];
+	LightCluster cluster;
+	cluster.center = glm::vec3(0.0f);
+	cluster.emittance = glm::vec3(0.0f);
+	cluster.numLights = 0;
+	float weight = 0.0f;
+	if (node.count > 0)
+	{
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			const SphericalLightFromFile& light = lights[lightBvh->bvh.primitives[i]];
+			const float lightWeight = MaxChannel(glm::vec3(light.emittance));
+			cluster.center += glm::vec3(light.centerAndRadius) * lightWeight;
+			cluster.emittance += glm::vec3(light.emittance);
+			weight += lightWeight;
+		}
+		cluster.numLights = node.count;
+	}
+	else
+	{
+		const LightCluster left = ComputeCluster(lights, node.leftOrFirst, lightBvh);
+		const LightCluster right = ComputeCluster(lights, node.leftOrFirst + 1, lightBvh);
+		const float leftWeight = MaxChannel(left.emittance);
+		const float rightWeight = MaxChannel(right.emittance);
+		cluster.center = left.center * leftWeight + right.center * rightWeight;
+		cluster.emittance = left.emittance + right.emittance;
+		cluster.numLights = left.numLights + right.numLights;
+		weight = leftWeight + rightWeight;
+	}
+	//Lights without emittance are placed at the center of the box
+	cluster.center = weight > 0.0f ? cluster.center / weight : (node.boundsMin + node.boundsMax) * 0.5f;
+	lightBvh->clusters[nodeIndex] = cluster;
+	return cluster;
+}
+
+BvhBuildStats BuildLightBvh(const std::vector<SphericalLightFromFile>& lights, ThreadPool& threadPool, LightBvh* lightBvh)
+{
+	std::vector<BoundingBox> lightBounds(lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		const glm::vec3 center(lights[i].centerAndRadius);
+		const float radius = lights[i].centerAndRadius.w;
+		lightBounds[i].Grow(center - glm::vec3(radius));
+		lightBounds[i].Grow(center + glm::vec3(radius));
+	}
+	const BvhBuildStats stats = BuildBvh(lightBounds, threadPool, &lightBvh->bvh);
+	lightBvh->clusters.resize(lightBvh->bvh.nodes.size());
+	if (!lightBvh->bvh.nodes.empty())
+	{
+		ComputeCluster(lights, 0, lightBvh);
+	}
+	return stats;
+}
+
+void GatherLights(const LightBvh& lightBvh, const std::vector<SphericalLightFromFile>& lights, const glm::vec3& point, float cutoff, std::vector<uint32_t>* shaded, std::vector<uint32_t>* clusters)
+{
+	shaded->clear();
+	clusters->clear();
+	if (cutoff <= 0.0f)
+	{
+		for (uint32_t i = 0; i < uint32_t(lights.size()); i++)
+		{
+			shaded->push_back(i);
+		}
+		return;
+	}
+	if (lightBvh.bvh.nodes.empty())
+	{
+		return;
+	}
+	
+	//No light of a node is closer to the point than its box, which holds their spheres, so all of them
+	//together add less than the cutoff when their summed emittance over that distance does
+	const std::vector<BvhNode>& nodes = lightBvh.bvh.nodes;
+	uint32_t stack[BVH_MAX_DEPTH + 1];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const uint32_t nodeIndex = stack[--stackSize];
+		const BvhNode& node = nodes[nodeIndex];
+		const glm::vec3 outside = glm::max(glm::max(node.boundsMin - point, point - node.boundsMax), glm::vec3(0.0f));
+		if (MaxChannel(lightBvh.clusters[nodeIndex].emittance) < cutoff * glm::length(outside))
+		{
+			clusters->push_back(nodeIndex);
+		}
+		else if (node.count == 0)
+		{
+			stack[stackSize++] = node.leftOrFirst;
+			stack[stackSize++] = node.leftOrFirst + 1;
+		}
+		else
+		{
+			shaded->insert(shaded->end(), lightBvh.bvh.primitives.begin() + node.leftOrFirst, lightBvh.bvh.primitives.begin() + node.leftOrFirst + node.count);
+		}
+	}
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
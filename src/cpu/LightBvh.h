@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include "BrhanFile.h"
+#include "Bvh.h"
+#include "glm/vec3.hpp"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+/*
+primary.rgen tests the primary ray against every spherical light and traces a shadow ray to every
+light, which makes a pixel cost as much as the scene has lights. The CPU passes find the light a ray
+hits through a BVH over the bounds of the spheres instead. Shading can skip the lights that are too
+dim or too far away to matter: a light adds at most its emittance over the distance to its surface
+to the color of a point. Every node knows the summed emittance of the lights below it, so a subtree
+of lights that together add too little to a point is shaded at once, as one light without a shadow
+ray, see GatherLights. The shader lights a point with emittance over distance, which falls off slowly,
+so many far away lights still add up to a lot. Leaving them out would darken the image much more.
+*/
+
+//The lights below a node of the light BVH, seen from far away
+struct LightCluster
+{
+	//Of the centers of the lights, weighted by their emittance
+	glm::vec3 center;
+	//Summed
+	glm::vec3 emittance;
+	uint32_t numLights;
+};
+
+struct LightBvh
+{
+	//Its primitives are indices into the lights
+	Bvh bvh;
+	//One per node
+	std::vector<LightCluster> clusters;
+};
+
+//Sphere.glsl. The distance along the ray to the sphere in [tMin, tMax], or -1 on a miss.
+float SphereIntersect(const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& rayOrigin, const glm::vec3& rayDir, float tMin, float tMax);
+//Binned SAH build over the bounds of the spheres. An empty tree without lights.
+BvhBuildStats BuildLightBvh(const std::vector<SphericalLightFromFile>& lights, ThreadPool& threadPool, LightBvh* lightBvh);
+//Splits the lights into those that are shaded one by one at 'point', written to 'shaded', and the
+//nodes whose lights all together add less than 'cutoff' to every color channel of it, written to
+//'clusters'. Lights with the point inside are always shaded. Each cluster is off by less than the
+//cutoff, so the error of a point grows with how many clusters there are rather than how many lights.
+//A cutoff of 0 or less shades all lights, in order.
+void GatherLights(const LightBvh& lightBvh, const std::vector<SphericalLightFromFile>& lights, const glm::vec3& point, float cutoff, std::vector<uint32_t>* shaded, std::vector<uint32_t>* clusters);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
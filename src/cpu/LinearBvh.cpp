@@ -0,0 +1,540 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "glm/common.hpp"
+#include "LinearBvh.h"
+
+//Ten bits per axis
+static const uint32_t MORTON_AXIS_BITS = 10;
+//Bits sorted per radix sort pass, four passes sort the 30 bit codes
+static const uint32_t RADIX_BITS = 8;
+static const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+static const uint32_t RADIX_PASSES = 4;
+//Primitives are sorted, and the tree is built, in chunks of this many per task
+static const uint32_t PARALLEL_CHUNK_SIZE = 16384;
+//Subtrees with more primitives than this are written out as tasks
+static const uint32_t PARALLEL_EMIT_SIZE = 4096;
+//Leaves of a treelet, as in Karras and Aila
+static const uint32_t TREELET_SIZE = 7;
+static const uint32_t TREELET_SUBSETS = 1 << TREELET_SIZE;
+//Only subtrees this large are reordered. The small ones are many, most become leaves anyway, and
+//reordering every subtree of seven takes longer than the SAH build.
+static const uint32_t TREELET_MIN_PRIMITIVES = 32;
+
+//The binary radix tree is built in place of the final tree. Its leaves hold one primitive each, and
+//the children of inner node i are at 1 + 2 * i and 2 + 2 * i, with the root at 0.
+struct LinearBuildContext
+{
+	//Primitive indices sorted by Morton code
+	std::vector<uint32_t> sortedPrimitives;
+	std::vector<uint32_t> codes;
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> parents;
+	//The second child to get its bounds goes on to the parent
+	std::vector<std::atomic<uint32_t>> visits;
+	//SAH cost of the subtrees, surface area times the cost of testing what they hold, and their
+	//primitives
+	std::vector<float> subtreeCosts;
+	std::vector<uint32_t> subtreePrimitives;
+	bool reorderTreelets;
+	Bvh* bvh;
+	std::atomic<uint32_t> numNodes;
+	std::atomic<uint32_t> numLeaves;
+	std::atomic<uint32_t> numPrimitives;
+	std::atomic<uint32_t> maxDepth;
+	ThreadPool* threadPool;
+};
+
+//Puts two zero bits in front of each of the lower ten bits
+static uint32_t SpreadBits(uint32_t v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+//'point' is in [0, 1] on every axis
+static uint32_t MortonCode(const glm::vec3& point)
+{
+	const float cells = float(1 << MORTON_AXIS_BITS);
+	const glm::vec3 cell = glm::clamp(point * cells, glm::vec3(0.0f), glm::vec3(cells - 1.0f));
+	return (SpreadBits(uint32_t(cell.x)) << 2) | (SpreadBits(uint32_t(cell.y)) << 1) | SpreadBits(uint32_t(cell.z));
+}
+
+//Stable LSD radix sort of 'codes', with 'values' moved along. Every pass counts the digits of each
+//chunk, and then scatters the chunks to where the counts of the chunks before them end.
+static void RadixSort(std::vector<uint32_t>& codes, std::vector<uint32_t>& values, ThreadPool& threadPool)
+{
+	const uint32_t count = uint32_t(codes.size());
+	const uint32_t numChunks = (count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+	std::vector<uint32_t> codesOut(count);
+	std::vector<uint32_t> valuesOut(count);
+	std::vector<uint32_t> offsets(numChunks * RADIX_SIZE);
+	for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+	{
+		const uint32_t shift = pass * RADIX_BITS;
+		threadPool.ParallelFor(0, numChunks, 1, [&](uint32_t chunk)
+		{
+			uint32_t* histogram = &offsets[chunk * RADIX_SIZE];
+			std::fill(histogram, histogram + RADIX_SIZE, 0);
+			const uint32_t end = std::min((chunk + 1) * PARALLEL_CHUNK_SIZE, count);
+			for (uint32_t i = chunk * PARALLEL_CHUNK_SIZE; i < end; i++)
+			{
+				histogram[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+			}
+		});
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < RADIX_SIZE; digit++)
+		{
+			for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+			{
+				const uint32_t digitCount = offsets[chunk * RADIX_SIZE + digit];
+				offsets[chunk * RADIX_SIZE + digit] = offset;
+				offset += digitCount;
+			}
+		}
+		threadPool.ParallelFor(0, numChunks, 1, [&](uint32_t chunk)
+		{
+			uint32_t* chunkOffsets = &offsets[chunk * RADIX_SIZE];
+			const uint32_t end = std::min((chunk + 1) * PARALLEL_CHUNK_SIZE, count);
+			for (uint32_t i = chunk * PARALLEL_CHUNK_SIZE; i < end; i++)
+			{
+				const uint32_t destination = chunkOffsets[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+				codesOut[destination] = codes[i];
+				valuesOut[destination] = values[i];
+			}
+		});
+		codes.swap(codesOut);
+		values.swap(valuesOut);
+	}
+}
+
+//Length of the common prefix of the codes at i and j, with the indices breaking ties between equal
+//codes. -1 when j is outside the leaves.
+static int CommonPrefix(const LinearBuildContext& context, int i, int j)
+{
+	if (j < 0 || j >= int(context.codes.size()))
+	{
+		return -1;
+	}
+	const uint32_t a = context.codes[i];
+	const uint32_t b = context.codes[j];
+	return a == b ? 32 + __builtin_clz(uint32_t(i ^ j)) : __builtin_clz(a ^ b);
+}
+
+//The leaves inner node i covers start or end at i, Karras finds the other end and where the
+//prefix of the range changes with binary searches. Children that cover one leaf are leaves.
+static void FindChildren(const LinearBuildContext& context, int i, int* split, bool* leftIsLeaf, bool* rightIsLeaf)
+{
+	const int direction = CommonPrefix(context, i, i + 1) > CommonPrefix(context, i, i - 1) ? 1 : -1;
+	const int minPrefix = CommonPrefix(context, i, i - direction);
+	int maxLength = 2;
+	while (CommonPrefix(context, i, i + maxLength * direction) > minPrefix)
+	{
+		maxLength *= 2;
+	}
+	int length = 0;
+	for (int step = maxLength / 2; step >= 1; step /= 2)
+	{
+		if (CommonPrefix(context, i, i + (length + step) * direction) > minPrefix)
+		{
+			length += step;
+		}
+	}
+	const int j = i + length * direction;
+	
+	const int nodePrefix = CommonPrefix(context, i, j);
+	int offset = 0;
+	int divisor = 2;
+	int step;
+	do
+	{
+		step = (length + divisor - 1) / divisor;
+		if (CommonPrefix(context, i, i + (offset + step) * direction) > nodePrefix)
+		{
+			offset += step;
+		}
+		divisor *= 2;
+	} while (step > 1);
+	*split = i + offset * direction + std::min(direction, 0);
+	*leftIsLeaf = std::min(i, j) == *split;
+	*rightIsLeaf = std::max(i, j) == *split + 1;
+}
+
+static BoundingBox NodeBounds(const BvhNode& node)
+{
+	BoundingBox bounds;
+	bounds.min = node.boundsMin;
+	bounds.max = node.boundsMax;
+	return bounds;
+}
+
+//Cost of a node holding 'numPrimitives' as a leaf, relative to its children's cost when it isn't.
+//Nodes with too many primitives are never made leaves.
+static float LeafCost(float area, uint32_t numPrimitives)
+{
+	return numPrimitives <= BVH_MAX_LEAF_SIZE ? BVH_INTERSECTION_COST * area * numPrimitives : FLT_MAX;
+}
+
+//Whether the subtree at 'index' is cheaper as a single leaf
+static bool CollapsesToLeaf(const LinearBuildContext& context, uint32_t index)
+{
+	const BvhNode& node = context.nodes[index];
+	if (node.count > 0)
+	{
+		return true;
+	}
+	const float area = NodeBounds(node).SurfaceArea();
+	const float splitCost = BVH_TRAVERSAL_COST * area + context.subtreeCosts[node.leftOrFirst] + context.subtreeCosts[node.leftOrFirst + 1];
+	return LeafCost(area, context.subtreePrimitives[index]) <= splitCost;
+}
+
+//Rebuilds the treelet at 'root' in the shape with the lowest SAH cost, found by trying every split of
+//every subset of its leaves, smallest subsets first
+static void ReorderTreelet(LinearBuildContext& context, uint32_t root)
+{
+	//Opens the leaf with the largest surface area until there are enough
+	uint32_t leaves[TREELET_SIZE];
+	uint32_t numLeaves = 2;
+	leaves[0] = context.nodes[root].leftOrFirst;
+	leaves[1] = leaves[0] + 1;
+	uint32_t pairs[TREELET_SIZE - 1];
+	uint32_t numPairs = 1;
+	pairs[0] = leaves[0];
+	while (numLeaves < TREELET_SIZE)
+	{
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (uint32_t i = 0; i < numLeaves; i++)
+		{
+			const BvhNode& node = context.nodes[leaves[i]];
+			if (node.count == 0 && NodeBounds(node).SurfaceArea() > largestArea)
+			{
+				largest = int(i);
+				largestArea = NodeBounds(node).SurfaceArea();
+			}
+		}
+		if (largest == -1)
+		{
+			break;
+		}
+		const uint32_t opened = context.nodes[leaves[largest]].leftOrFirst;
+		pairs[numPairs++] = opened;
+		leaves[largest] = opened;
+		leaves[numLeaves++] = opened + 1;
+	}
+	
+	BoundingBox subsetBounds[TREELET_SUBSETS];
+	float subsetCosts[TREELET_SUBSETS];
+	uint32_t subsetPrimitives[TREELET_SUBSETS];
+	uint32_t subsetSplits[TREELET_SUBSETS];
+	const uint32_t numSubsets = 1 << numLeaves;
+	subsetBounds[0] = BoundingBox();
+	subsetPrimitives[0] = 0;
+	for (uint32_t subset = 1; subset < numSubsets; subset++)
+	{
+		//The subset without its lowest leaf is done already
+		const uint32_t lowest = subset & (~subset + 1);
+		const uint32_t leaf = leaves[__builtin_ctz(subset)];
+		subsetBounds[subset] = subsetBounds[subset ^ lowest];
+		subsetBounds[subset].Grow(NodeBounds(context.nodes[leaf]));
+		subsetPrimitives[subset] = subsetPrimitives[subset ^ lowest] + context.subtreePrimitives[leaf];
+		if ((subset & (subset - 1)) == 0)
+		{
+			subsetCosts[subset] = context.subtreeCosts[leaf];
+			continue;
+		}
+		//Every split into two non-empty parts, with the lowest leaf on the left
+		float bestCost = FLT_MAX;
+		const uint32_t rest = subset ^ lowest;
+		for (uint32_t right = rest; right > 0; right = (right - 1) & rest)
+		{
+			const float cost = subsetCosts[subset ^ right] + subsetCosts[right];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				subsetSplits[subset] = subset ^ right;
+			}
+		}
+		const float area = subsetBounds[subset].SurfaceArea();
+		subsetCosts[subset] = std::min(BVH_TRAVERSAL_COST * area + bestCost, LeafCost(area, subsetPrimitives[subset]));
+	}
+	const uint32_t all = numSubsets - 1;
+	if (!(subsetCosts[all] < context.subtreeCosts[root]))
+	{
+		return;
+	}
+	
+	//The leaves are moved, so they are copied out first. The pairs of the inner nodes are reused.
+	BvhNode leafNodes[TREELET_SIZE];
+	float leafCosts[TREELET_SIZE];
+	for (uint32_t i = 0; i < numLeaves; i++)
+	{
+		leafNodes[i] = context.nodes[leaves[i]];
+		leafCosts[i] = context.subtreeCosts[leaves[i]];
+	}
+	uint32_t usedPairs = 0;
+	struct Placement
+	{
+		uint32_t index;
+		uint32_t subset;
+	};
+	Placement stack[2 * TREELET_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { root, all };
+	while (stackSize > 0)
+	{
+		const Placement placement = stack[--stackSize];
+		const uint32_t subset = placement.subset;
+		if ((subset & (subset - 1)) == 0)
+		{
+			const uint32_t leaf = __builtin_ctz(subset);
+			context.nodes[placement.index] = leafNodes[leaf];
+			context.subtreeCosts[placement.index] = leafCosts[leaf];
+			context.subtreePrimitives[placement.index] = subsetPrimitives[subset];
+			continue;
+		}
+		const uint32_t pair = pairs[usedPairs++];
+		BvhNode& node = context.nodes[placement.index];
+		node.boundsMin = subsetBounds[subset].min;
+		node.boundsMax = subsetBounds[subset].max;
+		node.leftOrFirst = pair;
+		node.count = 0;
+		context.subtreeCosts[placement.index] = subsetCosts[subset];
+		context.subtreePrimitives[placement.index] = subsetPrimitives[subset];
+		stack[stackSize++] = { pair, subsetSplits[subset] };
+		stack[stackSize++] = { pair + 1, subset ^ subsetSplits[subset] };
+	}
+}
+
+//Walks up from a leaf for as long as it is the second child of a node to be done, and sets the
+//bounds and cost of the nodes it passes
+static void BuildUpwards(LinearBuildContext& context, uint32_t leaf)
+{
+	uint32_t index = leaf;
+	while (index != 0)
+	{
+		index = context.parents[index];
+		if (context.visits[index].fetch_add(1) == 0)
+		{
+			return;
+		}
+		BvhNode& node = context.nodes[index];
+		const uint32_t left = node.leftOrFirst;
+		BoundingBox bounds = NodeBounds(context.nodes[left]);
+		bounds.Grow(NodeBounds(context.nodes[left + 1]));
+		node.boundsMin = bounds.min;
+		node.boundsMax = bounds.max;
+		const uint32_t numPrimitives = context.subtreePrimitives[left] + context.subtreePrimitives[left + 1];
+		context.subtreePrimitives[index] = numPrimitives;
+		const float area = bounds.SurfaceArea();
+		context.subtreeCosts[index] = std::min(BVH_TRAVERSAL_COST * area + context.subtreeCosts[left] + context.subtreeCosts[left + 1], LeafCost(area, numPrimitives));
+		if (context.reorderTreelets && numPrimitives >= TREELET_MIN_PRIMITIVES)
+		{
+			ReorderTreelet(context, index);
+		}
+	}
+}
+
+//Writes the primitives of the subtree at 'index' to Bvh::primitives from 'first' on
+static void GatherPrimitives(LinearBuildContext& context, uint32_t index, uint32_t* first)
+{
+	const BvhNode& node = context.nodes[index];
+	if (node.count > 0)
+	{
+		context.bvh->primitives[(*first)++] = context.sortedPrimitives[node.leftOrFirst];
+		return;
+	}
+	GatherPrimitives(context, node.leftOrFirst, first);
+	GatherPrimitives(context, node.leftOrFirst + 1, first);
+}
+
+//Copies the subtree at 'index' of the radix tree to 'bvhIndex' in the BVH, with the subtrees that
+//are cheaper as leaves made leaves
+static void EmitNode(LinearBuildContext& context, uint32_t index, uint32_t bvhIndex, uint32_t depth)
+{
+	uint32_t maxDepth = context.maxDepth;
+	while (depth > maxDepth && !context.maxDepth.compare_exchange_weak(maxDepth, depth));
+	
+	const BvhNode& node = context.nodes[index];
+	BvhNode* bvhNode = &context.bvh->nodes[bvhIndex];
+	bvhNode->boundsMin = node.boundsMin;
+	bvhNode->boundsMax = node.boundsMax;
+	if (CollapsesToLeaf(context, index) || depth == BVH_MAX_DEPTH - 1)
+	{
+		const uint32_t numPrimitives = context.subtreePrimitives[index];
+		uint32_t first = context.numPrimitives.fetch_add(numPrimitives);
+		bvhNode->leftOrFirst = first;
+		bvhNode->count = numPrimitives;
+		GatherPrimitives(context, index, &first);
+		context.numLeaves++;
+		return;
+	}
+	
+	//Siblings are next to each other
+	const uint32_t left = context.numNodes.fetch_add(2);
+	bvhNode->leftOrFirst = left;
+	bvhNode->count = 0;
+	const uint32_t child = node.leftOrFirst;
+	if (context.subtreePrimitives[index] > PARALLEL_EMIT_SIZE)
+	{
+		TaskGroup leftTask;
+		context.threadPool->Enqueue(&leftTask, [&context, child, left, depth]()
+		{
+			EmitNode(context, child, left, depth + 1);
+		});
+		EmitNode(context, child + 1, left + 1, depth + 1);
+		context.threadPool->Wait(&leftTask);
+	}
+	else
+	{
+		EmitNode(context, child, left, depth + 1);
+		EmitNode(context, child + 1, left + 1, depth + 1);
+	}
+}
+
+BvhBuildStats BuildLinearBvh(const std::vector<BoundingBox>& primitiveBounds, bool reorderTreelets, ThreadPool& threadPool, Bvh* bvh)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	const uint32_t numPrimitives = uint32_t(primitiveBounds.size());
+	bvh->nodes.clear();
+	bvh->primitives.clear();
+	BvhBuildStats stats;
+	if (numPrimitives == 0)
+	{
+		bvh->builtSahCost = 0.0f;
+		return stats;
+	}
+	
+	//Morton codes of the centroids, on a grid over their bounds
+	const uint32_t numChunks = (numPrimitives + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+	std::vector<BoundingBox> chunkBounds(numChunks);
+	threadPool.ParallelFor(0, numChunks, 1, [&](uint32_t chunk)
+	{
+		const uint32_t end = std::min((chunk + 1) * PARALLEL_CHUNK_SIZE, numPrimitives);
+		for (uint32_t i = chunk * PARALLEL_CHUNK_SIZE; i < end; i++)
+		{
+			chunkBounds[chunk].Grow(primitiveBounds[i].Center());
+		}
+	});
+	BoundingBox centroidBounds;
+	for (const BoundingBox& bounds : chunkBounds)
+	{
+		centroidBounds.Grow(bounds);
+	}
+	const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		scale[axis] = extent[axis] > 0.0f ? 1.0f / extent[axis] : 0.0f;
+	}
+	LinearBuildContext context;
+	context.codes.resize(numPrimitives);
+	context.sortedPrimitives.resize(numPrimitives);
+	threadPool.ParallelFor(0, numPrimitives, PARALLEL_CHUNK_SIZE, [&](uint32_t i)
+	{
+		context.codes[i] = MortonCode((primitiveBounds[i].Center() - centroidBounds.min) * scale);
+		context.sortedPrimitives[i] = i;
+	});
+	RadixSort(context.codes, context.sortedPrimitives, threadPool);
+	
+	//Leaf k of the radix tree is at the place its parent gives it, and holds the k-th sorted primitive
+	const uint32_t numTreeNodes = 2 * numPrimitives - 1;
+	context.nodes.resize(numTreeNodes);
+	context.parents.resize(numTreeNodes);
+	context.visits = std::vector<std::atomic<uint32_t>>(numTreeNodes);
+	context.subtreeCosts.resize(numTreeNodes);
+	context.subtreePrimitives.resize(numTreeNodes);
+	context.reorderTreelets = reorderTreelets;
+	context.bvh = bvh;
+	context.numNodes = 1;
+	context.numLeaves = 0;
+	context.numPrimitives = 0;
+	context.maxDepth = 0;
+	context.threadPool = &threadPool;
+	std::vector<uint32_t> internalPositions(numPrimitives, 0);
+	std::vector<uint32_t> leafPositions(numPrimitives, 0);
+	threadPool.ParallelFor(0, numPrimitives - 1, PARALLEL_CHUNK_SIZE, [&](uint32_t i)
+	{
+		int split;
+		bool leftIsLeaf;
+		bool rightIsLeaf;
+		FindChildren(context, int(i), &split, &leftIsLeaf, &rightIsLeaf);
+		const uint32_t left = 1 + 2 * i;
+		(leftIsLeaf ? leafPositions : internalPositions)[split] = left;
+		(rightIsLeaf ? leafPositions : internalPositions)[split + 1] = left + 1;
+	});
+	threadPool.ParallelFor(0, numPrimitives - 1, PARALLEL_CHUNK_SIZE, [&](uint32_t i)
+	{
+		const uint32_t position = internalPositions[i];
+		const uint32_t left = 1 + 2 * i;
+		context.nodes[position].leftOrFirst = left;
+		context.nodes[position].count = 0;
+		context.parents[left] = position;
+		context.parents[left + 1] = position;
+	});
+	threadPool.ParallelFor(0, numPrimitives, PARALLEL_CHUNK_SIZE, [&](uint32_t k)
+	{
+		const uint32_t position = leafPositions[k];
+		const BoundingBox& bounds = primitiveBounds[context.sortedPrimitives[k]];
+		BvhNode& node = context.nodes[position];
+		node.boundsMin = bounds.min;
+		node.boundsMax = bounds.max;
+		node.leftOrFirst = k;
+		node.count = 1;
+		context.subtreeCosts[position] = LeafCost(bounds.SurfaceArea(), 1);
+		context.subtreePrimitives[position] = 1;
+	});
+	threadPool.ParallelFor(0, numPrimitives, PARALLEL_CHUNK_SIZE, [&](uint32_t k)
+	{
+		BuildUpwards(context, leafPositions[k]);
+	});
+	
+	//A binary tree with one primitive per leaf has the most nodes
+	bvh->nodes.resize(numTreeNodes);
+	bvh->primitives.resize(numPrimitives);
+	EmitNode(context, 0, 0, 0);
+	bvh->nodes.resize(context.numNodes);
+	bvh->nodes.shrink_to_fit();
+	stats.numNodes = context.numNodes;
+	stats.numLeaves = context.numLeaves;
+	stats.maxDepth = context.maxDepth;
+	stats.numReferences = numPrimitives;
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.buildTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	stats.sahCost = BvhSahCost(*bvh);
+	bvh->builtSahCost = stats.sahCost;
+	return stats;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
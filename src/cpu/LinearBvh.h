@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "Bvh.h"
+#include "ThreadPool.h"
+#include <vector>
+
+//Linear BVH build of Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d
+//Trees" (2012). The primitives are sorted by the Morton codes of their centroids with a parallel
+//radix sort, and every inner node of the binary radix tree over the codes is found on its own. The
+//bounds are then computed from the leaves up, and subtrees become leaves where that lowers their
+//SAH cost. Every step runs on the thread pool. It is much faster than BuildBvh but slower to trace,
+//since the splits follow the Morton grid rather than the primitives.
+//'reorderTreelets' takes back some of the difference with the treelet restructuring of Karras and
+//Aila, "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies" (2013). On the way
+//up, the subtree of every node with enough primitives is cut into a treelet of up to seven leaves,
+//and the treelet is rebuilt in the shape with the lowest SAH cost.
+BvhBuildStats BuildLinearBvh(const std::vector<BoundingBox>& primitiveBounds, bool reorderTreelets, ThreadPool& threadPool, Bvh* bvh);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,471 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include <immintrin.h>
+#include "RayPacket.h"
+
+//The triangle test has to round like IntersectTriangle, see TriangleBlock.cpp
+#pragma GCC optimize("fp-contract=off")
+
+//The rays of a packet are tested in blocks that fill a SIMD register
+#ifdef __AVX2__
+typedef __m256 Lanes;
+#define LANES 8
+#define LanesSet1 _mm256_set1_ps
+#define LanesSet1Bits(bits) _mm256_castsi256_ps(_mm256_set1_epi32(int(bits)))
+#define LanesLoad _mm256_load_ps
+#define LanesStore _mm256_store_ps
+#define LanesAdd _mm256_add_ps
+#define LanesSub _mm256_sub_ps
+#define LanesMul _mm256_mul_ps
+#define LanesDiv _mm256_div_ps
+#define LanesMin _mm256_min_ps
+#define LanesMax _mm256_max_ps
+#define LanesAnd _mm256_and_ps
+#define LanesAndNot _mm256_andnot_ps
+#define LanesOr _mm256_or_ps
+#define LanesLess(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define LanesLessEqual(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define LanesNotEqual(a, b) _mm256_cmp_ps(a, b, _CMP_NEQ_OQ)
+#define LanesSelect(mask, a, b) _mm256_blendv_ps(b, a, mask)
+#define LanesMask _mm256_movemask_ps
+#else
+typedef __m128 Lanes;
+#define LANES 4
+#define LanesSet1 _mm_set1_ps
+#define LanesSet1Bits(bits) _mm_castsi128_ps(_mm_set1_epi32(int(bits)))
+#define LanesLoad _mm_load_ps
+#define LanesStore _mm_store_ps
+#define LanesAdd _mm_add_ps
+#define LanesSub _mm_sub_ps
+#define LanesMul _mm_mul_ps
+#define LanesDiv _mm_div_ps
+#define LanesMin _mm_min_ps
+#define LanesMax _mm_max_ps
+#define LanesAnd _mm_and_ps
+#define LanesAndNot _mm_andnot_ps
+#define LanesOr _mm_or_ps
+#define LanesLess _mm_cmplt_ps
+#define LanesLessEqual _mm_cmple_ps
+#define LanesNotEqual _mm_cmpneq_ps
+#define LanesSelect(mask, a, b) _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+#define LanesMask _mm_movemask_ps
+#endif
+
+//When no more than this many rays of a packet hit an inner node, they leave the packet and
+//go through the rest of the subtree on their own
+static const int PACKET_SINGLE_RAY_LIMIT = 2;
+
+static const uint32_t NO_TRIANGLE = 0xffffffff;
+//The tMax of a ray that has found a hit for HIT_ANY, it misses every node and triangle after
+static const float RAY_STOPPED = -FLT_MAX;
+
+//The packet padded to whole blocks with copies of its last ray, and what the rays have hit so far
+struct PacketState
+{
+	uint32_t numBlocks;
+	alignas(32) float originX[PACKET_MAX_RAYS];
+	alignas(32) float originY[PACKET_MAX_RAYS];
+	alignas(32) float originZ[PACKET_MAX_RAYS];
+	alignas(32) float inverseDirX[PACKET_MAX_RAYS];
+	alignas(32) float inverseDirY[PACKET_MAX_RAYS];
+	alignas(32) float inverseDirZ[PACKET_MAX_RAYS];
+	//Every ray prepared for the watertight triangle test once, with the shears in SoA as well
+	TriangleRay triangleRays[PACKET_MAX_RAYS];
+	alignas(32) float shearX[PACKET_MAX_RAYS];
+	alignas(32) float shearY[PACKET_MAX_RAYS];
+	alignas(32) float shearZ[PACKET_MAX_RAYS];
+	//All rays permute the axes the same way, so a block of them can be tested against a triangle at once
+	bool sharedAxes;
+	//The distance of the closest hit, tMax until there is one
+	alignas(32) float tMax[PACKET_MAX_RAYS];
+	alignas(32) float u[PACKET_MAX_RAYS];
+	alignas(32) float v[PACKET_MAX_RAYS];
+	alignas(32) uint32_t triangle[PACKET_MAX_RAYS];
+	//HIT_ANY only, the distance of the hit of a stopped ray
+	alignas(32) float anyHitT[PACKET_MAX_RAYS];
+};
+
+//The range of the origins and inverse directions of a packet, for culling all of it at once
+struct PacketInterval
+{
+	glm::vec3 originMin;
+	glm::vec3 originMax;
+	glm::vec3 inverseDirMin;
+	glm::vec3 inverseDirMax;
+};
+
+struct PacketStackEntry
+{
+	uint32_t node;
+	//The blocks of rays that may hit the node
+	uint32_t firstBlock;
+	uint32_t lastBlock;
+};
+
+void AddRay(RayPacket* packet, const Ray& ray)
+{
+	const uint32_t i = packet->numRays++;
+	packet->originX[i] = ray.origin.x;
+	packet->originY[i] = ray.origin.y;
+	packet->originZ[i] = ray.origin.z;
+	packet->dirX[i] = ray.dir.x;
+	packet->dirY[i] = ray.dir.y;
+	packet->dirZ[i] = ray.dir.z;
+}
+
+static Ray PacketRay(const RayPacket& packet, uint32_t i)
+{
+	Ray ray;
+	ray.origin = glm::vec3(packet.originX[i], packet.originY[i], packet.originZ[i]);
+	ray.dir = glm::vec3(packet.dirX[i], packet.dirY[i], packet.dirZ[i]);
+	return ray;
+}
+
+//Lower bound of a * b for every a in [aMin, aMax] and b in [bMin, bMax]
+static float ProductMin(float aMin, float aMax, float bMin, float bMax)
+{
+	return std::min(std::min(aMin * bMin, aMin * bMax), std::min(aMax * bMin, aMax * bMax));
+}
+
+static float ProductMax(float aMin, float aMax, float bMin, float bMax)
+{
+	return std::max(std::max(aMin * bMin, aMin * bMax), std::max(aMax * bMin, aMax * bMax));
+}
+
+//Interval arithmetic slab test, true when no ray of the packet can hit the planes
+static bool PacketMissesNode(const PacketInterval& interval, const glm::vec3& nearPlanes, const glm::vec3& farPlanes, float tMin, float tMax)
+{
+	float entry = tMin;
+	float exit = tMax;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		entry = std::max(entry, ProductMin(nearPlanes[axis] - interval.originMax[axis], nearPlanes[axis] - interval.originMin[axis], interval.inverseDirMin[axis], interval.inverseDirMax[axis]));
+		exit = std::min(exit, ProductMax(farPlanes[axis] - interval.originMax[axis], farPlanes[axis] - interval.originMin[axis], interval.inverseDirMin[axis], interval.inverseDirMax[axis]));
+	}
+	return entry > exit;
+}
+
+//Slab test of a block of rays, a bit per ray that hits the planes before its closest hit
+static uint32_t IntersectBlock(const PacketState& state, uint32_t block, const glm::vec3& nearPlanes, const glm::vec3& farPlanes, float tMin)
+{
+	const uint32_t i = block * LANES;
+	const Lanes originX = LanesLoad(state.originX + i);
+	const Lanes originY = LanesLoad(state.originY + i);
+	const Lanes originZ = LanesLoad(state.originZ + i);
+	const Lanes inverseDirX = LanesLoad(state.inverseDirX + i);
+	const Lanes inverseDirY = LanesLoad(state.inverseDirY + i);
+	const Lanes inverseDirZ = LanesLoad(state.inverseDirZ + i);
+	const Lanes nearX = LanesMul(LanesSub(LanesSet1(nearPlanes.x), originX), inverseDirX);
+	const Lanes nearY = LanesMul(LanesSub(LanesSet1(nearPlanes.y), originY), inverseDirY);
+	const Lanes nearZ = LanesMul(LanesSub(LanesSet1(nearPlanes.z), originZ), inverseDirZ);
+	const Lanes farX = LanesMul(LanesSub(LanesSet1(farPlanes.x), originX), inverseDirX);
+	const Lanes farY = LanesMul(LanesSub(LanesSet1(farPlanes.y), originY), inverseDirY);
+	const Lanes farZ = LanesMul(LanesSub(LanesSet1(farPlanes.z), originZ), inverseDirZ);
+	const Lanes entry = LanesMax(LanesMax(nearX, nearY), LanesMax(nearZ, LanesSet1(tMin)));
+	const Lanes exit = LanesMin(LanesMin(farX, farY), LanesMin(farZ, LanesLoad(state.tMax + i)));
+	return uint32_t(LanesMask(LanesLessEqual(entry, exit)));
+}
+
+//IntersectTriangle for a block of rays, doing the same float operations, so the rays find the hits
+//they would on their own
+static void IntersectTriangleRays(const CpuScene& scene, uint32_t triangle, uint32_t block, float tMin, PacketState* state)
+{
+	const uint32_t i = block * LANES;
+	const glm::vec3* vertices = &scene.vertices[triangle * 3];
+	if (!state->sharedAxes)
+	{
+		for (uint32_t ray = i; ray < i + LANES; ray++)
+		{
+			Hit hit;
+			if (IntersectTriangle(vertices[0], vertices[1], vertices[2], state->triangleRays[ray], tMin, state->tMax[ray], &hit))
+			{
+				state->tMax[ray] = hit.t;
+				state->u[ray] = hit.u;
+				state->v[ray] = hit.v;
+				state->triangle[ray] = triangle;
+			}
+		}
+		return;
+	}
+	
+	const int axisX = state->triangleRays[0].axisX;
+	const int axisY = state->triangleRays[0].axisY;
+	const int axisZ = state->triangleRays[0].axisZ;
+	const float* origins[3] = { state->originX + i, state->originY + i, state->originZ + i };
+	const Lanes originX = LanesLoad(origins[axisX]);
+	const Lanes originY = LanesLoad(origins[axisY]);
+	const Lanes originZ = LanesLoad(origins[axisZ]);
+	const Lanes shearX = LanesLoad(state->shearX + i);
+	const Lanes shearY = LanesLoad(state->shearY + i);
+	const Lanes shearZ = LanesLoad(state->shearZ + i);
+	Lanes x[3];
+	Lanes y[3];
+	Lanes z[3];
+	for (int corner = 0; corner < 3; corner++)
+	{
+		const Lanes relativeZ = LanesSub(LanesSet1(vertices[corner][axisZ]), originZ);
+		x[corner] = LanesSub(LanesSub(LanesSet1(vertices[corner][axisX]), originX), LanesMul(shearX, relativeZ));
+		y[corner] = LanesSub(LanesSub(LanesSet1(vertices[corner][axisY]), originY), LanesMul(shearY, relativeZ));
+		z[corner] = LanesMul(shearZ, relativeZ);
+	}
+	const Lanes u = LanesSub(LanesMul(x[2], y[1]), LanesMul(y[2], x[1]));
+	const Lanes v = LanesSub(LanesMul(x[0], y[2]), LanesMul(y[0], x[2]));
+	const Lanes w = LanesSub(LanesMul(x[1], y[0]), LanesMul(y[1], x[0]));
+	
+	const Lanes zero = LanesSet1(0.0f);
+	const Lanes negative = LanesOr(LanesOr(LanesLess(u, zero), LanesLess(v, zero)), LanesLess(w, zero));
+	const Lanes positive = LanesOr(LanesOr(LanesLess(zero, u), LanesLess(zero, v)), LanesLess(zero, w));
+	const Lanes determinant = LanesAdd(LanesAdd(u, v), w);
+	const Lanes t = LanesDiv(LanesAdd(LanesAdd(LanesMul(u, z[0]), LanesMul(v, z[1])), LanesMul(w, z[2])), determinant);
+	const Lanes closestT = LanesLoad(state->tMax + i);
+	Lanes valid = LanesAndNot(LanesAnd(negative, positive), LanesNotEqual(determinant, zero));
+	valid = LanesAnd(valid, LanesAnd(LanesLess(LanesSet1(tMin), t), LanesLess(t, closestT)));
+	if (LanesMask(valid) == 0)
+	{
+		return;
+	}
+	float* triangles = reinterpret_cast<float*>(state->triangle + i);
+	const Lanes triangleLanes = LanesSet1Bits(triangle);
+	LanesStore(state->tMax + i, LanesSelect(valid, t, closestT));
+	LanesStore(state->u + i, LanesSelect(valid, LanesDiv(v, determinant), LanesLoad(state->u + i)));
+	LanesStore(state->v + i, LanesSelect(valid, LanesDiv(w, determinant), LanesLoad(state->v + i)));
+	LanesStore(triangles, LanesSelect(valid, triangleLanes, LanesLoad(triangles)));
+}
+
+//Stops the rays of the blocks that have hit something
+static void StopRays(uint32_t firstBlock, uint32_t lastBlock, PacketState* state)
+{
+	for (uint32_t i = firstBlock * LANES; i < (lastBlock + 1) * LANES; i++)
+	{
+		if (state->triangle[i] != NO_TRIANGLE && state->tMax[i] != RAY_STOPPED)
+		{
+			state->anyHitT[i] = state->tMax[i];
+			state->tMax[i] = RAY_STOPPED;
+		}
+	}
+}
+
+void TracePacket(const CpuScene& scene, const RayPacket& packet, float tMin, float tMax, HitQuery query, Hit* hits, PacketStats* stats)
+{
+	stats->packets++;
+	if (packet.numRays == 0)
+	{
+		return;
+	}
+	
+	//The near plane of every axis has to be the same for all rays
+	bool positive[3] = { packet.dirX[0] >= 0.0f, packet.dirY[0] >= 0.0f, packet.dirZ[0] >= 0.0f };
+	bool coherent = true;
+	for (uint32_t i = 1; i < packet.numRays; i++)
+	{
+		coherent = coherent && (packet.dirX[i] >= 0.0f) == positive[0] && (packet.dirY[i] >= 0.0f) == positive[1] && (packet.dirZ[i] >= 0.0f) == positive[2];
+	}
+	//Two-level scenes are traced ray by ray as well
+	if (!coherent || scene.layout != CPU_SCENE_FLAT || FlatBvhView(scene).numNodes == 0)
+	{
+		for (uint32_t i = 0; i < packet.numRays; i++)
+		{
+			hits[i] = query == HIT_ANY ? TraceAnyHit(scene, PacketRay(packet, i), tMin, tMax) : TraceRay(scene, PacketRay(packet, i), tMin, tMax);
+		}
+		stats->singleRays += coherent && scene.layout == CPU_SCENE_FLAT ? 0 : packet.numRays;
+		return;
+	}
+	
+	PacketState state;
+	state.numBlocks = (packet.numRays + LANES - 1) / LANES;
+	PacketInterval interval;
+	interval.originMin = interval.inverseDirMin = glm::vec3(FLT_MAX);
+	interval.originMax = interval.inverseDirMax = glm::vec3(-FLT_MAX);
+	glm::vec3 dirSum(0.0f);
+	state.sharedAxes = true;
+	for (uint32_t i = 0; i < state.numBlocks * LANES; i++)
+	{
+		const Ray ray = PacketRay(packet, std::min(i, packet.numRays - 1));
+		const glm::vec3 inverseDir = 1.0f / ray.dir;
+		const TriangleRay triangleRay = PrepareTriangleRay(ray);
+		state.triangleRays[i] = triangleRay;
+		state.shearX[i] = triangleRay.shear.x;
+		state.shearY[i] = triangleRay.shear.y;
+		state.shearZ[i] = triangleRay.shear.z;
+		state.sharedAxes = state.sharedAxes && triangleRay.axisX == state.triangleRays[0].axisX && triangleRay.axisY == state.triangleRays[0].axisY;
+		state.originX[i] = ray.origin.x;
+		state.originY[i] = ray.origin.y;
+		state.originZ[i] = ray.origin.z;
+		state.inverseDirX[i] = inverseDir.x;
+		state.inverseDirY[i] = inverseDir.y;
+		state.inverseDirZ[i] = inverseDir.z;
+		state.tMax[i] = tMax;
+		state.u[i] = 0.0f;
+		state.v[i] = 0.0f;
+		state.triangle[i] = NO_TRIANGLE;
+		interval.originMin = glm::min(interval.originMin, ray.origin);
+		interval.originMax = glm::max(interval.originMax, ray.origin);
+		interval.inverseDirMin = glm::min(interval.inverseDirMin, inverseDir);
+		interval.inverseDirMax = glm::max(interval.inverseDirMax, inverseDir);
+		dirSum += ray.dir;
+	}
+	//Products of infinite inverse directions are not bounds
+	const bool useInterval = std::isfinite(interval.inverseDirMin.x + interval.inverseDirMin.y + interval.inverseDirMin.z + interval.inverseDirMax.x + interval.inverseDirMax.y + interval.inverseDirMax.z);
+	//Only lowered after leaves, it bounds the closest hits of the packet for interval culling
+	float packetTMax = tMax;
+	
+	const BvhView bvh = FlatBvhView(scene);
+	const BvhNode* nodes = bvh.nodes;
+	//One more than the depth, both children are pushed
+	PacketStackEntry stack[BVH_MAX_DEPTH + 1];
+	uint32_t stackSize = 1;
+	stack[0].node = 0;
+	stack[0].firstBlock = 0;
+	stack[0].lastBlock = state.numBlocks - 1;
+	while (stackSize > 0)
+	{
+		const PacketStackEntry current = stack[--stackSize];
+		const BvhNode& node = nodes[current.node];
+		glm::vec3 nearPlanes;
+		glm::vec3 farPlanes;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			nearPlanes[axis] = positive[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+			farPlanes[axis] = positive[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+		}
+		if (useInterval && PacketMissesNode(interval, nearPlanes, farPlanes, tMin, packetTMax))
+		{
+			continue;
+		}
+		
+		//Narrow down the range of blocks to the ones hitting the node
+		uint32_t first = current.firstBlock;
+		uint32_t firstMask = 0;
+		while (first <= current.lastBlock && (firstMask = IntersectBlock(state, first, nearPlanes, farPlanes, tMin)) == 0)
+		{
+			first++;
+		}
+		if (first > current.lastBlock)
+		{
+			continue;
+		}
+		uint32_t last = current.lastBlock;
+		while (last > first && IntersectBlock(state, last, nearPlanes, farPlanes, tMin) == 0)
+		{
+			last--;
+		}
+		
+		if (node.count > 0)
+		{
+			for (uint32_t block = first; block <= last; block++)
+			{
+				for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+				{
+					IntersectTriangleRays(scene, bvh.primitives[i], block, tMin, &state);
+				}
+			}
+			if (query == HIT_ANY)
+			{
+				StopRays(first, last, &state);
+			}
+			Lanes closestT = LanesLoad(state.tMax);
+			for (uint32_t block = 1; block < state.numBlocks; block++)
+			{
+				closestT = LanesMax(closestT, LanesLoad(state.tMax + block * LANES));
+			}
+			alignas(32) float closestTs[LANES];
+			LanesStore(closestTs, closestT);
+			packetTMax = *std::max_element(closestTs, closestTs + LANES);
+			if (packetTMax < tMin)
+			{
+				//Every ray has stopped
+				break;
+			}
+			continue;
+		}
+		
+		if (first == last && __builtin_popcount(firstMask) <= PACKET_SINGLE_RAY_LIMIT)
+		{
+			while (firstMask != 0)
+			{
+				const uint32_t i = first * LANES + __builtin_ctz(firstMask);
+				firstMask &= firstMask - 1;
+				if (i >= packet.numRays)
+				{
+					break;
+				}
+				Hit hit;
+				TraceSubtree(scene, current.node, PacketRay(packet, i), tMin, state.tMax[i], query, &hit);
+				if (hit.t >= 0.0f)
+				{
+					state.tMax[i] = hit.t;
+					state.u[i] = hit.u;
+					state.v[i] = hit.v;
+					state.triangle[i] = hit.triangle;
+					if (query == HIT_ANY)
+					{
+						StopRays(first, first, &state);
+					}
+				}
+				stats->singleRays++;
+			}
+			continue;
+		}
+		
+		//Visit the child that is nearer along the average direction first
+		uint32_t near = node.leftOrFirst;
+		uint32_t far = node.leftOrFirst + 1;
+		const glm::vec3 centerOffset = (nodes[far].boundsMin + nodes[far].boundsMax) - (nodes[near].boundsMin + nodes[near].boundsMax);
+		if (glm::dot(centerOffset, dirSum) < 0.0f)
+		{
+			std::swap(near, far);
+		}
+		stack[stackSize].node = far;
+		stack[stackSize].firstBlock = first;
+		stack[stackSize].lastBlock = last;
+		stackSize++;
+		stack[stackSize].node = near;
+		stack[stackSize].firstBlock = first;
+		stack[stackSize].lastBlock = last;
+		stackSize++;
+	}
+	
+	for (uint32_t i = 0; i < packet.numRays; i++)
+	{
+		hits[i] = Hit();
+		if (state.triangle[i] != NO_TRIANGLE)
+		{
+			hits[i].t = query == HIT_ANY ? state.anyHitT[i] : state.tMax[i];
+			hits[i].triangle = state.triangle[i];
+			hits[i].u = state.u[i];
+			hits[i].v = state.v[i];
+		}
+	}
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
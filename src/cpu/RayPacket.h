@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "CpuScene.h"
+#include <stdint.h>
+
+//A 16x16 tile of camera rays
+const uint32_t PACKET_MAX_RAYS = 256;
+
+//Rays traced together through the binary BVH, in SoA. The rays should be coherent, like the camera
+//rays of a screen tile, a packet of rays going every which way is slower than tracing them one by one.
+struct RayPacket
+{
+	uint32_t numRays = 0;
+	alignas(32) float originX[PACKET_MAX_RAYS];
+	alignas(32) float originY[PACKET_MAX_RAYS];
+	alignas(32) float originZ[PACKET_MAX_RAYS];
+	alignas(32) float dirX[PACKET_MAX_RAYS];
+	alignas(32) float dirY[PACKET_MAX_RAYS];
+	alignas(32) float dirZ[PACKET_MAX_RAYS];
+};
+
+struct PacketStats
+{
+	uint64_t packets = 0;
+	//Rays that were traced on their own, for all or part of the BVH
+	uint64_t singleRays = 0;
+};
+
+void AddRay(RayPacket* packet, const Ray& ray);
+//Triangle hits in (tMin, tMax) as 'query' asks, one per ray of the packet. The closest hits are the
+//ones TraceRay finds, but for ties between triangles, as the triangles are tested with the same
+//watertight test. With HIT_ANY a ray stops at its first hit, and the packet once all of its rays have.
+//The packet is culled against nodes as a whole, using the range of its origins and directions,
+//and only the range of rays from the first to the last one hitting a node is tested against it.
+//Packets whose directions don't share a sign on every axis are traced ray by ray, and so are
+//the few rays left of a packet once they are all that hits a node.
+void TracePacket(const CpuScene& scene, const RayPacket& packet, float tMin, float tMax, HitQuery query, Hit* hits, PacketStats* stats);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include "TileScheduler.h"
+
+//The tiles [front, end) of a thread's run, as front | end << 32 so both ends change together.
+//A cache line each, every thread updates its own front after every tile.
+struct TileRun
+{
+	std::atomic<uint64_t> range;
+	char padding[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+//16 bits of each coordinate interleaved
+static uint32_t MortonCode2D(uint32_t x, uint32_t y)
+{
+	uint32_t code = 0;
+	for (int axis = 0; axis < 2; axis++)
+	{
+		uint32_t value = (axis == 0 ? x : y) & 0xffff;
+		value = (value | (value << 8)) & 0x00ff00ff;
+		value = (value | (value << 4)) & 0x0f0f0f0f;
+		value = (value | (value << 2)) & 0x33333333;
+		value = (value | (value << 1)) & 0x55555555;
+		code |= value << axis;
+	}
+	return code;
+}
+
+//Takes the tile at the front, or at the back when stealing. Returns false when the run is empty.
+static bool TakeTile(TileRun* run, bool back, uint32_t* tile)
+{
+	uint64_t range = run->range.load();
+	while (true)
+	{
+		const uint32_t front = uint32_t(range);
+		const uint32_t end = uint32_t(range >> 32);
+		if (front >= end)
+		{
+			return false;
+		}
+		const uint64_t taken = back ? (uint64_t(end - 1) << 32) | front : (uint64_t(end) << 32) | (front + 1);
+		if (run->range.compare_exchange_weak(range, taken))
+		{
+			*tile = back ? end - 1 : front;
+			return true;
+		}
+	}
+}
+
+TileStats RunTiles(uint32_t width, uint32_t height, uint32_t tileSize, ThreadPool& threadPool, const std::function<void(uint32_t, uint32_t, uint32_t, uint32_t)>& func)
+{
+	TileStats stats;
+	stats.width = width;
+	stats.height = height;
+	stats.tileSize = std::max(tileSize, 1u);
+	stats.tilesX = (width + stats.tileSize - 1) / stats.tileSize;
+	stats.tilesY = (height + stats.tileSize - 1) / stats.tileSize;
+	const uint32_t numTiles = stats.tilesX * stats.tilesY;
+	stats.tileTimes.resize(numTiles);
+	stats.tileThreads.resize(numTiles);
+	
+	std::vector<uint32_t> order(numTiles);
+	std::vector<uint64_t> keys(numTiles);
+	for (uint32_t tile = 0; tile < numTiles; tile++)
+	{
+		keys[tile] = (uint64_t(MortonCode2D(tile % stats.tilesX, tile / stats.tilesX)) << 32) | tile;
+	}
+	std::sort(keys.begin(), keys.end());
+	for (uint32_t i = 0; i < numTiles; i++)
+	{
+		order[i] = uint32_t(keys[i]);
+	}
+	
+	const uint32_t numThreads = threadPool.NumThreads();
+	std::vector<TileRun> runs(numThreads);
+	for (uint32_t thread = 0; thread < numThreads; thread++)
+	{
+		const uint64_t front = uint64_t(numTiles) * thread / numThreads;
+		const uint64_t end = uint64_t(numTiles) * (thread + 1) / numThreads;
+		runs[thread].range = front | (end << 32);
+	}
+	stats.threadTimes.resize(numThreads);
+	stats.threadSteals.resize(numThreads);
+	
+	//One task per run. Tiles are never added, so a task is done once every run is empty.
+	TaskGroup group;
+	for (uint32_t thread = 0; thread < numThreads; thread++)
+	{
+		threadPool.Enqueue(&group, [&, thread]()
+		{
+			float busyTime = 0.0f;
+			uint32_t steals = 0;
+			while (true)
+			{
+				uint32_t position;
+				bool found = TakeTile(&runs[thread], false, &position);
+				for (uint32_t victim = 1; !found && victim < numThreads; victim++)
+				{
+					found = TakeTile(&runs[(thread + victim) % numThreads], true, &position);
+					steals += found ? 1 : 0;
+				}
+				if (!found)
+				{
+					break;
+				}
+				
+				const uint32_t tile = order[position];
+				const uint32_t startX = (tile % stats.tilesX) * stats.tileSize;
+				const uint32_t startY = (tile / stats.tilesX) * stats.tileSize;
+				auto startTime = std::chrono::high_resolution_clock::now();
+				func(startX, startY, std::min(startX + stats.tileSize, width), std::min(startY + stats.tileSize, height));
+				auto endTime = std::chrono::high_resolution_clock::now();
+				const float tileTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+				stats.tileTimes[tile] = tileTime;
+				stats.tileThreads[tile] = thread;
+				busyTime += tileTime;
+			}
+			stats.threadTimes[thread] = busyTime;
+			stats.threadSteals[thread] = steals;
+		});
+	}
+	threadPool.Wait(&group);
+	return stats;
+}
+
+uint32_t TotalSteals(const TileStats& stats)
+{
+	uint32_t steals = 0;
+	for (uint32_t threadSteals : stats.threadSteals)
+	{
+		steals += threadSteals;
+	}
+	return steals;
+}
+
+float TileImbalance(const TileStats& stats)
+{
+	float maxTime = 0.0f;
+	float totalTime = 0.0f;
+	for (float threadTime : stats.threadTimes)
+	{
+		maxTime = std::max(maxTime, threadTime);
+		totalTime += threadTime;
+	}
+	return totalTime > 0.0f ? maxTime * float(stats.threadTimes.size()) / totalTime : 1.0f;
+}
+
+bool WriteTileTimes(const std::string& filename, const TileStats& stats)
+{
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	//Rows go from the bottom up
+	fprintf(file, "Pf\n%u %u\n-1.0\n", stats.width, stats.height);
+	std::vector<float> row(stats.width);
+	for (uint32_t y = stats.height; y-- > 0;)
+	{
+		for (uint32_t x = 0; x < stats.width; x++)
+		{
+			row[x] = stats.tileTimes[(y / stats.tileSize) * stats.tilesX + x / stats.tileSize];
+		}
+		fwrite(row.data(), sizeof(float), row.size(), file);
+	}
+	return fclose(file) == 0;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
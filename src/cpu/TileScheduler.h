@@ -0,0 +1,76 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include "ThreadPool.h"
+#include <vector>
+
+/*
+Renders an image tile by tile on every thread of a ThreadPool. The tiles are issued in Morton order
+over the tile grid, so tiles next to each other, which mostly trace the same part of the scene, run
+one after another on the same thread. Every thread starts with its own run of that order and takes
+tiles from its front. A thread that runs out steals single tiles from the back of another thread's
+run, the tiles furthest from where that thread is working. The cost of a pixel varies a lot, from a
+miss or a pixel that skips AO to one that traces every occlusion ray, so splitting the image up front
+would leave threads idle. Every tile is timed to show where the time goes.
+*/
+
+const uint32_t DEFAULT_TILE_SIZE = 16;
+
+struct TileStats
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t tileSize = 0;
+	uint32_t tilesX = 0;
+	uint32_t tilesY = 0;
+	//Per tile, row by row from the top left one
+	std::vector<float> tileTimes; //ms
+	std::vector<uint32_t> tileThreads;
+	//Per thread, the time spent in tiles and the tiles it stole
+	std::vector<float> threadTimes; //ms
+	std::vector<uint32_t> threadSteals;
+};
+
+//Calls func(startX, startY, endX, endY) for every 'tileSize' squared tile of a width x height image,
+//clipped to it, on the threads of 'threadPool'
+TileStats RunTiles(uint32_t width, uint32_t height, uint32_t tileSize, ThreadPool& threadPool, const std::function<void(uint32_t, uint32_t, uint32_t, uint32_t)>& func);
+uint32_t TotalSteals(const TileStats& stats);
+//The busy time of the slowest thread over the average, 1 when the work was spread evenly
+float TileImbalance(const TileStats& stats);
+//A width x height portable float map where every pixel holds the time of its tile in ms
+bool WriteTileTimes(const std::string& filename, const TileStats& stats);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
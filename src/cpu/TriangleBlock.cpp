@@ -0,0 +1,324 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include "glm/common.hpp"
+#include <immintrin.h>
+#include "TriangleBlock.h"
+
+//g++ fuses multiplies and adds into one instruction by default in C++, which rounds once instead of
+//twice, and doesn't fuse the scalar and the SIMD tests the same way. Unfused they all round alike.
+#pragma GCC optimize("fp-contract=off")
+
+TriangleRay PrepareTriangleRay(const Ray& ray)
+{
+	TriangleRay triangleRay;
+	triangleRay.origin = ray.origin;
+	const glm::vec3 absDir = glm::abs(ray.dir);
+	int axisZ = 2;
+	if (absDir.x > absDir.y && absDir.x > absDir.z)
+	{
+		axisZ = 0;
+	}
+	else if (absDir.y > absDir.z)
+	{
+		axisZ = 1;
+	}
+	int axisX = (axisZ + 1) % 3;
+	int axisY = (axisX + 1) % 3;
+	if (ray.dir[axisZ] < 0.0f)
+	{
+		std::swap(axisX, axisY);
+	}
+	triangleRay.axisX = axisX;
+	triangleRay.axisY = axisY;
+	triangleRay.axisZ = axisZ;
+	triangleRay.shear.x = ray.dir[axisX] / ray.dir[axisZ];
+	triangleRay.shear.y = ray.dir[axisY] / ray.dir[axisZ];
+	triangleRay.shear.z = 1.0f / ray.dir[axisZ];
+	return triangleRay;
+}
+
+//A vertex in the space of the ray, where it starts at the origin and points along +z
+static glm::vec3 ToRaySpace(const glm::vec3& vertex, const TriangleRay& ray)
+{
+	const float relativeZ = vertex[ray.axisZ] - ray.origin[ray.axisZ];
+	const float x = (vertex[ray.axisX] - ray.origin[ray.axisX]) - ray.shear.x * relativeZ;
+	const float y = (vertex[ray.axisY] - ray.origin[ray.axisY]) - ray.shear.y * relativeZ;
+	return glm::vec3(x, y, ray.shear.z * relativeZ);
+}
+
+bool IntersectTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const TriangleRay& ray, float tMin, float tMax, Hit* hit)
+{
+	const glm::vec3 a = ToRaySpace(v0, ray);
+	const glm::vec3 b = ToRaySpace(v1, ray);
+	const glm::vec3 c = ToRaySpace(v2, ray);
+	//Twice the signed areas of the triangles the ray makes with each edge. A shared edge gives the
+	//same products in both triangles, so a ray can't miss both of them.
+	const float u = c.x * b.y - c.y * b.x;
+	const float v = a.x * c.y - a.y * c.x;
+	const float w = b.x * a.y - b.y * a.x;
+	if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+	{
+		return false;
+	}
+	const float determinant = u + v + w;
+	if (determinant == 0.0f)
+	{
+		return false;
+	}
+	const float t = (u * a.z + v * b.z + w * c.z) / determinant;
+	if (!(t > tMin && t < tMax))
+	{
+		return false;
+	}
+	hit->t = t;
+	hit->u = v / determinant;
+	hit->v = w / determinant;
+	return true;
+}
+
+void BuildTriangleBlocks(const Bvh8& wideBvh, const std::vector<glm::vec3>& vertices, ThreadPool& threadPool, TriangleBlocks* triangleBlocks)
+{
+	struct Leaf
+	{
+		uint32_t first;
+		uint32_t count;
+		uint32_t firstBlock;
+	};
+	
+	//Blocks are handed out in the order the nodes are, so the leaves of a node are next to each other
+	std::vector<Leaf> leaves;
+	uint32_t numBlocks = 0;
+	triangleBlocks->firstBlocks.assign(wideBvh.primitives.size(), 0);
+	for (const Bvh8Node& node : wideBvh.nodes)
+	{
+		for (int i = 0; i < 8 && node.child[i] != BVH8_EMPTY; i++)
+		{
+			if (node.count[i] > 0)
+			{
+				Leaf leaf = { node.child[i], node.count[i], numBlocks };
+				leaves.push_back(leaf);
+				triangleBlocks->firstBlocks[leaf.first] = numBlocks;
+				numBlocks += (leaf.count + TRIANGLE_BLOCK_SIZE - 1) / TRIANGLE_BLOCK_SIZE;
+			}
+		}
+	}
+	
+	triangleBlocks->blocks.resize(numBlocks);
+	threadPool.ParallelFor(0, uint32_t(leaves.size()), 1024, [&](uint32_t l)
+	{
+		const Leaf& leaf = leaves[l];
+		const uint32_t numSlots = (leaf.count + TRIANGLE_BLOCK_SIZE - 1) / TRIANGLE_BLOCK_SIZE * TRIANGLE_BLOCK_SIZE;
+		const uint32_t firstTriangle = wideBvh.primitives[leaf.first];
+		for (uint32_t i = 0; i < numSlots; i++)
+		{
+			TriangleBlock& block = triangleBlocks->blocks[leaf.firstBlock + i / TRIANGLE_BLOCK_SIZE];
+			const uint32_t slot = i % TRIANGLE_BLOCK_SIZE;
+			const uint32_t triangle = i < leaf.count ? wideBvh.primitives[leaf.first + i] : firstTriangle;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const glm::vec3& vertex = vertices[triangle * 3 + (i < leaf.count ? corner : 0)];
+				block.vertices[corner][0][slot] = vertex.x;
+				block.vertices[corner][1][slot] = vertex.y;
+				block.vertices[corner][2][slot] = vertex.z;
+			}
+			block.primitives[slot] = triangle;
+		}
+	});
+}
+
+//Picks the closest of the triangles in 'mask', the first one on a tie like IntersectTriangle called in order
+static bool ClosestSlot(const TriangleBlock& block, uint32_t mask, const float* t, const float* v, const float* w, const float* determinant, Hit* hit)
+{
+	if (mask == 0)
+	{
+		return false;
+	}
+	int closest = __builtin_ctz(mask);
+	mask &= mask - 1;
+	while (mask != 0)
+	{
+		const int slot = __builtin_ctz(mask);
+		mask &= mask - 1;
+		if (t[slot] < t[closest])
+		{
+			closest = slot;
+		}
+	}
+	hit->t = t[closest];
+	hit->u = v[closest] / determinant[closest];
+	hit->v = w[closest] / determinant[closest];
+	hit->triangle = block.primitives[closest];
+	return true;
+}
+
+bool IntersectBlockSse(const TriangleBlock& block, const TriangleRay& ray, float tMin, float tMax, Hit* hit)
+{
+	const __m128 originX = _mm_set1_ps(ray.origin[ray.axisX]);
+	const __m128 originY = _mm_set1_ps(ray.origin[ray.axisY]);
+	const __m128 originZ = _mm_set1_ps(ray.origin[ray.axisZ]);
+	const __m128 shearX = _mm_set1_ps(ray.shear.x);
+	const __m128 shearY = _mm_set1_ps(ray.shear.y);
+	const __m128 shearZ = _mm_set1_ps(ray.shear.z);
+	const __m128 rayMin = _mm_set1_ps(tMin);
+	const __m128 rayMax = _mm_set1_ps(tMax);
+	const __m128 zero = _mm_setzero_ps();
+	float ts[TRIANGLE_BLOCK_SIZE];
+	float vs[TRIANGLE_BLOCK_SIZE];
+	float ws[TRIANGLE_BLOCK_SIZE];
+	float determinants[TRIANGLE_BLOCK_SIZE];
+	uint32_t mask = 0;
+	for (uint32_t half = 0; half < TRIANGLE_BLOCK_SIZE; half += 4)
+	{
+		__m128 x[3];
+		__m128 y[3];
+		__m128 z[3];
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const __m128 relativeZ = _mm_sub_ps(_mm_loadu_ps(&block.vertices[corner][ray.axisZ][half]), originZ);
+			x[corner] = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.vertices[corner][ray.axisX][half]), originX), _mm_mul_ps(shearX, relativeZ));
+			y[corner] = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.vertices[corner][ray.axisY][half]), originY), _mm_mul_ps(shearY, relativeZ));
+			z[corner] = _mm_mul_ps(shearZ, relativeZ);
+		}
+		const __m128 u = _mm_sub_ps(_mm_mul_ps(x[2], y[1]), _mm_mul_ps(y[2], x[1]));
+		const __m128 v = _mm_sub_ps(_mm_mul_ps(x[0], y[2]), _mm_mul_ps(y[0], x[2]));
+		const __m128 w = _mm_sub_ps(_mm_mul_ps(x[1], y[0]), _mm_mul_ps(y[1], x[0]));
+		const __m128 negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+		const __m128 positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+		const __m128 determinant = _mm_add_ps(_mm_add_ps(u, v), w);
+		const __m128 t = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, z[0]), _mm_mul_ps(v, z[1])), _mm_mul_ps(w, z[2])), determinant);
+		__m128 valid = _mm_andnot_ps(_mm_and_ps(negative, positive), _mm_cmpneq_ps(determinant, zero));
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, rayMin), _mm_cmplt_ps(t, rayMax)));
+		_mm_storeu_ps(ts + half, t);
+		_mm_storeu_ps(vs + half, v);
+		_mm_storeu_ps(ws + half, w);
+		_mm_storeu_ps(determinants + half, determinant);
+		mask |= uint32_t(_mm_movemask_ps(valid)) << half;
+	}
+	return ClosestSlot(block, mask, ts, vs, ws, determinants, hit);
+}
+
+#ifdef __AVX2__
+bool IntersectBlockAvx2(const TriangleBlock& block, const TriangleRay& ray, float tMin, float tMax, Hit* hit)
+{
+	const __m256 originX = _mm256_set1_ps(ray.origin[ray.axisX]);
+	const __m256 originY = _mm256_set1_ps(ray.origin[ray.axisY]);
+	const __m256 originZ = _mm256_set1_ps(ray.origin[ray.axisZ]);
+	const __m256 shearX = _mm256_set1_ps(ray.shear.x);
+	const __m256 shearY = _mm256_set1_ps(ray.shear.y);
+	const __m256 shearZ = _mm256_set1_ps(ray.shear.z);
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 x[3];
+	__m256 y[3];
+	__m256 z[3];
+	for (int corner = 0; corner < 3; corner++)
+	{
+		const __m256 relativeZ = _mm256_sub_ps(_mm256_loadu_ps(block.vertices[corner][ray.axisZ]), originZ);
+		x[corner] = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.vertices[corner][ray.axisX]), originX), _mm256_mul_ps(shearX, relativeZ));
+		y[corner] = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.vertices[corner][ray.axisY]), originY), _mm256_mul_ps(shearY, relativeZ));
+		z[corner] = _mm256_mul_ps(shearZ, relativeZ);
+	}
+	const __m256 u = _mm256_sub_ps(_mm256_mul_ps(x[2], y[1]), _mm256_mul_ps(y[2], x[1]));
+	const __m256 v = _mm256_sub_ps(_mm256_mul_ps(x[0], y[2]), _mm256_mul_ps(y[0], x[2]));
+	const __m256 w = _mm256_sub_ps(_mm256_mul_ps(x[1], y[0]), _mm256_mul_ps(y[1], x[0]));
+	const __m256 negative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(v, zero, _CMP_LT_OQ)), _mm256_cmp_ps(w, zero, _CMP_LT_OQ));
+	const __m256 positive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_GT_OQ), _mm256_cmp_ps(v, zero, _CMP_GT_OQ)), _mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+	const __m256 determinant = _mm256_add_ps(_mm256_add_ps(u, v), w);
+	const __m256 t = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(u, z[0]), _mm256_mul_ps(v, z[1])), _mm256_mul_ps(w, z[2])), determinant);
+	__m256 valid = _mm256_andnot_ps(_mm256_and_ps(negative, positive), _mm256_cmp_ps(determinant, zero, _CMP_NEQ_UQ));
+	valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(tMin), _CMP_GT_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ)));
+	const uint32_t mask = uint32_t(_mm256_movemask_ps(valid));
+	if (mask == 0)
+	{
+		return false;
+	}
+	float ts[TRIANGLE_BLOCK_SIZE];
+	float vs[TRIANGLE_BLOCK_SIZE];
+	float ws[TRIANGLE_BLOCK_SIZE];
+	float determinants[TRIANGLE_BLOCK_SIZE];
+	_mm256_storeu_ps(ts, t);
+	_mm256_storeu_ps(vs, v);
+	_mm256_storeu_ps(ws, w);
+	_mm256_storeu_ps(determinants, determinant);
+	return ClosestSlot(block, mask, ts, vs, ws, determinants, hit);
+}
+#endif
+
+#ifdef __AVX512VL__
+bool IntersectBlockAvx512(const TriangleBlock& block, const TriangleRay& ray, float tMin, float tMax, Hit* hit)
+{
+	const __m256 originX = _mm256_set1_ps(ray.origin[ray.axisX]);
+	const __m256 originY = _mm256_set1_ps(ray.origin[ray.axisY]);
+	const __m256 originZ = _mm256_set1_ps(ray.origin[ray.axisZ]);
+	const __m256 shearX = _mm256_set1_ps(ray.shear.x);
+	const __m256 shearY = _mm256_set1_ps(ray.shear.y);
+	const __m256 shearZ = _mm256_set1_ps(ray.shear.z);
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 x[3];
+	__m256 y[3];
+	__m256 z[3];
+	for (int corner = 0; corner < 3; corner++)
+	{
+		const __m256 relativeZ = _mm256_sub_ps(_mm256_loadu_ps(block.vertices[corner][ray.axisZ]), originZ);
+		x[corner] = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.vertices[corner][ray.axisX]), originX), _mm256_mul_ps(shearX, relativeZ));
+		y[corner] = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.vertices[corner][ray.axisY]), originY), _mm256_mul_ps(shearY, relativeZ));
+		z[corner] = _mm256_mul_ps(shearZ, relativeZ);
+	}
+	const __m256 u = _mm256_sub_ps(_mm256_mul_ps(x[2], y[1]), _mm256_mul_ps(y[2], x[1]));
+	const __m256 v = _mm256_sub_ps(_mm256_mul_ps(x[0], y[2]), _mm256_mul_ps(y[0], x[2]));
+	const __m256 w = _mm256_sub_ps(_mm256_mul_ps(x[1], y[0]), _mm256_mul_ps(y[1], x[0]));
+	const __mmask8 negative = _mm256_cmp_ps_mask(u, zero, _CMP_LT_OQ) | _mm256_cmp_ps_mask(v, zero, _CMP_LT_OQ) | _mm256_cmp_ps_mask(w, zero, _CMP_LT_OQ);
+	const __mmask8 positive = _mm256_cmp_ps_mask(u, zero, _CMP_GT_OQ) | _mm256_cmp_ps_mask(v, zero, _CMP_GT_OQ) | _mm256_cmp_ps_mask(w, zero, _CMP_GT_OQ);
+	const __m256 determinant = _mm256_add_ps(_mm256_add_ps(u, v), w);
+	__mmask8 valid = _mm256_mask_cmp_ps_mask(__mmask8(~(negative & positive)), determinant, zero, _CMP_NEQ_UQ);
+	if (valid == 0)
+	{
+		return false;
+	}
+	//Only the lanes still in the running are divided
+	const __m256 t = _mm256_maskz_div_ps(valid, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(u, z[0]), _mm256_mul_ps(v, z[1])), _mm256_mul_ps(w, z[2])), determinant);
+	valid = _mm256_mask_cmp_ps_mask(valid, t, _mm256_set1_ps(tMin), _CMP_GT_OQ);
+	valid = _mm256_mask_cmp_ps_mask(valid, t, _mm256_set1_ps(tMax), _CMP_LT_OQ);
+	if (valid == 0)
+	{
+		return false;
+	}
+	float ts[TRIANGLE_BLOCK_SIZE];
+	float vs[TRIANGLE_BLOCK_SIZE];
+	float ws[TRIANGLE_BLOCK_SIZE];
+	float determinants[TRIANGLE_BLOCK_SIZE];
+	_mm256_storeu_ps(ts, t);
+	_mm256_storeu_ps(vs, v);
+	_mm256_storeu_ps(ws, w);
+	_mm256_storeu_ps(determinants, determinant);
+	return ClosestSlot(block, valid, ts, vs, ws, determinants, hit);
+}
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef TRIANGLE_BLOCK_H
+#define TRIANGLE_BLOCK_H
+
+#include "Bvh8.h"
+#include "glm/vec3.hpp"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+//Ray.glsl
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 dir;
+};
+
+//The closest hit along a ray, t is negative on a miss. u and v are the weights of the
+//second and third vertex of the triangle, like 'hitAttribs' in primary.rchit.
+//In a two-level scene 'triangle' is a triangle of the mesh of 'instance', otherwise 'instance' is unused.
+struct Hit
+{
+	float t = -1.0f;
+	uint32_t triangle = 0;
+	uint32_t instance = 0;
+	float u = 0.0f;
+	float v = 0.0f;
+};
+
+//A ray prepared for the watertight triangle test of Woop, Benthin and Wald, "Watertight Ray/Triangle
+//Intersection" (2013). The axes are permuted so the largest component of the direction is along z,
+//then the triangle is sheared so the ray starts at the origin and points along +z, and is tested in 2D.
+struct TriangleRay
+{
+	glm::vec3 origin;
+	//Swapped when the direction points along -z, so the winding of the triangles stays the same
+	int axisX;
+	int axisY;
+	int axisZ;
+	glm::vec3 shear;
+};
+
+const uint32_t TRIANGLE_BLOCK_SIZE = 8;
+
+//Up to eight triangles of a leaf in SoA, vertices[corner][axis][triangle], so a SIMD register holds
+//one coordinate of all of them. Unused slots are a single point, which is never hit.
+struct TriangleBlock
+{
+	float vertices[3][3][TRIANGLE_BLOCK_SIZE];
+	uint32_t primitives[TRIANGLE_BLOCK_SIZE];
+};
+
+//The triangles of every leaf of a BVH8 in blocks, in the order the leaves are in the tree
+struct TriangleBlocks
+{
+	std::vector<TriangleBlock> blocks;
+	//The first block of the leaf whose primitives start at Bvh8::primitives[i]. Set at the start of leaves only.
+	std::vector<uint32_t> firstBlocks;
+};
+
+TriangleRay PrepareTriangleRay(const Ray& ray);
+//Watertight, both sides of the triangle are hit. A ray through an edge or a vertex hits at least one
+//of the triangles sharing it. Triangles with two equal vertices are never hit, other collinear ones
+//can be if rounding makes them a sliver. Updates 'hit' when the triangle is hit in (tMin, tMax).
+bool IntersectTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const TriangleRay& ray, float tMin, float tMax, Hit* hit);
+//Packs the triangles of every leaf of 'wideBvh' into blocks. 'vertices' holds three per triangle.
+void BuildTriangleBlocks(const Bvh8& wideBvh, const std::vector<glm::vec3>& vertices, ThreadPool& threadPool, TriangleBlocks* triangleBlocks);
+//IntersectTriangle for every triangle of a block at once. Updates 'hit', including the triangle, with
+//the closest one hit in (tMin, tMax) and returns true if there was one. Every variant does the same
+//float operations as IntersectTriangle, without fused multiply-adds, so they all find the same hit.
+//The SSE one tests the block as two halves of four.
+bool IntersectBlockSse(const TriangleBlock& block, const TriangleRay& ray, float tMin, float tMax, Hit* hit);
+#ifdef __AVX2__
+bool IntersectBlockAvx2(const TriangleBlock& block, const TriangleRay& ray, float tMin, float tMax, Hit* hit);
+#endif
+#ifdef __AVX512VL__
+//Eight lanes too, with the tests kept in mask registers
+bool IntersectBlockAvx512(const TriangleBlock& block, const TriangleRay& ray, float tMin, float tMax, Hit* hit);
+#endif
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
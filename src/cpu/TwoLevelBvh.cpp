@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include "glm/matrix.hpp"
+#include "TwoLevelBvh.h"
+
+//Sets the transforms of an instance, and its bounds from the ones of its mesh
+static void PlaceInstance(const TwoLevelBvh& twoLevelBvh, const glm::mat4& transform, BvhInstance* instance)
+{
+	instance->transform = transform;
+	instance->inverseTransform = glm::inverse(transform);
+	instance->normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+	instance->bounds = BoundingBox();
+	const Bvh& bvh = twoLevelBvh.meshes[instance->mesh].bvh;
+	if (bvh.nodes.empty())
+	{
+		return;
+	}
+	//The eight corners of the object space bounds
+	const glm::vec3 corners[2] = { bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax };
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const glm::vec3 point(corners[corner & 1].x, corners[(corner >> 1) & 1].y, corners[(corner >> 2) & 1].z);
+		instance->bounds.Grow(glm::vec3(transform * glm::vec4(point, 1.0f)));
+	}
+}
+
+static std::vector<BoundingBox> InstanceBounds(const TwoLevelBvh& twoLevelBvh)
+{
+	std::vector<BoundingBox> instanceBounds;
+	instanceBounds.reserve(twoLevelBvh.instances.size());
+	for (const BvhInstance& instance : twoLevelBvh.instances)
+	{
+		instanceBounds.push_back(instance.bounds);
+	}
+	return instanceBounds;
+}
+
+//Copies the triangles of 'mesh' into 'meshBvh' in object space, and returns their bounds
+static std::vector<BoundingBox> CopyTriangles(const Mesh& mesh, ThreadPool& threadPool, MeshBvh* meshBvh)
+{
+	const uint32_t numTriangles = uint32_t(mesh.indices.size() / 3);
+	meshBvh->vertices.resize(numTriangles * 3);
+	meshBvh->normals.resize(numTriangles * 3);
+	std::vector<BoundingBox> triangleBounds(numTriangles);
+	threadPool.ParallelFor(0, numTriangles, 4096, [&](uint32_t i)
+	{
+		for (uint32_t corner = i * 3; corner < i * 3 + 3; corner++)
+		{
+			const uint32_t index = mesh.indices[corner];
+			meshBvh->vertices[corner] = glm::vec3(mesh.vertices[index * 3 + 0], mesh.vertices[index * 3 + 1], mesh.vertices[index * 3 + 2]);
+			meshBvh->normals[corner] = glm::vec3(mesh.normals[index * 3 + 0], mesh.normals[index * 3 + 1], mesh.normals[index * 3 + 2]);
+			triangleBounds[i].Grow(meshBvh->vertices[corner]);
+		}
+	});
+	return triangleBounds;
+}
+
+TwoLevelBvhStats BuildTwoLevelBvh(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, ThreadPool& threadPool, TwoLevelBvh* twoLevelBvh)
+{
+	TwoLevelBvhStats stats;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	//A mesh is built with the largest split budget of its instances
+	std::vector<float> splitBudgets(meshes.size(), 0.0f);
+	for (const MeshInstance& instance : instances)
+	{
+		splitBudgets[instance.meshIndex] = std::max(splitBudgets[instance.meshIndex], instance.splitBudget);
+	}
+	//Each build runs its subtrees on the pool, so the meshes are built one after another
+	twoLevelBvh->meshes.clear();
+	twoLevelBvh->meshes.resize(meshes.size());
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		MeshBvh& meshBvh = twoLevelBvh->meshes[m];
+		const std::vector<BoundingBox> triangleBounds = CopyTriangles(meshes[m], threadPool, &meshBvh);
+		if (splitBudgets[m] > 0.0f)
+		{
+			stats.numBottomLevelNodes += BuildSpatialSplitBvh(meshBvh.vertices, std::vector<uint8_t>(), splitBudgets[m], threadPool, &meshBvh.bvh).numNodes;
+		}
+		else
+		{
+			stats.numBottomLevelNodes += BuildBvh(triangleBounds, threadPool, &meshBvh.bvh).numNodes;
+		}
+		CollapseBvh(meshBvh.bvh, &meshBvh.wideBvh);
+		BuildTriangleBlocks(meshBvh.wideBvh, meshBvh.vertices, threadPool, &meshBvh.triangleBlocks);
+	}
+	auto bottomLevelEndTime = std::chrono::high_resolution_clock::now();
+	stats.bottomLevelTime = std::chrono::duration<float, std::milli>(bottomLevelEndTime - startTime).count();
+	
+	twoLevelBvh->instances.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		twoLevelBvh->instances[i].mesh = instances[i].meshIndex;
+		PlaceInstance(*twoLevelBvh, instances[i].transform, &twoLevelBvh->instances[i]);
+		stats.numInstancedTriangles += meshes[instances[i].meshIndex].indices.size() / 3;
+	}
+	const BvhBuildStats topLevelStats = BuildBvh(InstanceBounds(*twoLevelBvh), threadPool, &twoLevelBvh->topLevel);
+	auto endTime = std::chrono::high_resolution_clock::now();
+	stats.topLevelTime = std::chrono::duration<float, std::milli>(endTime - bottomLevelEndTime).count();
+	stats.numTopLevelNodes = topLevelStats.numNodes;
+	return stats;
+}
+
+uint32_t UpdateMeshVertices(const std::vector<Mesh>& meshes, float rebuildThreshold, ThreadPool& threadPool, TwoLevelBvh* twoLevelBvh, BvhBuilder builder)
+{
+	uint32_t numRebuilt = 0;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		MeshBvh& meshBvh = twoLevelBvh->meshes[m];
+		const std::vector<BoundingBox> triangleBounds = CopyTriangles(meshes[m], threadPool, &meshBvh);
+		if (RefitOrRebuildBvh(triangleBounds, rebuildThreshold, threadPool, &meshBvh.bvh, builder).rebuilt)
+		{
+			CollapseBvh(meshBvh.bvh, &meshBvh.wideBvh);
+			numRebuilt++;
+		}
+		else
+		{
+			RefitBvh8(triangleBounds, threadPool, &meshBvh.wideBvh);
+		}
+		BuildTriangleBlocks(meshBvh.wideBvh, meshBvh.vertices, threadPool, &meshBvh.triangleBlocks);
+	}
+	return numRebuilt;
+}
+
+BvhRefitStats UpdateInstanceTransforms(const std::vector<glm::mat4>& transforms, float rebuildThreshold, ThreadPool& threadPool, TwoLevelBvh* twoLevelBvh, BvhBuilder builder)
+{
+	threadPool.ParallelFor(0, uint32_t(twoLevelBvh->instances.size()), 256, [&](uint32_t i)
+	{
+		PlaceInstance(*twoLevelBvh, transforms[i], &twoLevelBvh->instances[i]);
+	});
+	return RefitOrRebuildBvh(InstanceBounds(*twoLevelBvh), rebuildThreshold, threadPool, &twoLevelBvh->topLevel, builder);
+}
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
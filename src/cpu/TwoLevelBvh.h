@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+#ifndef TWO_LEVEL_BVH_H
+#define TWO_LEVEL_BVH_H
+
+#include "Bvh.h"
+#include "Bvh8.h"
+#include "glm/mat3x3.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "MeshLoader.h"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include "TriangleBlock.h"
+#include <vector>
+
+//A mesh in object space with a BVH over its triangles, what a BottomAccStruct is on the GPU.
+//Every instance of the mesh shares it.
+struct MeshBvh
+{
+	//Three per triangle
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	Bvh bvh;
+	Bvh8 wideBvh;
+	TriangleBlocks triangleBlocks;
+};
+
+//A placement of a mesh, what a VkGeometryInstanceNV is on the GPU
+struct BvhInstance
+{
+	uint32_t mesh;
+	//Object to world
+	glm::mat4 transform;
+	//World to object, rays are taken into the space of the mesh with it
+	glm::mat4 inverseTransform;
+	//Takes object space normals to world space, like primary.rchit does
+	glm::mat3 normalMatrix;
+	//The bounds of the mesh in world space
+	BoundingBox bounds;
+};
+
+//One BVH per mesh, and a top level BVH over the world space bounds of the instances.
+//Moving instances only needs the top level to be refit or built again.
+struct TwoLevelBvh
+{
+	std::vector<MeshBvh> meshes;
+	std::vector<BvhInstance> instances;
+	//Its primitives are indices into 'instances'
+	Bvh topLevel;
+};
+
+struct TwoLevelBvhStats
+{
+	float bottomLevelTime = 0.0f; //ms
+	float topLevelTime = 0.0f; //ms
+	//Summed over the meshes
+	uint32_t numBottomLevelNodes = 0;
+	uint32_t numTopLevelNodes = 0;
+	//Triangles of all instances, what a flattened scene would hold
+	uint64_t numInstancedTriangles = 0;
+};
+
+//Builds the BVHs of all meshes, then the top level over 'instances'. Meshes with an instance that
+//has a split budget are built with spatial splits.
+TwoLevelBvhStats BuildTwoLevelBvh(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& instances, ThreadPool& threadPool, TwoLevelBvh* twoLevelBvh);
+//Gives every instance a new transform, one per instance in the same order, and brings the top level
+//up to date with RefitOrRebuildBvh. UpdateAccelerationStructureTransforms followed by
+//BuildAccelerationStructure on the GPU, which always rebuilds it.
+BvhRefitStats UpdateInstanceTransforms(const std::vector<glm::mat4>& transforms, float rebuildThreshold, ThreadPool& threadPool, TwoLevelBvh* twoLevelBvh, BvhBuilder builder = BVH_BUILDER_SAH);
+//Takes new vertices and normals of the meshes, with the same triangles, and refits or rebuilds the
+//BVH of every mesh. The bounds of the instances come from their meshes, so UpdateInstanceTransforms
+//has to place them again afterwards. Returns how many meshes had their BVH built again.
+uint32_t UpdateMeshVertices(const std::vector<Mesh>& meshes, float rebuildThreshold, ThreadPool& threadPool, TwoLevelBvh* twoLevelBvh, BvhBuilder builder = BVH_BUILDER_SAH);
+
+#endif
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,367 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Renders the color/position pass and the AO pass of a scene on the CPU, without Vulkan
+or a window, and writes the images they produce. Built with 'make cpu'.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./build/CpuRenderer <scene.brhan> [options]
+		--output <prefix>     the images are written to <prefix>_color.ppm, <prefix>_position.pfm,
+		                      <prefix>_normal.pfm, <prefix>_visibility.pfm and <prefix>_ao.pfm, and how long
+		                      the tile of every pixel took to <prefix>_color_tiles.pfm and <prefix>_ao_tiles.pfm
+		                      (default build/cpu)
+		--width <pixels>      overrides the film size of the scene
+		--height <pixels>
+		--threads <count>     0 uses every core (default 0)
+		--levels <count>      1 flattens every instance into one BVH, 2 keeps a BVH per mesh and one over
+		                      the instances like the GPU does (default 1)
+		--packets <size>      traces the primary rays of size x size pixel tiles as packets, 8 or 16,
+		                      or one ray at a time with 0 (default 16)
+		--tile-size <pixels>  both passes hand out size x size pixel tiles to the threads, which steal
+		                      them from each other when they run out, see TileScheduler.h. Rounded up
+		                      to whole packets (default 16)
+		--light-cutoff <value>
+		                      groups of lights that would add less than this to every color channel of a
+		                      pixel are shaded as one light without a shadow ray, see LightBvh.h. 0 shades
+		                      every light like the shader (default 0)
+		--ao <order>          'pixel' traces the occlusion rays pixel by pixel like the shader, 'stream' sorts
+		                      the rays of many pixels and traces them as packets, 'off' skips AO (default pixel)
+		--ao-query <query>    'closest' weights every occlusion ray by its closest hit like the shader, 'any'
+		                      by the first hit found, which stops the ray earlier (default closest)
+		--ao-cutoff <value>   occlusion rays end where a hit would add less than this to their occlusion,
+		                      0 traces them as far as the shader does (default 1/512, rays of length 3)
+		--frames <count>      renders this many frames, moving every instance before each one like Raytrace()
+		                      in main.cpp, and prints the update and render time of each. AO and the images
+		                      are of the last frame (default 1)
+		--rebuild-threshold <ratio>
+		                      moved instances refit the BVHs, which are built again once their SAH cost
+		                      is this many times what it was when built. 0 builds them every frame (default 1.2)
+		--rebuild-builder <builder>
+		                      how those BVHs are built again: 'sah' with BuildBvh, 'linear' with BuildLinearBvh,
+		                      which is faster to build and slower to trace, or 'treelets' with BuildLinearBvh
+		                      and treelet reordering (default sah)
+		--bvh-cache <file>    flat scenes map their BVHs from this file instead of building them, when it was
+		                      written for the same triangles, and write it otherwise. 'off' always builds
+		                      them (default <scene.brhan>.brhanbvh)
+*/
+
+#include "BrhanBvhFile.h"
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <chrono>
+#include "CpuAO.h"
+#include "CpuRenderer.h"
+#include "CpuScene.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/gtc/matrix_transform.hpp"
+#include "MeshLoader.h"
+#include "RayPacket.h"
+#include <string>
+#include <string.h>
+#include "ThreadPool.h"
+#include "TileScheduler.h"
+#include <vector>
+
+struct Options
+{
+	const char* sceneFile = NULL;
+	std::string output = "build/cpu";
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t numThreads = 0;
+	uint32_t packetSize = 16;
+	uint32_t tileSize = DEFAULT_TILE_SIZE;
+	float lightCutoff = 0.0f;
+	CpuSceneLayout layout = CPU_SCENE_FLAT;
+	bool ao = true;
+	AOSettings aoSettings;
+	uint32_t numFrames = 1;
+	float rebuildThreshold = DEFAULT_BVH_REBUILD_THRESHOLD;
+	BvhBuilder rebuildBuilder = BVH_BUILDER_SAH;
+	//Empty when off
+	std::string bvhCacheFile;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options)
+{
+	if (argc < 2)
+	{
+		return false;
+	}
+	options->sceneFile = argv[1];
+	options->bvhCacheFile = BrhanBvhFilePath(options->sceneFile);
+	for (int i = 2; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		const char* option = argv[i];
+		const char* value = argv[++i];
+		if (strcmp(option, "--output") == 0)
+		{
+			options->output = value;
+		}
+		else if (strcmp(option, "--width") == 0)
+		{
+			options->width = uint32_t(strtoul(value, NULL, 10));
+		}
+		else if (strcmp(option, "--height") == 0)
+		{
+			options->height = uint32_t(strtoul(value, NULL, 10));
+		}
+		else if (strcmp(option, "--threads") == 0)
+		{
+			options->numThreads = uint32_t(strtoul(value, NULL, 10));
+		}
+		else if (strcmp(option, "--levels") == 0)
+		{
+			if (strcmp(value, "2") == 0)
+			{
+				options->layout = CPU_SCENE_TWO_LEVEL;
+			}
+			else if (strcmp(value, "1") != 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option, "--packets") == 0)
+		{
+			options->packetSize = uint32_t(strtoul(value, NULL, 10));
+			if (options->packetSize * options->packetSize > PACKET_MAX_RAYS)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option, "--tile-size") == 0)
+		{
+			options->tileSize = uint32_t(strtoul(value, NULL, 10));
+			options->aoSettings.tileSize = options->tileSize;
+			if (options->tileSize == 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option, "--light-cutoff") == 0)
+		{
+			options->lightCutoff = strtof(value, NULL);
+		}
+		else if (strcmp(option, "--ao") == 0)
+		{
+			options->ao = strcmp(value, "off") != 0;
+			if (strcmp(value, "stream") == 0)
+			{
+				options->aoSettings.order = AO_RAY_STREAM;
+			}
+			else if (options->ao && strcmp(value, "pixel") != 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option, "--ao-query") == 0)
+		{
+			if (strcmp(value, "any") == 0)
+			{
+				options->aoSettings.query = HIT_ANY;
+			}
+			else if (strcmp(value, "closest") != 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option, "--ao-cutoff") == 0)
+		{
+			options->aoSettings.visibilityCutoff = strtof(value, NULL);
+		}
+		else if (strcmp(option, "--frames") == 0)
+		{
+			options->numFrames = uint32_t(strtoul(value, NULL, 10));
+			if (options->numFrames == 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option, "--rebuild-threshold") == 0)
+		{
+			options->rebuildThreshold = strtof(value, NULL);
+		}
+		else if (strcmp(option, "--rebuild-builder") == 0)
+		{
+			if (strcmp(value, "linear") == 0)
+			{
+				options->rebuildBuilder = BVH_BUILDER_LINEAR;
+			}
+			else if (strcmp(value, "treelets") == 0)
+			{
+				options->rebuildBuilder = BVH_BUILDER_LINEAR_TREELETS;
+			}
+			else if (strcmp(value, "sah") != 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option, "--bvh-cache") == 0)
+		{
+			options->bvhCacheFile = strcmp(value, "off") == 0 ? "" : value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		printf("Usage: %s <scene.brhan> [--output prefix] [--width pixels] [--height pixels] [--threads count] [--levels 1|2] [--packets size] [--tile-size pixels] [--light-cutoff value] [--ao pixel|stream|off] [--ao-query closest|any] [--ao-cutoff value] [--frames count] [--rebuild-threshold ratio] [--rebuild-builder sah|linear|treelets] [--bvh-cache file|off]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	auto startTime = std::chrono::high_resolution_clock::now();
+	BrhanFile sceneFile(options.sceneFile);
+	const uint32_t width = options.width > 0 ? options.width : sceneFile.filmWidth;
+	const uint32_t height = options.height > 0 ? options.height : sceneFile.filmHeight;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	
+	ThreadPool threadPool(options.numThreads);
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	
+	CpuScene scene;
+	CpuSceneStats sceneStats = BuildCpuScene(meshes, instances, sceneFile.sphericalLights, options.layout, threadPool, &scene, options.bvhCacheFile.empty() ? NULL : options.bvhCacheFile.c_str());
+	printf("CPU scene triangles: %llu    lights: %zu\n", (unsigned long long)sceneStats.numTriangles, scene.lights.size());
+	printf("Light BVH build time (ms): %.2f    nodes: %u    max depth: %u\n", sceneStats.lightBvh.buildTime, sceneStats.lightBvh.numNodes, sceneStats.lightBvh.maxDepth);
+	if (options.layout == CPU_SCENE_TWO_LEVEL)
+	{
+		printf("Bottom level build time (ms): %.2f    meshes: %zu    nodes: %u\n", sceneStats.twoLevel.bottomLevelTime, scene.twoLevel.meshes.size(), sceneStats.twoLevel.numBottomLevelNodes);
+		printf("Top level build time (ms): %.2f    instances: %zu    nodes: %u\n", sceneStats.twoLevel.topLevelTime, scene.twoLevel.instances.size(), sceneStats.twoLevel.numTopLevelNodes);
+	}
+	else if (sceneStats.bvhCached)
+	{
+		printf("BVH cache load time (ms): %.2f    '%s'    nodes: %u    leaves: %u    references: %u    max depth: %u    SAH cost: %.2f\n", sceneStats.bvhCacheTime, options.bvhCacheFile.c_str(), sceneStats.bvh.numNodes, sceneStats.bvh.numLeaves,
+			sceneStats.bvh.numReferences, sceneStats.bvh.maxDepth, sceneStats.bvh.sahCost);
+	}
+	else
+	{
+		printf("BVH build time (ms): %.2f    nodes: %u    leaves: %u    references: %u    max depth: %u    SAH cost: %.2f\n", sceneStats.bvh.buildTime, sceneStats.bvh.numNodes, sceneStats.bvh.numLeaves, sceneStats.bvh.numReferences, sceneStats.bvh.maxDepth, sceneStats.bvh.sahCost);
+		printf("BVH8 collapse time (ms): %.2f    nodes: %u    children per node: %.2f\n", sceneStats.wideBvh.collapseTime, sceneStats.wideBvh.numNodes, sceneStats.wideBvh.averageChildren);
+		if (!options.bvhCacheFile.empty())
+		{
+			printf("BVH cache hash and write time (ms): %.2f    '%s'\n", sceneStats.bvhCacheTime, options.bvhCacheFile.c_str());
+		}
+	}
+	
+	CpuImages images;
+	CpuRenderStats stats;
+	//Raytrace() in main.cpp translates in world space, after the model transformation
+	const glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(0.01f, 0.0f, 0.0f));
+	float totalUpdateTime = 0.0f;
+	float totalRenderTime = 0.0f;
+	uint32_t numRebuilds = 0;
+	for (uint32_t frame = 0; frame < options.numFrames; frame++)
+	{
+		CpuSceneUpdateStats updateStats;
+		if (frame > 0)
+		{
+			for (MeshInstance& instance : instances)
+			{
+				instance.transform = translation * instance.transform;
+			}
+			updateStats = UpdateCpuScene(meshes, instances, false, options.rebuildThreshold, threadPool, &scene, options.rebuildBuilder);
+			totalUpdateTime += updateStats.updateTime;
+			numRebuilds += updateStats.bvh.rebuilt ? 1 : 0;
+		}
+		stats = RenderColorPosition(scene, camera, options.packetSize, threadPool, &images, options.tileSize, options.lightCutoff);
+		totalRenderTime += stats.renderTime;
+		if (frame > 0)
+		{
+			printf("Frame %u    update time (ms): %.2f (%s)    SAH cost: %.2f, built with %.2f    render time (ms): %.2f\n", frame, updateStats.updateTime, updateStats.bvh.rebuilt ? "rebuilt" : "refit", updateStats.bvh.sahCost, updateStats.bvh.builtSahCost, stats.renderTime);
+		}
+	}
+	if (options.numFrames > 1)
+	{
+		printf("Average update time (ms): %.2f    rebuilds: %u of %u updates    average render time (ms): %.2f\n", totalUpdateTime / (options.numFrames - 1), numRebuilds, options.numFrames - 1, totalRenderTime / options.numFrames);
+	}
+	printf("Render time (ms): %.2f    %ux%u    threads: %u\n", stats.renderTime, width, height, threadPool.NumThreads());
+	printf("Primary rays: %llu    shadow rays: %llu    rays/s: %.0f\n", (unsigned long long)stats.primaryRays, (unsigned long long)stats.shadowRays, (stats.primaryRays + stats.shadowRays) / (stats.renderTime / 1000.0f));
+	if (options.packetSize > 0)
+	{
+		printf("Packets: %ux%u    primary rays traced on their own: %llu\n", options.packetSize, options.packetSize, (unsigned long long)stats.packetSingleRays);
+	}
+	printf("Tiles: %ux%u    count: %zu    steals: %u    slowest thread over average: %.2f\n", stats.tiles.tileSize, stats.tiles.tileSize, stats.tiles.tileTimes.size(), TotalSteals(stats.tiles), TileImbalance(stats.tiles));
+	AOStats aoStats;
+	if (options.ao)
+	{
+		//The texture main.cpp uses
+		const std::vector<float> blueNoise = LoadBlueNoise("data/textures/LDR64x64.png");
+		if (blueNoise.empty())
+		{
+			printf("Failed to load the blue noise texture data/textures/LDR64x64.png\n");
+			return EXIT_FAILURE;
+		}
+		aoStats = RenderAO(scene, blueNoise, 0, options.aoSettings, threadPool, &images);
+		printf("AO time (ms): %.2f    pixels: %u    rays: %llu    rays/s: %.0f\n", aoStats.renderTime, aoStats.aoPixels, (unsigned long long)aoStats.rays, aoStats.rays / (aoStats.renderTime / 1000.0f));
+		printf("AO radius: %.2f    query: %s\n", AORadius(options.aoSettings.visibilityCutoff), options.aoSettings.query == HIT_ANY ? "any hit" : "closest hit");
+		if (options.aoSettings.order == AO_RAY_STREAM)
+		{
+			printf("AO sort time (ms): %.2f    packets: %llu\n", aoStats.sortTime, (unsigned long long)aoStats.packets);
+		}
+		else
+		{
+			printf("AO tiles: %ux%u    count: %zu    steals: %u    slowest thread over average: %.2f\n", aoStats.tiles.tileSize, aoStats.tiles.tileSize, aoStats.tiles.tileTimes.size(), TotalSteals(aoStats.tiles), TileImbalance(aoStats.tiles));
+		}
+	}
+	
+	if (!WriteCpuImages(images, options.output))
+	{
+		printf("Failed to write the images to %s_*\n", options.output.c_str());
+		return EXIT_FAILURE;
+	}
+	if (!WriteTileTimes(options.output + "_color_tiles.pfm", stats.tiles) || (!aoStats.tiles.tileTimes.empty() && !WriteTileTimes(options.output + "_ao_tiles.pfm", aoStats.tiles)))
+	{
+		printf("Failed to write the tile times to %s_*_tiles.pfm\n", options.output.c_str());
+		return EXIT_FAILURE;
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	printf("Total time (ms): %.2f\n", std::chrono::duration<float, std::milli>(endTime - startTime).count());
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
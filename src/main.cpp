@@ -16,8 +16,16 @@ this for the sake of simplicity and easy modification.
 #define AO_PASS 1
 #define BLUR_PASS 1
 #define TEMPORAL_INTEGRATION_PASS 1
+#define STREAMING_SCENE_LOAD 0
+#define WATCH_SCENE_FILE 0
 
+#if STREAMING_SCENE_LOAD && WATCH_SCENE_FILE
+#error "WATCH_SCENE_FILE can't be combined with STREAMING_SCENE_LOAD"
+#endif
+
+#include <algorithm>
 #include "BrhanFile.h"
+#include <chrono>
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include "glm/gtc/constants.hpp"
 #include "glm/geometric.hpp"
@@ -25,9 +33,14 @@ this for the sake of simplicity and easy modification.
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/trigonometric.hpp"
 #include "glm/vec3.hpp"
+#include <limits>
+#include "Logger.h"
+#include "MeshLoader.h"
 #include "shaders/include/Defines.glsl"
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
+#include "ThreadPool.h"
 #include <vector>
 #include "VulkanApp.h"
 
@@ -348,6 +361,13 @@ void CreateRayTracingColorPositionPipelineAndData(VulkanApp& vkApp, RayTracingPi
 	perVertexAttributesDescriptorSetLayoutBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
 	perVertexAttributesDescriptorSetLayoutBinding.pImmutableSamplers = NULL;
 	
+	VkDescriptorSetLayoutBinding& indexDescriptorSetLayoutBinding = rtpd->descriptorSetLayoutBindings[1][RT0_INDEX_BUFFER_BINDING_LOCATION];
+	indexDescriptorSetLayoutBinding.binding = RT0_INDEX_BUFFER_BINDING_LOCATION;
+	indexDescriptorSetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	indexDescriptorSetLayoutBinding.descriptorCount = 1;
+	indexDescriptorSetLayoutBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV;
+	indexDescriptorSetLayoutBinding.pImmutableSamplers = NULL;
+	
 	VkDescriptorSetLayoutCreateInfo& descriptorSetLayoutInfo1 = rtpd->descriptorSetLayoutInfos[1];
 	descriptorSetLayoutInfo1.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	descriptorSetLayoutInfo1.pNext = NULL;
@@ -398,7 +418,7 @@ void CreateRayTracingColorPositionPipelineAndData(VulkanApp& vkApp, RayTracingPi
 	vkApp.CreateDeviceBuffer(rtpd->shaderBindingTableBufferSize, (void*)(rtpd->shaderGroupHandles.data()), VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, &rtpd->shaderBindingTableBuffer, &rtpd->shaderBindindTableBufferMemory);
 }
 
-void CreateDescriptorSetLayoutsColorPosition(VulkanApp& vkApp, VkDescriptorPool& descriptorPool, VulkanAccelerationStructure& accStruct, VkBuffer& cameraBuffer, VkDeviceSize& cameraBufferSize, VkBuffer& lightsBuffer, VkDeviceSize& lightsBufferSize, VkBuffer& otherDataBuffer, VkDeviceSize& otherDataBufferSize, VkBuffer& customIDToAttributeArrayIndexBuffer, VkDeviceSize& customIDToAttributeArrayIndexBufferSize, VkBuffer& perMeshAttributeBuffer, VkDeviceSize& perMeshAttributeBufferSize, VkBuffer& perVertexAttributeBuffer, VkDeviceSize& perVertexAttributeBufferSize, VkImageView& rayTracingColorImageView, VkImageView& rayTracingPositionImageView, VkImageView rayTracingNormalImageView, RayTracingPipelineData* rtpd)
+void CreateDescriptorSetLayoutsColorPosition(VulkanApp& vkApp, VkDescriptorPool& descriptorPool, VulkanAccelerationStructure& accStruct, VkBuffer& cameraBuffer, VkDeviceSize& cameraBufferSize, VkBuffer& lightsBuffer, VkDeviceSize& lightsBufferSize, VkBuffer& otherDataBuffer, VkDeviceSize& otherDataBufferSize, VkBuffer& customIDToAttributeArrayIndexBuffer, VkDeviceSize& customIDToAttributeArrayIndexBufferSize, VkBuffer& perMeshAttributeBuffer, VkDeviceSize& perMeshAttributeBufferSize, VkBuffer& perVertexAttributeBuffer, VkDeviceSize& perVertexAttributeBufferSize, VkBuffer& indexBuffer, VkDeviceSize& indexBufferSize, VkImageView& rayTracingColorImageView, VkImageView& rayTracingPositionImageView, VkImageView rayTracingNormalImageView, RayTracingPipelineData* rtpd)
 {
 	//Descriptor sets
 	rtpd->descriptorSets.resize(rtpd->numDescriptorSets);
@@ -600,6 +620,23 @@ void CreateDescriptorSetLayoutsColorPosition(VulkanApp& vkApp, VkDescriptorPool&
     perVerexAttributesWrite.pBufferInfo = &descriptorperVertexAttributesInfo;
     perVerexAttributesWrite.pTexelBufferView = NULL;
     
+    VkDescriptorBufferInfo descriptorIndexInfo = {};
+    descriptorIndexInfo.buffer = indexBuffer;
+    descriptorIndexInfo.offset = 0;
+    descriptorIndexInfo.range = indexBufferSize;
+    
+    VkWriteDescriptorSet& indexWrite = descriptorSet1Writes[RT0_INDEX_BUFFER_BINDING_LOCATION];
+    indexWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    indexWrite.pNext = NULL;
+    indexWrite.dstSet = descriptorSet1;
+    indexWrite.dstBinding = RT0_INDEX_BUFFER_BINDING_LOCATION;
+    indexWrite.dstArrayElement = 0;
+    indexWrite.descriptorCount = 1;
+    indexWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    indexWrite.pImageInfo = NULL;
+    indexWrite.pBufferInfo = &descriptorIndexInfo;
+    indexWrite.pTexelBufferView = NULL;
+    
     vkUpdateDescriptorSets(vkApp.vkDevice, descriptorSet1Writes.size(), descriptorSet1Writes.data(), 0, NULL);
 }
 
@@ -882,8 +919,189 @@ void CreateDescriptorSetLayoutsAO(VulkanApp& vkApp, VkDescriptorPool& descriptor
     vkUpdateDescriptorSets(vkApp.vkDevice, descriptorSet0Writes.size(), descriptorSet0Writes.data(), 0, NULL);
 }
 
+#if STREAMING_SCENE_LOAD || WATCH_SCENE_FILE
+// Rewrites the descriptors that point at the scene geometry, for when it has been replaced.
+// Nothing may be using the descriptor sets.
+void UpdateSceneDescriptorSets(VulkanApp& vkApp, VulkanAccelerationStructure& accStruct, VkBuffer& customIDToAttributeArrayIndexBuffer, VkDeviceSize& customIDToAttributeArrayIndexBufferSize, VkBuffer& perMeshAttributeBuffer, VkDeviceSize& perMeshAttributeBufferSize, VkBuffer& perVertexAttributeBuffer, VkDeviceSize& perVertexAttributeBufferSize, VkBuffer& indexBuffer, VkDeviceSize& indexBufferSize, RayTracingPipelineData* rtpdColorPosition, RayTracingPipelineData* rtpdAO)
+{
+	std::vector<VkWriteDescriptorSet> descriptorWrites(6);
+	
+	VkWriteDescriptorSetAccelerationStructureNV descriptorAccelerationStructureInfo = {};
+    descriptorAccelerationStructureInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_NV;
+    descriptorAccelerationStructureInfo.pNext = NULL;
+    descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
+    descriptorAccelerationStructureInfo.pAccelerationStructures = &accStruct.topAccStruct.accelerationStructure;
+    
+    VkWriteDescriptorSet& accelerationStructureColorPositionWrite = descriptorWrites[0];
+    accelerationStructureColorPositionWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    accelerationStructureColorPositionWrite.pNext = &descriptorAccelerationStructureInfo; // Notice that pNext is assigned here!
+    accelerationStructureColorPositionWrite.dstSet = rtpdColorPosition->descriptorSets[0];
+    accelerationStructureColorPositionWrite.dstBinding = RT0_ACCELERATION_STRUCTURE_NV_BINDING_LOCATION;
+    accelerationStructureColorPositionWrite.dstArrayElement = 0;
+    accelerationStructureColorPositionWrite.descriptorCount = 1;
+    accelerationStructureColorPositionWrite.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV;
+    accelerationStructureColorPositionWrite.pImageInfo = NULL;
+    accelerationStructureColorPositionWrite.pBufferInfo = NULL;
+    accelerationStructureColorPositionWrite.pTexelBufferView = NULL;
+    
+    VkWriteDescriptorSet& accelerationStructureAOWrite = descriptorWrites[1];
+    accelerationStructureAOWrite = accelerationStructureColorPositionWrite;
+    accelerationStructureAOWrite.dstSet = rtpdAO->descriptorSets[0];
+    accelerationStructureAOWrite.dstBinding = RT1_ACCELERATION_STRUCTURE_NV_BINDING_LOCATION;
+    
+    VkDescriptorBufferInfo descriptorCustomIDToAttributeArrayIndexInfo = {};
+    descriptorCustomIDToAttributeArrayIndexInfo.buffer = customIDToAttributeArrayIndexBuffer;
+    descriptorCustomIDToAttributeArrayIndexInfo.offset = 0;
+    descriptorCustomIDToAttributeArrayIndexInfo.range = customIDToAttributeArrayIndexBufferSize;
+    
+    VkDescriptorBufferInfo descriptorPerMeshAttributesInfo = {};
+    descriptorPerMeshAttributesInfo.buffer = perMeshAttributeBuffer;
+    descriptorPerMeshAttributesInfo.offset = 0;
+    descriptorPerMeshAttributesInfo.range = perMeshAttributeBufferSize;
+    
+    VkDescriptorBufferInfo descriptorPerVertexAttributesInfo = {};
+    descriptorPerVertexAttributesInfo.buffer = perVertexAttributeBuffer;
+    descriptorPerVertexAttributesInfo.offset = 0;
+    descriptorPerVertexAttributesInfo.range = perVertexAttributeBufferSize;
+    
+    VkDescriptorBufferInfo descriptorIndexInfo = {};
+    descriptorIndexInfo.buffer = indexBuffer;
+    descriptorIndexInfo.offset = 0;
+    descriptorIndexInfo.range = indexBufferSize;
+    
+    const uint32_t bufferBindings[] = {
+		RT0_CUSTOM_ID_TO_ATTRIBUTE_ARRAY_INDEX_BUFFER_BINDING_LOCATION,
+		RT0_PER_MESH_ATTRIBUTES_BINDING_LOCATION,
+		RT0_PER_VERTEX_ATTRIBUTES_BINDING_LOCATION,
+		RT0_INDEX_BUFFER_BINDING_LOCATION
+    };
+    const VkDescriptorBufferInfo* bufferInfos[] = {
+		&descriptorCustomIDToAttributeArrayIndexInfo,
+		&descriptorPerMeshAttributesInfo,
+		&descriptorPerVertexAttributesInfo,
+		&descriptorIndexInfo
+    };
+    for (uint32_t i = 0; i < 4; i++)
+    {
+		VkWriteDescriptorSet& bufferWrite = descriptorWrites[2 + i];
+		bufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		bufferWrite.pNext = NULL;
+		bufferWrite.dstSet = rtpdColorPosition->descriptorSets[1];
+		bufferWrite.dstBinding = bufferBindings[i];
+		bufferWrite.dstArrayElement = 0;
+		bufferWrite.descriptorCount = 1;
+		bufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bufferWrite.pImageInfo = NULL;
+		bufferWrite.pBufferInfo = bufferInfos[i];
+		bufferWrite.pTexelBufferView = NULL;
+    }
+    
+    vkUpdateDescriptorSets(vkApp.vkDevice, descriptorWrites.size(), descriptorWrites.data(), 0, NULL);
+}
+
+// Stands in for the scene until the first model has been loaded, so the buffers and the
+// acceleration structures are never empty. Its triangle has NaN positions, which makes it
+// inactive, so no ray ever hits it.
+Mesh PlaceholderMesh()
+{
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	Mesh mesh;
+	mesh.vertices = { nan, nan, nan, nan, nan, nan, nan, nan, nan };
+	mesh.normals = { 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+	mesh.uvs = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	mesh.indices = { 0, 1, 2 };
+	mesh.material.diffuseColor[0] = 1.0f;
+	mesh.material.diffuseColor[1] = 1.0f;
+	mesh.material.diffuseColor[2] = 1.0f;
+	mesh.material.diffuseColor[3] = 1.0f;
+	return mesh;
+}
+
+// Frees the buffer and creates it again with new contents. Nothing may be using the buffer.
+void ReplaceDeviceBuffer(VulkanApp& vkApp, VkDeviceSize bufferSize, void* bufferData, VkBufferUsageFlags bufferUsageFlags, VkBuffer* buffer, VkDeviceMemory* bufferMemory)
+{
+	vkFreeMemory(vkApp.vkDevice, *bufferMemory, NULL);
+	vkDestroyBuffer(vkApp.vkDevice, *buffer, NULL);
+	vkApp.CreateDeviceBuffer(bufferSize, bufferData, bufferUsageFlags, buffer, bufferMemory);
+}
+#endif
+
+#if WATCH_SCENE_FILE
+// Rewrites the descriptors of the lights, for when a different number of lights has been loaded.
+// Nothing may be using the descriptor set.
+void UpdateLightsDescriptorSet(VulkanApp& vkApp, VkBuffer& lightsBuffer, VkDeviceSize& lightsBufferSize, VkBuffer& otherDataBuffer, VkDeviceSize& otherDataBufferSize, RayTracingPipelineData* rtpdColorPosition)
+{
+	std::vector<VkWriteDescriptorSet> descriptorWrites(2);
+	
+    VkDescriptorBufferInfo descriptorLightsInfo = {};
+    descriptorLightsInfo.buffer = lightsBuffer;
+    descriptorLightsInfo.offset = 0;
+    descriptorLightsInfo.range = lightsBufferSize;
+    
+    VkWriteDescriptorSet& lightsWrite = descriptorWrites[0];
+    lightsWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightsWrite.pNext = NULL;
+    lightsWrite.dstSet = rtpdColorPosition->descriptorSets[0];
+    lightsWrite.dstBinding = RT0_LIGHTS_BUFFER_BINDING_LOCATION;
+    lightsWrite.dstArrayElement = 0;
+    lightsWrite.descriptorCount = 1;
+    lightsWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    lightsWrite.pImageInfo = NULL;
+    lightsWrite.pBufferInfo = &descriptorLightsInfo;
+    lightsWrite.pTexelBufferView = NULL;
+    
+    VkDescriptorBufferInfo descriptorOtherDataInfo = {};
+    descriptorOtherDataInfo.buffer = otherDataBuffer;
+    descriptorOtherDataInfo.offset = 0;
+    descriptorOtherDataInfo.range = otherDataBufferSize;
+    
+    VkWriteDescriptorSet& otherDataWrite = descriptorWrites[1];
+    otherDataWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    otherDataWrite.pNext = NULL;
+    otherDataWrite.dstSet = rtpdColorPosition->descriptorSets[0];
+    otherDataWrite.dstBinding = RT0_OTHER_DATA_BUFFER_BINDING_LOCATION;
+    otherDataWrite.dstArrayElement = 0;
+    otherDataWrite.descriptorCount = 1;
+    otherDataWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    otherDataWrite.pImageInfo = NULL;
+    otherDataWrite.pBufferInfo = &descriptorOtherDataInfo;
+    otherDataWrite.pTexelBufferView = NULL;
+    
+    vkUpdateDescriptorSets(vkApp.vkDevice, descriptorWrites.size(), descriptorWrites.data(), 0, NULL);
+}
+#endif
+
+// See shaders/include/Datalayouts.glsl for structure layout
+void BuildLightData(const std::vector<SphericalLightFromFile>& sphericalLights, std::vector<float>* lights)
+{
+	lights->clear();
+	for (const SphericalLightFromFile& sL : sphericalLights)
+	{
+		lights->push_back(sL.centerAndRadius.x);
+		lights->push_back(sL.centerAndRadius.y);
+		lights->push_back(sL.centerAndRadius.z);
+		lights->push_back(sL.centerAndRadius.w);
+		lights->push_back(sL.emittance.x);
+		lights->push_back(sL.emittance.y);
+		lights->push_back(sL.emittance.z);
+		lights->push_back(sL.emittance.w);
+	}
+}
+
+uint32_t CountSceneTriangles(const std::vector<Mesh>& meshes, const std::vector<MeshInstance>& meshInstances)
+{
+	uint32_t sceneTriangleCount = 0;
+	for (const MeshInstance& instance : meshInstances)
+	{
+		// divide by 3 because there are 3 indices per triangle
+		sceneTriangleCount += meshes[instance.meshIndex].indices.size() / 3;
+	}
+	return sceneTriangleCount;
+}
+
 void Raytrace(const char* brhanFile)
 {
+	auto raytraceStartTime = std::chrono::high_resolution_clock::now();
 	BrhanFile sceneFile(brhanFile);
 
 	std::vector<const char*> validationLayerNames = {
@@ -943,17 +1161,7 @@ void Raytrace(const char* brhanFile)
 	assert(sceneFile.sphericalLights.size() > 0);
 	const int numFloatsPerLight = 8;
 	std::vector<float> lights;
-	for (SphericalLightFromFile sL : sceneFile.sphericalLights)
-	{
-		lights.push_back(sL.centerAndRadius.x);
-		lights.push_back(sL.centerAndRadius.y);
-		lights.push_back(sL.centerAndRadius.z);
-		lights.push_back(sL.centerAndRadius.w);
-		lights.push_back(sL.emittance.x);
-		lights.push_back(sL.emittance.y);
-		lights.push_back(sL.emittance.z);
-		lights.push_back(sL.emittance.w);
-	}
+	BuildLightData(sceneFile.sphericalLights, &lights);
 	VkDeviceSize lightsBufferSize = lights.size() * sizeof(float);
 	VkBuffer lightsBuffer;
 	VkDeviceMemory lightsBufferMemory;
@@ -984,30 +1192,37 @@ void Raytrace(const char* brhanFile)
 	//////////GEOMETRY//////////
 	////////////////////////////
 	std::vector<Mesh> meshes;
-	for (const ModelFromFile& mff : sceneFile.models)
-	{
-		vkApp.LoadMesh(mff, &meshes);
-	}
-	uint32_t sceneTriangleCount = 0;
-	for (const Mesh& mesh : meshes)
-	{
-		// divide by 3 because there are 3 floats per vertex
-		// divide by 3 because there are 3 vertices per triangle
-		sceneTriangleCount += mesh.vertices.size() / 3 / 3;
-	}
-	printf("Scene triangle count: %u\n", sceneTriangleCount);
-	std::vector<std::vector<float>> geometryData;
+	std::vector<MeshInstance> meshInstances;
+#if STREAMING_SCENE_LOAD
+	// Rendering starts with only a placeholder, the models are added as they finish loading.
+	// The render thread never helps with the loads, so every core gets a worker.
+	ThreadPool threadPool(std::max(std::thread::hardware_concurrency(), 1u) + 1);
+	MeshStream meshStream;
+	StartMeshStream(sceneFile.models, &meshStream, threadPool);
+	meshes.push_back(PlaceholderMesh());
+	MeshInstance placeholderInstance;
+	placeholderInstance.meshIndex = 0;
+	placeholderInstance.transform = glm::mat4(1.0f);
+	meshInstances.push_back(placeholderInstance);
+#else
+	ThreadPool threadPool;
+	// Remembers where every model's meshes are, so a reload of the scene file only loads what changed
+	LoadedModelTable loadedModels;
+	LoadMeshes(sceneFile.models, &meshes, &meshInstances, threadPool, &loadedModels);
+	printf("Scene triangle count: %u\n", CountSceneTriangles(meshes, meshInstances));
+#endif
+	// Meshes are in object space and shared between instances, so there is one transformation per instance
 	std::vector<glm::mat4x4> transformationData;
-	for (Mesh& mesh : meshes)
+	for (const MeshInstance& instance : meshInstances)
 	{
-		geometryData.push_back(mesh.vertices);
-		transformationData.push_back(glm::mat4x4(1.0f));
+		transformationData.push_back(instance.transform);
 	}
 	
 	std::vector<float> perMeshAttributeData;
 	std::vector<float> perVertexAttributeData;
+	std::vector<uint32_t> meshIndexData;
 	std::vector<uint32_t> customIDToAttributeArrayIndex;
-	vkApp.BuildColorAndAttributeData(meshes, &perMeshAttributeData, &perVertexAttributeData, &customIDToAttributeArrayIndex);
+	vkApp.BuildColorAndAttributeData(meshes, &perMeshAttributeData, &perVertexAttributeData, &meshIndexData, &customIDToAttributeArrayIndex);
 	
 	VkDeviceSize perMeshAttributeBufferSize = perMeshAttributeData.size() * sizeof(float);
 	VkBuffer perMeshAttributeBuffer;
@@ -1016,11 +1231,18 @@ void Raytrace(const char* brhanFile)
 	perMeshAttributeData.resize(0);
 	
 	VkDeviceSize perVertexAttributeBufferSize = perVertexAttributeData.size() * sizeof(float);
+	printf("Per-vertex attribute buffer (MB): %.2f\n", perVertexAttributeBufferSize / (1024.0f * 1024.0f));
 	VkBuffer perVertexAttributeBuffer;
 	VkDeviceMemory perVertexAttributeBufferMemory;
 	vkApp.CreateDeviceBuffer(perVertexAttributeBufferSize, (void*)(perVertexAttributeData.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &perVertexAttributeBuffer, &perVertexAttributeBufferMemory);
 	perVertexAttributeData.resize(0);
 	
+	VkDeviceSize meshIndexBufferSize = meshIndexData.size() * sizeof(uint32_t);
+	VkBuffer meshIndexBuffer;
+	VkDeviceMemory meshIndexBufferMemory;
+	vkApp.CreateDeviceBuffer(meshIndexBufferSize, (void*)(meshIndexData.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &meshIndexBuffer, &meshIndexBufferMemory);
+	meshIndexData.resize(0);
+	
 	VkDeviceSize customIDToAttributeArrayIndexBufferSize = customIDToAttributeArrayIndex.size() * sizeof(uint32_t);
 	VkBuffer customIDToAttributeArrayIndexBuffer;
 	VkDeviceMemory customIDToAttributeArrayIndexBufferMemory;
@@ -1039,9 +1261,8 @@ void Raytrace(const char* brhanFile)
 	///ACCELERATION STRUCTURE///
 	////////////////////////////
 	VulkanAccelerationStructure accStruct;
-	vkApp.CreateVulkanAccelerationStructure(geometryData, &accStruct);
+	vkApp.CreateVulkanAccelerationStructure(meshes, meshInstances, &accStruct);
 	vkApp.BuildAccelerationStructure(accStruct);
-	geometryData.resize(0);
 	
 	/////////////////////////////
 	////RAY TRACING PIPELINES////
@@ -1181,7 +1402,7 @@ void Raytrace(const char* brhanFile)
 		{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, 2 },
         { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4 },
         { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 },
         { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 },
 	};
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
@@ -1194,7 +1415,7 @@ void Raytrace(const char* brhanFile)
 	VkDescriptorPool descriptorPool;
 	CHECK_VK_RESULT(vkCreateDescriptorPool(vkApp.vkDevice, &descriptorPoolInfo, NULL, &descriptorPool))
 	
-	CreateDescriptorSetLayoutsColorPosition(vkApp, descriptorPool, accStruct, cameraBuffer, cameraBufferSize, lightsBuffer, lightsBufferSize, otherDataBuffer, otherDataBufferSize, customIDToAttributeArrayIndexBuffer, customIDToAttributeArrayIndexBufferSize, perMeshAttributeBuffer, perMeshAttributeBufferSize, perVertexAttributeBuffer, perVertexAttributeBufferSize, rayTracingColorImageView, rayTracingPositionImageView, rayTracingNormalImageView, &rtpdColorPosition);
+	CreateDescriptorSetLayoutsColorPosition(vkApp, descriptorPool, accStruct, cameraBuffer, cameraBufferSize, lightsBuffer, lightsBufferSize, otherDataBuffer, otherDataBufferSize, customIDToAttributeArrayIndexBuffer, customIDToAttributeArrayIndexBufferSize, perMeshAttributeBuffer, perMeshAttributeBufferSize, perVertexAttributeBuffer, perVertexAttributeBufferSize, meshIndexBuffer, meshIndexBufferSize, rayTracingColorImageView, rayTracingPositionImageView, rayTracingNormalImageView, &rtpdColorPosition);
 	
 	CreateDescriptorSetLayoutsAO(vkApp, descriptorPool, accStruct, rayTracingPositionImageView, rayTracingNormalImageView, nearestSampler, rayTracingAOImageView, currentFrameBuffer, blueNoiseTexture.imageView, nearestRepeatSampler, &rtpdAO);
     
@@ -1781,116 +2002,165 @@ void Raytrace(const char* brhanFile)
     std::vector<VkCommandBuffer> graphicsQueueCommandBuffers;
 	vkApp.AllocateDefaultGraphicsQueueCommandBuffers(graphicsQueueCommandBuffers);
 	VkDeviceSize offset = 0;
-	for (size_t i = 0; i < graphicsQueueCommandBuffers.size(); i++)
+	// Recorded again when streamed in geometry replaces the buffers bound by the descriptor sets
+	auto RecordCommandBuffers = [&]()
 	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.pNext = NULL;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = NULL;
-		CHECK_VK_RESULT(vkBeginCommandBuffer(graphicsQueueCommandBuffers[i], &beginInfo))
-		
+		for (size_t i = 0; i < graphicsQueueCommandBuffers.size(); i++)
+		{
+			VkCommandBufferBeginInfo beginInfo = {};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.pNext = NULL;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+			beginInfo.pInheritanceInfo = NULL;
+			CHECK_VK_RESULT(vkBeginCommandBuffer(graphicsQueueCommandBuffers[i], &beginInfo))
+			
 #if REBUILD_ACC_STRUCT
-		// Rebuild acceleration structure
-		vkCmdBuildAccelerationStructureNV(graphicsQueueCommandBuffers[i], &accStruct.topAccStruct.accelerationStructureInfo, accStruct.geometryInstancesBuffer, 0, VK_FALSE, accStruct.topAccStruct.accelerationStructure, VK_NULL_HANDLE, accStruct.scratchBuffer, 0);
-		//Barrier before tracing can begin
-		VkMemoryBarrier memoryBarrier = {};
-		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-		memoryBarrier.pNext = NULL;
-		memoryBarrier.srcAccessMask = 0;
-		memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
-		vkCmdPipelineBarrier(graphicsQueueCommandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+			// Rebuild acceleration structure
+			vkCmdBuildAccelerationStructureNV(graphicsQueueCommandBuffers[i], &accStruct.topAccStruct.accelerationStructureInfo, accStruct.geometryInstancesBuffer, 0, VK_FALSE, accStruct.topAccStruct.accelerationStructure, VK_NULL_HANDLE, accStruct.scratchBuffer, 0);
+			//Barrier before tracing can begin
+			VkMemoryBarrier memoryBarrier = {};
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.pNext = NULL;
+			memoryBarrier.srcAccessMask = 0;
+			memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+			vkCmdPipelineBarrier(graphicsQueueCommandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
 #endif
-		
-		// Ray trace color, position and normal
+			
+			// Ray trace color, position and normal
 #if DEFERRED_PASS
-		vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdColorPosition.rayTracingPipeline);
-		vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdColorPosition.rayTracingPipelineLayout, 0, rtpdColorPosition.descriptorSets.size(), rtpdColorPosition.descriptorSets.data(), 0, NULL);
-		vkCmdTraceRaysNV(graphicsQueueCommandBuffers[i], 
-			rtpdColorPosition.shaderBindingTableBuffer, 0 * rtpdColorPosition.shaderGroupHandleSize,
-			rtpdColorPosition.shaderBindingTableBuffer, 3 * rtpdColorPosition.shaderGroupHandleSize, rtpdColorPosition.shaderGroupHandleSize,
-			rtpdColorPosition.shaderBindingTableBuffer, 1 * rtpdColorPosition.shaderGroupHandleSize, rtpdColorPosition.shaderGroupHandleSize,
-			 VK_NULL_HANDLE, 0, 0, vkApp.vkSurfaceExtent.width, vkApp.vkSurfaceExtent.height, 1);
+			vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdColorPosition.rayTracingPipeline);
+			vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdColorPosition.rayTracingPipelineLayout, 0, rtpdColorPosition.descriptorSets.size(), rtpdColorPosition.descriptorSets.data(), 0, NULL);
+			vkCmdTraceRaysNV(graphicsQueueCommandBuffers[i], 
+				rtpdColorPosition.shaderBindingTableBuffer, 0 * rtpdColorPosition.shaderGroupHandleSize,
+				rtpdColorPosition.shaderBindingTableBuffer, 3 * rtpdColorPosition.shaderGroupHandleSize, rtpdColorPosition.shaderGroupHandleSize,
+				rtpdColorPosition.shaderBindingTableBuffer, 1 * rtpdColorPosition.shaderGroupHandleSize, rtpdColorPosition.shaderGroupHandleSize,
+				 VK_NULL_HANDLE, 0, 0, vkApp.vkSurfaceExtent.width, vkApp.vkSurfaceExtent.height, 1);
 #endif
-		
-		// Barrier - wait for ray tracing to finish and transition images
-		vkApp.TransitionImageLayoutInProgress(rayTracingColorImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
-		vkApp.TransitionImageLayoutInProgress(rayTracingPositionImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
-		vkApp.TransitionImageLayoutInProgress(rayTracingNormalImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
-		
-		// Ray trace AO
+			
+			// Barrier - wait for ray tracing to finish and transition images
+			vkApp.TransitionImageLayoutInProgress(rayTracingColorImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
+			vkApp.TransitionImageLayoutInProgress(rayTracingPositionImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
+			vkApp.TransitionImageLayoutInProgress(rayTracingNormalImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
+			
+			// Ray trace AO
 #if AO_PASS
-		vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdAO.rayTracingPipeline);
-		vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdAO.rayTracingPipelineLayout, 0, rtpdAO.descriptorSets.size(), rtpdAO.descriptorSets.data(), 0, NULL);
-		vkCmdTraceRaysNV(graphicsQueueCommandBuffers[i], 
-			rtpdAO.shaderBindingTableBuffer, 0 * rtpdAO.shaderGroupHandleSize,
-			rtpdAO.shaderBindingTableBuffer, 2 * rtpdAO.shaderGroupHandleSize, rtpdAO.shaderGroupHandleSize,
-			rtpdAO.shaderBindingTableBuffer, 1 * rtpdAO.shaderGroupHandleSize, rtpdAO.shaderGroupHandleSize,
-			 VK_NULL_HANDLE, 0, 0, aoImageExtent.width, aoImageExtent.height, 1);
+			vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdAO.rayTracingPipeline);
+			vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, rtpdAO.rayTracingPipelineLayout, 0, rtpdAO.descriptorSets.size(), rtpdAO.descriptorSets.data(), 0, NULL);
+			vkCmdTraceRaysNV(graphicsQueueCommandBuffers[i], 
+				rtpdAO.shaderBindingTableBuffer, 0 * rtpdAO.shaderGroupHandleSize,
+				rtpdAO.shaderBindingTableBuffer, 2 * rtpdAO.shaderGroupHandleSize, rtpdAO.shaderGroupHandleSize,
+				rtpdAO.shaderBindingTableBuffer, 1 * rtpdAO.shaderGroupHandleSize, rtpdAO.shaderGroupHandleSize,
+				 VK_NULL_HANDLE, 0, 0, aoImageExtent.width, aoImageExtent.height, 1);
 #endif
-			 
-		// Barrier - wait for ray tracing to finish and transition images
-		vkApp.TransitionImageLayoutInProgress(rayTracingAOImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
-		
-		// Blur ambient occlusion result and combine with light result
-		VkClearColorValue clearColorValue = { 0.0f, 0.0f, 0.0f, 1.0f };
-		VkClearValue clearValues[] = { clearColorValue };
-		// Begin render pass
-		VkRenderPassBeginInfo renderpassInfo = {};
-		renderpassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderpassInfo.pNext = NULL;
-		renderpassInfo.renderPass = renderPass;
-		renderpassInfo.framebuffer = framebuffersRenderPass[i];
-		renderpassInfo.renderArea.offset = { 0, 0 };
-		renderpassInfo.renderArea.extent = vkApp.vkSurfaceExtent;
-		renderpassInfo.clearValueCount = 1;
-		renderpassInfo.pClearValues = clearValues;
-		vkCmdBeginRenderPass(graphicsQueueCommandBuffers[i], &renderpassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		// Subpass 0
+				 
+			// Barrier - wait for ray tracing to finish and transition images
+			vkApp.TransitionImageLayoutInProgress(rayTracingAOImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, graphicsQueueCommandBuffers[i]);
+			
+			// Blur ambient occlusion result and combine with light result
+			VkClearColorValue clearColorValue = { 0.0f, 0.0f, 0.0f, 1.0f };
+			VkClearValue clearValues[] = { clearColorValue };
+			// Begin render pass
+			VkRenderPassBeginInfo renderpassInfo = {};
+			renderpassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderpassInfo.pNext = NULL;
+			renderpassInfo.renderPass = renderPass;
+			renderpassInfo.framebuffer = framebuffersRenderPass[i];
+			renderpassInfo.renderArea.offset = { 0, 0 };
+			renderpassInfo.renderArea.extent = vkApp.vkSurfaceExtent;
+			renderpassInfo.clearValueCount = 1;
+			renderpassInfo.pClearValues = clearValues;
+			vkCmdBeginRenderPass(graphicsQueueCommandBuffers[i], &renderpassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			// Subpass 0
 #if BLUR_PASS
-		vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineSubpass0);
-		vkCmdBindVertexBuffers(graphicsQueueCommandBuffers[i], 0, 1, &vertexBuffer, &offset);
-		vkCmdBindIndexBuffer(graphicsQueueCommandBuffers[i], indexBuffer, offset, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayoutGraphicsSubpass0, 0, 1, &descriptorSetGraphicsSubpass0, 0, NULL);
-		vkCmdDrawIndexed(graphicsQueueCommandBuffers[i], uint32_t(indexData.size()), 1, 0, 0, 0);
+			vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineSubpass0);
+			vkCmdBindVertexBuffers(graphicsQueueCommandBuffers[i], 0, 1, &vertexBuffer, &offset);
+			vkCmdBindIndexBuffer(graphicsQueueCommandBuffers[i], indexBuffer, offset, VK_INDEX_TYPE_UINT32);
+			vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayoutGraphicsSubpass0, 0, 1, &descriptorSetGraphicsSubpass0, 0, NULL);
+			vkCmdDrawIndexed(graphicsQueueCommandBuffers[i], uint32_t(indexData.size()), 1, 0, 0, 0);
 #endif
-		// Subpass 1
-		vkCmdNextSubpass(graphicsQueueCommandBuffers[i], VK_SUBPASS_CONTENTS_INLINE);
+			// Subpass 1
+			vkCmdNextSubpass(graphicsQueueCommandBuffers[i], VK_SUBPASS_CONTENTS_INLINE);
 #if TEMPORAL_INTEGRATION_PASS
-		vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineSubpass1);
-		vkCmdBindVertexBuffers(graphicsQueueCommandBuffers[i], 0, 1, &vertexBuffer, &offset);
-		vkCmdBindIndexBuffer(graphicsQueueCommandBuffers[i], indexBuffer, offset, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayoutGraphicsSubpass1, 0, 1, &descriptorSetGraphicsSubpass1, 0, NULL);
-		vkCmdDrawIndexed(graphicsQueueCommandBuffers[i], uint32_t(indexData.size()), 1, 0, 0, 0);
+			vkCmdBindPipeline(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineSubpass1);
+			vkCmdBindVertexBuffers(graphicsQueueCommandBuffers[i], 0, 1, &vertexBuffer, &offset);
+			vkCmdBindIndexBuffer(graphicsQueueCommandBuffers[i], indexBuffer, offset, VK_INDEX_TYPE_UINT32);
+			vkCmdBindDescriptorSets(graphicsQueueCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayoutGraphicsSubpass1, 0, 1, &descriptorSetGraphicsSubpass1, 0, NULL);
+			vkCmdDrawIndexed(graphicsQueueCommandBuffers[i], uint32_t(indexData.size()), 1, 0, 0, 0);
 #endif
-		// End render pass
-		vkCmdEndRenderPass(graphicsQueueCommandBuffers[i]);
-		
-		// Barrier - wait for blurring and TAA to finish and transition image
-		vkApp.TransitionImageLayoutInProgress(previousFrameImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, graphicsQueueCommandBuffers[i]);
-		
-		// Blit swap chain image to previous image
-		VkImageBlit blitRegion = {};
-		blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-		VkOffset3D offsetStart = { 0, 0, 0 };
-		VkOffset3D offsetEnd = { int32_t(vkApp.vkSurfaceExtent.width), int32_t(vkApp.vkSurfaceExtent.height), 1 };
-		blitRegion.srcOffsets[0] = offsetStart;
-		blitRegion.srcOffsets[1] = offsetEnd;
-		blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-		blitRegion.dstOffsets[0] = offsetStart;
-		blitRegion.dstOffsets[1] = offsetEnd;
-		vkCmdBlitImage(graphicsQueueCommandBuffers[i], vkApp.vkSwapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, previousFrameImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, VK_FILTER_LINEAR);
+			// End render pass
+			vkCmdEndRenderPass(graphicsQueueCommandBuffers[i]);
+			
+			// Barrier - wait for blurring and TAA to finish and transition image
+			vkApp.TransitionImageLayoutInProgress(previousFrameImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, graphicsQueueCommandBuffers[i]);
+			
+			// Blit swap chain image to previous image
+			VkImageBlit blitRegion = {};
+			blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+			VkOffset3D offsetStart = { 0, 0, 0 };
+			VkOffset3D offsetEnd = { int32_t(vkApp.vkSurfaceExtent.width), int32_t(vkApp.vkSurfaceExtent.height), 1 };
+			blitRegion.srcOffsets[0] = offsetStart;
+			blitRegion.srcOffsets[1] = offsetEnd;
+			blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+			blitRegion.dstOffsets[0] = offsetStart;
+			blitRegion.dstOffsets[1] = offsetEnd;
+			vkCmdBlitImage(graphicsQueueCommandBuffers[i], vkApp.vkSwapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, previousFrameImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, VK_FILTER_LINEAR);
+			
+			//Barrier - wait for blit to finish and transition images
+			vkApp.TransitionImageLayoutInProgress(vkApp.vkSwapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
+			vkApp.TransitionImageLayoutInProgress(previousFrameImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
+			vkApp.TransitionImageLayoutInProgress(rayTracingColorImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
+			vkApp.TransitionImageLayoutInProgress(rayTracingPositionImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
+			vkApp.TransitionImageLayoutInProgress(rayTracingNormalImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
+			vkApp.TransitionImageLayoutInProgress(rayTracingAOImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
+			
+			CHECK_VK_RESULT(vkEndCommandBuffer(graphicsQueueCommandBuffers[i]))
+		}
+	};
+	RecordCommandBuffers();
+	
+#if STREAMING_SCENE_LOAD || WATCH_SCENE_FILE
+	// The descriptor sets can't change while command buffers using them are pending, so they are recorded anew
+	auto RerecordCommandBuffers = [&]()
+	{
+		vkFreeCommandBuffers(vkApp.vkDevice, vkApp.vkGraphicsQueueCommandPool, uint32_t(graphicsQueueCommandBuffers.size()), graphicsQueueCommandBuffers.data());
+		vkApp.AllocateDefaultGraphicsQueueCommandBuffers(graphicsQueueCommandBuffers);
+		RecordCommandBuffers();
+	};
+	
+	// Replaces the geometry buffers with ones built from 'meshes', adds the bottom level acceleration
+	// structures of new meshes and rebuilds the top level one from 'meshInstances' and 'transformationData'.
+	// The device must be idle.
+	auto UploadSceneGeometry = [&]()
+	{
+		vkApp.BuildColorAndAttributeData(meshes, &perMeshAttributeData, &perVertexAttributeData, &meshIndexData, &customIDToAttributeArrayIndex);
+		perMeshAttributeBufferSize = perMeshAttributeData.size() * sizeof(float);
+		ReplaceDeviceBuffer(vkApp, perMeshAttributeBufferSize, (void*)(perMeshAttributeData.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &perMeshAttributeBuffer, &perMeshAttributeBufferMemory);
+		perMeshAttributeData.resize(0);
+		perVertexAttributeBufferSize = perVertexAttributeData.size() * sizeof(float);
+		ReplaceDeviceBuffer(vkApp, perVertexAttributeBufferSize, (void*)(perVertexAttributeData.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &perVertexAttributeBuffer, &perVertexAttributeBufferMemory);
+		perVertexAttributeData.resize(0);
+		meshIndexBufferSize = meshIndexData.size() * sizeof(uint32_t);
+		ReplaceDeviceBuffer(vkApp, meshIndexBufferSize, (void*)(meshIndexData.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &meshIndexBuffer, &meshIndexBufferMemory);
+		meshIndexData.resize(0);
+		customIDToAttributeArrayIndexBufferSize = customIDToAttributeArrayIndex.size() * sizeof(uint32_t);
+		ReplaceDeviceBuffer(vkApp, customIDToAttributeArrayIndexBufferSize, (void*)(customIDToAttributeArrayIndex.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &customIDToAttributeArrayIndexBuffer, &customIDToAttributeArrayIndexBufferMemory);
+		customIDToAttributeArrayIndex.resize(0);
 		
-		//Barrier - wait for blit to finish and transition images
-		vkApp.TransitionImageLayoutInProgress(vkApp.vkSwapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
-		vkApp.TransitionImageLayoutInProgress(previousFrameImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
-		vkApp.TransitionImageLayoutInProgress(rayTracingColorImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
-		vkApp.TransitionImageLayoutInProgress(rayTracingPositionImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
-		vkApp.TransitionImageLayoutInProgress(rayTracingNormalImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
-		vkApp.TransitionImageLayoutInProgress(rayTracingAOImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, graphicsQueueCommandBuffers[i]);
+		vkApp.ExtendVulkanAccelerationStructure(meshes, meshInstances, &accStruct);
+		vkApp.UpdateAccelerationStructureTransforms(accStruct, transformationData);
+		vkApp.BuildAccelerationStructure(accStruct);
 		
-		CHECK_VK_RESULT(vkEndCommandBuffer(graphicsQueueCommandBuffers[i]))
-	}
+		UpdateSceneDescriptorSets(vkApp, accStruct, customIDToAttributeArrayIndexBuffer, customIDToAttributeArrayIndexBufferSize, perMeshAttributeBuffer, perMeshAttributeBufferSize, perVertexAttributeBuffer, perVertexAttributeBufferSize, meshIndexBuffer, meshIndexBufferSize, &rtpdColorPosition, &rtpdAO);
+		RerecordCommandBuffers();
+	};
+#endif
+#if WATCH_SCENE_FILE
+	// The scene file is reloaded once its modification time has stayed the same for one check,
+	// so a file that is still being written isn't read
+	auto lastSceneFileCheckTime = vkApp.GetTime();
+	int64_t sceneFileModifiedTime = FileModifiedTime(brhanFile);
+	int64_t pendingSceneFileModifiedTime = sceneFileModifiedTime;
+#endif
 	
 	// Render
 	glfwSetCursorPosCallback(vkApp.window, MouseCallback);
@@ -1900,9 +2170,159 @@ void Raytrace(const char* brhanFile)
 	float totalRenderTimeOffscreen = 0.0f;
 	uint32_t frameCountOnscreen = 0;
 	uint32_t frameCountOffscreen = 0;
+	bool firstFrameRendered = false;
 	while (!glfwWindowShouldClose(vkApp.window))
 	{
 		glfwPollEvents();
+#if STREAMING_SCENE_LOAD
+		// Add the models that finished loading since the last frame. The geometry buffers and
+		// the instances are replaced as a whole, the bottom level acceleration structures of the
+		// meshes that are already in the scene are kept.
+		if (!MeshStreamFinished(meshStream) && CollectStreamedMeshes(&meshStream, &meshes, &meshInstances) > 0)
+		{
+			auto streamUpdateStartTime = vkApp.GetTime();
+			vkDeviceWaitIdle(vkApp.vkDevice);
+			for (size_t i = transformationData.size(); i < meshInstances.size(); i++)
+			{
+				transformationData.push_back(meshInstances[i].transform);
+			}
+			
+			UploadSceneGeometry();
+			
+			auto streamUpdateEndTime = vkApp.GetTime();
+			printf("Scene update time (ms): %.2f    meshes: %zu    instances: %zu\n", std::chrono::duration<float, std::milli>(streamUpdateEndTime - streamUpdateStartTime).count(), meshes.size() - 1, meshInstances.size() - 1);
+			// Loading progress in the title bar
+			char windowTitle[128];
+			snprintf(windowTitle, sizeof(windowTitle), "Vulkan RTX - loaded %u/%zu models", meshStream.numCollectedModels, meshStream.uniqueModels.size());
+			if (MeshStreamFinished(meshStream))
+			{
+				float streamMs = std::chrono::duration<float, std::milli>(streamUpdateEndTime - meshStream.startTime).count();
+				printf("Scene streamed in (ms): %.2f\n", streamMs);
+				printf("Scene triangle count: %u\n", CountSceneTriangles(meshes, meshInstances) - 1);
+				snprintf(windowTitle, sizeof(windowTitle), "Vulkan RTX");
+			}
+			glfwSetWindowTitle(vkApp.window, windowTitle);
+		}
+#endif
+#if WATCH_SCENE_FILE
+		auto sceneFileCheckTime = vkApp.GetTime();
+		if (std::chrono::duration<float, std::milli>(sceneFileCheckTime - lastSceneFileCheckTime).count() >= 100.0f)
+		{
+			lastSceneFileCheckTime = sceneFileCheckTime;
+			int64_t modifiedTime = FileModifiedTime(brhanFile);
+			bool reload = modifiedTime != -1 && modifiedTime != sceneFileModifiedTime && modifiedTime == pendingSceneFileModifiedTime;
+			pendingSceneFileModifiedTime = modifiedTime;
+			// A file that fails to parse, or has a model that fails to load, leaves the current scene as it is
+			// until the file is saved again
+			BrhanFile newSceneFile;
+			BrhanFileDiff diff;
+			std::vector<uint32_t> keptMeshes;
+			uint32_t numReloadedModels = 0;
+			std::string reloadError;
+			if (reload)
+			{
+				sceneFileModifiedTime = modifiedTime;
+				reload = newSceneFile.Load(brhanFile, 0, &reloadError);
+			}
+			if (reload)
+			{
+				// Only the parts of the scene that differ from the previous version are updated
+				diff = DiffBrhanFiles(sceneFile, newSceneFile);
+				if (diff.lightsChanged && newSceneFile.sphericalLights.empty())
+				{
+					LOG_WARNING(false, __FILE__, __FUNCTION__, __LINE__, "%s has no lights, the previous ones are kept\n", brhanFile);
+					newSceneFile.sphericalLights = sceneFile.sphericalLights;
+					diff.lightsChanged = false;
+				}
+				if (diff.modelsChanged && newSceneFile.models.empty())
+				{
+					LOG_WARNING(false, __FILE__, __FUNCTION__, __LINE__, "%s has no models, the previous ones are kept\n", brhanFile);
+					newSceneFile.models = sceneFile.models;
+					diff.modelsChanged = false;
+				}
+				// The models are loaded before anything else is updated, so one that fails to load changes nothing
+				if (diff.modelsChanged)
+				{
+					reload = UpdateMeshes(newSceneFile.models, &loadedModels, &meshes, &meshInstances, &keptMeshes, &numReloadedModels, &reloadError, threadPool);
+				}
+			}
+			if (!reloadError.empty())
+			{
+				LOG_WARNING(false, __FILE__, __FUNCTION__, __LINE__, "Failed to reload %s, the current scene is kept: %s\n", brhanFile, reloadError.c_str());
+			}
+			if (reload)
+			{
+				if (!diff.Empty())
+				{
+					vkDeviceWaitIdle(vkApp.vkDevice);
+				}
+				bool rerecord = false;
+				if (diff.filmChanged)
+				{
+					LOG_WARNING(false, __FILE__, __FUNCTION__, __LINE__, "The film size of %s changed, restart to use it\n", brhanFile);
+					newSceneFile.filmWidth = sceneFile.filmWidth;
+					newSceneFile.filmHeight = sceneFile.filmHeight;
+				}
+				if (diff.cameraChanged)
+				{
+					vkApp.camera = Camera(sceneFile.filmWidth, sceneFile.filmHeight, newSceneFile.cameraVerticalFOV, newSceneFile.cameraOrigin, newSceneFile.cameraViewDir);
+					vkApp.previousFrameCamera = vkApp.camera;
+				}
+				if (diff.lightsChanged)
+				{
+					BuildLightData(newSceneFile.sphericalLights, &lights);
+					if (lights.size() * sizeof(float) == lightsBufferSize)
+					{
+						vkApp.UpdateHostVisibleBuffer(lightsBufferSize, lights.data(), lightsBufferMemory);
+					}
+					else
+					{
+						vkFreeMemory(vkApp.vkDevice, lightsBufferMemory, NULL);
+						vkDestroyBuffer(vkApp.vkDevice, lightsBuffer, NULL);
+						lightsBufferSize = lights.size() * sizeof(float);
+						vkApp.CreateHostVisibleBuffer(lightsBufferSize, (void*)(lights.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &lightsBuffer, &lightsBufferMemory);
+						int numLights = int(lights.size() / numFloatsPerLight);
+						ReplaceDeviceBuffer(vkApp, otherDataBufferSize, (void*)(&numLights), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &otherDataBuffer, &otherDataBufferMemory);
+						UpdateLightsDescriptorSet(vkApp, lightsBuffer, lightsBufferSize, otherDataBuffer, otherDataBufferSize, &rtpdColorPosition);
+						rerecord = true;
+					}
+				}
+				if (diff.modelsChanged)
+				{
+					// Models whose file didn't change keep their meshes and bottom level acceleration structures,
+					// those of reloaded and removed models are freed so repeated edits don't accumulate them
+					vkApp.CompactVulkanAccelerationStructure(keptMeshes, &accStruct);
+					transformationData.clear();
+					for (const MeshInstance& instance : meshInstances)
+					{
+						transformationData.push_back(instance.transform);
+					}
+					UploadSceneGeometry();
+					rerecord = false;
+				}
+				else if (!diff.transformedModels.empty())
+				{
+					std::vector<uint32_t> changedInstances;
+					UpdateInstanceTransforms(newSceneFile.models, diff.transformedModels, loadedModels, &meshInstances, &changedInstances);
+					for (uint32_t i : changedInstances)
+					{
+						transformationData[i] = meshInstances[i].transform;
+					}
+					// Only the top level acceleration structure is built again
+					vkApp.UpdateAccelerationStructureTransforms(accStruct, transformationData);
+					vkApp.BuildAccelerationStructure(accStruct);
+				}
+				if (rerecord)
+				{
+					RerecordCommandBuffers();
+				}
+				sceneFile = newSceneFile;
+				
+				auto sceneReloadEndTime = vkApp.GetTime();
+				printf("Scene reload time (ms): %.2f    camera: %d    lights: %d    models reloaded: %u    models moved: %zu\n", std::chrono::duration<float, std::milli>(sceneReloadEndTime - sceneFileCheckTime).count(), int(diff.cameraChanged), int(diff.lightsChanged), numReloadedModels, diff.transformedModels.size());
+			}
+		}
+#endif
 		// Camera
 		vkApp.camera.Update();
 		//printf("Origin: %f %f %f\n", vkApp.camera.origin.x, vkApp.camera.origin.y, vkApp.camera.origin.z);
@@ -1921,11 +2341,12 @@ void Raytrace(const char* brhanFile)
 		vkApp.UpdateHostVisibleBuffer(blurBufferSize, &blurVariable, blurBufferMemory);
 		vkApp.previousFrameCamera = vkApp.camera;
 		
-		// Update the transformation for each mesh
+		// Update the transformation for each instance
 		for (glm::mat4x4& transformation : transformationData)
 		{
+			// Translate in world space, after the model transformation
 			glm::mat4 translateM = glm::translate(glm::mat4x4(1.0f), glm::vec3(0.01f, 0.0f, 0.0f));
-			transformation *= translateM;
+			transformation = translateM * transformation;
 		}
 		// Update acceleration structure
 		vkApp.UpdateAccelerationStructureTransforms(accStruct, transformationData);
@@ -1966,6 +2387,12 @@ void Raytrace(const char* brhanFile)
 			totalRenderTimeOffscreen += vkApp.RenderOffscreen(graphicsQueueCommandBuffers.data(), 0.0f);
 			frameCountOffscreen++;
 		}
+		if (!firstFrameRendered)
+		{
+			auto firstFrameTime = std::chrono::high_resolution_clock::now();
+			printf("\nTime to first frame (ms): %.2f\n", std::chrono::duration<float, std::milli>(firstFrameTime - raytraceStartTime).count());
+			firstFrameRendered = true;
+		}
 	}
 	vkDeviceWaitIdle(vkApp.vkDevice);
 	
@@ -44,6 +44,13 @@ struct VertexAttributes
 	vec4 uv;
 };
 
+// std430, see COMPACT_VERTEX_ATTRIBUTES
+struct CompactVertexAttributes
+{
+	uint normal; // Octahedral, packSnorm2x16
+	uint uv; // packHalf2x16
+};
+
 //////////////////////////////////
 //////Shader-local structures/////
 //////////////////////////////////
@@ -39,10 +39,16 @@ WARNINIG: do not change these values unless you REALLY know what you're doing!
 #define RT0_OTHER_DATA_BUFFER_BINDING_LOCATION 6
 
 // Set 1
-#define RT0_DESCRIPTOR_SET_1_NUM_BINDINGS 3
+#define RT0_DESCRIPTOR_SET_1_NUM_BINDINGS 4
 #define RT0_CUSTOM_ID_TO_ATTRIBUTE_ARRAY_INDEX_BUFFER_BINDING_LOCATION 0
 #define RT0_PER_MESH_ATTRIBUTES_BINDING_LOCATION 1
 #define RT0_PER_VERTEX_ATTRIBUTES_BINDING_LOCATION 2
+#define RT0_INDEX_BUFFER_BINDING_LOCATION 3
+
+// Per-vertex attribute layout. 0: VertexAttributes, 32 bytes per vertex.
+// 1: CompactVertexAttributes, 8 bytes per vertex: an octahedral normal and the uv as halfs.
+// Shared with 'VulkanApp.cpp', recompile the shaders after changing it.
+#define COMPACT_VERTEX_ATTRIBUTES 0
 
 ///////////////////////////
 //SECOND RAY TRACING PASS//
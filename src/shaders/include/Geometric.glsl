@@ -30,4 +30,16 @@ mat4 Rotate(float angle, vec3 axis)
                 0.0f, 0.0f, 0.0f, 1.0f);
 }
 
+// Octahedral normal encoding, the inverse of EncodeOctahedralNormal in 'VertexEncoding.cpp'
+// http://jcgt.org/published/0003/02/01/
+vec3 OctahedralDecode(uint encoded)
+{
+	vec2 f = unpackSnorm2x16(encoded);
+	vec3 n = vec3(f.x, f.y, 1.0f - abs(f.x) - abs(f.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
 #endif
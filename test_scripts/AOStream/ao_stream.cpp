@@ -0,0 +1,212 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Compares the two orders the CPU AO pass can trace its occlusion rays in: pixel by pixel like
+the shader, and as sorted ray streams. Every pixel that hit geometry gets AO here, not only the
+ones that see no light, so there are enough rays to measure. Prints the time, rays/s and, where
+the kernel allows reading the hardware counters, cache misses of both.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/AOStream/ao_stream <scene.brhan> [width] [height] [threads]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include "cpu/CpuAO.h"
+#include "cpu/CpuRenderer.h"
+#include "cpu/CpuScene.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <linux/perf_event.h>
+#include "MeshLoader.h"
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "ThreadPool.h"
+#include <unistd.h>
+#include <vector>
+
+//A hardware counter of the calling thread, and of the threads it creates after it's opened
+struct Counter
+{
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+	int fd;
+};
+
+static void OpenCounter(Counter* counter)
+{
+	perf_event_attr attributes;
+	memset(&attributes, 0, sizeof(attributes));
+	attributes.size = sizeof(attributes);
+	attributes.type = counter->type;
+	attributes.config = counter->config;
+	attributes.disabled = 1;
+	attributes.inherit = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	counter->fd = int(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+static void StartCounter(const Counter& counter)
+{
+	if (counter.fd >= 0)
+	{
+		ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+static uint64_t StopCounter(const Counter& counter)
+{
+	uint64_t value = 0;
+	if (counter.fd >= 0)
+	{
+		ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(counter.fd, &value, sizeof(value)) != sizeof(value))
+		{
+			value = 0;
+		}
+	}
+	return value;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [width] [height] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t width = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : sceneFile.filmWidth;
+	const uint32_t height = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : sceneFile.filmHeight;
+	const uint32_t numThreads = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : 0;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	const std::vector<float> blueNoise = LoadBlueNoise("data/textures/LDR64x64.png");
+	if (blueNoise.empty())
+	{
+		printf("Failed to load the blue noise texture data/textures/LDR64x64.png\n");
+		return EXIT_FAILURE;
+	}
+	
+	//The counters have to exist before the threads of the pool to count them
+	Counter counters[] =
+	{
+		{ "cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1 },
+		{ "L1d read misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1 },
+		{ "LLC read misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1 }
+	};
+	const uint32_t numCounters = sizeof(counters) / sizeof(counters[0]);
+	for (Counter& counter : counters)
+	{
+		OpenCounter(&counter);
+	}
+	
+	ThreadPool threadPool(numThreads);
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	CpuScene scene;
+	BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene);
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	CpuImages images;
+	RenderColorPosition(scene, camera, 16, threadPool, &images);
+	for (glm::vec4& position : images.position)
+	{
+		position.w = 0.0f;
+	}
+	printf("Triangles: %zu    %ux%u    threads: %u\n", scene.triangleMeshes.size(), width, height, threadPool.NumThreads());
+	
+	const AOOrder orders[] = { AO_PER_PIXEL, AO_RAY_STREAM };
+	const char* orderNames[] = { "per pixel", "stream" };
+	std::vector<float> aoImages[2];
+	float times[2];
+	for (int o = 0; o < 2; o++)
+	{
+		//Best of three, the counters are from the last run
+		AOStats bestStats;
+		bestStats.renderTime = 1e30f;
+		uint64_t counts[numCounters];
+		for (int run = 0; run < 3; run++)
+		{
+			for (Counter& counter : counters)
+			{
+				StartCounter(counter);
+			}
+			AOSettings settings;
+			settings.order = orders[o];
+			AOStats stats = RenderAO(scene, blueNoise, 0, settings, threadPool, &images);
+			for (uint32_t c = 0; c < numCounters; c++)
+			{
+				counts[c] = StopCounter(counters[c]);
+			}
+			if (stats.renderTime < bestStats.renderTime)
+			{
+				bestStats = stats;
+			}
+		}
+		aoImages[o] = images.ao;
+		times[o] = bestStats.renderTime;
+		printf("%-9s  pixels: %u    rays: %llu    time (ms): %.2f    Mrays/s: %.2f", orderNames[o], bestStats.aoPixels, (unsigned long long)bestStats.rays, bestStats.renderTime, bestStats.rays / (bestStats.renderTime * 1000.0f));
+		if (orders[o] == AO_RAY_STREAM)
+		{
+			printf("    sort time (ms): %.2f    packets: %llu", bestStats.sortTime, (unsigned long long)bestStats.packets);
+		}
+		printf("\n");
+		for (uint32_t c = 0; c < numCounters; c++)
+		{
+			if (counters[c].fd >= 0)
+			{
+				printf("           %s: %llu    per ray: %.2f\n", counters[c].name, (unsigned long long)counts[c], double(counts[c]) / double(std::max(bestStats.rays, uint64_t(1))));
+			}
+			else
+			{
+				printf("           %s: unavailable\n", counters[c].name);
+			}
+		}
+	}
+	
+	float maxDifference = 0.0f;
+	for (size_t i = 0; i < aoImages[0].size(); i++)
+	{
+		maxDifference = std::max(maxDifference, std::fabs(aoImages[0][i] - aoImages[1][i]));
+	}
+	printf("Stream speedup: %.2f    largest AO difference: %g\n", times[0] / times[1], maxDifference);
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Measures the parse throughput of BrhanFile on a synthetic scene file.
+
+Usage: ./parse [number of lines] [scene file to write]
+	Defaults to 1000000 lines written to /tmp/synthetic.brhan. Roughly nine out
+	of ten lines are models and the rest are spherical lights. The file is
+	parsed with 1, 2, 4, ... threads up to the number of cores, and every run is
+	checked against the single-threaded result. Then every number in the file is
+	parsed on its own with ParseFloat, strtof and std::stof, which the parser used
+	before, and ParseFloat is checked to give the same bits as strtof.
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "NumberParser.h"
+#include <random>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+void WriteSyntheticScene(const char* filename, unsigned int numLines)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == NULL)
+	{
+		printf("Failed to open %s for writing\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	fprintf(file, "Camera position[0 5 15] view_direction[0 -0.3 -1.0] vertical_fov[45] width[1920] height[1080]\n\n");
+	for (unsigned int i = 0; i < numLines; i++)
+	{
+		if (i % 10 == 9)
+		{
+			fprintf(file, "SphericalLight center[%f %f %f] radius[%f] emittance[%f %f %f]\n", position(generator), position(generator), position(generator), unit(generator), 10.0f * unit(generator), 10.0f * unit(generator), 10.0f * unit(generator));
+		}
+		else
+		{
+			float scale = 0.01f + unit(generator);
+			fprintf(file, "Model file[data/dragon/dragon.obj] translate[%f %f %f] rotate[%f %f %f] scale[%f %f %f] material[matte] diffuse[%f %f %f]\n", position(generator), position(generator), position(generator), angle(generator), angle(generator), angle(generator), scale, scale, scale, unit(generator), unit(generator), unit(generator));
+		}
+	}
+	fclose(file);
+}
+
+bool SameResult(const BrhanFile& a, const BrhanFile& b)
+{
+	if (a.models.size() != b.models.size() || a.sphericalLights.size() != b.sphericalLights.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a.models.size(); i++)
+	{
+		const ModelFromFile& ma = a.models[i];
+		const ModelFromFile& mb = b.models[i];
+		if (ma.file != mb.file || ma.material != mb.material || ma.translation != mb.translation || ma.rotation != mb.rotation || ma.scaling != mb.scaling || ma.diffuse != mb.diffuse)
+		{
+			return false;
+		}
+	}
+	return memcmp(a.sphericalLights.data(), b.sphericalLights.data(), a.sphericalLights.size() * sizeof(SphericalLightFromFile)) == 0;
+}
+
+struct NumberToken
+{
+	const char* begin;
+	const char* end;
+};
+
+//The values inside [] that start like a number, so file and material names are skipped
+std::vector<NumberToken> FindNumbers(const std::string& contents)
+{
+	std::vector<NumberToken> numbers;
+	const char* p = contents.data();
+	const char* end = contents.data() + contents.size();
+	while ((p = (const char*)(memchr(p, '[', size_t(end - p)))) != NULL)
+	{
+		const char* valueEnd = (const char*)(memchr(p, ']', size_t(end - p)));
+		if (valueEnd == NULL)
+		{
+			break;
+		}
+		for (p++; p < valueEnd; )
+		{
+			while (p < valueEnd && *p == ' ') { p++; }
+			const char* begin = p;
+			while (p < valueEnd && *p != ' ') { p++; }
+			if (begin < p && (*begin == '-' || *begin == '+' || *begin == '.' || (*begin >= '0' && *begin <= '9')))
+			{
+				NumberToken number = { begin, p };
+				numbers.push_back(number);
+			}
+		}
+	}
+	return numbers;
+}
+
+template <typename Parse>
+double BestTime(const std::vector<NumberToken>& numbers, std::vector<float>* values, Parse parse)
+{
+	double bestMs = 1e30;
+	for (int run = 0; run < 3; run++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < numbers.size(); i++)
+		{
+			(*values)[i] = parse(numbers[i]);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return bestMs;
+}
+
+//The float parser of BrhanFile next to the ones it replaced, on the same numbers
+void BenchmarkFloats(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	fseek(file, 0, SEEK_END);
+	std::string contents(size_t(ftell(file)), '\0');
+	fseek(file, 0, SEEK_SET);
+	if (fread(&contents[0], 1, contents.size(), file) != contents.size())
+	{
+		printf("Failed to read %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	fclose(file);
+	const std::vector<NumberToken> numbers = FindNumbers(contents);
+	
+	std::vector<float> parsed(numbers.size());
+	std::vector<float> strtofValues(numbers.size());
+	std::vector<float> stofValues(numbers.size());
+	const double parseMs = BestTime(numbers, &parsed, [](const NumberToken& number)
+	{
+		const char* p = number.begin;
+		float value = 0.0f;
+		ParseFloat(p, number.end, &value);
+		return value;
+	});
+	//Every number is followed by a space or a ']', where strtof stops
+	const double strtofMs = BestTime(numbers, &strtofValues, [](const NumberToken& number)
+	{
+		return strtof(number.begin, NULL);
+	});
+	const double stofMs = BestTime(numbers, &stofValues, [](const NumberToken& number)
+	{
+		return std::stof(std::string(number.begin, number.end));
+	});
+	
+	size_t mismatches = 0;
+	for (size_t i = 0; i < numbers.size(); i++)
+	{
+		mismatches += memcmp(&parsed[i], &strtofValues[i], sizeof(float)) != 0 ? 1 : 0;
+	}
+	printf("Floats: %zu    mismatches against strtof: %zu\n", numbers.size(), mismatches);
+	printf("ParseFloat    time (ms): %8.2f    Mfloats/s: %7.1f\n", parseMs, (numbers.size() / 1e6) / (parseMs / 1000.0));
+	printf("strtof        time (ms): %8.2f    Mfloats/s: %7.1f    ParseFloat speedup: %5.2f\n", strtofMs, (numbers.size() / 1e6) / (strtofMs / 1000.0), strtofMs / parseMs);
+	printf("std::stof     time (ms): %8.2f    Mfloats/s: %7.1f    ParseFloat speedup: %5.2f\n", stofMs, (numbers.size() / 1e6) / (stofMs / 1000.0), stofMs / parseMs);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int numLines = argc > 1 ? (unsigned int)(atoi(argv[1])) : 1000000;
+	const char* filename = argc > 2 ? argv[2] : "/tmp/synthetic.brhan";
+	
+	printf("Writing %u lines to %s\n", numLines, filename);
+	WriteSyntheticScene(filename, numLines);
+	FILE* file = fopen(filename, "rb");
+	fseek(file, 0, SEEK_END);
+	double fileMB = double(ftell(file)) / (1024.0 * 1024.0);
+	fclose(file);
+	
+	//Warm up the page cache so every run reads from memory
+	BrhanFile reference(filename, 1);
+	
+	unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads))
+	{
+		const int numRuns = 3;
+		double bestMs = 1e30;
+		bool identical = true;
+		for (int run = 0; run < numRuns; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			BrhanFile scene(filename, numThreads);
+			auto end = std::chrono::high_resolution_clock::now();
+			bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+			identical = identical && SameResult(reference, scene);
+		}
+		printf("Threads: %2u    time (ms): %8.2f    MB/s: %8.1f    Mlines/s: %6.2f    %s\n", numThreads, bestMs, fileMB / (bestMs / 1000.0), (numLines / 1e6) / (bestMs / 1000.0), identical ? "identical" : "MISMATCH");
+		
+		if (numThreads == maxThreads)
+		{
+			break;
+		}
+	}
+	
+	BenchmarkFloats(filename);
+	
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
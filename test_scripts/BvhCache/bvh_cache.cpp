@@ -0,0 +1,241 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Compares building the BVHs of a flat scene against mapping them from a .brhanbvh cache, see
+BrhanBvhFile.h. Writes the cache next to the scene, then loads it warm and, after evicting it from
+the page cache, cold. Primary rays traced through the mapped BVHs have to find the same hits as
+through the built ones, otherwise the run fails. Then that many processes map the cache at once
+and trace the same rays, and each prints how much of the mapping is resident for it and its
+proportional share, which falls as they share the pages.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/BvhCache/bvh_cache <scene.brhan> [processes]
+*/
+
+#include "BrhanFile.h"
+#include "Camera.h"
+#include "cpu/BrhanBvhFile.h"
+#include "cpu/CpuScene.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include "glm/geometric.hpp"
+#include "MeshLoader.h"
+#include <string>
+#include <string.h>
+#include <sys/wait.h>
+#include "ThreadPool.h"
+#include <unistd.h>
+#include <vector>
+
+//Best effort, the pages of a file that is mapped elsewhere stay resident
+static void EvictFromPageCache(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1)
+	{
+		return;
+	}
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+//kB of the mapping of 'filename' that are resident, and the share of them this process is charged for
+static void MappingMemory(const std::string& filename, unsigned long* rss, unsigned long* pss)
+{
+	*rss = 0;
+	*pss = 0;
+	FILE* smaps = fopen("/proc/self/smaps", "r");
+	if (smaps == NULL)
+	{
+		return;
+	}
+	char line[4096];
+	bool inMapping = false;
+	while (fgets(line, sizeof(line), smaps) != NULL)
+	{
+		unsigned long value;
+		//Mappings start with an address range, their fields with a name and a colon
+		if (strchr(line, '-') != NULL && strchr(line, ':') != NULL && strstr(line, " kB") == NULL)
+		{
+			inMapping = strstr(line, filename.c_str()) != NULL;
+		}
+		else if (inMapping && sscanf(line, "Rss: %lu kB", &value) == 1)
+		{
+			*rss += value;
+		}
+		else if (inMapping && sscanf(line, "Pss: %lu kB", &value) == 1)
+		{
+			*pss += value;
+		}
+	}
+	fclose(smaps);
+}
+
+static std::vector<Hit> TraceAll(const CpuScene& scene, const std::vector<Ray>& rays)
+{
+	std::vector<Hit> hits(rays.size());
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		hits[i] = TraceRay(scene, rays[i], 0.0f, 100.0f);
+	}
+	return hits;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [processes]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	const uint32_t numProcesses = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : 4;
+	BrhanFile sceneFile(argv[1]);
+	Camera camera(sceneFile.filmWidth, sceneFile.filmHeight, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	ThreadPool threadPool;
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	const std::string cacheFile = BrhanBvhFilePath(argv[1]);
+	remove(cacheFile.c_str());
+	
+	//Camera.glsl
+	std::vector<Ray> rays;
+	for (uint32_t y = 0; y < sceneFile.filmHeight; y++)
+	{
+		for (uint32_t x = 0; x < sceneFile.filmWidth; x++)
+		{
+			Ray ray;
+			ray.origin = camera.origin;
+			const float u = float(x) / float(sceneFile.filmWidth - 1);
+			const float v = float(y) / float(sceneFile.filmHeight - 1);
+			ray.dir = glm::normalize(camera.topLeftCorner + (u * camera.horizontalEnd) + (v * camera.verticalEnd) - ray.origin);
+			rays.push_back(ray);
+		}
+	}
+	
+	CpuScene builtScene;
+	CpuSceneStats stats = BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &builtScene, cacheFile.c_str());
+	printf("Triangles: %llu    nodes: %u    SAH cost: %.2f\n", (unsigned long long)stats.numTriangles, stats.bvh.numNodes, stats.bvh.sahCost);
+	printf("build (ms):       %8.2f    BVH8 collapse (ms): %.2f    hash and write (ms): %.2f\n", stats.bvh.buildTime, stats.wideBvh.collapseTime, stats.bvhCacheTime);
+	const std::vector<Hit> builtHits = TraceAll(builtScene, rays);
+	
+	bool allMatch = true;
+	const char* loads[] = { "warm", "cold" };
+	for (int load = 0; load < 2; load++)
+	{
+		if (load == 1)
+		{
+			EvictFromPageCache(cacheFile);
+		}
+		CpuScene scene;
+		stats = BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene, cacheFile.c_str());
+		if (!stats.bvhCached)
+		{
+			printf("The cache was not loaded\n");
+			return EXIT_FAILURE;
+		}
+		const std::vector<Hit> hits = TraceAll(scene, rays);
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < hits.size(); i++)
+		{
+			mismatches += hits[i].t != builtHits[i].t || hits[i].triangle != builtHits[i].triangle ? 1 : 0;
+		}
+		allMatch = allMatch && mismatches == 0;
+		printf("%s load (ms):  %8.2f    mismatches: %u\n", loads[load], stats.bvhCacheTime, mismatches);
+	}
+	
+	//Every process traces, then waits for the others before it measures, and again before it exits
+	int ready[2];
+	int measure[2];
+	int release[2];
+	if (pipe(ready) != 0 || pipe(measure) != 0 || pipe(release) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+	fflush(stdout);
+	for (uint32_t p = 0; p < numProcesses; p++)
+	{
+		if (fork() == 0)
+		{
+			close(measure[1]);
+			close(release[1]);
+			//The workers of the parent's pool are not forked
+			ThreadPool childThreadPool;
+			CpuScene scene;
+			BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, childThreadPool, &scene, cacheFile.c_str());
+			TraceAll(scene, rays);
+			const char done = 1;
+			char unused;
+			if (write(ready[1], &done, 1) != 1 || read(measure[0], &unused, 1) != 0)
+			{
+				_exit(EXIT_FAILURE);
+			}
+			unsigned long rss;
+			unsigned long pss;
+			MappingMemory(cacheFile, &rss, &pss);
+			printf("process %u    mapped and resident (kB): %lu    proportional share (kB): %lu\n", p, rss, pss);
+			fflush(stdout);
+			if (write(ready[1], &done, 1) != 1 || read(release[0], &unused, 1) != 0)
+			{
+				_exit(EXIT_FAILURE);
+			}
+			_exit(EXIT_SUCCESS);
+		}
+	}
+	close(measure[0]);
+	close(release[0]);
+	int* barriers[] = { measure, release };
+	for (int* barrier : barriers)
+	{
+		for (uint32_t p = 0; p < numProcesses; p++)
+		{
+			char done;
+			if (read(ready[0], &done, 1) != 1)
+			{
+				break;
+			}
+		}
+		close(barrier[1]);
+	}
+	for (uint32_t p = 0; p < numProcesses; p++)
+	{
+		wait(NULL);
+	}
+	
+	if (!allMatch)
+	{
+		printf("Some hits differ from the built BVHs\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
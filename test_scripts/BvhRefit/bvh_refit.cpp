@@ -0,0 +1,214 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Animates a scene and keeps its CPU BVHs up to date with UpdateCpuScene, comparing rebuilding every
+frame against refitting with different rebuild thresholds. Three motions are run:
+	translate  every instance moves by 0.01 along x, like Raytrace() in main.cpp. Refits stay as good as builds.
+	scatter    every instance moves its own way, so the boxes of the refit trees grow apart
+	deform     the vertices of every mesh follow a wave, which refits the mesh BVHs of two-level scenes
+After the last frame the scene is rendered once. Its rays/s show what the refits cost the traversal,
+and the pixels are compared with the image of the scene that was built every frame.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/BvhRefit/bvh_refit <scene.brhan> [frames] [width] [height] [threads]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <cmath>
+#include "cpu/CpuRenderer.h"
+#include "cpu/CpuScene.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/gtc/matrix_transform.hpp"
+#include "MeshLoader.h"
+#include <random>
+#include <string.h>
+#include "ThreadPool.h"
+#include <vector>
+
+enum Motion
+{
+	MOTION_TRANSLATE,
+	MOTION_SCATTER,
+	MOTION_DEFORM
+};
+
+static const char* MOTION_NAMES[] = { "translate", "scatter", "deform" };
+
+//Never rebuilds
+static const float REFIT_ONLY = FLT_MAX;
+
+//Sets the meshes and instances of 'frame' from the ones the scene was loaded with
+static void Animate(Motion motion, uint32_t frame, const std::vector<Mesh>& baseMeshes, const std::vector<MeshInstance>& baseInstances, const std::vector<glm::vec3>& scatterSteps, std::vector<Mesh>* meshes, std::vector<MeshInstance>* instances)
+{
+	for (size_t i = 0; i < baseInstances.size(); i++)
+	{
+		glm::vec3 offset(0.0f);
+		if (motion == MOTION_TRANSLATE)
+		{
+			offset = glm::vec3(0.01f * frame, 0.0f, 0.0f);
+		}
+		else if (motion == MOTION_SCATTER)
+		{
+			offset = scatterSteps[i] * float(frame);
+		}
+		(*instances)[i].transform = glm::translate(glm::mat4(1.0f), offset) * baseInstances[i].transform;
+	}
+	if (motion != MOTION_DEFORM)
+	{
+		return;
+	}
+	for (size_t m = 0; m < baseMeshes.size(); m++)
+	{
+		const std::vector<float>& baseVertices = baseMeshes[m].vertices;
+		BoundingBox bounds;
+		for (size_t v = 0; v < baseVertices.size(); v += 3)
+		{
+			bounds.Grow(glm::vec3(baseVertices[v], baseVertices[v + 1], baseVertices[v + 2]));
+		}
+		const glm::vec3 extent = bounds.max - bounds.min;
+		const float size = std::max(std::max(extent.x, extent.y), extent.z);
+		if (!(size > 0.0f))
+		{
+			continue;
+		}
+		//A wave along x that pushes the vertices up and down by 10% of the mesh
+		std::vector<float>& vertices = (*meshes)[m].vertices;
+		for (size_t v = 0; v < baseVertices.size(); v += 3)
+		{
+			const float phase = 6.2831853f * (baseVertices[v] - bounds.min.x) / size + 0.5f * frame;
+			vertices[v + 1] = baseVertices[v + 1] + 0.1f * size * std::sin(phase);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [frames] [width] [height] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t numFrames = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : 10;
+	const uint32_t width = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : 640;
+	const uint32_t height = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : 360;
+	const uint32_t numThreads = argc > 5 ? uint32_t(strtoul(argv[5], NULL, 10)) : 0;
+	if (numFrames < 2 || width < 2 || height < 2)
+	{
+		printf("There have to be at least 2 frames and a film of 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	
+	ThreadPool threadPool(numThreads);
+	std::vector<Mesh> baseMeshes;
+	std::vector<MeshInstance> baseInstances;
+	LoadMeshes(sceneFile.models, &baseMeshes, &baseInstances, threadPool);
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	
+	//Scattered instances move 1% of the scene size per frame
+	CpuScene scene;
+	BuildCpuScene(baseMeshes, baseInstances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene);
+	const BoundingBox sceneBounds = CpuSceneBounds(scene);
+	const float stepLength = 0.01f * glm::length(sceneBounds.max - sceneBounds.min);
+	std::mt19937 generator(1);
+	std::normal_distribution<float> distribution;
+	std::vector<glm::vec3> scatterSteps;
+	for (size_t i = 0; i < baseInstances.size(); i++)
+	{
+		glm::vec3 direction(distribution(generator), distribution(generator), distribution(generator));
+		scatterSteps.push_back(stepLength * glm::normalize(direction));
+	}
+	printf("Instances: %zu    meshes: %zu    frames: %u    %ux%u    threads: %u\n", baseInstances.size(), baseMeshes.size(), numFrames, width, height, threadPool.NumThreads());
+	
+	const CpuSceneLayout layouts[] = { CPU_SCENE_FLAT, CPU_SCENE_TWO_LEVEL };
+	const float thresholds[] = { 0.0f, DEFAULT_BVH_REBUILD_THRESHOLD, 1.5f, REFIT_ONLY };
+	for (int motion = MOTION_TRANSLATE; motion <= MOTION_DEFORM; motion++)
+	{
+		for (CpuSceneLayout layout : layouts)
+		{
+			printf("\n%s, %s\n", MOTION_NAMES[motion], layout == CPU_SCENE_FLAT ? "flat" : "two-level");
+			printf("%-14s %18s %15s %10s %18s %10s %12s\n", "update", "update time (ms)", "BVH time (ms)", "rebuilds", "SAH cost / built", "Mrays/s", "diff pixels");
+			std::vector<glm::vec4> rebuiltPositions;
+			for (float threshold : thresholds)
+			{
+				std::vector<Mesh> meshes = baseMeshes;
+				std::vector<MeshInstance> instances = baseInstances;
+				BuildCpuScene(meshes, instances, sceneFile.sphericalLights, layout, threadPool, &scene);
+				float updateTime = 0.0f;
+				float bvhTime = 0.0f;
+				uint32_t numRebuilds = 0;
+				CpuSceneUpdateStats updateStats;
+				for (uint32_t frame = 1; frame < numFrames; frame++)
+				{
+					Animate(Motion(motion), frame, baseMeshes, baseInstances, scatterSteps, &meshes, &instances);
+					updateStats = UpdateCpuScene(meshes, instances, motion == MOTION_DEFORM, threshold, threadPool, &scene);
+					updateTime += updateStats.updateTime;
+					bvhTime += updateStats.bvh.refitTime + updateStats.bvh.rebuildTime;
+					numRebuilds += (updateStats.bvh.rebuilt ? 1 : 0) + updateStats.rebuiltMeshes;
+				}
+				
+				CpuImages images;
+				const CpuRenderStats renderStats = RenderColorPosition(scene, camera, 0, threadPool, &images);
+				const uint64_t numRays = renderStats.primaryRays + renderStats.shadowRays;
+				//The scene rebuilt every frame comes first, the refit ones should hit the same triangles
+				uint32_t differentPixels = 0;
+				if (rebuiltPositions.empty())
+				{
+					rebuiltPositions = images.position;
+				}
+				for (size_t i = 0; i < images.position.size(); i++)
+				{
+					differentPixels += images.position[i] != rebuiltPositions[i] ? 1 : 0;
+				}
+				
+				char name[32];
+				if (threshold == REFIT_ONLY)
+				{
+					snprintf(name, sizeof(name), "refit only");
+				}
+				else if (threshold > 0.0f)
+				{
+					snprintf(name, sizeof(name), "refit, %.1fx", threshold);
+				}
+				else
+				{
+					snprintf(name, sizeof(name), "rebuild");
+				}
+				const float sahRatio = updateStats.bvh.builtSahCost > 0.0f ? updateStats.bvh.sahCost / updateStats.bvh.builtSahCost : 1.0f;
+				printf("%-14s %18.3f %15.3f %10u %18.2f %10.2f %12u\n", name, updateTime / (numFrames - 1), bvhTime / (numFrames - 1), numRebuilds, sahRatio, numRays / (renderStats.renderTime * 1000.0f), differentPixels);
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,224 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Shows what a pixel of the CPU color/position pass costs as the number of spherical lights grows,
+see LightBvh.h. The lights of the scene file are replaced by 2 to 10000 random ones in a layer above
+the geometry, sharing an emittance of 10 like the lights test_scripts/SceneGenerator writes. For
+every count it prints the time to build the light BVH, then the time a primary ray takes to find
+the light it hits by testing every light like primary.rgen does and through the light BVH, and how
+many of them differ. Then the color/position pass is rendered with light cutoffs of 0, which shades
+every light, and larger, and for each it prints the time per pixel, the shadow rays per pixel and
+how far the color image is from the one with every light shaded, in steps of its 8 bits.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/LightBvh/light_bvh <scene.brhan> [width] [height] [threads]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <chrono>
+#include <cmath>
+#include "cpu/CpuRenderer.h"
+#include "cpu/CpuScene.h"
+#include "cpu/LightBvh.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "MeshLoader.h"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+static uint64_t SplitMix64(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static float RandomFloat(uint64_t* state)
+{
+	return float(SplitMix64(state) >> 40) / float(1 << 24);
+}
+
+//The loop of primary.rgen
+static int TraceLightsLinear(const std::vector<SphericalLightFromFile>& lights, const Ray& ray, float tMin, float tMax, float* lightT)
+{
+	*lightT = tMax;
+	int lightIdx = -1;
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		const glm::vec4& centerAndRadius = lights[i].centerAndRadius;
+		const float t = SphereIntersect(glm::vec3(centerAndRadius), centerAndRadius.w, ray.origin, ray.dir, tMin, tMax);
+		if (t > tMin && t < *lightT)
+		{
+			*lightT = t;
+			lightIdx = int(i);
+		}
+	}
+	return lightIdx;
+}
+
+//The largest and the average difference of the 8-bit colors of two images
+static void ColorError(const CpuImages& a, const CpuImages& b, float* maxError, float* averageError)
+{
+	*maxError = 0.0f;
+	double sum = 0.0;
+	for (size_t i = 0; i < a.color.size(); i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			const float error = std::fabs(std::round(glm::clamp(a.color[i][c], 0.0f, 1.0f) * 255.0f) - std::round(glm::clamp(b.color[i][c], 0.0f, 1.0f) * 255.0f));
+			*maxError = std::max(*maxError, error);
+			sum += error;
+		}
+	}
+	*averageError = float(sum / (a.color.size() * 3));
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [width] [height] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t width = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : 80;
+	const uint32_t height = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : 60;
+	const uint32_t numThreads = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : 0;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	
+	ThreadPool threadPool(numThreads);
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	CpuScene scene;
+	BuildCpuScene(meshes, instances, std::vector<SphericalLightFromFile>(), CPU_SCENE_FLAT, threadPool, &scene);
+	const BoundingBox bounds = CpuSceneBounds(scene);
+	const glm::vec3 extent = bounds.max - bounds.min;
+	printf("Triangles: %zu    %ux%u    threads: %u\n", scene.triangleMeshes.size(), width, height, threadPool.NumThreads());
+	
+	//Camera.glsl
+	std::vector<Ray> rays;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			Ray ray;
+			ray.origin = camera.origin;
+			const float u = float(x) / float(width - 1);
+			const float v = float(y) / float(height - 1);
+			ray.dir = glm::normalize(camera.topLeftCorner + (u * camera.horizontalEnd) + (v * camera.verticalEnd) - ray.origin);
+			rays.push_back(ray);
+		}
+	}
+	
+	const uint32_t lightCounts[] = { 2, 10, 100, 1000, 10000 };
+	const float cutoffs[] = { 0.0f, 1.0f / 16384.0f, 1.0f / 4096.0f, 1.0f / 1024.0f, 1.0f / 256.0f };
+	bool allMatch = true;
+	for (uint32_t numLights : lightCounts)
+	{
+		std::vector<SphericalLightFromFile> lights(numLights);
+		uint64_t rngState = numLights;
+		for (SphericalLightFromFile& light : lights)
+		{
+			const glm::vec3 center(bounds.min.x + RandomFloat(&rngState) * extent.x, bounds.max.y + RandomFloat(&rngState) * extent.y, bounds.min.z + RandomFloat(&rngState) * extent.z);
+			light.centerAndRadius = glm::vec4(center, 0.05f);
+			light.emittance = glm::vec4(glm::vec3(10.0f / float(numLights)), 0.0f);
+		}
+		scene.lights = lights;
+		const BvhBuildStats buildStats = BuildLightBvh(lights, threadPool, &scene.lightBvh);
+		
+		//Best of three
+		float linearTime = 1e30f;
+		float bvhTime = 1e30f;
+		uint32_t mismatches = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			std::vector<int> linearLights(rays.size());
+			std::vector<float> linearTs(rays.size());
+			auto startTime = std::chrono::high_resolution_clock::now();
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				linearLights[i] = TraceLightsLinear(lights, rays[i], 0.0f, 100.0f, &linearTs[i]);
+			}
+			auto midTime = std::chrono::high_resolution_clock::now();
+			std::vector<int> bvhLights(rays.size());
+			std::vector<float> bvhTs(rays.size());
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				bvhLights[i] = TraceLights(scene, rays[i], 0.0f, 100.0f, &bvhTs[i]);
+			}
+			auto endTime = std::chrono::high_resolution_clock::now();
+			linearTime = std::min(linearTime, std::chrono::duration<float, std::nano>(midTime - startTime).count() / rays.size());
+			bvhTime = std::min(bvhTime, std::chrono::duration<float, std::nano>(endTime - midTime).count() / rays.size());
+			mismatches = 0;
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				mismatches += linearLights[i] != bvhLights[i] || (linearLights[i] >= 0 && linearTs[i] != bvhTs[i]) ? 1 : 0;
+			}
+		}
+		allMatch = allMatch && mismatches == 0;
+		printf("Lights: %5u    light BVH build (ms): %.2f    nodes: %u    primary ray against the lights (ns): every light %.1f, light BVH %.1f    mismatches: %u\n", numLights, buildStats.buildTime, buildStats.numNodes, linearTime, bvhTime,
+			mismatches);
+		
+		CpuImages reference;
+		for (float cutoff : cutoffs)
+		{
+			CpuImages images;
+			const CpuRenderStats stats = RenderColorPosition(scene, camera, 16, threadPool, &images, DEFAULT_TILE_SIZE, cutoff);
+			if (cutoff == 0.0f)
+			{
+				reference = images;
+			}
+			float maxError;
+			float averageError;
+			ColorError(images, reference, &maxError, &averageError);
+			printf("    cutoff: %.6f    time per pixel (us): %9.2f    shadow rays per pixel: %8.1f    color error, largest: %3.0f average: %.3f\n", cutoff, stats.renderTime * 1000.0f / stats.primaryRays,
+				double(stats.shadowRays) / stats.primaryRays, maxError, averageError);
+		}
+	}
+	if (!allMatch)
+	{
+		printf("The light BVH found other lights than testing every light\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
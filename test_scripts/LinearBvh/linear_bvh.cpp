@@ -0,0 +1,256 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Compares the builders RefitOrRebuildBvh can rebuild a scene with every frame: the binned SAH build,
+the linear build and the linear build with treelet reordering, see BuildLinearBvh. For each it
+prints the build time, the time to collapse the tree to BVH8 and build the triangle blocks, the
+nodes and the SAH cost, then the rays per second of the default BVH8 kernel. A frame is the rebuild
+followed by tracing every ray once, and the last column is how long that takes.
+Rays are traced like in test_scripts/TraversalBenchmark:
+	primary    one per pixel from the camera
+	ao         cosine distributed over the hemisphere of every primary hit
+Every builder has to find the same closest hits as the SAH build, otherwise the run fails.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/LinearBvh/linear_bvh <scene.brhan> [width] [height] [aoRaysPerPixel] [threads]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <chrono>
+#include <cmath>
+#include "cpu/CpuScene.h"
+#include "cpu/LinearBvh.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/geometric.hpp"
+#include "MeshLoader.h"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+struct RaySet
+{
+	const char* name;
+	std::vector<Ray> rays;
+	float tMax;
+};
+
+static uint64_t SplitMix64(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static float RandomFloat(uint64_t* state)
+{
+	return float(SplitMix64(state) >> 40) / float(1 << 24);
+}
+
+//Cosine distributed around 'normal'
+static glm::vec3 CosineSample(const glm::vec3& normal, float r1, float r2)
+{
+	const glm::vec3 helper = std::fabs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	const glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+	const glm::vec3 bitangent = glm::cross(normal, tangent);
+	const float phi = 2.0f * 3.14159265f * r1;
+	const float radius = std::sqrt(r2);
+	return glm::normalize(tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(1.0f - r2));
+}
+
+static std::vector<Hit> TraceAll(const CpuScene& scene, const RaySet& set, float* time)
+{
+	std::vector<Hit> hits(set.rays.size());
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < set.rays.size(); i++)
+	{
+		hits[i] = TraceRay(scene, set.rays[i], 0.0f, set.tMax);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	*time = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return hits;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [width] [height] [aoRaysPerPixel] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t width = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : sceneFile.filmWidth;
+	const uint32_t height = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : sceneFile.filmHeight;
+	const uint32_t aoRaysPerPixel = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : 4;
+	const uint32_t numThreads = argc > 5 ? uint32_t(strtoul(argv[5], NULL, 10)) : 0;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	
+	ThreadPool threadPool(numThreads);
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	//Spatial splits are not rebuilt every frame
+	for (MeshInstance& instance : instances)
+	{
+		instance.splitBudget = 0.0f;
+	}
+	CpuScene scene;
+	BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene);
+	printf("Triangles: %zu    threads: %u\n", scene.triangleMeshes.size(), threadPool.NumThreads());
+	
+	//Camera.glsl
+	RaySet primary = { "primary", std::vector<Ray>(), 100.0f };
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			Ray ray;
+			ray.origin = camera.origin;
+			const float u = float(x) / float(width - 1);
+			const float v = float(y) / float(height - 1);
+			ray.dir = glm::normalize(camera.topLeftCorner + (u * camera.horizontalEnd) + (v * camera.verticalEnd) - ray.origin);
+			primary.rays.push_back(ray);
+		}
+	}
+	float time;
+	const std::vector<Hit> primaryHits = TraceAll(scene, primary, &time);
+	RaySet ao = { "ao", std::vector<Ray>(), 100.0f };
+	uint64_t rngState = 1;
+	for (size_t i = 0; i < primaryHits.size(); i++)
+	{
+		if (primaryHits[i].t < 0.0f)
+		{
+			continue;
+		}
+		const Ray& ray = primary.rays[i];
+		const glm::vec3 point = ray.origin + ray.dir * primaryHits[i].t;
+		glm::vec3 normal = HitNormal(scene, primaryHits[i]);
+		if (glm::dot(normal, ray.dir) > 0.0f)
+		{
+			normal = -normal;
+		}
+		Ray secondary;
+		secondary.origin = point + normal * 0.001f;
+		for (uint32_t j = 0; j < aoRaysPerPixel; j++)
+		{
+			const float r1 = RandomFloat(&rngState);
+			const float r2 = RandomFloat(&rngState);
+			secondary.dir = CosineSample(normal, r1, r2);
+			ao.rays.push_back(secondary);
+		}
+	}
+	
+	std::vector<BoundingBox> triangleBounds(scene.triangleMeshes.size());
+	for (size_t i = 0; i < triangleBounds.size(); i++)
+	{
+		for (size_t corner = i * 3; corner < i * 3 + 3; corner++)
+		{
+			triangleBounds[i].Grow(scene.vertices[corner]);
+		}
+	}
+	const BvhBuilder builders[] = { BVH_BUILDER_SAH, BVH_BUILDER_LINEAR, BVH_BUILDER_LINEAR_TREELETS };
+	const char* builderNames[] = { "sah", "linear", "treelets" };
+	RaySet* sets[] = { &primary, &ao };
+	std::vector<Hit> references[2];
+	bool allMatch = true;
+	for (int b = 0; b < 3; b++)
+	{
+		//Best of three
+		BvhBuildStats buildStats;
+		float buildTime = 1e30f;
+		float wideTime = 1e30f;
+		for (int run = 0; run < 3; run++)
+		{
+			if (builders[b] == BVH_BUILDER_SAH)
+			{
+				buildStats = BuildBvh(triangleBounds, threadPool, &scene.bvh);
+			}
+			else
+			{
+				buildStats = BuildLinearBvh(triangleBounds, builders[b] == BVH_BUILDER_LINEAR_TREELETS, threadPool, &scene.bvh);
+			}
+			buildTime = std::min(buildTime, buildStats.buildTime);
+			auto startTime = std::chrono::high_resolution_clock::now();
+			CollapseBvh(scene.bvh, &scene.wideBvh);
+			BuildTriangleBlocks(scene.wideBvh, scene.vertices, threadPool, &scene.triangleBlocks);
+			auto endTime = std::chrono::high_resolution_clock::now();
+			wideTime = std::min(wideTime, std::chrono::duration<float, std::milli>(endTime - startTime).count());
+		}
+		printf("%-8s build time (ms): %8.2f    BVH8 and blocks (ms): %8.2f    nodes: %8u    max depth: %2u    SAH cost: %.2f\n", builderNames[b], buildTime, wideTime, buildStats.numNodes,
+			buildStats.maxDepth, buildStats.sahCost);
+		
+		float traceTime = 0.0f;
+		for (int s = 0; s < 2; s++)
+		{
+			const RaySet& set = *sets[s];
+			if (set.rays.empty())
+			{
+				printf("    %-8s no rays\n", set.name);
+				continue;
+			}
+			float bestTime = 1e30f;
+			std::vector<Hit> hits;
+			for (int run = 0; run < 3; run++)
+			{
+				hits = TraceAll(scene, set, &time);
+				bestTime = std::min(bestTime, time);
+			}
+			if (builders[b] == BVH_BUILDER_SAH)
+			{
+				references[s] = hits;
+			}
+			//Several triangles can be hit at the same distance, so only the distances have to agree
+			uint32_t mismatches = 0;
+			for (size_t i = 0; i < hits.size(); i++)
+			{
+				mismatches += hits[i].t != references[s][i].t ? 1 : 0;
+			}
+			allMatch = allMatch && mismatches == 0;
+			traceTime += bestTime;
+			printf("    %-8s Mrays/s: %6.2f    mismatches: %u\n", set.name, set.rays.size() / (bestTime * 1000.0f), mismatches);
+		}
+		printf("    frame (ms): %.2f\n", buildTime + wideTime + traceTime);
+	}
+	if (!allMatch)
+	{
+		printf("Some hits differ from the SAH build\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,195 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Builds .brhanmesh caches and compares loading them against parsing the OBJ.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/MeshCache/mesh_cache build [scenes directory]
+		Writes an up-to-date cache for every OBJ referenced by the .brhan files
+		in the directory (default scenes/).
+	./test_scripts/MeshCache/mesh_cache bench <obj file> [runs]
+		Loads the OBJ through tinyobjloader and through its cache, evicting both
+		files from the page cache before every run so the loads start cold.
+*/
+
+#include "BrhanFile.h"
+#include "BrhanMeshFile.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include "MeshLoader.h"
+#include <set>
+#include <string>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+//Best effort, the pages of a file that is mapped elsewhere stay resident
+void EvictFromPageCache(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1)
+	{
+		return;
+	}
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+size_t CountTriangles(const std::vector<Mesh>& meshes)
+{
+	size_t numTriangles = 0;
+	for (const Mesh& mesh : meshes)
+	{
+		numTriangles += mesh.indices.size() / 3;
+	}
+	return numTriangles;
+}
+
+int Build(const char* scenesDirectory)
+{
+	DIR* directory = opendir(scenesDirectory);
+	if (directory == NULL)
+	{
+		printf("Failed to open directory %s\n", scenesDirectory);
+		return EXIT_FAILURE;
+	}
+	std::set<std::string> objFiles;
+	for (dirent* entry = readdir(directory); entry != NULL; entry = readdir(directory))
+	{
+		size_t length = strlen(entry->d_name);
+		if (length < 6 || strcmp(entry->d_name + length - 6, ".brhan") != 0)
+		{
+			continue;
+		}
+		std::string sceneFile = std::string(scenesDirectory) + "/" + entry->d_name;
+		BrhanFile scene(sceneFile.c_str());
+		for (const ModelFromFile& model : scene.models)
+		{
+			objFiles.insert(model.file);
+		}
+	}
+	closedir(directory);
+	
+	int numFailed = 0;
+	for (const std::string& objFile : objFiles)
+	{
+		std::vector<Mesh> meshes;
+		bool hasMaterials;
+		if (LoadBrhanMeshFile(objFile, &meshes, &hasMaterials))
+		{
+			printf("Up to date: %s\n", BrhanMeshFilePath(objFile).c_str());
+			continue;
+		}
+		auto startTime = std::chrono::high_resolution_clock::now();
+		if (!LoadObjMeshes(objFile, &meshes, &hasMaterials) || !WriteBrhanMeshFile(objFile, meshes, hasMaterials))
+		{
+			printf("Failed: %s\n", objFile.c_str());
+			numFailed++;
+			continue;
+		}
+		auto endTime = std::chrono::high_resolution_clock::now();
+		float ms = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+		printf("Built: %s    triangles: %zu    time (ms): %.2f\n", BrhanMeshFilePath(objFile).c_str(), CountTriangles(meshes), ms);
+	}
+	
+	return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int Bench(const char* objFile, int runs)
+{
+	std::string cacheFile = BrhanMeshFilePath(objFile);
+	{
+		std::vector<Mesh> meshes;
+		bool hasMaterials;
+		if (!LoadBrhanMeshFile(objFile, &meshes, &hasMaterials))
+		{
+			meshes.clear();
+			if (!LoadObjMeshes(objFile, &meshes, &hasMaterials) || !WriteBrhanMeshFile(objFile, meshes, hasMaterials))
+			{
+				printf("Failed to build %s\n", cacheFile.c_str());
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	
+	float objTotal = 0.0f;
+	float cacheTotal = 0.0f;
+	size_t objTriangles = 0;
+	size_t cacheTriangles = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		std::vector<Mesh> meshes;
+		bool hasMaterials;
+		EvictFromPageCache(objFile);
+		auto startTime = std::chrono::high_resolution_clock::now();
+		LoadObjMeshes(objFile, &meshes, &hasMaterials);
+		auto endTime = std::chrono::high_resolution_clock::now();
+		objTotal += std::chrono::duration<float, std::milli>(endTime - startTime).count();
+		objTriangles = CountTriangles(meshes);
+		
+		meshes.clear();
+		EvictFromPageCache(cacheFile);
+		EvictFromPageCache(objFile);
+		startTime = std::chrono::high_resolution_clock::now();
+		LoadBrhanMeshFile(objFile, &meshes, &hasMaterials);
+		endTime = std::chrono::high_resolution_clock::now();
+		cacheTotal += std::chrono::duration<float, std::milli>(endTime - startTime).count();
+		cacheTriangles = CountTriangles(meshes);
+	}
+	
+	printf("%s    triangles: %zu\n", objFile, objTriangles);
+	printf("OBJ load (ms): %.2f\n", objTotal / runs);
+	printf("Cache load (ms): %.2f    speedup: %.1fx\n", cacheTotal / runs, objTotal / cacheTotal);
+	if (objTriangles != cacheTriangles)
+	{
+		printf("Triangle count mismatch: %zu vs %zu\n", objTriangles, cacheTriangles);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "build") == 0)
+	{
+		return Build(argc >= 3 ? argv[2] : "scenes");
+	}
+	if (argc >= 3 && strcmp(argv[1], "bench") == 0)
+	{
+		return Bench(argv[2], argc >= 4 ? atoi(argv[3]) : 5);
+	}
+	printf("Usage: %s build [scenes directory]\n       %s bench <obj file> [runs]\n", argv[0], argv[0]);
+	return EXIT_FAILURE;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
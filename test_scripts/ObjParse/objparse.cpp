@@ -0,0 +1,227 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Compares LoadObjFile against tinyobj::LoadObj, both for speed and for the result.
+
+Usage: ./objparse [obj files ...]
+	Without arguments a synthetic OBJ (a 2000 x 2000 vertex grid of quads with
+	normals, texcoords, several materials and groups and some relative indices)
+	is written to /tmp/synthetic.obj and used instead. Every file is loaded once
+	through tinyobjloader and with 1, 2, 4, ... threads up to the number of
+	cores (at least 4) through LoadObjFile, from the page cache. Indices, materials and
+	shapes must match exactly. Floats may differ in the last bit since
+	tinyobjloader doesn't round correctly, so the largest difference is shown.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "ObjFile.h"
+#include <string>
+#include <string.h>
+#include <thread>
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tinyobjloader/tiny_obj_loader.h"
+
+struct ObjResult
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+};
+
+void WriteSyntheticObj(const char* filename, int gridSize)
+{
+	const char* mtlFilename = "/tmp/synthetic.mtl";
+	FILE* mtl = fopen(mtlFilename, "w");
+	FILE* file = fopen(filename, "w");
+	if (mtl == NULL || file == NULL)
+	{
+		printf("Failed to open %s or %s for writing\n", filename, mtlFilename);
+		exit(EXIT_FAILURE);
+	}
+	const int numMaterials = 4;
+	for (int i = 0; i < numMaterials; i++)
+	{
+		fprintf(mtl, "newmtl material%i\nKd %f %f %f\n", i, 0.2f * i, 0.5f, 1.0f - 0.2f * i);
+	}
+	fclose(mtl);
+	
+	fprintf(file, "# Synthetic grid\nmtllib %s\n", mtlFilename);
+	for (int y = 0; y < gridSize; y++)
+	{
+		for (int x = 0; x < gridSize; x++)
+		{
+			float u = float(x) / (gridSize - 1);
+			float v = float(y) / (gridSize - 1);
+			float height = 0.1f * sinf(20.0f * u) * cosf(20.0f * v);
+			fprintf(file, "v %f %f %f\nvt %f %f\nvn %f %f %f\n", u * 100.0f, height, v * 100.0f, u, v, 0.0f, 1.0f, 0.0f);
+		}
+	}
+	for (int y = 0; y < gridSize - 1; y++)
+	{
+		if (y % 256 == 0)
+		{
+			fprintf(file, "g rows%i\n", y);
+		}
+		if (y % 100 == 0)
+		{
+			fprintf(file, "usemtl material%i\n", (y / 100) % numMaterials);
+		}
+		for (int x = 0; x < gridSize - 1; x++)
+		{
+			int a = y * gridSize + x + 1;
+			int b = a + 1;
+			int c = a + gridSize + 1;
+			int d = a + gridSize;
+			if (x == 0)
+			{
+				//Relative indices, counted back from the last vertex
+				int n = gridSize * gridSize + 1;
+				fprintf(file, "f %i/%i/%i %i/%i/%i %i/%i/%i %i/%i/%i\n", a - n, a - n, a - n, b - n, b - n, b - n, c - n, c - n, c - n, d - n, d - n, d - n);
+			}
+			else
+			{
+				fprintf(file, "f %i/%i/%i %i/%i/%i %i/%i/%i %i/%i/%i\n", a, a, a, b, b, b, c, c, c, d, d, d);
+			}
+		}
+	}
+	fclose(file);
+}
+
+float MaxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+	if (a.size() != b.size())
+	{
+		return INFINITY;
+	}
+	float maxDifference = 0.0f;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		maxDifference = std::max(maxDifference, fabsf(a[i] - b[i]));
+	}
+	return maxDifference;
+}
+
+bool SameTopology(const ObjResult& a, const ObjResult& b)
+{
+	if (a.shapes.size() != b.shapes.size() || a.materials.size() != b.materials.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a.shapes.size(); i++)
+	{
+		const tinyobj::mesh_t& ma = a.shapes[i].mesh;
+		const tinyobj::mesh_t& mb = b.shapes[i].mesh;
+		if (a.shapes[i].name != b.shapes[i].name || ma.indices.size() != mb.indices.size() || ma.material_ids != mb.material_ids || ma.num_face_vertices != mb.num_face_vertices)
+		{
+			return false;
+		}
+		if (memcmp(ma.indices.data(), mb.indices.data(), ma.indices.size() * sizeof(tinyobj::index_t)) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void Compare(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		printf("Failed to open %s\n", filename);
+		return;
+	}
+	fseek(file, 0, SEEK_END);
+	double fileMB = double(ftell(file)) / (1024.0 * 1024.0);
+	fclose(file);
+	printf("%s (%.1f MB)\n", filename, fileMB);
+	
+	ObjResult reference;
+	std::string err;
+	//Warm up the page cache so every run reads from memory
+	tinyobj::LoadObj(&reference.attrib, &reference.shapes, &reference.materials, &err, filename);
+	auto start = std::chrono::high_resolution_clock::now();
+	reference = ObjResult();
+	if (!tinyobj::LoadObj(&reference.attrib, &reference.shapes, &reference.materials, &err, filename))
+	{
+		printf("tinyobjloader failed: %s\n", err.c_str());
+		return;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	double tinyobjMs = std::chrono::duration<double, std::milli>(end - start).count();
+	printf("tinyobjloader       time (ms): %8.2f    MB/s: %8.1f\n", tinyobjMs, fileMB / (tinyobjMs / 1000.0));
+	
+	//At least 4 so that merging several chunks is checked on small machines too
+	unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 4u);
+	for (unsigned int numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads))
+	{
+		const int numRuns = 3;
+		double bestMs = 1e30;
+		ObjResult result;
+		for (int run = 0; run < numRuns; run++)
+		{
+			result = ObjResult();
+			start = std::chrono::high_resolution_clock::now();
+			LoadObjFile(filename, &result.attrib, &result.shapes, &result.materials, &err, numThreads);
+			end = std::chrono::high_resolution_clock::now();
+			bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		float maxDifference = std::max(MaxDifference(reference.attrib.vertices, result.attrib.vertices), std::max(MaxDifference(reference.attrib.normals, result.attrib.normals), MaxDifference(reference.attrib.texcoords, result.attrib.texcoords)));
+		printf("Threads: %2u    time (ms): %8.2f    MB/s: %8.1f    speedup: %5.2fx    topology: %s    max float difference: %g\n", numThreads, bestMs, fileMB / (bestMs / 1000.0), tinyobjMs / bestMs, SameTopology(reference, result) ? "identical" : "MISMATCH", maxDifference);
+		
+		if (numThreads == maxThreads)
+		{
+			break;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			Compare(argv[i]);
+		}
+		return EXIT_SUCCESS;
+	}
+	
+	const char* filename = "/tmp/synthetic.obj";
+	printf("Writing %s\n", filename);
+	WriteSyntheticObj(filename, 2000);
+	Compare(filename);
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
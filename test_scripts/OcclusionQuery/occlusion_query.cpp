@@ -0,0 +1,213 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Compares closest hit traces against bounded occlusion queries, for the shadow rays of the color
+pass and the rays of the AO pass. The shader traces both kinds to tMax 100 and looks at the
+closest hit. Shadow rays only need to know whether something is in front of the light, and AO
+hardly changes from hits further away than a few units, since they are weighted by 8^-t.
+Every pixel that hit geometry gets AO here, not only the ones that see no light.
+
+For the shadow rays the answers have to agree, otherwise the run fails. For AO the images of the
+bounded traces are compared to the one of the shader's trace.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/OcclusionQuery/occlusion_query <scene.brhan> [width] [height] [cutoff] [threads]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <chrono>
+#include <cmath>
+#include "cpu/CpuAO.h"
+#include "cpu/CpuRenderer.h"
+#include "cpu/CpuScene.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/geometric.hpp"
+#include "MeshLoader.h"
+#include "ThreadPool.h"
+#include <vector>
+
+struct AOVariant
+{
+	const char* name;
+	AOOrder order;
+	HitQuery query;
+	bool bounded;
+};
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [width] [height] [cutoff] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t width = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : sceneFile.filmWidth;
+	const uint32_t height = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : sceneFile.filmHeight;
+	const float cutoff = argc > 4 ? strtof(argv[4], NULL) : DEFAULT_AO_VISIBILITY_CUTOFF;
+	const uint32_t numThreads = argc > 5 ? uint32_t(strtoul(argv[5], NULL, 10)) : 0;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	const std::vector<float> blueNoise = LoadBlueNoise("data/textures/LDR64x64.png");
+	if (blueNoise.empty())
+	{
+		printf("Failed to load the blue noise texture data/textures/LDR64x64.png\n");
+		return EXIT_FAILURE;
+	}
+	
+	ThreadPool threadPool(numThreads);
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	CpuScene scene;
+	BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene);
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	CpuImages images;
+	RenderColorPosition(scene, camera, 16, threadPool, &images);
+	for (glm::vec4& position : images.position)
+	{
+		position.w = 0.0f;
+	}
+	printf("Triangles: %zu    lights: %zu    %ux%u    threads: %u\n", scene.triangleMeshes.size(), scene.lights.size(), width, height, threadPool.NumThreads());
+	
+	//The shadow rays of primary.rgen
+	std::vector<Ray> shadowRays;
+	std::vector<float> lightDistances;
+	for (size_t pixel = 0; pixel < images.position.size(); pixel++)
+	{
+		const glm::vec3 isectPoint(images.position[pixel]);
+		const glm::vec3 isectNormal(images.normal[pixel]);
+		if (isectPoint == glm::vec3(0.0f))
+		{
+			continue;
+		}
+		for (const SphericalLightFromFile& light : scene.lights)
+		{
+			const glm::vec3 isectPointToLightCenter = glm::vec3(light.centerAndRadius) - isectPoint;
+			Ray ray;
+			ray.origin = isectPoint + (isectNormal * 0.001f);
+			ray.dir = glm::normalize(isectPointToLightCenter);
+			shadowRays.push_back(ray);
+			lightDistances.push_back(glm::length(isectPointToLightCenter) - light.centerAndRadius.w);
+		}
+	}
+	if (!shadowRays.empty())
+	{
+		std::vector<char> visible[2];
+		float times[2];
+		for (int query = 0; query < 2; query++)
+		{
+			visible[query].resize(shadowRays.size());
+			auto startTime = std::chrono::high_resolution_clock::now();
+			threadPool.ParallelFor(0, uint32_t(shadowRays.size()), 1024, [&](uint32_t i)
+			{
+				if (query == 0)
+				{
+					const Hit hit = TraceRay(scene, shadowRays[i], 0.0f, 100.0f);
+					visible[query][i] = hit.t < 0.0f || hit.t >= lightDistances[i];
+				}
+				else
+				{
+					visible[query][i] = !Occluded(scene, shadowRays[i], 0.0f, std::min(lightDistances[i], 100.0f));
+				}
+			});
+			auto endTime = std::chrono::high_resolution_clock::now();
+			times[query] = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+		}
+		size_t mismatches = 0;
+		size_t numVisible = 0;
+		for (size_t i = 0; i < shadowRays.size(); i++)
+		{
+			mismatches += visible[0][i] != visible[1][i] ? 1 : 0;
+			numVisible += visible[0][i] ? 1 : 0;
+		}
+		printf("Shadow rays: %zu    visible: %zu\n", shadowRays.size(), numVisible);
+		printf("  closest hit to 100    time (ms): %8.2f    Mrays/s: %6.2f\n", times[0], shadowRays.size() / (times[0] * 1000.0f));
+		printf("  occluded to light     time (ms): %8.2f    Mrays/s: %6.2f    speedup: %.2f    mismatches: %zu\n", times[1], shadowRays.size() / (times[1] * 1000.0f), times[0] / times[1], mismatches);
+		if (mismatches > 0)
+		{
+			printf("The occlusion queries disagree with the closest hits\n");
+			return EXIT_FAILURE;
+		}
+	}
+	
+	printf("AO radius: %.2f    visibility cutoff: %g\n", AORadius(cutoff), cutoff);
+	const AOVariant variants[] =
+	{
+		{ "pixel   closest hit to 100", AO_PER_PIXEL, HIT_CLOSEST, false },
+		{ "pixel   closest hit to radius", AO_PER_PIXEL, HIT_CLOSEST, true },
+		{ "pixel   any hit to radius", AO_PER_PIXEL, HIT_ANY, true },
+		{ "stream  closest hit to 100", AO_RAY_STREAM, HIT_CLOSEST, false },
+		{ "stream  closest hit to radius", AO_RAY_STREAM, HIT_CLOSEST, true },
+		{ "stream  any hit to radius", AO_RAY_STREAM, HIT_ANY, true }
+	};
+	std::vector<float> reference;
+	float referenceTime = 0.0f;
+	for (const AOVariant& variant : variants)
+	{
+		AOSettings settings;
+		settings.order = variant.order;
+		settings.query = variant.query;
+		settings.visibilityCutoff = variant.bounded ? cutoff : 0.0f;
+		//Best of three
+		AOStats bestStats;
+		bestStats.renderTime = 1e30f;
+		for (int run = 0; run < 3; run++)
+		{
+			AOStats stats = RenderAO(scene, blueNoise, 0, settings, threadPool, &images);
+			if (stats.renderTime < bestStats.renderTime)
+			{
+				bestStats = stats;
+			}
+		}
+		if (reference.empty())
+		{
+			reference = images.ao;
+			referenceTime = bestStats.renderTime;
+		}
+		double differenceSum = 0.0;
+		float maxDifference = 0.0f;
+		for (size_t i = 0; i < reference.size(); i++)
+		{
+			const float difference = std::fabs(images.ao[i] - reference[i]);
+			differenceSum += difference;
+			maxDifference = std::max(maxDifference, difference);
+		}
+		printf("  %-30s  time (ms): %8.2f    Mrays/s: %6.2f    speedup: %.2f    AO difference mean: %.2e  max: %.2e\n", variant.name, bestStats.renderTime, bestStats.rays / (bestStats.renderTime * 1000.0f), referenceTime / bestStats.renderTime, differenceSum / std::max(bestStats.aoPixels, 1u), maxDifference);
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
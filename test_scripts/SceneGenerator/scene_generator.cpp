@@ -0,0 +1,544 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Writes procedural stress scenes for scaling measurements: a .brhan file plus the OBJ
+meshes it places.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/SceneGenerator/scene_generator [options]
+		--name <name>            scenes/<name>.brhan and data/generated/<name>/ (default stress)
+		--layout <layout>        grid, scatter or clutter (default grid)
+		--instances <count>      model instances (default 1000)
+		--triangles <count>      triangles per mesh, rounded to the nearest tessellation (default 1000)
+		--meshes <count>         unique meshes, the instances cycle through them (default 1)
+		--lights <count>         spherical lights (default 1)
+		--seed <seed>            placement and mesh variation (default 1)
+
+	grid     instances on a square grid on the ground plane
+	scatter  random positions, rotations and scales in a volume that grows with
+	         the number of instances, so the density stays the same
+	clutter  like scatter, but packed so densely that most of the scene is
+	         occluded, which makes for long AO and shadow ray traversals
+
+	The meshes cycle through a sphere, a torus and a box, each subdivided to the
+	requested triangle count and stretched differently so no two are the same.
+	A ground plane is always added. The same options and seed always give the
+	same files. The total triangle count is instances times triangles per mesh,
+	so e.g. --instances 100000 --triangles 1000 gives a scene of 100 million
+	triangles from a few kilobytes of OBJ.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+#include <stdint.h>
+#include <string>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+
+//splitmix64, so the scenes are the same on every platform and standard library
+struct Random
+{
+	uint64_t state;
+
+	Random(uint64_t seed) : state(seed) {}
+
+	uint64_t Next()
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	//[0, 1)
+	float Uniform()
+	{
+		return float(Next() >> 40) / float(1 << 24);
+	}
+
+	float Uniform(float min, float max)
+	{
+		return min + (max - min) * Uniform();
+	}
+};
+
+struct ObjMesh
+{
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<float> uvs;
+	//Triangles, each vertex shares its position, normal and uv index
+	std::vector<uint32_t> indices;
+
+	void AddVertex(float px, float py, float pz, float nx, float ny, float nz, float u, float v)
+	{
+		positions.push_back(px);
+		positions.push_back(py);
+		positions.push_back(pz);
+		normals.push_back(nx);
+		normals.push_back(ny);
+		normals.push_back(nz);
+		uvs.push_back(u);
+		uvs.push_back(v);
+	}
+
+	void AddQuad(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+	{
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+		indices.push_back(a);
+		indices.push_back(c);
+		indices.push_back(d);
+	}
+};
+
+//Unit sphere of 2 * slices * (rings - 1) triangles, with a fan at each pole
+ObjMesh Sphere(uint32_t numTriangles)
+{
+	uint32_t rings = std::max(3u, uint32_t(std::sqrt(numTriangles / 4.0) + 1.5));
+	uint32_t slices = std::max(3u, uint32_t(numTriangles / (2.0 * (rings - 1)) + 0.5));
+	const float pi = 3.14159265358979f;
+	ObjMesh mesh;
+	//Poles
+	mesh.AddVertex(0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.5f, 0.0f);
+	mesh.AddVertex(0.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.5f, 1.0f);
+	//Rings 1 to rings - 1, with the seam vertex duplicated for the uvs
+	for (uint32_t r = 1; r < rings; r++)
+	{
+		float theta = pi * float(r) / float(rings);
+		for (uint32_t s = 0; s <= slices; s++)
+		{
+			float phi = 2.0f * pi * float(s) / float(slices);
+			float x = std::sin(theta) * std::cos(phi);
+			float y = std::cos(theta);
+			float z = std::sin(theta) * std::sin(phi);
+			mesh.AddVertex(x, y, z, x, y, z, float(s) / float(slices), float(r) / float(rings));
+		}
+	}
+	auto ringVertex = [&](uint32_t r, uint32_t s) { return 2 + (r - 1) * (slices + 1) + s; };
+	for (uint32_t s = 0; s < slices; s++)
+	{
+		mesh.indices.push_back(0);
+		mesh.indices.push_back(ringVertex(1, s + 1));
+		mesh.indices.push_back(ringVertex(1, s));
+		mesh.indices.push_back(1);
+		mesh.indices.push_back(ringVertex(rings - 1, s));
+		mesh.indices.push_back(ringVertex(rings - 1, s + 1));
+	}
+	for (uint32_t r = 1; r + 1 < rings; r++)
+	{
+		for (uint32_t s = 0; s < slices; s++)
+		{
+			mesh.AddQuad(ringVertex(r, s), ringVertex(r, s + 1), ringVertex(r + 1, s + 1), ringVertex(r + 1, s));
+		}
+	}
+	return mesh;
+}
+
+//Torus with an outer radius of 1, 2 * major * minor triangles
+ObjMesh Torus(uint32_t numTriangles)
+{
+	uint32_t minor = std::max(3u, uint32_t(std::sqrt(numTriangles / 4.0) + 0.5));
+	uint32_t major = std::max(3u, uint32_t(numTriangles / (2.0 * minor) + 0.5));
+	const float pi = 3.14159265358979f;
+	const float majorRadius = 0.7f;
+	const float minorRadius = 0.3f;
+	ObjMesh mesh;
+	for (uint32_t i = 0; i <= major; i++)
+	{
+		float u = 2.0f * pi * float(i) / float(major);
+		for (uint32_t j = 0; j <= minor; j++)
+		{
+			float v = 2.0f * pi * float(j) / float(minor);
+			float nx = std::cos(v) * std::cos(u);
+			float ny = std::sin(v);
+			float nz = std::cos(v) * std::sin(u);
+			mesh.AddVertex(majorRadius * std::cos(u) + minorRadius * nx, minorRadius * ny, majorRadius * std::sin(u) + minorRadius * nz, nx, ny, nz, float(i) / float(major), float(j) / float(minor));
+		}
+	}
+	for (uint32_t i = 0; i < major; i++)
+	{
+		for (uint32_t j = 0; j < minor; j++)
+		{
+			uint32_t a = i * (minor + 1) + j;
+			uint32_t b = (i + 1) * (minor + 1) + j;
+			mesh.AddQuad(a, a + 1, b + 1, b);
+		}
+	}
+	return mesh;
+}
+
+//Box from -1 to 1 with each face split into n x n quads, 12 * n * n triangles
+ObjMesh Box(uint32_t numTriangles)
+{
+	uint32_t n = std::max(1u, uint32_t(std::sqrt(numTriangles / 12.0) + 0.5));
+	//Normal, then the two axes spanning the face, with normal = cross(u, v)
+	const float faces[6][3][3] = {
+		{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+		{ { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+		{ { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } },
+		{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+		{ { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+		{ { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } }
+	};
+	ObjMesh mesh;
+	for (uint32_t f = 0; f < 6; f++)
+	{
+		const float* normal = faces[f][0];
+		const float* u = faces[f][1];
+		const float* v = faces[f][2];
+		uint32_t first = uint32_t(mesh.positions.size() / 3);
+		for (uint32_t i = 0; i <= n; i++)
+		{
+			float a = -1.0f + 2.0f * float(i) / float(n);
+			for (uint32_t j = 0; j <= n; j++)
+			{
+				float b = -1.0f + 2.0f * float(j) / float(n);
+				mesh.AddVertex(normal[0] + a * u[0] + b * v[0], normal[1] + a * u[1] + b * v[1], normal[2] + a * u[2] + b * v[2], normal[0], normal[1], normal[2], float(i) / float(n), float(j) / float(n));
+			}
+		}
+		for (uint32_t i = 0; i < n; i++)
+		{
+			for (uint32_t j = 0; j < n; j++)
+			{
+				uint32_t a = first + i * (n + 1) + j;
+				uint32_t b = first + (i + 1) * (n + 1) + j;
+				mesh.AddQuad(a, b, b + 1, a + 1);
+			}
+		}
+	}
+	return mesh;
+}
+
+//Plane from -1 to 1 in x and z, facing up
+ObjMesh Plane()
+{
+	ObjMesh mesh;
+	mesh.AddVertex(-1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+	mesh.AddVertex(-1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f);
+	mesh.AddVertex(1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f);
+	mesh.AddVertex(1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f);
+	mesh.AddQuad(0, 1, 2, 3);
+	return mesh;
+}
+
+//Stretches the mesh along its axes, keeping it within [-1, 1]
+void Stretch(ObjMesh* mesh, const float scale[3])
+{
+	for (size_t i = 0; i < mesh->positions.size(); i++)
+	{
+		mesh->positions[i] *= scale[i % 3];
+	}
+	//Normals transform with the inverse scale
+	for (size_t i = 0; i < mesh->normals.size(); i += 3)
+	{
+		float nx = mesh->normals[i] / scale[0];
+		float ny = mesh->normals[i + 1] / scale[1];
+		float nz = mesh->normals[i + 2] / scale[2];
+		float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+		mesh->normals[i] = nx / length;
+		mesh->normals[i + 1] = ny / length;
+		mesh->normals[i + 2] = nz / length;
+	}
+}
+
+//Every OBJ gets its own material file with a single material, since the
+//loader makes one mesh per material of the file. Paths are relative to the repository root.
+bool WriteObj(const std::string& objPath, const ObjMesh& mesh, const float diffuse[3])
+{
+	std::string mtlPath = objPath.substr(0, objPath.size() - 4) + ".mtl";
+	FILE* mtlFile = fopen(mtlPath.c_str(), "w");
+	if (mtlFile == NULL)
+	{
+		printf("Failed to open %s for writing\n", mtlPath.c_str());
+		return false;
+	}
+	fprintf(mtlFile, "newmtl generated\nKd %.3f %.3f %.3f\n", diffuse[0], diffuse[1], diffuse[2]);
+	fclose(mtlFile);
+
+	FILE* file = fopen(objPath.c_str(), "w");
+	if (file == NULL)
+	{
+		printf("Failed to open %s for writing\n", objPath.c_str());
+		return false;
+	}
+	static char buffer[1 << 20];
+	setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+	fprintf(file, "mtllib %s\n", mtlPath.c_str());
+	for (size_t i = 0; i < mesh.positions.size(); i += 3)
+	{
+		fprintf(file, "v %.6g %.6g %.6g\n", mesh.positions[i], mesh.positions[i + 1], mesh.positions[i + 2]);
+	}
+	for (size_t i = 0; i < mesh.normals.size(); i += 3)
+	{
+		fprintf(file, "vn %.5g %.5g %.5g\n", mesh.normals[i], mesh.normals[i + 1], mesh.normals[i + 2]);
+	}
+	for (size_t i = 0; i < mesh.uvs.size(); i += 2)
+	{
+		fprintf(file, "vt %.5g %.5g\n", mesh.uvs[i], mesh.uvs[i + 1]);
+	}
+	fprintf(file, "usemtl generated\n");
+	for (size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		uint32_t a = mesh.indices[i] + 1;
+		uint32_t b = mesh.indices[i + 1] + 1;
+		uint32_t c = mesh.indices[i + 2] + 1;
+		fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+	}
+	bool success = ferror(file) == 0;
+	success = fclose(file) == 0 && success;
+	if (!success)
+	{
+		printf("Failed to write %s\n", objPath.c_str());
+	}
+	return success;
+}
+
+bool MakeDirectories(const std::string& path)
+{
+	for (size_t i = 1; i <= path.size(); i++)
+	{
+		if (i == path.size() || path[i] == '/')
+		{
+			std::string directory = path.substr(0, i);
+			if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+			{
+				printf("Failed to create directory %s\n", directory.c_str());
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+struct Options
+{
+	std::string name = "stress";
+	std::string layout = "grid";
+	uint64_t numInstances = 1000;
+	uint64_t numTriangles = 1000;
+	uint32_t numMeshes = 1;
+	uint32_t numLights = 1;
+	uint64_t seed = 1;
+};
+
+bool ParseOptions(int argc, char** argv, Options* options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		const char* option = argv[i];
+		const char* value = argv[++i];
+		if (strcmp(option, "--name") == 0)
+		{
+			options->name = value;
+		}
+		else if (strcmp(option, "--layout") == 0)
+		{
+			options->layout = value;
+		}
+		else if (strcmp(option, "--instances") == 0)
+		{
+			options->numInstances = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(option, "--triangles") == 0)
+		{
+			options->numTriangles = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(option, "--meshes") == 0)
+		{
+			options->numMeshes = uint32_t(strtoul(value, NULL, 10));
+		}
+		else if (strcmp(option, "--lights") == 0)
+		{
+			options->numLights = uint32_t(strtoul(value, NULL, 10));
+		}
+		else if (strcmp(option, "--seed") == 0)
+		{
+			options->seed = strtoull(value, NULL, 10);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return (options->layout == "grid" || options->layout == "scatter" || options->layout == "clutter") &&
+		options->numInstances > 0 && options->numTriangles > 0 && options->numMeshes > 0 && options->numLights > 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		printf("Usage: %s [--name name] [--layout grid|scatter|clutter] [--instances count] [--triangles count] [--meshes count] [--lights count] [--seed seed]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (options.numTriangles > 0xffffffffull / 3)
+	{
+		printf("At most %llu triangles per mesh, use more instances or meshes instead\n", 0xffffffffull / 3);
+		return EXIT_FAILURE;
+	}
+
+	const std::string dataDirectory = "data/generated/" + options.name;
+	const std::string scenePath = "scenes/" + options.name + ".brhan";
+	if (!MakeDirectories(dataDirectory))
+	{
+		return EXIT_FAILURE;
+	}
+	Random random(options.seed);
+
+	//Meshes
+	const char* shapeNames[] = { "sphere", "torus", "box" };
+	std::vector<std::string> meshPaths;
+	std::vector<uint64_t> meshTriangles;
+	uint64_t uniqueTriangles = 0;
+	for (uint32_t i = 0; i < options.numMeshes; i++)
+	{
+		uint32_t shape = i % 3;
+		ObjMesh mesh = shape == 0 ? Sphere(uint32_t(options.numTriangles)) : shape == 1 ? Torus(uint32_t(options.numTriangles)) : Box(uint32_t(options.numTriangles));
+		float scale[3] = { random.Uniform(0.7f, 1.0f), random.Uniform(0.7f, 1.0f), random.Uniform(0.7f, 1.0f) };
+		Stretch(&mesh, scale);
+		float diffuse[3] = { random.Uniform(0.3f, 0.9f), random.Uniform(0.3f, 0.9f), random.Uniform(0.3f, 0.9f) };
+		char filename[64];
+		snprintf(filename, sizeof(filename), "/%s_%u.obj", shapeNames[shape], i);
+		meshPaths.push_back(dataDirectory + filename);
+		meshTriangles.push_back(mesh.indices.size() / 3);
+		uniqueTriangles += meshTriangles.back();
+		if (!WriteObj(meshPaths.back(), mesh, diffuse))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	const float groundDiffuse[3] = { 0.8f, 0.8f, 0.8f };
+	const std::string planePath = dataDirectory + "/plane.obj";
+	if (!WriteObj(planePath, Plane(), groundDiffuse))
+	{
+		return EXIT_FAILURE;
+	}
+
+	//Instances, every mesh fits in a unit sphere before scaling. The scene covers
+	//[-extent, extent] in x and z and [0, height] in y.
+	FILE* file = fopen(scenePath.c_str(), "w");
+	if (file == NULL)
+	{
+		printf("Failed to open %s for writing\n", scenePath.c_str());
+		return EXIT_FAILURE;
+	}
+	static char buffer[1 << 20];
+	setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+	const double numInstances = double(options.numInstances);
+	float extent;
+	float height;
+	if (options.layout == "grid")
+	{
+		const uint64_t side = uint64_t(std::ceil(std::sqrt(numInstances)));
+		const float spacing = 3.0f;
+		extent = 0.5f * spacing * float(side);
+		height = 2.0f;
+	}
+	else
+	{
+		//Volume per instance, a scattered instance has room around it, a cluttered one overlaps its neighbours
+		const float volumePerInstance = options.layout == "scatter" ? 64.0f : 2.0f;
+		//A slab twice as wide as it is high
+		const float volume = float(numInstances) * volumePerInstance;
+		height = std::cbrt(volume / 16.0f) * 2.0f;
+		extent = height * 2.0f;
+	}
+
+	//Camera above the front edge, looking at the middle of the scene
+	const float cameraX = 0.0f;
+	const float cameraY = height + extent * 0.8f;
+	const float cameraZ = extent * 1.6f;
+	const float toCenter[3] = { -cameraX, 0.5f * height - cameraY, -cameraZ };
+	const float toCenterLength = std::sqrt(toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] + toCenter[2] * toCenter[2]);
+	fprintf(file, "Camera position[%.4g %.4g %.4g] view_direction[%.4g %.4g %.4g] vertical_fov[45] width[1920] height[1080]\n\n", cameraX, cameraY, cameraZ, toCenter[0] / toCenterLength, toCenter[1] / toCenterLength, toCenter[2] / toCenterLength);
+
+	fprintf(file, "Model file[%s] scale[%.6g 1 %.6g]\n", planePath.c_str(), extent + 2.0f, extent + 2.0f);
+	const uint64_t gridSide = uint64_t(std::ceil(std::sqrt(numInstances)));
+	for (uint64_t i = 0; i < options.numInstances; i++)
+	{
+		const uint32_t mesh = uint32_t(i % options.numMeshes);
+		if (options.layout == "grid")
+		{
+			float x = -extent + 3.0f * (float(i % gridSide) + 0.5f);
+			float z = -extent + 3.0f * (float(i / gridSide) + 0.5f);
+			fprintf(file, "Model file[%s] translate[%.6g 1 %.6g]\n", meshPaths[mesh].c_str(), x, z);
+		}
+		else
+		{
+			float scale = options.layout == "scatter" ? random.Uniform(0.5f, 1.5f) : random.Uniform(0.3f, 1.0f);
+			float x = random.Uniform(-extent, extent);
+			float y = random.Uniform(scale, std::max(scale, height - scale));
+			float z = random.Uniform(-extent, extent);
+			fprintf(file, "Model file[%s] translate[%.6g %.6g %.6g] rotate[%.4g %.4g %.4g] scale[%.4g %.4g %.4g]\n", meshPaths[mesh].c_str(), x, y, z,
+				random.Uniform(0.0f, 360.0f), random.Uniform(0.0f, 360.0f), random.Uniform(0.0f, 360.0f), scale, scale, scale);
+		}
+	}
+
+	//Lights above the scene. The emitted power is split between them and grows with
+	//the covered area, so the brightness stays about the same for every light count and size.
+	const float areaScale = std::max(1.0f, (extent * extent) / 100.0f);
+	const float emittance = 10.0f * areaScale / float(options.numLights);
+	fprintf(file, "\n");
+	for (uint32_t i = 0; i < options.numLights; i++)
+	{
+		float x = options.numLights == 1 ? 0.0f : random.Uniform(-extent, extent);
+		float z = options.numLights == 1 ? 0.0f : random.Uniform(-extent, extent);
+		fprintf(file, "SphericalLight center[%.6g %.6g %.6g] radius[0.2] emittance[%.6g %.6g %.6g]\n", x, height + 2.0f, z, emittance, emittance, emittance);
+	}
+	bool success = ferror(file) == 0;
+	success = fclose(file) == 0 && success;
+	if (!success)
+	{
+		printf("Failed to write %s\n", scenePath.c_str());
+		return EXIT_FAILURE;
+	}
+
+	uint64_t instancedTriangles = 0;
+	for (uint64_t i = 0; i < options.numInstances; i++)
+	{
+		instancedTriangles += meshTriangles[i % options.numMeshes];
+	}
+	printf("Wrote %s\n", scenePath.c_str());
+	printf("Layout: %s    extent: %.1f    height: %.1f    seed: %llu\n", options.layout.c_str(), 2.0f * extent, height, (unsigned long long)(options.seed));
+	printf("Unique meshes: %u    unique triangles: %llu    instances: %llu    instanced triangles: %llu    lights: %u\n", options.numMeshes, (unsigned long long)(uniqueTriangles), (unsigned long long)(options.numInstances), (unsigned long long)(instancedTriangles + 2), options.numLights);
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,345 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Compares the object split BVH of a scene with spatial split BVHs of it at several split budgets,
+see BuildSpatialSplitBvh. For each it prints the build time, the nodes, how many references the
+splits added and the SAH cost, then the traversal steps per ray through the binary BVH, nodes
+whose box was tested and triangles tested, and the rays per second of the default BVH8 kernel.
+Rays are traced like in test_scripts/TraversalBenchmark:
+	primary    one per pixel from the camera
+	ao         cosine distributed over the hemisphere of every primary hit
+Every BVH has to find the same closest hits as the object split one, otherwise the run fails.
+All the triangles of the scene may be split, whatever budget its models ask for.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/SpatialSplits/spatial_splits <scene.brhan> [width] [height] [aoRaysPerPixel]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <chrono>
+#include <cmath>
+#include "cpu/CpuScene.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "MeshLoader.h"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+struct RaySet
+{
+	const char* name;
+	std::vector<Ray> rays;
+	float tMax;
+};
+
+struct TraversalSteps
+{
+	uint64_t nodes = 0;
+	uint64_t triangles = 0;
+};
+
+static uint64_t SplitMix64(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static float RandomFloat(uint64_t* state)
+{
+	return float(SplitMix64(state) >> 40) / float(1 << 24);
+}
+
+//Cosine distributed around 'normal'
+static glm::vec3 CosineSample(const glm::vec3& normal, float r1, float r2)
+{
+	const glm::vec3 helper = std::fabs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	const glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+	const glm::vec3 bitangent = glm::cross(normal, tangent);
+	const float phi = 2.0f * 3.14159265f * r1;
+	const float radius = std::sqrt(r2);
+	return glm::normalize(tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(1.0f - r2));
+}
+
+//Slab test, the entry distance or FLT_MAX on a miss
+static float IntersectNode(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDir, float tMax)
+{
+	const glm::vec3 t0 = (node.boundsMin - origin) * inverseDir;
+	const glm::vec3 t1 = (node.boundsMax - origin) * inverseDir;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+	return entry <= exit ? entry : FLT_MAX;
+}
+
+//Closest hit through the binary BVH, nearest child first like TRAVERSAL_BINARY, counting the steps
+static Hit CountingTrace(const CpuScene& scene, const Ray& ray, float tMax, TraversalSteps* steps)
+{
+	const Bvh& bvh = scene.bvh;
+	const TriangleRay triangleRay = PrepareTriangleRay(ray);
+	const glm::vec3 inverseDir = 1.0f / ray.dir;
+	Hit hit;
+	steps->nodes++;
+	if (IntersectNode(bvh.nodes[0], ray.origin, inverseDir, tMax) == FLT_MAX)
+	{
+		return hit;
+	}
+	uint32_t stack[BVH_MAX_DEPTH];
+	float stackEntries[BVH_MAX_DEPTH];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+	while (true)
+	{
+		const BvhNode& node = bvh.nodes[nodeIndex];
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const uint32_t triangle = bvh.primitives[i];
+				const glm::vec3* v = &scene.vertices[triangle * 3];
+				steps->triangles++;
+				if (IntersectTriangle(v[0], v[1], v[2], triangleRay, 0.0f, tMax, &hit))
+				{
+					hit.triangle = triangle;
+					tMax = hit.t;
+				}
+			}
+		}
+		else
+		{
+			const uint32_t left = node.leftOrFirst;
+			float leftEntry = IntersectNode(bvh.nodes[left], ray.origin, inverseDir, tMax);
+			float rightEntry = IntersectNode(bvh.nodes[left + 1], ray.origin, inverseDir, tMax);
+			steps->nodes += 2;
+			uint32_t near = left;
+			uint32_t far = left + 1;
+			if (rightEntry < leftEntry)
+			{
+				std::swap(near, far);
+				std::swap(leftEntry, rightEntry);
+			}
+			if (leftEntry != FLT_MAX)
+			{
+				if (rightEntry != FLT_MAX)
+				{
+					stack[stackSize] = far;
+					stackEntries[stackSize++] = rightEntry;
+				}
+				nodeIndex = near;
+				continue;
+			}
+		}
+		//Skip the nodes that start behind the closest hit
+		while (stackSize > 0 && stackEntries[stackSize - 1] > tMax)
+		{
+			stackSize--;
+		}
+		if (stackSize == 0)
+		{
+			return hit;
+		}
+		nodeIndex = stack[--stackSize];
+	}
+}
+
+static std::vector<Hit> TraceAll(const CpuScene& scene, const RaySet& set, float* time)
+{
+	std::vector<Hit> hits(set.rays.size());
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < set.rays.size(); i++)
+	{
+		hits[i] = TraceRay(scene, set.rays[i], 0.0f, set.tMax);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	*time = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return hits;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [width] [height] [aoRaysPerPixel]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t width = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : sceneFile.filmWidth;
+	const uint32_t height = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : sceneFile.filmHeight;
+	const uint32_t aoRaysPerPixel = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : 4;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	
+	ThreadPool threadPool;
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	//The object split BVH, whatever the scene file asks for
+	for (MeshInstance& instance : instances)
+	{
+		instance.splitBudget = 0.0f;
+	}
+	CpuScene scene;
+	BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene);
+	printf("Triangles: %zu\n", scene.triangleMeshes.size());
+	
+	//Camera.glsl
+	RaySet primary = { "primary", std::vector<Ray>(), 100.0f };
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			Ray ray;
+			ray.origin = camera.origin;
+			const float u = float(x) / float(width - 1);
+			const float v = float(y) / float(height - 1);
+			ray.dir = glm::normalize(camera.topLeftCorner + (u * camera.horizontalEnd) + (v * camera.verticalEnd) - ray.origin);
+			primary.rays.push_back(ray);
+		}
+	}
+	float time;
+	const std::vector<Hit> primaryHits = TraceAll(scene, primary, &time);
+	RaySet ao = { "ao", std::vector<Ray>(), 100.0f };
+	uint64_t rngState = 1;
+	for (size_t i = 0; i < primaryHits.size(); i++)
+	{
+		if (primaryHits[i].t < 0.0f)
+		{
+			continue;
+		}
+		const Ray& ray = primary.rays[i];
+		const glm::vec3 point = ray.origin + ray.dir * primaryHits[i].t;
+		glm::vec3 normal = HitNormal(scene, primaryHits[i]);
+		if (glm::dot(normal, ray.dir) > 0.0f)
+		{
+			normal = -normal;
+		}
+		Ray secondary;
+		secondary.origin = point + normal * 0.001f;
+		for (uint32_t j = 0; j < aoRaysPerPixel; j++)
+		{
+			const float r1 = RandomFloat(&rngState);
+			const float r2 = RandomFloat(&rngState);
+			secondary.dir = CosineSample(normal, r1, r2);
+			ao.rays.push_back(secondary);
+		}
+	}
+	
+	std::vector<BoundingBox> triangleBounds(scene.triangleMeshes.size());
+	for (size_t i = 0; i < triangleBounds.size(); i++)
+	{
+		for (size_t corner = i * 3; corner < i * 3 + 3; corner++)
+		{
+			triangleBounds[i].Grow(scene.vertices[corner]);
+		}
+	}
+	//0 is the object split BVH
+	const float budgets[] = { 0.0f, 0.3f, 1.0f, 3.0f };
+	RaySet* sets[] = { &primary, &ao };
+	std::vector<Hit> references[2];
+	TraversalSteps objectSteps[2];
+	bool allMatch = true;
+	for (float budget : budgets)
+	{
+		//Best of three
+		BvhBuildStats buildStats;
+		float buildTime = 1e30f;
+		for (int run = 0; run < 3; run++)
+		{
+			if (budget > 0.0f)
+			{
+				buildStats = BuildSpatialSplitBvh(scene.vertices, std::vector<uint8_t>(), budget, threadPool, &scene.bvh);
+			}
+			else
+			{
+				buildStats = BuildBvh(triangleBounds, threadPool, &scene.bvh);
+			}
+			buildTime = std::min(buildTime, buildStats.buildTime);
+		}
+		CollapseBvh(scene.bvh, &scene.wideBvh);
+		BuildTriangleBlocks(scene.wideBvh, scene.vertices, threadPool, &scene.triangleBlocks);
+		printf("budget %.2f    build time (ms): %9.2f    nodes: %8u    references: %8u (+%.1f%%)    SAH cost: %.2f\n", budget, buildTime, buildStats.numNodes, buildStats.numReferences,
+			100.0f * (float(buildStats.numReferences) / scene.triangleMeshes.size() - 1.0f), buildStats.sahCost);
+		
+		for (int s = 0; s < 2; s++)
+		{
+			const RaySet& set = *sets[s];
+			if (set.rays.empty())
+			{
+				printf("    %-8s no rays\n", set.name);
+				continue;
+			}
+			TraversalSteps steps;
+			uint32_t mismatches = 0;
+			std::vector<Hit> hits(set.rays.size());
+			for (size_t i = 0; i < set.rays.size(); i++)
+			{
+				hits[i] = CountingTrace(scene, set.rays[i], set.tMax, &steps);
+			}
+			if (budget == 0.0f)
+			{
+				references[s] = hits;
+				objectSteps[s] = steps;
+			}
+			//Several triangles can be hit at the same distance, so only the distances have to agree
+			for (size_t i = 0; i < hits.size(); i++)
+			{
+				mismatches += hits[i].t != references[s][i].t ? 1 : 0;
+			}
+			allMatch = allMatch && mismatches == 0;
+			float bestTime = 1e30f;
+			for (int run = 0; run < 3; run++)
+			{
+				TraceAll(scene, set, &time);
+				bestTime = std::min(bestTime, time);
+			}
+			const double numRays = double(set.rays.size());
+			printf("    %-8s nodes/ray: %7.2f    triangles/ray: %7.2f    steps vs object splits: %.2f    Mrays/s: %6.2f    mismatches: %u\n", set.name, steps.nodes / numRays, steps.triangles / numRays,
+				double(steps.nodes + steps.triangles) / double(objectSteps[s].nodes + objectSteps[s].triangles), set.rays.size() / (bestTime * 1000.0f), mismatches);
+		}
+	}
+	if (!allMatch)
+	{
+		printf("Some hits differ from the object split BVH\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,170 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Shows how evenly the tile scheduler of the CPU renderer spreads the color/position pass and the AO
+pass over the threads, see TileScheduler.h. Every pixel that hit geometry gets AO here, not only the
+ones that see no light, so misses cost next to nothing and hits trace every occlusion ray. For every
+tile size both passes are rendered on one thread, which gives the cost of every tile, and then on
+every thread of the pool. Prints for the second run the time, the tiles stolen and the busy time of
+the slowest thread over the average. From the first run it prints the same ratio for two splits
+without stealing: the image cut into one band of rows per thread, and one task per row of tiles
+handed out in order like ParallelFor does.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/TileScheduler/tile_scheduler <scene.brhan> [width] [height] [threads]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include "cpu/CpuAO.h"
+#include "cpu/CpuRenderer.h"
+#include "cpu/CpuScene.h"
+#include "cpu/TileScheduler.h"
+#include <cstdio>
+#include <cstdlib>
+#include "MeshLoader.h"
+#include "ThreadPool.h"
+#include <vector>
+
+//The cost of every row of tiles
+static std::vector<float> RowTimes(const TileStats& tiles)
+{
+	std::vector<float> rowTimes(tiles.tilesY, 0.0f);
+	for (uint32_t tile = 0; tile < tiles.tileTimes.size(); tile++)
+	{
+		rowTimes[tile / tiles.tilesX] += tiles.tileTimes[tile];
+	}
+	return rowTimes;
+}
+
+//The slowest thread over the average when every thread gets one band of rows
+static float BandImbalance(const std::vector<float>& rowTimes, uint32_t numThreads)
+{
+	std::vector<float> threadTimes(numThreads, 0.0f);
+	for (size_t row = 0; row < rowTimes.size(); row++)
+	{
+		threadTimes[row * numThreads / rowTimes.size()] += rowTimes[row];
+	}
+	float total = 0.0f;
+	for (float time : threadTimes)
+	{
+		total += time;
+	}
+	return total > 0.0f ? *std::max_element(threadTimes.begin(), threadTimes.end()) * float(numThreads) / total : 1.0f;
+}
+
+//The same when every row goes to the thread that is free first
+static float RowTaskImbalance(const std::vector<float>& rowTimes, uint32_t numThreads)
+{
+	std::vector<float> threadTimes(numThreads, 0.0f);
+	float total = 0.0f;
+	for (float rowTime : rowTimes)
+	{
+		*std::min_element(threadTimes.begin(), threadTimes.end()) += rowTime;
+		total += rowTime;
+	}
+	return total > 0.0f ? *std::max_element(threadTimes.begin(), threadTimes.end()) * float(numThreads) / total : 1.0f;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [width] [height] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t width = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : sceneFile.filmWidth;
+	const uint32_t height = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : sceneFile.filmHeight;
+	const uint32_t numThreads = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : 0;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	const std::vector<float> blueNoise = LoadBlueNoise("data/textures/LDR64x64.png");
+	if (blueNoise.empty())
+	{
+		printf("Failed to load the blue noise texture data/textures/LDR64x64.png\n");
+		return EXIT_FAILURE;
+	}
+	
+	ThreadPool threadPool(numThreads);
+	ThreadPool singleThread(1);
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	CpuScene scene;
+	BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene);
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	const uint32_t threads = threadPool.NumThreads();
+	printf("Triangles: %zu    %ux%u    threads: %u\n", scene.triangleMeshes.size(), width, height, threads);
+	printf("%-10s %-6s %10s %8s %10s %10s %10s\n", "tiles", "pass", "time (ms)", "steals", "stealing", "bands", "row tasks");
+	
+	const uint32_t tileSizes[] = { 8, 16, 32, 64 };
+	for (uint32_t tileSize : tileSizes)
+	{
+		CpuImages images;
+		AOSettings settings;
+		settings.tileSize = tileSize;
+		TileStats oneThread[2];
+		TileStats allThreads[2];
+		float times[2];
+		for (int run = 0; run < 2; run++)
+		{
+			ThreadPool& pool = run == 0 ? singleThread : threadPool;
+			TileStats* tiles = run == 0 ? oneThread : allThreads;
+			//Packets of 8 so every tile size is whole packets
+			const CpuRenderStats stats = RenderColorPosition(scene, camera, 8, pool, &images, tileSize);
+			for (glm::vec4& position : images.position)
+			{
+				position.w = 0.0f;
+			}
+			const AOStats aoStats = RenderAO(scene, blueNoise, 0, settings, pool, &images);
+			tiles[0] = stats.tiles;
+			tiles[1] = aoStats.tiles;
+			times[0] = stats.renderTime;
+			times[1] = aoStats.renderTime;
+		}
+		
+		const char* passNames[] = { "color", "ao" };
+		for (int pass = 0; pass < 2; pass++)
+		{
+			const std::vector<float> rowTimes = RowTimes(oneThread[pass]);
+			char tiles[16];
+			snprintf(tiles, sizeof(tiles), "%ux%u", tileSize, tileSize);
+			printf("%-10s %-6s %10.2f %8u %10.2f %10.2f %10.2f\n", tiles, passNames[pass], times[pass], TotalSteals(allThreads[pass]), TileImbalance(allThreads[pass]),
+				BandImbalance(rowTimes, threads), RowTaskImbalance(rowTimes, threads));
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
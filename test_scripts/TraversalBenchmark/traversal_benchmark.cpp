@@ -0,0 +1,298 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Measures how many rays per second each traversal kernel of the CPU tracer handles, on one thread,
+for the three kinds of rays the renderer traces:
+	primary    one per pixel from the camera
+	shadow     from every primary hit towards the center of every light
+	ao         cosine distributed over the hemisphere of every primary hit, like the AO pass
+The camera rays are also traced in 8x8 and 16x16 packets through the binary BVH.
+Every kernel has to find the same closest hits as the binary BVH, otherwise the run fails.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/TraversalBenchmark/traversal_benchmark <scene.brhan> [width] [height] [aoRaysPerPixel]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <chrono>
+#include <cmath>
+#include "cpu/CpuScene.h"
+#include "cpu/RayPacket.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/geometric.hpp"
+#include "MeshLoader.h"
+#include <stdint.h>
+#include "ThreadPool.h"
+#include <vector>
+
+struct RaySet
+{
+	const char* name;
+	std::vector<Ray> rays;
+	float tMax;
+};
+
+struct Kernel
+{
+	const char* name;
+	TraversalKernel kernel;
+};
+
+static uint64_t SplitMix64(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static float RandomFloat(uint64_t* state)
+{
+	return float(SplitMix64(state) >> 40) / float(1 << 24);
+}
+
+//Cosine distributed around 'normal'
+static glm::vec3 CosineSample(const glm::vec3& normal, float r1, float r2)
+{
+	const glm::vec3 helper = std::fabs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	const glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+	const glm::vec3 bitangent = glm::cross(normal, tangent);
+	const float phi = 2.0f * 3.14159265f * r1;
+	const float radius = std::sqrt(r2);
+	return glm::normalize(tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(1.0f - r2));
+}
+
+static std::vector<Hit> TraceAll(const CpuScene& scene, const RaySet& set, TraversalKernel kernel, float* time)
+{
+	std::vector<Hit> hits(set.rays.size());
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < set.rays.size(); i++)
+	{
+		hits[i] = TraceRay(scene, set.rays[i], 0.0f, set.tMax, kernel);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	*time = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+	return hits;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [width] [height] [aoRaysPerPixel]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t width = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : sceneFile.filmWidth;
+	const uint32_t height = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : sceneFile.filmHeight;
+	const uint32_t aoRaysPerPixel = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : 4;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	
+	ThreadPool threadPool;
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	CpuScene scene;
+	CpuSceneStats sceneStats = BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &scene);
+	printf("Triangles: %zu    BVH nodes: %u    BVH8 nodes: %u    children per node: %.2f\n", scene.triangleMeshes.size(), sceneStats.bvh.numNodes, sceneStats.wideBvh.numNodes, sceneStats.wideBvh.averageChildren);
+	const float megaByte = 1024.0f * 1024.0f;
+	printf("BVH memory (MB): %.2f    BVH8 memory (MB): %.2f    quantized BVH8 memory (MB): %.2f\n", scene.bvh.nodes.size() * sizeof(BvhNode) / megaByte, scene.wideBvh.nodes.size() * sizeof(Bvh8Node) / megaByte, scene.wideBvh.quantizedNodes.size() * sizeof(Bvh8QuantizedNode) / megaByte);
+	printf("Vertices memory (MB): %.2f    triangle blocks memory (MB): %.2f\n", scene.vertices.size() * sizeof(glm::vec3) / megaByte, scene.triangleBlocks.blocks.size() * sizeof(TriangleBlock) / megaByte);
+	
+	//Camera.glsl
+	RaySet primary = { "primary", std::vector<Ray>(), 100.0f };
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			Ray ray;
+			ray.origin = camera.origin;
+			const float u = float(x) / float(width - 1);
+			const float v = float(y) / float(height - 1);
+			ray.dir = glm::normalize(camera.topLeftCorner + (u * camera.horizontalEnd) + (v * camera.verticalEnd) - ray.origin);
+			primary.rays.push_back(ray);
+		}
+	}
+	float time;
+	const std::vector<Hit> primaryHits = TraceAll(scene, primary, TRAVERSAL_BINARY, &time);
+	
+	RaySet shadow = { "shadow", std::vector<Ray>(), 100.0f };
+	RaySet ao = { "ao", std::vector<Ray>(), 100.0f };
+	uint64_t rngState = 1;
+	for (size_t i = 0; i < primaryHits.size(); i++)
+	{
+		if (primaryHits[i].t < 0.0f)
+		{
+			continue;
+		}
+		const Ray& ray = primary.rays[i];
+		const glm::vec3 point = ray.origin + ray.dir * primaryHits[i].t;
+		glm::vec3 normal = HitNormal(scene, primaryHits[i]);
+		if (glm::dot(normal, ray.dir) > 0.0f)
+		{
+			normal = -normal;
+		}
+		Ray secondary;
+		secondary.origin = point + normal * 0.001f;
+		for (const SphericalLightFromFile& light : scene.lights)
+		{
+			secondary.dir = glm::normalize(glm::vec3(light.centerAndRadius) - point);
+			shadow.rays.push_back(secondary);
+		}
+		for (uint32_t j = 0; j < aoRaysPerPixel; j++)
+		{
+			const float r1 = RandomFloat(&rngState);
+			const float r2 = RandomFloat(&rngState);
+			secondary.dir = CosineSample(normal, r1, r2);
+			ao.rays.push_back(secondary);
+		}
+	}
+	
+	Kernel kernels[] =
+	{
+		{ "binary", TRAVERSAL_BINARY },
+		{ "bvh8 sse", TRAVERSAL_BVH8_SSE },
+#ifdef __AVX2__
+		{ "bvh8 avx2", TRAVERSAL_BVH8_AVX2 },
+#endif
+#ifdef __AVX512VL__
+		{ "bvh8 avx512", TRAVERSAL_BVH8_AVX512 },
+#endif
+		{ "bvh8 quant", TRAVERSAL_BVH8_QUANTIZED },
+	};
+	const uint32_t numKernels = sizeof(kernels) / sizeof(kernels[0]);
+	RaySet* sets[] = { &primary, &shadow, &ao };
+	bool allMatch = true;
+	for (RaySet* set : sets)
+	{
+		if (set->rays.empty())
+		{
+			printf("%-8s no rays\n", set->name);
+			continue;
+		}
+		std::vector<Hit> reference;
+		float referenceTime = 0.0f;
+		for (uint32_t k = 0; k < numKernels; k++)
+		{
+			//Best of three, the first run also warms the caches
+			float bestTime = 1e30f;
+			std::vector<Hit> hits;
+			for (int run = 0; run < 3; run++)
+			{
+				hits = TraceAll(scene, *set, kernels[k].kernel, &time);
+				bestTime = std::min(bestTime, time);
+			}
+			uint32_t mismatches = 0;
+			if (k == 0)
+			{
+				reference = hits;
+				referenceTime = bestTime;
+			}
+			else
+			{
+				for (size_t i = 0; i < hits.size(); i++)
+				{
+					if (hits[i].t != reference[i].t || (hits[i].t >= 0.0f && hits[i].triangle != reference[i].triangle))
+					{
+						mismatches++;
+					}
+				}
+			}
+			allMatch = allMatch && mismatches == 0;
+			printf("%-8s %-11s rays: %8zu    time (ms): %9.2f    Mrays/s: %7.2f    speedup: %.2f    mismatches: %u\n", set->name, kernels[k].name, set->rays.size(), bestTime, set->rays.size() / (bestTime * 1000.0f), referenceTime / bestTime, mismatches);
+		}
+	}
+	
+	//Camera rays in square tiles, against the binary BVH one ray at a time. The packet triangle test
+	//is not compiled the same way as the scalar one, so it may round differently at triangle edges.
+	float binaryTime = 1e30f;
+	for (int run = 0; run < 3; run++)
+	{
+		TraceAll(scene, primary, TRAVERSAL_BINARY, &time);
+		binaryTime = std::min(binaryTime, time);
+	}
+	const uint32_t packetSizes[] = { 8, 16 };
+	for (uint32_t packetSize : packetSizes)
+	{
+		std::vector<Hit> hits(primary.rays.size());
+		PacketStats packetStats;
+		float bestTime = 1e30f;
+		for (int run = 0; run < 3; run++)
+		{
+			packetStats = PacketStats();
+			auto startTime = std::chrono::high_resolution_clock::now();
+			for (uint32_t tileY = 0; tileY < height; tileY += packetSize)
+			{
+				for (uint32_t tileX = 0; tileX < width; tileX += packetSize)
+				{
+					RayPacket packet;
+					for (uint32_t y = tileY; y < std::min(tileY + packetSize, height); y++)
+					{
+						for (uint32_t x = tileX; x < std::min(tileX + packetSize, width); x++)
+						{
+							AddRay(&packet, primary.rays[y * width + x]);
+						}
+					}
+					Hit packetHits[PACKET_MAX_RAYS];
+					TracePacket(scene, packet, 0.0f, primary.tMax, HIT_CLOSEST, packetHits, &packetStats);
+					uint32_t i = 0;
+					for (uint32_t y = tileY; y < std::min(tileY + packetSize, height); y++)
+					{
+						for (uint32_t x = tileX; x < std::min(tileX + packetSize, width); x++)
+						{
+							hits[y * width + x] = packetHits[i++];
+						}
+					}
+				}
+			}
+			auto endTime = std::chrono::high_resolution_clock::now();
+			bestTime = std::min(bestTime, std::chrono::duration<float, std::milli>(endTime - startTime).count());
+		}
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < hits.size(); i++)
+		{
+			if ((hits[i].t < 0.0f) != (primaryHits[i].t < 0.0f) || (hits[i].t >= 0.0f && hits[i].triangle != primaryHits[i].triangle))
+			{
+				mismatches++;
+			}
+		}
+		printf("primary  packet %2ux%-2u rays: %8zu    time (ms): %9.2f    Mrays/s: %7.2f    speedup: %.2f    different hits: %u    single rays: %llu\n", packetSize, packetSize, primary.rays.size(), bestTime, primary.rays.size() / (bestTime * 1000.0f), binaryTime / bestTime, mismatches, (unsigned long long)packetStats.singleRays);
+	}
+	return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,585 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Checks the watertight ray/triangle tests of the CPU tracer and measures how long each takes.
+
+	shared edges    rays through the edges and vertices inside a tilted grid and a fan have to hit
+	                at least one triangle. The Möller-Trumbore test the tracer used before is
+	                counted too, its misses are only reported.
+	grazing rays    almost parallel to a triangle hit it, rays in its plane or parallel to it don't
+	degenerate      triangles with repeated or equal vertices, or on a line, are never hit
+	bounds          hits exactly at tMin or tMax don't count, both windings are hit the same way
+	random blocks   every block kernel has to find the same hit as IntersectTriangle, bit for bit
+
+Every test goes through IntersectTriangle and all block kernels, which have to agree, and the run
+fails if any check does. The benchmark then traces random rays against random small triangles on
+one thread and prints the time per ray/triangle test of each variant.
+
+Usage:
+	./test_scripts/TriangleKernels/triangle_kernels [random blocks] [benchmark rays]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "cpu/TriangleBlock.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "glm/geometric.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+typedef bool (*IntersectBlockFunction)(const TriangleBlock&, const TriangleRay&, float, float, Hit*);
+
+struct BlockKernel
+{
+	const char* name;
+	IntersectBlockFunction intersect;
+};
+
+const BlockKernel blockKernels[] =
+{
+	{ "sse", IntersectBlockSse },
+#ifdef __AVX2__
+	{ "avx2", IntersectBlockAvx2 },
+#endif
+#ifdef __AVX512VL__
+	{ "avx512", IntersectBlockAvx512 },
+#endif
+};
+const size_t NUM_BLOCK_KERNELS = sizeof(blockKernels) / sizeof(blockKernels[0]);
+
+int numFailed = 0;
+//Hits of a block kernel that differ from IntersectTriangle, over all tests
+uint64_t numKernelMismatches = 0;
+
+uint64_t rngState = 0x853c49e6748fea9bull;
+
+//splitmix64, uniform in [0, 1)
+float Random()
+{
+	uint64_t z = (rngState += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	z = z ^ (z >> 31);
+	return float(double(z >> 11) / double(1ull << 53));
+}
+
+glm::vec3 RandomPoint(float scale)
+{
+	return glm::vec3(Random() * 2.0f - 1.0f, Random() * 2.0f - 1.0f, Random() * 2.0f - 1.0f) * scale;
+}
+
+void Check(bool passed, const char* what)
+{
+	if (!passed)
+	{
+		printf("Failed: %s\n", what);
+		numFailed++;
+	}
+}
+
+//The test CpuScene.cpp used before, kept to count its misses
+bool IntersectTriangleMollerTrumbore(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const Ray& ray, float tMin, float tMax, Hit* hit)
+{
+	const glm::vec3 edge1 = v1 - v0;
+	const glm::vec3 edge2 = v2 - v0;
+	const glm::vec3 p = glm::cross(ray.dir, edge2);
+	const float determinant = glm::dot(edge1, p);
+	if (determinant == 0.0f)
+	{
+		return false;
+	}
+	const float inverseDeterminant = 1.0f / determinant;
+	const glm::vec3 s = ray.origin - v0;
+	const float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f)
+	{
+		return false;
+	}
+	const glm::vec3 q = glm::cross(s, edge1);
+	const float v = glm::dot(ray.dir, q) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f)
+	{
+		return false;
+	}
+	const float t = glm::dot(edge2, q) * inverseDeterminant;
+	if (t <= tMin || t >= tMax)
+	{
+		return false;
+	}
+	hit->t = t;
+	hit->u = u;
+	hit->v = v;
+	return true;
+}
+
+//Packs triangles, three vertices each, into blocks the way BuildTriangleBlocks packs a leaf.
+//The primitive of a slot is the index of its triangle.
+std::vector<TriangleBlock> MakeBlocks(const std::vector<glm::vec3>& vertices)
+{
+	const uint32_t numTriangles = uint32_t(vertices.size() / 3);
+	std::vector<TriangleBlock> blocks((numTriangles + TRIANGLE_BLOCK_SIZE - 1) / TRIANGLE_BLOCK_SIZE);
+	for (uint32_t i = 0; i < blocks.size() * TRIANGLE_BLOCK_SIZE; i++)
+	{
+		TriangleBlock& block = blocks[i / TRIANGLE_BLOCK_SIZE];
+		const uint32_t slot = i % TRIANGLE_BLOCK_SIZE;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			//Unused slots repeat the first vertex
+			const glm::vec3& vertex = i < numTriangles ? vertices[i * 3 + corner] : vertices[0];
+			block.vertices[corner][0][slot] = vertex.x;
+			block.vertices[corner][1][slot] = vertex.y;
+			block.vertices[corner][2][slot] = vertex.z;
+		}
+		block.primitives[slot] = i < numTriangles ? i : 0;
+	}
+	return blocks;
+}
+
+bool SameHit(const Hit& a, const Hit& b)
+{
+	return memcmp(&a.t, &b.t, sizeof(float)) == 0 && memcmp(&a.u, &b.u, sizeof(float)) == 0 && memcmp(&a.v, &b.v, sizeof(float)) == 0 && a.triangle == b.triangle;
+}
+
+//The closest hit of 'ray' in (tMin, tMax) among the triangles, with IntersectTriangle called on them
+//in order. Every block kernel has to find the same one, if not it's counted as a mismatch.
+bool Intersect(const std::vector<glm::vec3>& vertices, const Ray& ray, float tMin, float tMax, Hit* hit)
+{
+	const TriangleRay triangleRay = PrepareTriangleRay(ray);
+	bool found = false;
+	float closestT = tMax;
+	for (uint32_t i = 0; i < vertices.size() / 3; i++)
+	{
+		if (IntersectTriangle(vertices[i * 3 + 0], vertices[i * 3 + 1], vertices[i * 3 + 2], triangleRay, tMin, closestT, hit))
+		{
+			hit->triangle = i;
+			closestT = hit->t;
+			found = true;
+		}
+	}
+	
+	const std::vector<TriangleBlock> blocks = MakeBlocks(vertices);
+	for (size_t k = 0; k < NUM_BLOCK_KERNELS; k++)
+	{
+		Hit blockHit;
+		bool blockFound = false;
+		float blockMax = tMax;
+		for (const TriangleBlock& block : blocks)
+		{
+			if (blockKernels[k].intersect(block, triangleRay, tMin, blockMax, &blockHit))
+			{
+				blockMax = blockHit.t;
+				blockFound = true;
+			}
+		}
+		if (blockFound != found || (found && !SameHit(blockHit, *hit)))
+		{
+			numKernelMismatches++;
+		}
+	}
+	return found;
+}
+
+bool Intersect(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const Ray& ray, float tMin, float tMax, Hit* hit)
+{
+	const std::vector<glm::vec3> vertices = { v0, v1, v2 };
+	return Intersect(vertices, ray, tMin, tMax, hit);
+}
+
+bool IntersectMollerTrumbore(const std::vector<glm::vec3>& vertices, const Ray& ray)
+{
+	Hit hit;
+	for (size_t i = 0; i < vertices.size(); i += 3)
+	{
+		if (IntersectTriangleMollerTrumbore(vertices[i], vertices[i + 1], vertices[i + 2], ray, 0.0f, INFINITY, &hit))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//Casts rays from random points above the triangles through each target, all of which have to be
+//inside the surface the triangles make
+void TestLeaks(const char* name, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& targets, const glm::vec3& normal)
+{
+	uint32_t numLeaks = 0;
+	uint32_t numMollerTrumboreLeaks = 0;
+	for (const glm::vec3& target : targets)
+	{
+		Ray ray;
+		ray.origin = target + normal * (0.5f + Random() * 4.0f) + RandomPoint(2.0f);
+		ray.dir = target - ray.origin;
+		Hit hit;
+		if (!Intersect(vertices, ray, 0.0f, INFINITY, &hit))
+		{
+			numLeaks++;
+		}
+		if (!IntersectMollerTrumbore(vertices, ray))
+		{
+			numMollerTrumboreLeaks++;
+		}
+	}
+	printf("%-28s rays: %7zu    watertight misses: %5u    Moller-Trumbore misses: %5u\n", name, targets.size(), numLeaks, numMollerTrumboreLeaks);
+	Check(numLeaks == 0, name);
+}
+
+void TestSharedEdges(uint32_t numRays)
+{
+	//A grid of quads, two triangles each, turned so no coordinate of it is round
+	const uint32_t GRID_SIZE = 8;
+	const glm::mat4 rotation = glm::rotate(glm::rotate(glm::mat4(1.0f), 0.7f, glm::vec3(1.0f, 0.0f, 0.0f)), 0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
+	std::vector<glm::vec3> gridPoints;
+	for (uint32_t y = 0; y <= GRID_SIZE; y++)
+	{
+		for (uint32_t x = 0; x <= GRID_SIZE; x++)
+		{
+			gridPoints.push_back(glm::vec3(rotation * glm::vec4(x * 0.1f + 0.013f, y * 0.1f - 0.37f, 1.3f, 1.0f)));
+		}
+	}
+	std::vector<glm::vec3> grid;
+	for (uint32_t y = 0; y < GRID_SIZE; y++)
+	{
+		for (uint32_t x = 0; x < GRID_SIZE; x++)
+		{
+			const uint32_t corner = y * (GRID_SIZE + 1) + x;
+			const glm::vec3 quad[4] = { gridPoints[corner], gridPoints[corner + 1], gridPoints[corner + GRID_SIZE + 2], gridPoints[corner + GRID_SIZE + 1] };
+			//The diagonal alternates, so vertices are shared by four or eight triangles
+			const int first = (x + y) % 2;
+			grid.insert(grid.end(), { quad[first], quad[first + 1], quad[first + 2] });
+			grid.insert(grid.end(), { quad[first], quad[first + 2], quad[(first + 3) % 4] });
+		}
+	}
+	const glm::vec3 gridNormal = glm::vec3(rotation * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f));
+	
+	//Through the inner vertices, and through points on the inner edges
+	std::vector<glm::vec3> vertexTargets;
+	std::vector<glm::vec3> edgeTargets;
+	for (uint32_t i = 0; i < numRays; i++)
+	{
+		const uint32_t x = 1 + i % (GRID_SIZE - 1);
+		const uint32_t y = 1 + (i / (GRID_SIZE - 1)) % (GRID_SIZE - 1);
+		const uint32_t corner = y * (GRID_SIZE + 1) + x;
+		vertexTargets.push_back(gridPoints[corner]);
+		const float s = Random();
+		const glm::vec3& other = (i % 2) == 0 ? gridPoints[corner + 1] : gridPoints[corner + GRID_SIZE + 1];
+		edgeTargets.push_back(gridPoints[corner] * (1.0f - s) + other * s);
+	}
+	TestLeaks("grid vertices", grid, vertexTargets, gridNormal);
+	TestLeaks("grid edges", grid, edgeTargets, gridNormal);
+	
+	//Thin triangles around one vertex
+	const uint32_t FAN_SIZE = 64;
+	const glm::vec3 center(0.31f, -0.17f, 2.9f);
+	std::vector<glm::vec3> fan;
+	for (uint32_t i = 0; i < FAN_SIZE; i++)
+	{
+		const float angle0 = i * 6.2831853f / FAN_SIZE;
+		const float angle1 = (i + 1) * 6.2831853f / FAN_SIZE;
+		fan.insert(fan.end(), { center, center + glm::vec3(std::cos(angle0), std::sin(angle0), 0.1f * std::sin(3.0f * angle0)), center + glm::vec3(std::cos(angle1), std::sin(angle1), 0.1f * std::sin(3.0f * angle1)) });
+	}
+	std::vector<glm::vec3> centerTargets(numRays, center);
+	TestLeaks("fan center", fan, centerTargets, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+void TestGrazingRays()
+{
+	const glm::vec3 v0(-1.0f, -1.0f, 0.0f);
+	const glm::vec3 v1(1.0f, -1.0f, 0.0f);
+	const glm::vec3 v2(0.0f, 1.0f, 0.0f);
+	Hit hit;
+	//From 2 to the left of the triangle down to z = 0 at x = 0, at less than a thousandth of a degree
+	Ray ray = { glm::vec3(-2.0f, 0.0f, 2e-5f), glm::vec3(1.0f, 0.0f, -1e-5f) };
+	Check(Intersect(v0, v1, v2, ray, 0.0f, INFINITY, &hit) && std::fabs(hit.t - 2.0f) < 1e-4f, "grazing ray hits");
+	ray.dir = glm::vec3(1.0f, 0.0f, 1e-5f);
+	Check(!Intersect(v0, v1, v2, ray, 0.0f, INFINITY, &hit), "grazing ray away from the triangle misses");
+	//In the plane of the triangle, through it
+	ray = { glm::vec3(-2.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) };
+	hit = Hit();
+	Check(!Intersect(v0, v1, v2, ray, 0.0f, INFINITY, &hit) && hit.t == -1.0f, "ray in the plane misses");
+	ray.origin.z = 1e-3f;
+	Check(!Intersect(v0, v1, v2, ray, 0.0f, INFINITY, &hit), "ray parallel to the plane misses");
+	//Along an edge of the triangle
+	ray = { glm::vec3(-3.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) };
+	Check(!Intersect(v0, v1, v2, ray, 0.0f, INFINITY, &hit), "ray along an edge misses");
+}
+
+void TestDegenerateTriangles()
+{
+	//Rounding in the space of the ray can turn collinear triangles into slivers that are hit. On a
+	//line along x they stay collinear for rays that aren't mostly along x, which are the ones cast here.
+	const glm::vec3 a(0.25f, 0.5f, 1.0f);
+	const glm::vec3 b(0.75f, 0.5f, 1.0f);
+	const glm::vec3 middle(0.5f, 0.5f, 1.0f);
+	const glm::vec3 triangles[][3] =
+	{
+		{ a, b, middle },
+		{ a, b, b },
+		{ a, a, b },
+		{ a, a, a },
+		{ middle, middle, middle },
+	};
+	uint32_t numHit = 0;
+	for (const glm::vec3* triangle : triangles)
+	{
+		//Straight through the points of the triangle, and from random directions
+		const glm::vec3 targets[3] = { triangle[0], triangle[1], (triangle[0] + triangle[1] + triangle[2]) / 3.0f };
+		for (int i = 0; i < 300; i++)
+		{
+			const glm::vec3& target = targets[i % 3];
+			glm::vec3 offset = RandomPoint(1.0f);
+			offset[1 + i % 2] = (i % 4) < 2 ? 1.0f + Random() : -1.0f - Random();
+			const glm::vec3 origin = i < 3 ? target - glm::vec3(0.0f, 0.0f, 1.0f) : target + offset;
+			const Ray ray = { origin, target - origin };
+			Hit hit;
+			if (Intersect(triangle[0], triangle[1], triangle[2], ray, 0.0f, INFINITY, &hit))
+			{
+				numHit++;
+			}
+		}
+	}
+	Check(numHit == 0, "degenerate triangles are never hit");
+}
+
+void TestBounds()
+{
+	//At t = 2 exactly
+	const glm::vec3 v0(-1.0f, -1.0f, 2.0f);
+	const glm::vec3 v1(1.0f, -1.0f, 2.0f);
+	const glm::vec3 v2(0.0f, 1.0f, 2.0f);
+	const Ray ray = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) };
+	Hit hit;
+	Check(Intersect(v0, v1, v2, ray, 0.0f, INFINITY, &hit) && hit.t == 2.0f, "hit at t = 2");
+	Check(!Intersect(v0, v1, v2, ray, 0.0f, 2.0f, &hit), "hit at tMax is excluded");
+	Check(Intersect(v0, v1, v2, ray, 0.0f, std::nextafter(2.0f, INFINITY), &hit), "hit just below tMax");
+	Check(!Intersect(v0, v1, v2, ray, 2.0f, INFINITY, &hit), "hit at tMin is excluded");
+	Check(Intersect(v0, v1, v2, ray, std::nextafter(2.0f, 0.0f), INFINITY, &hit), "hit just above tMin");
+	const Ray away = { ray.origin, -ray.dir };
+	Check(!Intersect(v0, v1, v2, away, 0.0f, INFINITY, &hit), "triangle behind the ray misses");
+	
+	//Both windings, and u and v weight the second and third vertex like primary.rchit expects.
+	//Swapping two vertices sums the products for t in another order, so t can change in its last bit.
+	uint32_t numWrong = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		const glm::vec3 p0 = RandomPoint(1.0f);
+		const glm::vec3 p1 = RandomPoint(1.0f);
+		const glm::vec3 p2 = RandomPoint(1.0f);
+		const float s = Random() * 0.9f + 0.05f;
+		const float r = Random() * 0.9f + 0.05f;
+		const glm::vec3 target = p0 + (p1 - p0) * s * (1.0f - r) + (p2 - p0) * s * r;
+		Ray randomRay;
+		randomRay.origin = target + RandomPoint(3.0f);
+		randomRay.dir = target - randomRay.origin;
+		Hit front;
+		Hit back;
+		if (!Intersect(p0, p1, p2, randomRay, 0.0f, INFINITY, &front) || !Intersect(p0, p2, p1, randomRay, 0.0f, INFINITY, &back))
+		{
+			numWrong++;
+			continue;
+		}
+		const glm::vec3 position = p0 * (1.0f - front.u - front.v) + p1 * front.u + p2 * front.v;
+		const glm::vec3 rayPosition = randomRay.origin + randomRay.dir * front.t;
+		if (glm::length(position - rayPosition) > 1e-4f || std::fabs(front.t - 1.0f) > 1e-4f || std::fabs(front.t - back.t) > 1e-6f || std::fabs(front.u - back.v) > 1e-5f || std::fabs(front.v - back.u) > 1e-5f)
+		{
+			numWrong++;
+		}
+	}
+	Check(numWrong == 0, "both windings give the same hit and the weights of the vertices");
+}
+
+//Triangles from a small set of vertices so blocks share edges and have equally close hits,
+//with some degenerate ones. Compares every block kernel with IntersectTriangle.
+void TestRandomBlocks(uint32_t numBlocks)
+{
+	const uint64_t startMismatches = numKernelMismatches;
+	uint32_t numHits = 0;
+	for (uint32_t b = 0; b < numBlocks; b++)
+	{
+		glm::vec3 pool[6];
+		for (glm::vec3& point : pool)
+		{
+			point = RandomPoint(1.0f);
+		}
+		std::vector<glm::vec3> vertices;
+		const uint32_t numTriangles = 1 + b % TRIANGLE_BLOCK_SIZE;
+		for (uint32_t i = 0; i < numTriangles * 3; i++)
+		{
+			vertices.push_back(pool[uint32_t(Random() * 6.0f) % 6]);
+		}
+		for (int r = 0; r < 8; r++)
+		{
+			Ray ray;
+			ray.origin = RandomPoint(4.0f);
+			//Half of them through a vertex or the middle of an edge
+			const glm::vec3 target = (r % 2) == 0 ? pool[r % 6] : (r % 4) == 1 ? (pool[0] + pool[1]) * 0.5f : RandomPoint(1.0f);
+			ray.dir = target - ray.origin;
+			//Axis aligned, every axis and sign
+			if (r == 7)
+			{
+				ray.dir = glm::vec3(0.0f);
+				ray.dir[b % 3] = (b % 2) == 0 ? 1.0f : -1.0f;
+				ray.origin = target - ray.dir * 3.0f;
+			}
+			Hit hit;
+			if (Intersect(vertices, ray, Random() * 0.5f, Random() < 0.5f ? INFINITY : 1.0f + Random() * 5.0f, &hit))
+			{
+				numHits++;
+			}
+		}
+	}
+	printf("Random blocks: %u    rays: %u    hits: %u    kernel mismatches: %llu\n", numBlocks, numBlocks * 8, numHits, (unsigned long long)(numKernelMismatches - startMismatches));
+}
+
+struct BenchmarkResult
+{
+	float time; //ms
+	uint32_t hits;
+};
+
+template <typename Trace>
+BenchmarkResult Benchmark(const std::vector<Ray>& rays, Trace trace)
+{
+	BenchmarkResult result = { 0.0f, 0 };
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (const Ray& ray : rays)
+	{
+		Hit hit;
+		if (trace(ray, &hit))
+		{
+			result.hits++;
+		}
+	}
+	result.time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return result;
+}
+
+void RunBenchmark(uint32_t numRays)
+{
+	//Small triangles in a unit cube, the closest hit of each ray among all of them
+	const uint32_t NUM_TRIANGLES = 4096;
+	std::vector<glm::vec3> vertices;
+	for (uint32_t i = 0; i < NUM_TRIANGLES; i++)
+	{
+		const glm::vec3 center = RandomPoint(1.0f);
+		vertices.insert(vertices.end(), { center + RandomPoint(0.1f), center + RandomPoint(0.1f), center + RandomPoint(0.1f) });
+	}
+	const std::vector<TriangleBlock> blocks = MakeBlocks(vertices);
+	std::vector<Ray> rays(numRays);
+	for (Ray& ray : rays)
+	{
+		ray.origin = glm::normalize(RandomPoint(1.0f)) * 3.0f;
+		ray.dir = RandomPoint(1.0f) - ray.origin;
+	}
+	const double numTests = double(numRays) * NUM_TRIANGLES;
+	printf("Benchmark: %u rays against %u triangles, one thread\n", numRays, NUM_TRIANGLES);
+	
+	auto print = [&](const char* name, const BenchmarkResult& result)
+	{
+		printf("%-24s time (ms): %8.2f    ns per test: %6.3f    hits: %u\n", name, result.time, result.time * 1e6 / numTests, result.hits);
+	};
+	print("Moller-Trumbore scalar", Benchmark(rays, [&](const Ray& ray, Hit* hit)
+	{
+		bool found = false;
+		float tMax = INFINITY;
+		for (uint32_t i = 0; i < NUM_TRIANGLES; i++)
+		{
+			if (IntersectTriangleMollerTrumbore(vertices[i * 3 + 0], vertices[i * 3 + 1], vertices[i * 3 + 2], ray, 0.0f, tMax, hit))
+			{
+				tMax = hit->t;
+				found = true;
+			}
+		}
+		return found;
+	}));
+	print("watertight scalar", Benchmark(rays, [&](const Ray& ray, Hit* hit)
+	{
+		const TriangleRay triangleRay = PrepareTriangleRay(ray);
+		bool found = false;
+		float tMax = INFINITY;
+		for (uint32_t i = 0; i < NUM_TRIANGLES; i++)
+		{
+			if (IntersectTriangle(vertices[i * 3 + 0], vertices[i * 3 + 1], vertices[i * 3 + 2], triangleRay, 0.0f, tMax, hit))
+			{
+				tMax = hit->t;
+				found = true;
+			}
+		}
+		return found;
+	}));
+	for (const BlockKernel& kernel : blockKernels)
+	{
+		const std::string name = std::string("watertight ") + kernel.name;
+		print(name.c_str(), Benchmark(rays, [&](const Ray& ray, Hit* hit)
+		{
+			const TriangleRay triangleRay = PrepareTriangleRay(ray);
+			bool found = false;
+			float tMax = INFINITY;
+			for (const TriangleBlock& block : blocks)
+			{
+				if (kernel.intersect(block, triangleRay, 0.0f, tMax, hit))
+				{
+					tMax = hit->t;
+					found = true;
+				}
+			}
+			return found;
+		}));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const uint32_t numRandomBlocks = argc > 1 ? uint32_t(strtoul(argv[1], NULL, 10)) : 100000;
+	const uint32_t numBenchmarkRays = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : 2000;
+	
+	printf("Block kernels:");
+	for (const BlockKernel& kernel : blockKernels)
+	{
+		printf(" %s", kernel.name);
+	}
+	printf("\n");
+	TestSharedEdges(20000);
+	TestGrazingRays();
+	TestDegenerateTriangles();
+	TestBounds();
+	TestRandomBlocks(numRandomBlocks);
+	printf("Block kernel mismatches over all tests: %llu\n", (unsigned long long)numKernelMismatches);
+	Check(numKernelMismatches == 0, "block kernels find the same hits as IntersectTriangle");
+	printf(numFailed == 0 ? "Passed\n" : "Failed\n");
+	
+	RunBenchmark(numBenchmarkRays);
+	return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Compares the flat and the two-level layout of the CPU scene. Both are built from the same meshes
+and instances, then every frame moves all instances the way Raytrace() in main.cpp does, by 0.01
+along x. The flat scene has to be built again for that, the two-level one only rebuilds its top
+level. After the last frame both render the color/position pass one ray at a time, which shows
+what tracing through two levels costs, and the images are compared.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/TwoLevelBvh/two_level <scene.brhan> [frames] [width] [height] [threads]
+*/
+
+#include <algorithm>
+#include "BrhanFile.h"
+#include "Camera.h"
+#include <chrono>
+#include <cmath>
+#include "cpu/CpuRenderer.h"
+#include "cpu/CpuScene.h"
+#include <cstdio>
+#include <cstdlib>
+#include "glm/gtc/matrix_transform.hpp"
+#include "MeshLoader.h"
+#include "ThreadPool.h"
+#include <vector>
+
+static float Milliseconds(std::chrono::high_resolution_clock::time_point startTime)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+static float MegaBytes(size_t bytes)
+{
+	return bytes / (1024.0f * 1024.0f);
+}
+
+static size_t BvhBytes(const Bvh& bvh)
+{
+	return bvh.nodes.size() * sizeof(BvhNode) + bvh.primitives.size() * sizeof(uint32_t);
+}
+
+static size_t Bvh8Bytes(const Bvh8& bvh)
+{
+	return bvh.nodes.size() * sizeof(Bvh8Node) + bvh.quantizedNodes.size() * sizeof(Bvh8QuantizedNode) + bvh.primitives.size() * sizeof(uint32_t);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <scene.brhan> [frames] [width] [height] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	BrhanFile sceneFile(argv[1]);
+	const uint32_t numFrames = argc > 2 ? uint32_t(strtoul(argv[2], NULL, 10)) : 10;
+	const uint32_t width = argc > 3 ? uint32_t(strtoul(argv[3], NULL, 10)) : sceneFile.filmWidth;
+	const uint32_t height = argc > 4 ? uint32_t(strtoul(argv[4], NULL, 10)) : sceneFile.filmHeight;
+	const uint32_t numThreads = argc > 5 ? uint32_t(strtoul(argv[5], NULL, 10)) : 0;
+	if (width < 2 || height < 2)
+	{
+		printf("The film has to be at least 2x2 pixels\n");
+		return EXIT_FAILURE;
+	}
+	
+	ThreadPool threadPool(numThreads);
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	LoadMeshes(sceneFile.models, &meshes, &instances, threadPool);
+	
+	auto startTime = std::chrono::high_resolution_clock::now();
+	CpuScene flatScene;
+	const CpuSceneStats flatStats = BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &flatScene);
+	const float flatBuildTime = Milliseconds(startTime);
+	startTime = std::chrono::high_resolution_clock::now();
+	CpuScene twoLevelScene;
+	const CpuSceneStats twoLevelStats = BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_TWO_LEVEL, threadPool, &twoLevelScene);
+	const float twoLevelBuildTime = Milliseconds(startTime);
+	
+	size_t flatBytes = (flatScene.vertices.size() + flatScene.normals.size()) * sizeof(glm::vec3) + flatScene.triangleMeshes.size() * sizeof(uint32_t);
+	flatBytes += BvhBytes(flatScene.bvh) + Bvh8Bytes(flatScene.wideBvh);
+	size_t twoLevelBytes = twoLevelScene.twoLevel.instances.size() * sizeof(BvhInstance) + BvhBytes(twoLevelScene.twoLevel.topLevel);
+	for (const MeshBvh& mesh : twoLevelScene.twoLevel.meshes)
+	{
+		twoLevelBytes += (mesh.vertices.size() + mesh.normals.size()) * sizeof(glm::vec3) + BvhBytes(mesh.bvh) + Bvh8Bytes(mesh.wideBvh);
+	}
+	printf("Triangles: %llu    meshes: %zu    instances: %zu    threads: %u\n", (unsigned long long)flatStats.numTriangles, meshes.size(), instances.size(), threadPool.NumThreads());
+	printf("Flat        build time (ms): %8.2f    memory (MB): %7.2f\n", flatBuildTime, MegaBytes(flatBytes));
+	printf("Two-level   build time (ms): %8.2f    memory (MB): %7.2f    bottom level (ms): %.2f    top level (ms): %.2f\n", twoLevelBuildTime, MegaBytes(twoLevelBytes), twoLevelStats.twoLevel.bottomLevelTime, twoLevelStats.twoLevel.topLevelTime);
+	
+	//Raytrace() translates in world space, after the model transformation
+	const glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(0.01f, 0.0f, 0.0f));
+	std::vector<glm::mat4> transforms;
+	for (const MeshInstance& instance : instances)
+	{
+		transforms.push_back(instance.transform);
+	}
+	float flatUpdateTime = 0.0f;
+	float twoLevelUpdateTime = 0.0f;
+	for (uint32_t frame = 0; frame < numFrames; frame++)
+	{
+		for (size_t i = 0; i < instances.size(); i++)
+		{
+			transforms[i] = translation * transforms[i];
+			instances[i].transform = transforms[i];
+		}
+		startTime = std::chrono::high_resolution_clock::now();
+		BuildCpuScene(meshes, instances, sceneFile.sphericalLights, CPU_SCENE_FLAT, threadPool, &flatScene);
+		flatUpdateTime += Milliseconds(startTime);
+		//A threshold of 0 rebuilds the top level every frame, like the GPU does
+		startTime = std::chrono::high_resolution_clock::now();
+		UpdateInstanceTransforms(transforms, 0.0f, threadPool, &twoLevelScene.twoLevel);
+		twoLevelUpdateTime += Milliseconds(startTime);
+	}
+	if (numFrames > 0)
+	{
+		printf("Per frame update time (ms), %u frames    flat rebuild: %.3f    top level rebuild: %.3f    speedup: %.1f\n", numFrames, flatUpdateTime / numFrames, twoLevelUpdateTime / numFrames, flatUpdateTime / std::max(twoLevelUpdateTime, 1e-6f));
+	}
+	
+	Camera camera(width, height, sceneFile.cameraVerticalFOV, sceneFile.cameraOrigin, sceneFile.cameraViewDir);
+	CpuImages flatImages;
+	CpuImages twoLevelImages;
+	const CpuRenderStats flatRender = RenderColorPosition(flatScene, camera, 0, threadPool, &flatImages);
+	const CpuRenderStats twoLevelRender = RenderColorPosition(twoLevelScene, camera, 0, threadPool, &twoLevelImages);
+	const uint64_t numRays = flatRender.primaryRays + flatRender.shadowRays;
+	printf("Flat        render time (ms): %8.2f    Mrays/s: %6.2f\n", flatRender.renderTime, numRays / (flatRender.renderTime * 1000.0f));
+	printf("Two-level   render time (ms): %8.2f    Mrays/s: %6.2f\n", twoLevelRender.renderTime, numRays / (twoLevelRender.renderTime * 1000.0f));
+	
+	//The triangles are tested in different spaces, which rounds differently
+	uint32_t differentPixels = 0;
+	for (size_t i = 0; i < flatImages.position.size(); i++)
+	{
+		const glm::vec4 difference = glm::abs(flatImages.position[i] - twoLevelImages.position[i]);
+		if (std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)) > 1e-3f)
+		{
+			differentPixels++;
+		}
+	}
+	printf("Pixels with a different position or light visibility: %u of %zu\n", differentPixels, flatImages.position.size());
+	return EXIT_SUCCESS;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
@@ -0,0 +1,281 @@
+/*
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+LICENSE: See end of file for license information.
+*/
+
+/*
+Checks the compact per-vertex attribute encoding (COMPACT_VERTEX_ATTRIBUTES) and
+reports what it saves.
+
+Usage: run from the repository root, since scene files use paths relative to it.
+	./test_scripts/VertexEncoding/vertex_encoding test [samples]
+		Round-trips random and edge case normals and uvs and fails if the error
+		is larger than the encoding allows.
+	./test_scripts/VertexEncoding/vertex_encoding report [scenes directory]
+		Loads every .brhan scene in the directory (default scenes/) and prints the
+		per-vertex attribute buffer size of both layouts, and the error on its data.
+*/
+
+#include "BrhanFile.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include "MeshLoader.h"
+#include <string>
+#include <string.h>
+#include "ThreadPool.h"
+#include <thread>
+#include <vector>
+#include "VertexEncoding.h"
+
+//Bytes per vertex in the two layouts, see DataLayouts.glsl
+const size_t STANDARD_VERTEX_SIZE = 32;
+const size_t COMPACT_VERTEX_SIZE = 8;
+//16 bit octahedral coordinates with the best of the neighbouring quantizations
+const double MAX_NORMAL_ERROR_DEGREES = 0.003;
+
+uint64_t rngState = 0x853c49e6748fea9bull;
+
+//splitmix64, uniform in [0, 1)
+double Random()
+{
+	uint64_t z = (rngState += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	z = z ^ (z >> 31);
+	return double(z >> 11) / double(1ull << 53);
+}
+
+//Angle between 'normal' and its round trip
+double NormalErrorDegrees(const float normal[3])
+{
+	float decoded[3];
+	DecodeOctahedralNormal(EncodeOctahedralNormal(normal), decoded);
+	double length = std::sqrt(double(normal[0]) * normal[0] + double(normal[1]) * normal[1] + double(normal[2]) * normal[2]);
+	double dot = (double(normal[0]) * decoded[0] + double(normal[1]) * decoded[1] + double(normal[2]) * decoded[2]) / length;
+	//acos loses precision near 1, the length of the difference does not
+	double dx = decoded[0] - normal[0] / length;
+	double dy = decoded[1] - normal[1] / length;
+	double dz = decoded[2] - normal[2] / length;
+	double chord = std::sqrt(dx * dx + dy * dy + dz * dz);
+	double angle = dot < 0.0 ? M_PI - 2.0 * std::asin(std::fmin(std::sqrt(std::fmax(4.0 - chord * chord, 0.0)) / 2.0, 1.0)) : 2.0 * std::asin(std::fmin(chord / 2.0, 1.0));
+	return angle * 180.0 / M_PI;
+}
+
+//How far a uv component may move: half of a half ulp
+double MaxUVError(float value)
+{
+	double magnitude = std::fabs(value);
+	if (magnitude < std::ldexp(1.0, -14))
+	{
+		return std::ldexp(1.0, -25);
+	}
+	int exponent;
+	std::frexp(magnitude, &exponent);
+	return std::ldexp(1.0, exponent - 12);
+}
+
+int Test(int samples)
+{
+	int numFailed = 0;
+	
+	//Every half survives a trip through float
+	for (uint32_t h = 0; h < 0x10000; h++)
+	{
+		bool isNaN = (h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0;
+		uint16_t roundTrip = FloatToHalf(HalfToFloat(uint16_t(h)));
+		if (!isNaN && roundTrip != h)
+		{
+			printf("Half 0x%04x round trips to 0x%04x\n", h, roundTrip);
+			numFailed++;
+		}
+	}
+	if (FloatToHalf(65519.0f) != 0x7bff || FloatToHalf(65520.0f) != 0x7c00 || FloatToHalf(1.0f + 1.0f / 2048.0f) != 0x3c00 || FloatToHalf(1.0f + 3.0f / 2048.0f) != 0x3c02)
+	{
+		printf("Half rounding is not round to nearest even\n");
+		numFailed++;
+	}
+	
+	//Normals: the axes, the octahedron edges and a uniform sampling of the sphere
+	std::vector<float> normals;
+	for (int i = 0; i < 3; i++)
+	{
+		for (float sign = -1.0f; sign <= 1.0f; sign += 2.0f)
+		{
+			float axis[3] = {0.0f, 0.0f, 0.0f};
+			axis[i] = sign;
+			normals.insert(normals.end(), axis, axis + 3);
+		}
+	}
+	for (int i = 0; i < samples; i++)
+	{
+		//z = 0 is where the lower hemisphere folds over
+		double angle = Random() * 2.0 * M_PI;
+		normals.push_back(float(std::cos(angle)));
+		normals.push_back(float(std::sin(angle)));
+		normals.push_back(i % 2 == 0 ? 0.0f : -0.0f);
+		
+		double z = Random() * 2.0 - 1.0;
+		double r = std::sqrt(std::fmax(1.0 - z * z, 0.0));
+		angle = Random() * 2.0 * M_PI;
+		normals.push_back(float(r * std::cos(angle)));
+		normals.push_back(float(r * std::sin(angle)));
+		normals.push_back(float(z));
+	}
+	double maxNormalError = 0.0;
+	double totalNormalError = 0.0;
+	for (size_t i = 0; i < normals.size(); i += 3)
+	{
+		double error = NormalErrorDegrees(&normals[i]);
+		maxNormalError = std::fmax(maxNormalError, error);
+		totalNormalError += error;
+	}
+	printf("Normals: %zu    max error (degrees): %.5f    mean error (degrees): %.5f\n", normals.size() / 3, maxNormalError, totalNormalError / (normals.size() / 3));
+	if (!(maxNormalError <= MAX_NORMAL_ERROR_DEGREES))
+	{
+		printf("Normal error is above %.5f degrees\n", MAX_NORMAL_ERROR_DEGREES);
+		numFailed++;
+	}
+	
+	//Uvs: [0, 1], tiling ones up to 64 and tiny ones down in the subnormals
+	double maxUVError = 0.0;
+	int numUVsFailed = 0;
+	for (int i = 0; i < samples; i++)
+	{
+		float uv[2];
+		uv[0] = float(Random());
+		switch (i % 3)
+		{
+			case 0: uv[1] = float(Random()); break;
+			case 1: uv[1] = float((Random() * 2.0 - 1.0) * 64.0); break;
+			default: uv[1] = float(std::ldexp(Random(), -int(Random() * 24.0))); break;
+		}
+		float decoded[2];
+		UnpackHalf2(PackHalf2(uv[0], uv[1]), &decoded[0], &decoded[1]);
+		for (int c = 0; c < 2; c++)
+		{
+			double error = std::fabs(double(decoded[c]) - uv[c]);
+			maxUVError = std::fmax(maxUVError, error);
+			if (!(error <= MaxUVError(uv[c])))
+			{
+				numUVsFailed++;
+			}
+		}
+	}
+	printf("Uvs: %d    max error: %.7f\n", samples, maxUVError);
+	if (numUVsFailed > 0)
+	{
+		printf("%d uv components are off by more than half a half ulp\n", numUVsFailed);
+		numFailed++;
+	}
+	
+	printf(numFailed == 0 ? "Passed\n" : "Failed\n");
+	return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int Report(const char* scenesDirectory)
+{
+	DIR* directory = opendir(scenesDirectory);
+	if (directory == NULL)
+	{
+		printf("Failed to open directory %s\n", scenesDirectory);
+		return EXIT_FAILURE;
+	}
+	std::vector<std::string> sceneFiles;
+	for (dirent* entry = readdir(directory); entry != NULL; entry = readdir(directory))
+	{
+		size_t length = strlen(entry->d_name);
+		if (length >= 6 && strcmp(entry->d_name + length - 6, ".brhan") == 0)
+		{
+			sceneFiles.push_back(std::string(scenesDirectory) + "/" + entry->d_name);
+		}
+	}
+	closedir(directory);
+	
+	ThreadPool threadPool(std::thread::hardware_concurrency());
+	for (const std::string& sceneFile : sceneFiles)
+	{
+		BrhanFile scene(sceneFile.c_str());
+		bool missingModel = false;
+		for (const ModelFromFile& model : scene.models)
+		{
+			if (FileModifiedTime(model.file.c_str()) == -1)
+			{
+				printf("%s    skipped, missing %s\n", sceneFile.c_str(), model.file.c_str());
+				missingModel = true;
+				break;
+			}
+		}
+		if (missingModel)
+		{
+			continue;
+		}
+		
+		std::vector<Mesh> meshes;
+		std::vector<MeshInstance> instances;
+		LoadMeshes(scene.models, &meshes, &instances, threadPool);
+		size_t numVertices = 0;
+		double maxNormalError = 0.0;
+		double maxUVError = 0.0;
+		float maxUV = 0.0f;
+		for (const Mesh& mesh : meshes)
+		{
+			numVertices += mesh.vertices.size() / 3;
+			for (size_t i = 0; i < mesh.vertices.size() / 3; i++)
+			{
+				maxNormalError = std::fmax(maxNormalError, NormalErrorDegrees(&mesh.normals[i * 3]));
+				float decoded[2];
+				UnpackHalf2(PackHalf2(mesh.uvs[i * 2 + 0], mesh.uvs[i * 2 + 1]), &decoded[0], &decoded[1]);
+				for (int c = 0; c < 2; c++)
+				{
+					maxUVError = std::fmax(maxUVError, std::fabs(double(decoded[c]) - mesh.uvs[i * 2 + c]));
+					maxUV = std::fmax(maxUV, std::fabs(mesh.uvs[i * 2 + c]));
+				}
+			}
+		}
+		printf("%s    vertices: %zu\n", sceneFile.c_str(), numVertices);
+		printf("\tstandard (KB): %.1f    compact (KB): %.1f    saved (KB): %.1f\n", numVertices * STANDARD_VERTEX_SIZE / 1024.0, numVertices * COMPACT_VERTEX_SIZE / 1024.0, numVertices * (STANDARD_VERTEX_SIZE - COMPACT_VERTEX_SIZE) / 1024.0);
+		printf("\tmax normal error (degrees): %.5f    max uv error: %.7f    largest uv: %.2f\n", maxNormalError, maxUVError, maxUV);
+	}
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "test") == 0)
+	{
+		return Test(argc >= 3 ? atoi(argv[2]) : 1000000);
+	}
+	if (argc >= 2 && strcmp(argv[1], "report") == 0)
+	{
+		return Report(argc >= 3 ? argv[2] : "scenes");
+	}
+	printf("Usage: %s test [samples]\n       %s report [scenes directory]\n", argv[0], argv[0]);
+	return EXIT_FAILURE;
+}
+
+
+/*
+MIT License
+
+Copyright (c) 2018-2019 Daniel Fedai Larsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/